@@ -0,0 +1,133 @@
+(* Throughput and allocation per operation of the stubs, as CSV lines
+     backend,type,op,variant,limbs,runs,ns_per_op,words_per_op
+   where variant is "alloc" for the allocating functions (Z.add...),
+   "dest" for destination passing (Z2.add...) and "gmp" for the same
+   operation looped in C, i.e. the cost of GMP itself.  words_per_op
+   counts OCaml heap words; limbs 0 stands for small integers.
+   Compare a row with its "gmp" row for the overhead of the stubs. *)
+open Gmp;;
+
+external gmp_loop: int->int->'a->'a->int->unit = "_mlgmp_bench_loop";;
+
+let max_limbs = ref (1 lsl 20)
+let max_q_limbs = ref (1 lsl 14)
+let budget = ref 0.1
+let header = ref true
+
+let () =
+  Arg.parse [
+    "-max-limbs", Arg.Set_int max_limbs,
+    "n  largest operands, in limbs (default 2^20)";
+    "-max-q-limbs", Arg.Set_int max_q_limbs,
+    "n  largest rationals, whose gcds are slow (default 2^14)";
+    "-time", Arg.Set_float budget,
+    "s  CPU time per measurement (default 0.1)";
+    "-no-header", Arg.Clear header, " omit the CSV header" ]
+    (fun s -> raise (Arg.Bad s)) "bench_suite [options]"
+
+let backend =
+  match Sys.backend_type with
+    Sys.Native -> "native"
+  | Sys.Bytecode -> "bytecode"
+  | Sys.Other s -> s
+
+(* GMP limbs are machine words on the usual platforms. *)
+let limb_bits = Sys.word_size
+
+(* Runs f n, which does n operations, in doubling batches until the
+   budget is spent; returns the runs, seconds and words allocated. *)
+let measure f =
+  let rec go batch runs time words =
+    if time >= !budget then (runs, time, words)
+    else begin
+      let (mi0, pr0, ma0) = Gc.counters () in
+      let t0 = Sys.time () in
+      f batch;
+      let t = Sys.time () -. t0 in
+      let (mi1, pr1, ma1) = Gc.counters () in
+      go (2 * batch) (runs + batch) (time +. t)
+	(words +. (mi1 -. mi0) +. (ma1 -. ma0) -. (pr1 -. pr0))
+    end in
+  go 1 0 0. 0.
+
+let report ty op variant limbs f =
+  let (runs, time, words) = measure f in
+  let n = float_of_int runs in
+  Printf.printf "%s,%s,%s,%s,%d,%d,%.1f,%.2f\n%!"
+    backend ty op variant limbs runs (time *. 1e9 /. n) (words /. n)
+
+let repeat g n =
+  for _i = 1 to n do ignore (Sys.opaque_identity (g ())) done
+
+let state = RNG.randinit RNG.GMP_RAND_ALG_MT
+let () = RNG.seed state 42
+let small_state = Random.State.make [| 42 |]
+
+(* A random number of exactly limbs limbs, or a small positive integer. *)
+let operand limbs =
+  if limbs = 0 then Z.from_int (1 + Random.State.bits small_state)
+  else
+    let nbits = limbs * limb_bits in
+    Z.add (Z.mul_2exp Z.one (nbits - 1))
+      (Z.urandomb ~state ~nbits: (nbits - 1))
+
+let sizes =
+  let rec up n = if n > !max_limbs then [] else n :: up (4 * n) in
+  0 :: up 1
+
+let ops = [ "add", 0; "mul", 1 ]
+
+let bench_z limbs =
+  let a = operand limbs and b = operand limbs in
+  let r = Z2.create () in
+  List.iter (fun (op, code) ->
+    let alloc, dest =
+      if code = 0 then Z.add, Z2.add ~dest: r else Z.mul, Z2.mul ~dest: r in
+    report "Z" op "alloc" limbs (repeat (fun () -> alloc a b));
+    report "Z" op "dest" limbs (repeat (fun () -> dest a b));
+    report "Z" op "gmp" limbs (gmp_loop 0 code a b)) ops
+
+let bench_q limbs =
+  let a = Q.from_zs (operand limbs) (operand limbs)
+  and b = Q.from_zs (operand limbs) (operand limbs) in
+  let r = Q2.create () in
+  List.iter (fun (op, code) ->
+    let alloc, dest =
+      if code = 0 then Q.add, Q2.add ~dest: r else Q.mul, Q2.mul ~dest: r in
+    report "Q" op "alloc" limbs (repeat (fun () -> alloc a b));
+    report "Q" op "dest" limbs (repeat (fun () -> dest a b));
+    report "Q" op "gmp" limbs (gmp_loop 1 code a b)) ops
+
+let bench_f limbs =
+  let prec = max 1 limbs * limb_bits in
+  let a = F.from_z_prec ~prec (operand limbs)
+  and b = F.from_z_prec ~prec (operand limbs) in
+  let r = F2.create_prec ~prec in
+  List.iter (fun (op, code) ->
+    let alloc, dest =
+      if code = 0 then F.add_prec ~prec, F2.add ~dest: r
+      else F.mul_prec ~prec, F2.mul ~dest: r in
+    report "F" op "alloc" limbs (repeat (fun () -> alloc a b));
+    report "F" op "dest" limbs (repeat (fun () -> dest a b));
+    report "F" op "gmp" limbs (gmp_loop 2 code a b)) ops
+
+let bench_fr limbs =
+  let prec = max 1 limbs * limb_bits in
+  let a = FR.from_z_prec ~prec ~mode: GMP_RNDN (operand limbs)
+  and b = FR.from_z_prec ~prec ~mode: GMP_RNDN (operand limbs) in
+  let r = FR2.create_prec ~prec () in
+  List.iter (fun (op, code) ->
+    let alloc, dest =
+      if code = 0 then FR.add_prec ~prec ~mode: GMP_RNDN, FR2.add ~dest: r
+      else FR.mul_prec ~prec ~mode: GMP_RNDN, FR2.mul ~dest: r in
+    report "FR" op "alloc" limbs (repeat (fun () -> alloc a b));
+    report "FR" op "dest" limbs (repeat (fun () -> dest a b));
+    report "FR" op "gmp" limbs (gmp_loop 3 code a b)) ops
+
+let () =
+  if !header then
+    print_endline "backend,type,op,variant,limbs,runs,ns_per_op,words_per_op";
+  List.iter bench_z sizes;
+  List.iter bench_q (List.filter (fun l -> l <= !max_q_limbs) sizes);
+  List.iter bench_f sizes;
+  if FR.is_available () then List.iter bench_fr sizes
@@ -1,7 +1,11 @@
 #define SERIALIZE
 #define USE_MPFR
+#define USE_MMAP
 #define NDEBUG
 #undef TRACE
+#undef STATS
+#undef STATS_TIME
+#undef CENSUS
 
 #include <stdint.h>
 
@@ -10,16 +14,81 @@
 #include <mpfr.h>
 #endif
 
-/* This is the largest prime less than 2^32 */
-#define HASH_MODULUS 4294967291UL
+/* Amount of limb memory (in bytes) that makes the GC run a full major
+   cycle when it is reported through caml_adjust_gc_speed, i.e. for
+   in-place growth, and for all allocations with OCaml < 4.08. */
+#define GC_LIMB_MAX (64UL << 20)
+
+/* Long operations (powm, primality, factorials, MPFR functions...) on
+   operands or results of at least this many limbs release the runtime
+   lock while they run. */
+#define RELEASE_LOCK_LIMBS 64
+
+/* Gmp.Z.Modular works in scratch space on the stack for moduli of up
+   to about MODULAR_STACK_LIMBS / 23 limbs, and in malloc'd space above. */
+#define MODULAR_STACK_LIMBS 768
+
+/* Gmp.ZPoly multiplies by Kronecker substitution when both factors have
+   at least ZPOLY_KRONECKER_LENGTH coefficients, and divides by Newton's
+   iteration when both the quotient and the divisor have at least
+   ZPOLY_NEWTON_LENGTH. */
+#define ZPOLY_KRONECKER_LENGTH 4
+#define ZPOLY_NEWTON_LENGTH 16
+
+/* Default cap on the limbs kept for reuse when Gmp.Alloc recycling is
+   on, in bytes. */
+#define RECYCLE_LIMIT_BYTES ((size_t) 16 << 20)
+
+/* The limb pool of Gmp.Alloc serves blocks of up to POOL_MAX_BYTES, and
+   threads keep up to POOL_CACHE_BLOCKS free blocks per size class.  Its
+   chunks come from a range of POOL_RESERVE_BYTES of address space, which
+   takes memory only as it is used. */
+#ifdef USE_MMAP
+#define USE_POOL
+#endif
+#define POOL_MAX_BYTES 2048
+#define POOL_CACHE_BLOCKS 64
+#define POOL_CHUNK_BYTES ((size_t) 64 << 10)
+#if SIZE_MAX > 0xffffffffUL
+#define POOL_RESERVE_BYTES ((size_t) 64 << 30)
+#else
+#define POOL_RESERVE_BYTES ((size_t) 512 << 20)
+#endif
+
+/* Gmp.Q and Gmp.Q2 add, subtract, multiply and divide fractions whose
+   numerators and denominators fit in a long with word arithmetic, and
+   fall back on mpq when it overflows.  Needs the overflow builtins of
+   gcc >= 5 or clang. */
+#if defined(__GNUC__) && (__GNUC__ >= 5 || defined(__clang__))
+#define Q_SMALL
+#endif
+
+/* trace(f) marks the entry of the stub f.  TRACE logs the calls on
+   stderr.  STATS counts them for Gmp.Stats, along with the Z.t, Q.t, F.t
+   and FR.t blocks and their limbs; STATS_TIME also adds up the time spent
+   in each stub, except in those that raise (GCC only). */
+#ifdef STATS_TIME
+#define STATS
+#endif
 
 #ifdef TRACE
-#define trace(x) do { fprintf(stderr, "mlgmp: %s%s\n", MODULE, #x);\
-                      fflush(stderr); } while(0)
+#define trace_print(name) do { fprintf(stderr, "mlgmp: %s\n", name);\
+                               fflush(stderr); } while(0)
+#else
+#define trace_print(name)
+#endif
+
+#ifdef STATS
+#define trace_name(name) stat_point(name); trace_print(name)
 #else
-#define trace(x)
+#define trace_name(name) trace_print(name)
 #endif
 
+#define trace(x) trace_name(MODULE #x)
+
+/* CENSUS keeps a record of each live Z.t, Q.t, F.t and FR.t block for
+   Gmp.Census, at the cost of a word in the block and a malloc'd record. */
+
 #ifdef __GNUC__
 #define mlgmp_noreturn __attribute__((noreturn))
 #else
@@ -31,6 +31,295 @@
  */
 
 #include <assert.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include <caml/version.h>
+#include <caml/hash.h>
+#include <caml/signals.h>
+
+/*** Statistics */
+
+/* Kinds of numbers whose blocks are counted by Gmp.Stats. */
+enum stat_kind { STAT_Z, STAT_Q, STAT_F, STAT_FR, STAT_KINDS };
+
+#ifdef STATS
+#include <stdatomic.h>
+#include <time.h>
+
+/* Counters of a trace() point, which links itself into the list read by
+   Gmp.Stats the first time it is reached.  Defined in mlgmp_misc.c. */
+struct stat_site {
+  const char *name;
+  atomic_ulong calls, nanos;
+  atomic_int linked;
+  struct stat_site *next;
+};
+
+struct stat_blocks {
+  atomic_ulong allocated, finalized, bytes_allocated, bytes_freed;
+};
+
+extern struct stat_blocks mlgmp_stat_blocks[STAT_KINDS];
+extern atomic_ulong mlgmp_stat_bytes_grown;
+void mlgmp_stat_link(struct stat_site *s);
+
+#define stat_add(counter, n) \
+  atomic_fetch_add_explicit(&(counter), (n), memory_order_relaxed)
+
+static inline void stat_call (struct stat_site *s)
+{
+  if (! atomic_load_explicit(&s->linked, memory_order_acquire))
+    mlgmp_stat_link(s);
+  stat_add(s->calls, 1);
+}
+
+#if defined(STATS_TIME) && defined(__GNUC__)
+struct stat_timer {
+  struct stat_site *site;
+  unsigned long start;
+};
+
+static inline unsigned long stat_clock (void)
+{
+  struct timespec t;
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return (unsigned long) t.tv_sec * 1000000000UL + t.tv_nsec;
+}
+
+static inline struct stat_timer stat_enter (struct stat_site *s)
+{
+  struct stat_timer t;
+  stat_call(s);
+  t.site = s;
+  t.start = stat_clock();
+  return t;
+}
+
+/* Run when the stub returns; a stub left by an exception is not timed. */
+static inline void stat_leave (struct stat_timer *t)
+{
+  stat_add(t->site->nanos, stat_clock() - t->start);
+}
+
+#define stat_point(name)						\
+  static struct stat_site stat_site = { name };				\
+  struct stat_timer stat_timer __attribute__((cleanup(stat_leave))) =	\
+    stat_enter(&stat_site)
+#else
+#define stat_point(name)			\
+  static struct stat_site stat_site = { name };	\
+  stat_call(&stat_site)
+#endif
+#endif /* STATS */
+
+static inline void stat_alloc (enum stat_kind kind, mp_size_t nlimbs)
+{
+#ifdef STATS
+  stat_add(mlgmp_stat_blocks[kind].allocated, 1);
+  stat_add(mlgmp_stat_blocks[kind].bytes_allocated,
+	   nlimbs * sizeof(mp_limb_t));
+#endif
+}
+
+static inline void stat_free (enum stat_kind kind, mp_size_t nlimbs)
+{
+#ifdef STATS
+  stat_add(mlgmp_stat_blocks[kind].finalized, 1);
+  stat_add(mlgmp_stat_blocks[kind].bytes_freed, nlimbs * sizeof(mp_limb_t));
+#endif
+}
+
+/*** Census */
+
+/* Record of a live block in the list of mlgmp_misc.c. */
+struct census_node {
+  struct census_node *prev, *next;
+  enum stat_kind kind;
+  mp_size_t limbs;
+};
+
+#ifdef CENSUS
+struct census_node *mlgmp_census_add(enum stat_kind kind, mp_size_t limbs);
+void mlgmp_census_remove(struct census_node *n);
+void mlgmp_census_resize(struct census_node *n, mp_size_t limbs);
+
+/* The blocks made by alloc_mpz, alloc_mpq... point to their record from
+   a slot after the number, which takes size bytes.  Blocks read by
+   input_value are as long as the number alone, and are not counted. */
+#define CENSUS_SLOT sizeof(struct census_node *)
+
+static inline struct census_node **census_slot (value v, size_t size)
+{
+  if (Bosize_val(v) < sizeof(value) + size + CENSUS_SLOT)
+    return NULL;
+  return (struct census_node **) ((char *) Data_custom_val(v) + size);
+}
+#else
+#define CENSUS_SLOT 0
+#endif
+
+static inline void census_register (enum stat_kind kind, value v,
+				     size_t size, mp_size_t nlimbs)
+{
+#ifdef CENSUS
+  *census_slot(v, size) = mlgmp_census_add(kind, nlimbs);
+#endif
+}
+
+static inline void census_unregister (value v, size_t size)
+{
+#ifdef CENSUS
+  struct census_node **slot = census_slot(v, size);
+  if (slot != NULL && *slot != NULL)
+    mlgmp_census_remove(*slot);
+#endif
+}
+
+/* For numbers whose limbs changed in place. */
+static inline void census_resize (value v, size_t size, mp_size_t nlimbs)
+{
+#ifdef CENSUS
+  struct census_node **slot = census_slot(v, size);
+  if (slot != NULL && *slot != NULL && (*slot)->limbs != nlimbs)
+    mlgmp_census_resize(*slot, nlimbs);
+#endif
+}
+
+/*** GC accounting */
+
+/* Percentage of the limb memory owned by custom blocks that is reported
+   to the GC; 0 turns the accounting off.  Defined in mlgmp_misc.c. */
+extern uintnat mlgmp_gc_ratio;
+
+static inline mlsize_t limbs_mem (mp_size_t nlimbs)
+{
+  return (mlsize_t) nlimbs * sizeof(mp_limb_t) * mlgmp_gc_ratio / 100;
+}
+
+static inline value alloc_custom_limbs (struct custom_operations *ops,
+					uintnat size, mp_size_t nlimbs)
+{
+#if OCAML_VERSION >= 40800
+  return caml_alloc_custom_mem(ops, size, limbs_mem(nlimbs));
+#else
+  return caml_alloc_custom(ops, size, limbs_mem(nlimbs), GC_LIMB_MAX);
+#endif
+}
+
+/* Limbs gained by an in-place operation on an existing block. */
+static inline void account_limbs (mp_size_t grown)
+{
+#ifdef STATS
+  if (grown > 0)
+    stat_add(mlgmp_stat_bytes_grown, grown * sizeof(mp_limb_t));
+#endif
+  if (grown > 0 && mlgmp_gc_ratio)
+    caml_adjust_gc_speed(limbs_mem(grown), GC_LIMB_MAX);
+}
+
+#ifdef PRAGMA_INLINE
+#pragma inline(limbs_mem, alloc_custom_limbs, account_limbs)
+#endif
+
+/*** Hashing */
+
+/* Mixes n limbs, most significant first, into h.  Low zero limbs are
+   skipped, so that F.t and FR.t values that only differ by their
+   precision hash alike. */
+static inline uint32_t hash_limbs (uint32_t h, mp_srcptr d, mp_size_t n)
+{
+  mp_size_t i, low = 0;
+  while (low < n && d[low] == 0) low++;
+  for(i = n - 1; i >= low; i--)
+    {
+#if GMP_NUMB_BITS > 32
+      h = caml_hash_mix_uint32(h, (uint32_t) (d[i] >> 32));
+#endif
+      h = caml_hash_mix_uint32(h, (uint32_t) d[i]);
+    }
+  return h;
+}
+
+#ifdef PRAGMA_INLINE
+#pragma inline(hash_limbs)
+#endif
+
+/*** Strings */
+
+/* Strings are written in place: allocated at an upper bound of their
+   length, filled by mpz_get_str and friends, then trimmed to the length
+   actually written.  The final NUL may land on the last byte of the
+   block, where OCaml keeps the padding: it is set again afterwards. */
+static inline void restore_string_padding (value s, mlsize_t len)
+{
+  mlsize_t bsize = Bosize_val(s);
+  Byte(s, bsize - 1) = bsize - 1 - len;
+}
+
+/* Shortens s to len bytes: in place if it keeps the same number of
+   words, otherwise by copying. */
+static value trim_string (value s, mlsize_t len)
+{
+  CAMLparam1(s);
+  CAMLlocal1(r);
+  if ((len + sizeof(value)) / sizeof(value) == Wosize_val(s))
+    {
+      restore_string_padding(s, len);
+      CAMLreturn(s);
+    }
+  r = caml_alloc_string(len);
+  memcpy((char *) String_val(r), String_val(s), len);
+  CAMLreturn(r);
+}
+
+/* Digits needed in base for a mantissa of the given number of bits,
+   rounded up generously. */
+static inline size_t mantissa_digits (long bits, int base)
+{
+  return (size_t) (bits * (log(2.) / log((double) base))) + 2;
+}
+
+/* Bases accepted by mpz_get_str and friends: negative ones ask for upper
+   case digits. */
+static inline int valid_base (int base)
+{
+  return (base >= 2 && base <= 62) || (base >= -36 && base <= -2);
+}
+
+#ifdef PRAGMA_INLINE
+#pragma inline(restore_string_padding, mantissa_digits, valid_base)
+#endif
+
+/*** Releasing the runtime lock */
+
+/* Long computations on big enough numbers run outside the runtime lock,
+   so that other threads keep running.  Nothing in the OCaml heap may be
+   touched meanwhile: operands are read through copies of their mpz or
+   mpfr structs (the limbs themselves are malloc'd and do not move), and
+   results are built in C memory.  A number that is being overwritten by
+   another thread at the same time (a Z2.t or FR2.t accumulator) must not
+   be used as an operand. */
+static inline int release_lock_p (mp_size_t nlimbs)
+{
+  return nlimbs >= RELEASE_LOCK_LIMBS;
+}
+
+#define blocking_section(cond, stmt)		\
+  do {						\
+    if (cond)					\
+      {						\
+	caml_enter_blocking_section();		\
+	stmt;					\
+	caml_leave_blocking_section();		\
+      }						\
+    else					\
+      stmt;					\
+  } while (0)
+
+#ifdef PRAGMA_INLINE
+#pragma inline(release_lock_p)
+#endif
 
 struct custom_operations _mlgmp_custom_z;
 
@@ -50,24 +339,354 @@ static inline mpz_t * mpz_val (value val)
   return ((mpz_t *) (Data_custom_val(val)));
 }
 
-static inline value alloc_mpz (void)
+static inline value alloc_mpz (mp_size_t nlimbs)
 {
-  return caml_alloc_custom(&_mlgmp_custom_z,
-		       sizeof(mpz_t),
-		       0,
-		       1);
+  value r;
+  stat_alloc(STAT_Z, nlimbs);
+  r = alloc_custom_limbs(&_mlgmp_custom_z, sizeof(mpz_t) + CENSUS_SLOT,
+			 nlimbs);
+  census_register(STAT_Z, r, sizeof(mpz_t), nlimbs);
+  return r;
 }
 
 static inline value alloc_init_mpz (void)
 {
-  value r= alloc_mpz();
+  value r= alloc_mpz(1);
   mpz_init(*mpz_val(r));
   return r;
 }
 
+/* Recycling of the limbs of freed numbers; defined in mlgmp_alloc.c.
+   mlgmp_recycled_here is set while the calling thread keeps buffers,
+   which it frees in either function once recycling is off. */
+extern int mlgmp_recycling;
+extern _Thread_local int mlgmp_recycled_here;
+void mlgmp_recycle(mpz_ptr z);
+void mlgmp_init_limbs(mpz_ptr z, mp_size_t n);
+
+static inline void z_clear(mpz_ptr z)
+{
+  if (mlgmp_recycling || mlgmp_recycled_here)
+    mlgmp_recycle(z);
+  else
+    mpz_clear(z);
+}
+
+/* mpz_init for a result that will likely need n limbs. */
+static inline void z_init_limbs(mpz_ptr z, mp_size_t n)
+{
+  if ((mlgmp_recycling && n > 1) || mlgmp_recycled_here)
+    mlgmp_init_limbs(z, n);
+  else
+    mpz_init(z);
+}
+
+/* A Z.t is either an unboxed OCaml integer or a custom block holding
+   an mpz_t.  The operations only build custom blocks for values that do
+   not fit in an OCaml integer, but a custom block may still hold a small
+   value: Z2.as_z hands out the accumulator as it is, and deserialization
+   cannot return an unboxed integer.  So a number may have two
+   representations, which mpz_src, compare and hash all accept; no code
+   may tell numbers apart, or take them for big, by Is_long alone. */
+
+#if defined(ARCH_SIXTYFOUR) && GMP_NUMB_BITS < 64
+#error "mlgmp: GMP limbs must be at least as wide as OCaml integers"
+#endif
+
+/* Room for reading an unboxed Z.t as a one-limb mpz_t. */
+typedef struct {
+  __mpz_struct z;
+  mp_limb_t limb;
+} mpz_small_t;
+
+static inline mpz_ptr mpz_small_set(mpz_small_t *s, intnat n)
+{
+  s->z._mp_alloc = 1;
+  s->z._mp_d = &s->limb;
+  if (n >= 0)
+    {
+      s->limb = (mp_limb_t) n;
+      s->z._mp_size = (n != 0);
+    }
+  else
+    {
+      s->limb = - (mp_limb_t) n;
+      s->z._mp_size = -1;
+    }
+  return &s->z;
+}
+
+/* Read-only mpz view of a Z.t.  The result must not be kept across an
+   OCaml allocation, nor written to. */
+#define mpz_src(v, s) \
+  (Is_long(v) ? mpz_small_set(&(s), Long_val(v)) : *mpz_val(v))
+
+static inline int mpz_fits_value(mpz_srcptr z)
+{
+  switch (z->_mp_size)
+    {
+    case 0:
+      return 1;
+    case 1:
+      return z->_mp_d[0] <= (mp_limb_t) Max_long;
+    case -1:
+      return z->_mp_d[0] <= (mp_limb_t) Max_long + 1;
+    default:
+      return 0;
+    }
+}
+
+/* Only valid when mpz_fits_value(z). */
+static inline value Val_small_mpz(mpz_srcptr z)
+{
+  if (z->_mp_size == 0) return Val_long(0);
+  if (z->_mp_size > 0) return Val_long((intnat) z->_mp_d[0]);
+  return Val_long(- (intnat) z->_mp_d[0]);
+}
+
+/* Turns an initialized mpz_t into a Z.t.  The limbs of z are either freed
+   or handed over to the new custom block: z must not be used afterwards. */
+static inline value wrap_mpz(mpz_t z)
+{
+  value r;
+  if (mpz_fits_value(z))
+    {
+      r = Val_small_mpz(z);
+      z_clear(z);
+    }
+  else
+    {
+      r = alloc_mpz(z->_mp_alloc);
+      (*mpz_val(r))[0] = z[0];
+    }
+  return r;
+}
+
+/* Hash of a Z.t.  The runtime mixes the result of a custom hash function
+   the way it mixes the tagged value of an immediate, so small values hash
+   like the OCaml integers they stand for, whether they are boxed (as in
+   Z2.as_z) or not. */
+static inline uint32_t hash_mpz(mpz_srcptr z)
+{
+  if (mpz_fits_value(z))
+    {
+      intnat d = (intnat) Val_small_mpz(z);
+#ifdef ARCH_SIXTYFOUR
+      return (uint32_t) ((d >> 32) ^ (d >> 63) ^ d);
+#else
+      return (uint32_t) d;
+#endif
+    }
+  return hash_limbs((uint32_t) z->_mp_size, z->_mp_d, mpz_size(z));
+}
+
+/* Copy of the mpz struct of a Z.t, which may be used while the runtime
+   lock is released. */
+#define mpz_detach(v, s) (*mpz_src(v, s))
+
+/* Runs op(r, ...) for the Z2.t r outside the runtime lock.  The result
+   goes to a temporary which is swapped in afterwards, since the detached
+   operands may share limbs with r. */
+#define z2_blocking_section(r, op, ...)		\
+  do {						\
+    mpz_t z2_tmp;				\
+    mpz_init(z2_tmp);				\
+    caml_enter_blocking_section();		\
+    op(z2_tmp, __VA_ARGS__);			\
+    caml_leave_blocking_section();		\
+    mpz_swap(*mpz_val(r), z2_tmp);		\
+    z_clear(z2_tmp);				\
+  } while (0)
+
+/* In-place operations on a Z2.t may grow the limbs of their destination;
+   the growth is reported to the GC when leaving. */
+#define z2_enter(r) int z2_alloc_##r = (*mpz_val(r))->_mp_alloc
+#define z2_leave(r)						\
+  do {								\
+    account_limbs((*mpz_val(r))->_mp_alloc - z2_alloc_##r);	\
+    census_resize(r, sizeof(mpz_t), (*mpz_val(r))->_mp_alloc);	\
+  } while (0)
+
 #ifdef PRAGMA_INLINE
 #pragma inline(Int_option_val, mpz_val, alloc_mpz, alloc_init_mpz)
+#pragma inline(mpz_small_set, mpz_fits_value, Val_small_mpz, wrap_mpz)
+#pragma inline(z_clear, z_init_limbs)
+#pragma inline(hash_mpz)
+#endif
+
+/*** Parsing */
+
+/* Value of a digit, as for mpz_set_str: case does not matter up to base
+   36, lower case letters come after upper case ones above. */
+static inline int digit_value (int c, int base)
+{
+  if (c >= '0' && c <= '9') return c - '0';
+  if (c >= 'A' && c <= 'Z') return c - 'A' + 10;
+  if (c >= 'a' && c <= 'z') return c - 'a' + (base <= 36 ? 10 : 36);
+  return 255;
+}
+
+#define PARSE_STACK_DIGITS 256
+
+/* Sets z, which must not be in the OCaml heap, from the len characters
+   at s: an optional sign, then digits in base; no NUL is needed.
+   Returns 0 if they do not make a number.  The conversion is done by
+   mpn_set_str (subquadratic on huge inputs) on a copy of the digit
+   values, outside the runtime lock for big numbers: s may not be used
+   by the caller afterwards if it is in the OCaml heap. */
+static int mpz_set_substring (mpz_ptr z, const char *s, size_t len, int base)
+{
+  unsigned char stack[PARSE_STACK_DIGITS], *d;
+  int neg = 0, bits;
+  size_t i;
+  mp_size_t n, limbs;
+  if (base < 2 || base > 62)
+    return 0;
+  if (len > 0 && (s[0] == '-' || s[0] == '+'))
+    {
+      neg = (s[0] == '-');
+      s++;
+      len--;
+    }
+  if (len == 0)
+    return 0;
+  while (len > 1 && s[0] == '0')
+    {
+      s++;
+      len--;
+    }
+  d = len <= PARSE_STACK_DIGITS ? stack : malloc(len);
+  if (d == NULL)
+    caml_raise_out_of_memory();
+  for(i=0; i<len; i++)
+    {
+      int v = digit_value((unsigned char) s[i], base);
+      if (v >= base)
+	{
+	  if (d != stack) free(d);
+	  return 0;
+	}
+      d[i] = v;
+    }
+  if (d[0] == 0)
+    mpz_set_ui(z, 0);
+  else
+    {
+      for(bits=1; (1 << bits) < base; bits++) ;
+      limbs = (mp_size_t) (len * bits / GMP_NUMB_BITS + 1);
+      _mpz_realloc(z, limbs);
+      blocking_section(release_lock_p(limbs),
+		       n = mpn_set_str(z->_mp_d, d, len, base));
+      while (n > 0 && z->_mp_d[n-1] == 0)
+	n--;
+      z->_mp_size = neg ? -n : n;
+    }
+  if (d != stack) free(d);
+  return 1;
+}
+
+/* Checks that pos and len make a substring of s. */
+static inline void check_substring (value s, value pos, value len,
+				    const char *name)
+{
+  if (Long_val(pos) < 0 || Long_val(len) < 0
+      || Long_val(pos) + Long_val(len) > caml_string_length(s))
+    caml_invalid_argument(name);
+}
+
+#ifdef PRAGMA_INLINE
+#pragma inline(digit_value, check_substring)
+#endif
+
+#ifdef SERIALIZE
+/*** Binary serialization */
+
+/* The binary format starts with SERIAL_MAGIC | version on 4 bytes.  The
+   old hex format started with a string length or a precision, which never
+   has the top bit set, so both can be read back.
+   Magnitudes are written as a signed count of 64-bit words followed by
+   the words, least significant first; caml_serialize_block_8 takes care
+   of the byte order, so 32-bit and 64-bit limbs are interchangeable. */
+#define SERIAL_MAGIC 0x80000000UL
+#define SERIAL_VERSION 1
+
+static inline void serialize_header (void)
+{
+  caml_serialize_int_4((int32_t) (SERIAL_MAGIC | SERIAL_VERSION));
+}
+
+/* Reads the first word of a serialized value; returns 1 for the binary
+   format, and 0 with the word in *old for the hex one. */
+static inline int deserialize_header (uint32_t *old)
+{
+  uint32_t w = caml_deserialize_uint_4();
+  if (! (w & SERIAL_MAGIC))
+    {
+      *old = w;
+      return 0;
+    }
+  if (w != (SERIAL_MAGIC | SERIAL_VERSION))
+    caml_deserialize_error("Gmp: unknown serialization format version");
+  return 1;
+}
+
+static inline void serialize_mpz (mpz_srcptr z)
+{
+  mp_size_t n = mpz_size(z);
+  mp_srcptr d = z->_mp_d;
+  int64_t words = (n * GMP_NUMB_BITS + 63) / 64;
+
+  caml_serialize_int_8(mpz_sgn(z) < 0 ? - words : words);
+#if GMP_NUMB_BITS == 64
+  caml_serialize_block_8((void *) d, n);
+#elif GMP_NUMB_BITS == 32
+  {
+    mp_size_t i;
+    for(i = 0; i + 1 < n; i += 2)
+      caml_serialize_int_8((int64_t) ((uint64_t) d[i+1] << 32 | d[i]));
+    if (n & 1)
+      caml_serialize_int_8((int64_t) d[n-1]);
+  }
+#else
+#error "mlgmp: serialization needs 32-bit or 64-bit limbs"
+#endif
+}
+
+/* z must be initialized. */
+static inline void deserialize_mpz (mpz_ptr z)
+{
+  int64_t words = caml_deserialize_sint_8();
+  int neg = words < 0;
+  mp_size_t n;
+  mp_ptr d;
+
+  if (neg) words = - words;
+  if (words < 0 || (uint64_t) words > (uint64_t) Max_long / 64)
+    caml_deserialize_error("Gmp: bad integer size");
+  n = words * (64 / GMP_NUMB_BITS);
+  d = (mp_ptr) _mpz_realloc(z, n ? n : 1);
+#if GMP_NUMB_BITS == 64
+  caml_deserialize_block_8(d, n);
+#else
+  {
+    mp_size_t i;
+    for(i = 0; i < n; i += 2)
+      {
+	uint64_t w = caml_deserialize_uint_8();
+	d[i] = (mp_limb_t) w;
+	d[i+1] = (mp_limb_t) (w >> 32);
+      }
+  }
 #endif
+  while (n > 0 && d[n-1] == 0) n--;
+  z->_mp_size = neg ? - n : n;
+}
+
+#ifdef PRAGMA_INLINE
+#pragma inline(serialize_header, deserialize_header)
+#pragma inline(serialize_mpz, deserialize_mpz)
+#endif
+#endif /* SERIALIZE */
 
 struct custom_operations _mlgmp_custom_q;
 
@@ -76,23 +695,38 @@ static inline mpq_t * mpq_val (value val)
   return ((mpq_t *) (Data_custom_val(val)));
 }
 
-static inline value alloc_mpq (void)
+static inline value alloc_mpq (mp_size_t nlimbs)
 {
-  return caml_alloc_custom(&_mlgmp_custom_q,
-		       sizeof(mpq_t),
-		       0,
-		       1);
+  value r;
+  stat_alloc(STAT_Q, nlimbs);
+  r = alloc_custom_limbs(&_mlgmp_custom_q, sizeof(mpq_t) + CENSUS_SLOT,
+			 nlimbs);
+  census_register(STAT_Q, r, sizeof(mpq_t), nlimbs);
+  return r;
 }
 
 static inline value alloc_init_mpq (void)
 {
-  value r= alloc_mpq();
+  value r= alloc_mpq(2);
   mpq_init(*mpq_val(r));
   return r;
 }
 
+static inline mp_size_t mpq_alloc (mpq_srcptr q)
+{
+  return mpq_numref(q)->_mp_alloc + mpq_denref(q)->_mp_alloc;
+}
+
+/* Same as wrap_mpz: the limbs of q are handed over to the result. */
+static inline value wrap_mpq (mpq_t q)
+{
+  value r= alloc_mpq(mpq_alloc(q));
+  (*mpq_val(r))[0] = q[0];
+  return r;
+}
+
 #ifdef PRAGMA_INLINE
-#pragma inline(mpq_val, alloc_mpq, alloc_init_mpq)
+#pragma inline(mpq_val, alloc_mpq, alloc_init_mpq, wrap_mpq, mpq_alloc)
 #endif
 
 struct custom_operations _mlgmp_custom_f;
@@ -102,17 +736,25 @@ static inline mpf_t * mpf_val (value val)
   return ((mpf_t *) (Data_custom_val(val)));
 }
 
-static inline value alloc_mpf (void)
+/* Limbs allocated by mpf_init2 for a given precision. */
+static inline mp_size_t mpf_prec_limbs (long prec)
 {
-  return caml_alloc_custom(&_mlgmp_custom_f,
-		       sizeof(mpf_t),
-		       0,
-		       1);
+  return (prec + 2 * GMP_NUMB_BITS - 1) / GMP_NUMB_BITS + 1;
+}
+
+static inline value alloc_mpf (mp_size_t nlimbs)
+{
+  value r;
+  stat_alloc(STAT_F, nlimbs);
+  r = alloc_custom_limbs(&_mlgmp_custom_f, sizeof(mpf_t) + CENSUS_SLOT,
+			 nlimbs);
+  census_register(STAT_F, r, sizeof(mpf_t), nlimbs);
+  return r;
 }
 
 static inline value alloc_init_mpf (value prec)
 {
-  value r= alloc_mpf();
+  value r= alloc_mpf(mpf_prec_limbs(Int_val(prec)));
   mpf_init2(*mpf_val(r), Int_val(prec));
   return r;
 }
@@ -131,18 +773,49 @@ static inline mp_rnd_t Mode_val (value val)
   return (mp_rnd_t) (Int_val(val));
 }
 
-static inline value alloc_mpfr (void)
+static inline mp_size_t mpfr_prec_limbs (long prec)
+{
+  return (prec + GMP_NUMB_BITS - 1) / GMP_NUMB_BITS + 1;
+}
+
+static inline value alloc_mpfr (mp_size_t nlimbs)
 {
-  return caml_alloc_custom(&_mlgmp_custom_fr,
-		       sizeof(mpfr_t),
-		       0,
-		       1);
+  value r;
+  stat_alloc(STAT_FR, nlimbs);
+  r = alloc_custom_limbs(&_mlgmp_custom_fr, sizeof(mpfr_t) + CENSUS_SLOT,
+			 nlimbs);
+  census_register(STAT_FR, r, sizeof(mpfr_t), nlimbs);
+  return r;
 }
 
 static inline value alloc_init_mpfr (value prec)
 {
-  value r= alloc_mpfr();
+  value r= alloc_mpfr(mpfr_prec_limbs(Int_val(prec)));
   mpfr_init2(*mpfr_val(r), Int_val(prec));
   return r;
 }
+
+/* Same as wrap_mpz: the mantissa of x is handed over to the result. */
+static inline value wrap_mpfr (mpfr_t x)
+{
+  value r= alloc_mpfr(mpfr_prec_limbs(mpfr_get_prec(x)));
+  (*mpfr_val(r))[0] = x[0];
+  return r;
+}
+
+/* Copy of the mpfr struct of an FR.t, which may be used while the runtime
+   lock is released. */
+#define mpfr_detach(v) ((*mpfr_val(v))[0])
+
+/* Same as z2_blocking_section, for an FR2.t destination. */
+#define fr2_blocking_section(r, op, ...)			\
+  do {								\
+    mpfr_t fr2_tmp;						\
+    mpfr_init2(fr2_tmp, mpfr_get_prec(*mpfr_val(r)));		\
+    caml_enter_blocking_section();				\
+    op(fr2_tmp, __VA_ARGS__);					\
+    caml_leave_blocking_section();				\
+    mpfr_swap(*mpfr_val(r), fr2_tmp);				\
+    mpfr_clear(fr2_tmp);					\
+  } while (0)
 #endif
@@ -37,78 +37,149 @@ type rounding_mode =
   | GMP_RNDU
   | GMP_RNDD
 
+type bigstring =
+    (char, Bigarray.int8_unsigned_elt, Bigarray.c_layout) Bigarray.Array1.t
+
 exception Unimplemented of string;;
 let _ = Callback.register_exception "Gmp.Division_by_zero" Division_by_zero;;
 let _ = Callback.register_exception "Gmp.Unimplemented" (Unimplemented "foo");;
 
 module RNG = struct
   type randstate_t;;
-  type randalg_t = GMP_RAND_ALG_LC of int;;
+  type randalg_t = GMP_RAND_ALG_LC of int | GMP_RAND_ALG_MT;;
 
   external randinit_lc: int->randstate_t = "_mlgmp_randinit_lc";;
+  external randinit_mt: unit->randstate_t = "_mlgmp_randinit_mt";;
+  external copy: randstate_t->randstate_t = "_mlgmp_randinit_copy";;
+
+  external seed: randstate_t->int->unit = "_mlgmp_randseed_ui";;
+  external seed_string: randstate_t->string->unit =
+    "_mlgmp_randseed_string";;
+  external split: randstate_t->randstate_t = "_mlgmp_randsplit";;
 
   let randinit = function
     GMP_RAND_ALG_LC(n) ->
       (if n>128 || n<1
       then raise (Invalid_argument "Gmp.Random.randinit"));
       randinit_lc n
+  | GMP_RAND_ALG_MT -> randinit_mt ()
 
+  (* Shared by all domains: use local () instead from parallel code. *)
   let default = randinit (GMP_RAND_ALG_LC 128)
+
+  let local_state = Gmp_local.new_key ~split: split randinit_mt
+  let local () = Gmp_local.get local_state
 end;;
 
-module Z2 = struct
+module Z = struct
   external z_initialize : unit->unit = "_mlgmp_z_initialize";;
   z_initialize ();;
 
+  (* A Z.t is an unboxed integer whenever the value fits in one, and a
+     custom block holding an mpz_t otherwise.  The stubs accept both and
+     always return the unboxed form when possible. *)
   type t;;
-  external from_int: dest: t->int->unit = "_mlgmp_z2_from_int";;
-  external from_string_base: dest: t->base: int->string->unit
-      ="_mlgmp_z2_from_string_base";;
-  external from_float: dest: t->float->unit = "_mlgmp_z2_from_float";;
+  external is_small: t->bool = "%obj_is_int";;
+  external small_val: t->int = "%identity";;
+  external val_small: int->t = "%identity";;
 
-  external create: unit->t = "_mlgmp_z_create";;
-  external copy: dest: t-> from: t-> unit = "_mlgmp_z_copy";;
-  external add: dest: t-> t->t->unit = "_mlgmp_z2_add";;
-  external sub: dest: t-> t->t->unit = "_mlgmp_z2_sub";;
-  external mul: dest: t-> t->t->unit = "_mlgmp_z2_mul";;
-
-  external tdiv_q: dest: t-> t->t->unit = "_mlgmp_z2_tdiv_q";;
-  external tdiv_r: dest: t-> t->t->unit = "_mlgmp_z2_tdiv_r";;
-  external cdiv_q: dest: t-> t->t->unit = "_mlgmp_z2_cdiv_q";;
-  external cdiv_r: dest: t-> t->t->unit = "_mlgmp_z2_cdiv_r";;
-  external fdiv_q: dest: t-> t->t->unit = "_mlgmp_z2_fdiv_q";;
-  external fdiv_r: dest: t-> t->t->unit = "_mlgmp_z2_fdiv_r";;
-  external divexact: dest: t-> t->t->unit = "_mlgmp_z2_divexact";;
-
-  external neg: dest: t->t->unit = "_mlgmp_z2_neg";;
-  external abs: dest: t->t->unit = "_mlgmp_z2_abs";;
-end;;
+  (* Products of integers below this bound in absolute value cannot
+     overflow. *)
+  let mul_bound = 1 lsl ((Sys.int_size - 1) / 2);;
+  let int_compare (a: int) b = compare a b;;
 
-module Z = struct
-  type t = Z2.t;;
-  external of_int: int->t = "_mlgmp_z_from_int";;
-  external from_int: int->t = "_mlgmp_z_from_int";;
+  let of_int x = val_small x
+  let from_int = of_int
   external from_string_base: base: int->string->t="_mlgmp_z_from_string_base";;
-  external of_float: float->t = "_mlgmp_z_from_float";;
-  external from_float: float->t = "_mlgmp_z_from_float";;
+  external of_substring_base: base: int->string->pos: int->len: int->t =
+    "_mlgmp_z_from_substring";;
+  external of_subbytes_base: base: int->bytes->pos: int->len: int->t =
+    "_mlgmp_z_from_substring";;
+  external of_float: (float [@unboxed])->t =
+    "_mlgmp_z_from_float" "_mlgmp_z_from_float_unboxed";;
+  external from_float: (float [@unboxed])->t =
+    "_mlgmp_z_from_float" "_mlgmp_z_from_float_unboxed";;
 
   external to_string_base: base: int->t->string = "_mlgmp_z_to_string_base";;
-  external to_int: t->int = "_mlgmp_z_to_int";;
-  external to_float: t->float = "_mlgmp_z_to_float";;
-
-  external int_from: t->int = "_mlgmp_z_to_int";;
-  external float_from: t->float = "_mlgmp_z_to_float";;
-
-  external add: t->t->t = "_mlgmp_z_add";;
-  external sub: t->t->t = "_mlgmp_z_sub";;
-  external mul: t->t->t = "_mlgmp_z_mul";;
+  external string_size_base: base: int->t->int =
+    "_mlgmp_z_string_size_base";;
+  external blit_string_base: base: int->t->bytes->int->int =
+    "_mlgmp_z_blit_string_base";;
+
+  (* Magnitudes as unsigned numbers on len bytes, zero-padded; the sign
+     is not stored. *)
+  external raw_size: t->(int [@untagged]) =
+    "_mlgmp_z_raw_size" "_mlgmp_z_raw_size_untagged" [@@noalloc];;
+  external import_bytes: little_endian: bool->bytes->pos: int->len: int->t =
+    "_mlgmp_z_import_bytes";;
+  external import_string: little_endian: bool->string->pos: int->len: int->t =
+    "_mlgmp_z_import_bytes";;
+  external import_bigstring:
+    little_endian: bool->bigstring->pos: int->len: int->t =
+    "_mlgmp_z_import_bigstring";;
+  external export_bytes:
+    little_endian: bool->t->bytes->pos: int->len: int->unit =
+    "_mlgmp_z_export_bytes";;
+  external export_bigstring:
+    little_endian: bool->t->bigstring->pos: int->len: int->unit =
+    "_mlgmp_z_export_bigstring";;
+  external big_to_int: t->(int [@untagged]) =
+    "_mlgmp_z_to_int" "_mlgmp_z_to_int_untagged" [@@noalloc];;
+  external to_float: t->(float [@unboxed]) =
+    "_mlgmp_z_to_float" "_mlgmp_z_to_float_unboxed" [@@noalloc];;
+
+  let to_int x = if is_small x then small_val x else big_to_int x
+  let int_from = to_int
+  external float_from: t->(float [@unboxed]) =
+    "_mlgmp_z_to_float" "_mlgmp_z_to_float_unboxed" [@@noalloc];;
+
+  external big_add: t->t->t = "_mlgmp_z_add";;
+  external big_sub: t->t->t = "_mlgmp_z_sub";;
+  external big_mul: t->t->t = "_mlgmp_z_mul";;
+
+  let add x y =
+    if is_small x && is_small y then
+      let a = small_val x and b = small_val y in
+      let s = a + b in
+      if (a lxor s) land (b lxor s) >= 0 then val_small s else big_add x y
+    else big_add x y
+
+  let sub x y =
+    if is_small x && is_small y then
+      let a = small_val x and b = small_val y in
+      let s = a - b in
+      if (a lxor b) land (a lxor s) >= 0 then val_small s else big_sub x y
+    else big_sub x y
+
+  let mul x y =
+    if is_small x && is_small y then
+      let a = small_val x and b = small_val y in
+      if a < mul_bound && a > - mul_bound && b < mul_bound && b > - mul_bound
+      then val_small (a * b)
+      else big_mul x y
+    else big_mul x y
 
   external add_ui: t->int->t = "_mlgmp_z_add_ui";;
   external sub_ui: t->int->t = "_mlgmp_z_sub_ui";;
   external mul_ui: t->int->t = "_mlgmp_z_mul_ui";;
 
-  external neg: t->t = "_mlgmp_z_neg";;
-  external abs: t->t = "_mlgmp_z_abs";;
+  external addmul: t->t->t->t = "_mlgmp_z_addmul";;
+  external submul: t->t->t->t = "_mlgmp_z_submul";;
+  external addmul_ui: t->t->int->t = "_mlgmp_z_addmul_ui";;
+  external submul_ui: t->t->int->t = "_mlgmp_z_submul_ui";;
+  external mul_add: t->t->t->t->t = "_mlgmp_z_mul_add";;
+  external lincomb: t array->t array->t = "_mlgmp_z_lincomb";;
+
+  external big_neg: t->t = "_mlgmp_z_neg";;
+  external big_abs: t->t = "_mlgmp_z_abs";;
+
+  let neg x =
+    if is_small x && small_val x <> min_int then val_small (- (small_val x))
+    else big_neg x
+
+  let abs x =
+    if is_small x && small_val x <> min_int then val_small (abs (small_val x))
+    else big_abs x
 
   external tdiv_qr: t->t->t*t = "_mlgmp_z_tdiv_qr";;
   external tdiv_q: t->t->t = "_mlgmp_z_tdiv_q";;
@@ -163,24 +234,29 @@ module Z = struct
   external sqrt: t->t = "_mlgmp_z_sqrt"
   external sqrtrem: t->t*t = "_mlgmp_z_sqrtrem"
   external root: t->int->t = "_mlgmp_z_root"
-  external perfect_power_p: t->bool = "_mlgmp_z_perfect_power_p"
-  external perfect_square_p: t->bool = "_mlgmp_z_perfect_square_p"
-  external is_perfect_power: t->bool = "_mlgmp_z_perfect_power_p"
-  external is_perfect_square: t->bool = "_mlgmp_z_perfect_square_p"
+  external perfect_power_p: t->bool = "_mlgmp_z_perfect_power_p" [@@noalloc]
+  external perfect_square_p: t->bool = "_mlgmp_z_perfect_square_p" [@@noalloc]
+  external is_perfect_power: t->bool = "_mlgmp_z_perfect_power_p" [@@noalloc]
+  external is_perfect_square: t->bool =
+    "_mlgmp_z_perfect_square_p" [@@noalloc]
 
   external probab_prime_p: t->int->bool = "_mlgmp_z_probab_prime_p"
   external is_probab_prime: t->int->bool = "_mlgmp_z_probab_prime_p"
   external nextprime: t->t = "_mlgmp_z_nextprime"
 
   external gcd: t->t->t = "_mlgmp_z_gcd"
-  external gcd_ui: t->t->t = "_mlgmp_z_gcd_ui"
+  external gcd_ui: t->int->t = "_mlgmp_z_gcd_ui"
   external lcm: t->t->t = "_mlgmp_z_lcm"
   external gcdext: t->t->t*t*t = "_mlgmp_z_gcdext"
   external inverse: t->t->t option="_mlgmp_z_invert"
-  external legendre: t->t->int="_mlgmp_z_legendre"
-  external jacobi: t->t->int="_mlgmp_z_jacobi"
-  external kronecker_si: t->int->int="_mlgmp_z_kronecker_si"
-  external si_kronecker: int->t->int="_mlgmp_z_si_kronecker"
+  external legendre: t->t->(int [@untagged]) =
+    "_mlgmp_z_legendre" "_mlgmp_z_legendre_untagged" [@@noalloc]
+  external jacobi: t->t->(int [@untagged]) =
+    "_mlgmp_z_jacobi" "_mlgmp_z_jacobi_untagged" [@@noalloc]
+  external kronecker_si: t->(int [@untagged])->(int [@untagged]) =
+    "_mlgmp_z_kronecker_si" "_mlgmp_z_kronecker_si_untagged" [@@noalloc]
+  external si_kronecker: (int [@untagged])->t->(int [@untagged]) =
+    "_mlgmp_z_si_kronecker" "_mlgmp_z_si_kronecker_untagged" [@@noalloc]
   external remove: t->t->t*int="_mlgmp_z_remove"
 
   external fac_ui: int->t="_mlgmp_z_fac_ui"
@@ -188,21 +264,38 @@ module Z = struct
   external bin_ui: n: t-> k: int->t="_mlgmp_z_bin_ui"
   external bin_uiui: n: int-> k: int->t="_mlgmp_z_bin_uiui"
 
-  external cmp: t->t->int = "_mlgmp_z_compare";;
-  external cmp_si: t->int->int = "_mlgmp_z_compare_si";;
-  external compare: t->t->int = "_mlgmp_z_compare";;
-  external compare_si: t->int->int = "_mlgmp_z_compare_si";;
-  external compare_int: t->int->int = "_mlgmp_z_compare_si";;
-  external sgn: t->int = "_mlgmp_z_sgn";;
+  external big_compare: t->t->(int [@untagged]) =
+    "_mlgmp_z_compare" "_mlgmp_z_compare_untagged" [@@noalloc];;
+  external big_compare_si: t->(int [@untagged])->(int [@untagged]) =
+    "_mlgmp_z_compare_si" "_mlgmp_z_compare_si_untagged" [@@noalloc];;
+  external big_sgn: t->(int [@untagged]) =
+    "_mlgmp_z_sgn" "_mlgmp_z_sgn_untagged" [@@noalloc];;
+
+  let compare x y =
+    if is_small x && is_small y then int_compare (small_val x) (small_val y)
+    else big_compare x y
+  let compare_si x n =
+    if is_small x then int_compare (small_val x) n
+    else big_compare_si x n
+  let cmp = compare
+  let cmp_si = compare_si
+  let compare_int = compare_si
+  let sgn x =
+    if is_small x then int_compare (small_val x) 0
+    else big_sgn x
 
   external band: t->t->t = "_mlgmp_z_and";;
   external bior: t->t->t = "_mlgmp_z_ior";;
   external bxor: t->t->t = "_mlgmp_z_xor";;
   external bcom: t->t = "_mlgmp_z_com";;
-  external popcount: t->int = "_mlgmp_z_popcount";;
-  external hamdist: t->t->int = "_mlgmp_z_hamdist";;
-  external scan0: t->int->int = "_mlgmp_z_scan0";;
-  external scan1: t->int->int = "_mlgmp_z_scan1";;
+  external popcount: t->(int [@untagged]) =
+    "_mlgmp_z_popcount" "_mlgmp_z_popcount_untagged" [@@noalloc];;
+  external hamdist: t->t->(int [@untagged]) =
+    "_mlgmp_z_hamdist" "_mlgmp_z_hamdist_untagged" [@@noalloc];;
+  external scan0: t->(int [@untagged])->(int [@untagged]) =
+    "_mlgmp_z_scan0" "_mlgmp_z_scan0_untagged" [@@noalloc];;
+  external scan1: t->(int [@untagged])->(int [@untagged]) =
+    "_mlgmp_z_scan1" "_mlgmp_z_scan1_untagged" [@@noalloc];;
 
 (* missing set/clear bit *)
 
@@ -220,24 +313,91 @@ module Z = struct
   let max x y = if (compare x y) >= 0 then x else y
 
   let is_prime ?(prec = 10) x = is_probab_prime x prec
-  let equal x y = (compare x y) = 0
+  let equal x y =
+    if is_small x && is_small y then small_val x = small_val y
+    else (big_compare x y) = 0
   let equal_int x y = (compare_int x y) = 0
   let is_zero x = (sgn x) = 0
 
   let to_string = to_string_base ~base: 10
   let from_string = from_string_base ~base: 10
   let string_from = to_string
+  let of_substring = of_substring_base ~base: 10
+  let of_subbytes = of_subbytes_base ~base: 10
+
+  let of_raw_string ?(little_endian = false) s =
+    import_string ~little_endian s ~pos: 0 ~len: (String.length s)
+  let to_raw_string ?(little_endian = false) x =
+    let n = raw_size x in
+    let s = Bytes.create n in
+    export_bytes ~little_endian x s ~pos: 0 ~len: n;
+    Bytes.unsafe_to_string s
+
+  (* Reads blanks, an optional sign and digits from a Scanf buffer; the
+     first character that is not a digit is left there. *)
+  let scan_base ~base: base ib =
+    let is_digit c =
+      (match c with
+	'0'..'9' -> Char.code c - 48
+      | 'A'..'Z' -> Char.code c - 55
+      | 'a'..'z' -> Char.code c - (if base <= 36 then 87 else 61)
+      | _ -> base) < base in
+    let peek () =
+      try Scanf.bscanf ib "%0c" (fun c -> Some c) with End_of_file -> None in
+    let s = ref (Bytes.create 64) and n = ref 0 in
+    let take c =
+      (if !n = Bytes.length !s then
+	let s' = Bytes.create (2 * !n) in
+	Bytes.blit !s 0 s' 0 !n;
+	s := s');
+      Bytes.set !s !n c;
+      incr n;
+      Scanf.bscanf ib "%c" ignore in
+    Scanf.bscanf ib " " ();
+    (match peek () with
+      Some ('-' | '+' as c) -> take c
+    | _ -> ());
+    let rec digits () =
+      match peek () with
+	Some c when is_digit c -> take c; digits ()
+      | _ -> () in
+    digits ();
+    of_subbytes_base ~base !s ~pos: 0 ~len: !n
+  let scan = scan_base ~base: 10
+
+  (* Digits for buffers and channels go through a scratch area rather
+     than through a fresh string.  The threads of a domain share it, and
+     Buffer.add_subbytes or output may switch threads, so a thread empties
+     the slot while it uses the area: one that comes in meanwhile finds it
+     empty and makes its own. *)
+  let scratch_area =
+    Gmp_local.new_key ~split: (fun _ -> ref (Bytes.create 64))
+      (fun () -> ref (Bytes.create 64))
+  let with_scratch base x f =
+    let r = Gmp_local.get scratch_area in
+    let s = !r in
+    r := Bytes.empty;
+    let n = string_size_base ~base x in
+    let s = if Bytes.length s >= n then s
+      else Bytes.create (if n < 2 * Bytes.length s
+			 then 2 * Bytes.length s else n) in
+    f s (blit_string_base ~base x s 0);
+    r := s
+
+  let add_to_buffer_base ~base: base buf x =
+    with_scratch base x (fun s n -> Buffer.add_subbytes buf s 0 n)
+  let add_to_buffer = add_to_buffer_base ~base: 10
 
   let output chan n =
-    output_string chan (to_string n);;
+    with_scratch 10 n (fun s len -> output chan s 0 len);;
   let sprintf () = to_string;;
   let print formatter x = Format.pp_print_string formatter (to_string x)
 
   module Infixes=
   struct
-    external ( +! ) : t -> t -> t = "_mlgmp_z_add"
-    external ( -! ) : t -> t -> t = "_mlgmp_z_sub"
-    external ( *! ) : t -> t -> t = "_mlgmp_z_mul"
+    let ( +! ) = add
+    let ( -! ) = sub
+    let ( *! ) = mul
     external ( /! ) : t -> t -> t = "_mlgmp_z_fdiv_q" 
     external ( %! ) : t -> t -> t = "_mlgmp_z_fdiv_r"
     let ( <!  ) x y = (cmp x y)<0
@@ -247,6 +407,304 @@ module Z = struct
     let ( >!  ) x y = (cmp x y)>0
     let ( <>! ) x y = (cmp x y)<>0
   end;;
+
+  (* Operations on whole arrays, done in a single loop in C. *)
+  module Vec=
+  struct
+    external sum: t array->t = "_mlgmp_z_vec_sum"
+    external dot: t array->t array->t = "_mlgmp_z_vec_dot"
+    external product: t array->t = "_mlgmp_z_vec_product"
+    external add: t array->t array->t array = "_mlgmp_z_vec_add"
+    external sub: t array->t array->t array = "_mlgmp_z_vec_sub"
+    external mul: t array->t array->t array = "_mlgmp_z_vec_mul"
+    external scale: t->t array->t array = "_mlgmp_z_vec_scale"
+  end;;
+
+  (* Product trees over arrays of numbers, for reducing one number by
+     many moduli at once; the trees live outside the OCaml heap. *)
+  module Tree=
+  struct
+    type tree
+    external create: t array->tree = "_mlgmp_z_tree_create"
+    external length: tree->int = "_mlgmp_z_tree_length"
+    external product: tree->t = "_mlgmp_z_tree_product"
+    external remainders: tree->t->t array = "_mlgmp_z_tree_remainders"
+    external batch_gcd: t array->t array = "_mlgmp_z_batch_gcd"
+  end;;
+
+  module Column=
+  struct
+    type column
+    external write: string->t array->unit = "_mlgmp_z_column_write"
+    external open_file: string->column = "_mlgmp_z_column_open"
+    external close: column->unit = "_mlgmp_z_column_close"
+    external length: column->int = "_mlgmp_z_column_length"
+    external get: column->int->t = "_mlgmp_z_column_get"
+    external sgn: column->int->int = "_mlgmp_z_column_sgn"
+    external compare: column->int->t->int = "_mlgmp_z_column_compare"
+    external sum: column->t = "_mlgmp_z_column_sum"
+    let to_array c = Array.init (length c) (get c)
+  end;;
+
+  module Modular=
+  struct
+    type modulus
+    type elt
+    external create: t->modulus = "_mlgmp_z_modular_create"
+    external modulus: modulus->t = "_mlgmp_z_modular_modulus"
+    external elt: modulus->elt = "_mlgmp_z_modular_elt"
+    external of_z: modulus->t->elt = "_mlgmp_z_modular_of_z"
+    external to_z: modulus->elt->t = "_mlgmp_z_modular_to_z"
+    external set_z: modulus->dest: elt->t->unit = "_mlgmp_z_modular_set_z"
+    external add: modulus->dest: elt->elt->elt->unit
+      = "_mlgmp_z_modular_add"
+    external sub: modulus->dest: elt->elt->elt->unit
+      = "_mlgmp_z_modular_sub"
+    external mul: modulus->dest: elt->elt->elt->unit
+      = "_mlgmp_z_modular_mul"
+    external sqr: modulus->dest: elt->elt->unit = "_mlgmp_z_modular_sqr"
+    external pow: modulus->dest: elt->elt->t->unit = "_mlgmp_z_modular_pow"
+    external inv: modulus->dest: elt->elt->bool = "_mlgmp_z_modular_inv"
+  end;;
+end;;
+
+(* Destination-passing operations.  A Z2.t is always a custom block, so
+   that it can be overwritten in place; operands are ordinary Z.t values,
+   and as_z gives one (sharing the accumulator storage) without copying.
+   Operations with several results take one destination per result, and
+   raise Invalid_argument if the same one is passed twice. *)
+module Z2 = struct
+  type t;;
+  external create: unit->t = "_mlgmp_z_create";;
+  external of_z: Z.t->t = "_mlgmp_z2_of_z";;
+  external to_z: t->Z.t = "_mlgmp_z_copy";;
+  external as_z: t->Z.t = "%identity";;
+
+  external from_int: dest: t->int->unit = "_mlgmp_z2_from_int";;
+  external from_string_base: dest: t->base: int->string->unit
+      ="_mlgmp_z2_from_string_base";;
+  external from_float: dest: t->(float [@unboxed])->unit =
+    "_mlgmp_z2_from_float" "_mlgmp_z2_from_float_unboxed";;
+  external import_bytes:
+    dest: t->little_endian: bool->bytes->pos: int->len: int->unit =
+    "_mlgmp_z2_import_bytes";;
+  external import_bigstring:
+    dest: t->little_endian: bool->bigstring->pos: int->len: int->unit =
+    "_mlgmp_z2_import_bigstring";;
+  external column_get: dest: t->Z.Column.column->int->unit =
+    "_mlgmp_z2_column_get";;
+
+  external copy: dest: t-> from: Z.t-> unit = "_mlgmp_z2_set";;
+  external add: dest: t-> Z.t->Z.t->unit = "_mlgmp_z2_add";;
+  external sub: dest: t-> Z.t->Z.t->unit = "_mlgmp_z2_sub";;
+  external mul: dest: t-> Z.t->Z.t->unit = "_mlgmp_z2_mul";;
+  external add_ui: dest: t-> Z.t->int->unit = "_mlgmp_z2_add_ui";;
+  external sub_ui: dest: t-> Z.t->int->unit = "_mlgmp_z2_sub_ui";;
+  external mul_ui: dest: t-> Z.t->int->unit = "_mlgmp_z2_mul_ui";;
+
+  external addmul: dest: t-> Z.t->Z.t->unit = "_mlgmp_z2_addmul";;
+  external submul: dest: t-> Z.t->Z.t->unit = "_mlgmp_z2_submul";;
+  external addmul_ui: dest: t-> Z.t->int->unit = "_mlgmp_z2_addmul_ui";;
+  external submul_ui: dest: t-> Z.t->int->unit = "_mlgmp_z2_submul_ui";;
+  external mul_add: dest: t-> Z.t->Z.t->Z.t->Z.t->unit = "_mlgmp_z2_mul_add";;
+  external lincomb: dest: t-> Z.t array->Z.t array->unit =
+    "_mlgmp_z2_lincomb";;
+
+  external neg: dest: t->Z.t->unit = "_mlgmp_z2_neg";;
+  external abs: dest: t->Z.t->unit = "_mlgmp_z2_abs";;
+
+  external tdiv_qr: q: t-> r: t-> Z.t->Z.t->unit = "_mlgmp_z2_tdiv_qr";;
+  external tdiv_q: dest: t-> Z.t->Z.t->unit = "_mlgmp_z2_tdiv_q";;
+  external tdiv_r: dest: t-> Z.t->Z.t->unit = "_mlgmp_z2_tdiv_r";;
+
+  external cdiv_qr: q: t-> r: t-> Z.t->Z.t->unit = "_mlgmp_z2_cdiv_qr";;
+  external cdiv_q: dest: t-> Z.t->Z.t->unit = "_mlgmp_z2_cdiv_q";;
+  external cdiv_r: dest: t-> Z.t->Z.t->unit = "_mlgmp_z2_cdiv_r";;
+
+  external fdiv_qr: q: t-> r: t-> Z.t->Z.t->unit = "_mlgmp_z2_fdiv_qr";;
+  external fdiv_q: dest: t-> Z.t->Z.t->unit = "_mlgmp_z2_fdiv_q";;
+  external fdiv_r: dest: t-> Z.t->Z.t->unit = "_mlgmp_z2_fdiv_r";;
+
+  external dmod: dest: t-> Z.t->Z.t->unit = "_mlgmp_z2_mod";;
+  external dmod_ui: dest: t-> Z.t->int->unit = "_mlgmp_z2_mod_ui";;
+  external modulo: dest: t-> Z.t->Z.t->unit = "_mlgmp_z2_mod";;
+
+  external tdiv_qr_ui: q: t-> r: t-> Z.t->int->unit = "_mlgmp_z2_tdiv_qr_ui";;
+  external tdiv_q_ui: dest: t-> Z.t->int->unit = "_mlgmp_z2_tdiv_q_ui";;
+  external tdiv_r_ui: dest: t-> Z.t->int->unit = "_mlgmp_z2_tdiv_r_ui";;
+
+  external cdiv_qr_ui: q: t-> r: t-> Z.t->int->unit = "_mlgmp_z2_cdiv_qr_ui";;
+  external cdiv_q_ui: dest: t-> Z.t->int->unit = "_mlgmp_z2_cdiv_q_ui";;
+  external cdiv_r_ui: dest: t-> Z.t->int->unit = "_mlgmp_z2_cdiv_r_ui";;
+
+  external fdiv_qr_ui: q: t-> r: t-> Z.t->int->unit = "_mlgmp_z2_fdiv_qr_ui";;
+  external fdiv_q_ui: dest: t-> Z.t->int->unit = "_mlgmp_z2_fdiv_q_ui";;
+  external fdiv_r_ui: dest: t-> Z.t->int->unit = "_mlgmp_z2_fdiv_r_ui";;
+
+  external divexact: dest: t-> Z.t->Z.t->unit = "_mlgmp_z2_divexact";;
+
+  external mul_2exp: dest: t-> Z.t->int->unit = "_mlgmp_z2_mul_2exp";;
+  external tdiv_q_2exp: dest: t-> Z.t->int->unit = "_mlgmp_z2_tdiv_q_2exp";;
+  external tdiv_r_2exp: dest: t-> Z.t->int->unit = "_mlgmp_z2_tdiv_r_2exp";;
+  external fdiv_q_2exp: dest: t-> Z.t->int->unit = "_mlgmp_z2_fdiv_q_2exp";;
+  external fdiv_r_2exp: dest: t-> Z.t->int->unit = "_mlgmp_z2_fdiv_r_2exp";;
+  external cdiv_q_2exp: dest: t-> Z.t->int->unit = "_mlgmp_z2_cdiv_q_2exp";;
+  external cdiv_r_2exp: dest: t-> Z.t->int->unit = "_mlgmp_z2_cdiv_r_2exp";;
+
+  external powm: dest: t-> Z.t->Z.t->Z.t->unit = "_mlgmp_z2_powm";;
+  external powm_ui: dest: t-> Z.t->int->Z.t->unit = "_mlgmp_z2_powm_ui";;
+  external pow_ui: dest: t-> Z.t->int->unit = "_mlgmp_z2_pow_ui";;
+  external ui_pow_ui: dest: t-> int->int->unit = "_mlgmp_z2_ui_pow_ui";;
+
+  external sqrt: dest: t-> Z.t->unit = "_mlgmp_z2_sqrt";;
+  external sqrtrem: s: t-> r: t-> Z.t->unit = "_mlgmp_z2_sqrtrem";;
+  external root: dest: t-> Z.t->int->unit = "_mlgmp_z2_root";;
+
+  external nextprime: dest: t-> Z.t->unit = "_mlgmp_z2_nextprime";;
+  external gcd: dest: t-> Z.t->Z.t->unit = "_mlgmp_z2_gcd";;
+  external gcd_ui: dest: t-> Z.t->int->unit = "_mlgmp_z2_gcd_ui";;
+  external lcm: dest: t-> Z.t->Z.t->unit = "_mlgmp_z2_lcm";;
+  external gcdext: g: t-> s: t-> t: t-> Z.t->Z.t->unit = "_mlgmp_z2_gcdext";;
+  (* false if there is no inverse, dest is then undefined *)
+  external inverse: dest: t-> Z.t->Z.t->bool = "_mlgmp_z2_invert";;
+  external remove: dest: t-> Z.t->Z.t->int = "_mlgmp_z2_remove";;
+
+  external fac_ui: dest: t-> int->unit = "_mlgmp_z2_fac_ui";;
+  external fib_ui: dest: t-> int->unit = "_mlgmp_z2_fib_ui";;
+  external bin_ui: dest: t-> n: Z.t-> k: int->unit = "_mlgmp_z2_bin_ui";;
+  external bin_uiui: dest: t-> n: int-> k: int->unit = "_mlgmp_z2_bin_uiui";;
+
+  external band: dest: t-> Z.t->Z.t->unit = "_mlgmp_z2_and";;
+  external bior: dest: t-> Z.t->Z.t->unit = "_mlgmp_z2_ior";;
+  external bxor: dest: t-> Z.t->Z.t->unit = "_mlgmp_z2_xor";;
+  external bcom: dest: t-> Z.t->unit = "_mlgmp_z2_com";;
+
+  external urandomb: dest: t-> state: RNG.randstate_t->nbits: int->unit =
+    "_mlgmp_z2_urandomb";;
+  external urandomm: dest: t-> state: RNG.randstate_t->n: Z.t->unit =
+    "_mlgmp_z2_urandomm";;
+  external rrandomb: dest: t-> state: RNG.randstate_t->nbits: int->unit =
+    "_mlgmp_z2_rrandomb";;
+
+  (* Elementwise operations into an array of destinations. *)
+  module Vec=
+  struct
+    external add: dest: t array->Z.t array->Z.t array->unit =
+      "_mlgmp_z2_vec_add"
+    external sub: dest: t array->Z.t array->Z.t array->unit =
+      "_mlgmp_z2_vec_sub"
+    external mul: dest: t array->Z.t array->Z.t array->unit =
+      "_mlgmp_z2_vec_mul"
+    external scale: dest: t array->Z.t->Z.t array->unit =
+      "_mlgmp_z2_vec_scale"
+  end;;
+end;;
+
+(* Integers modulo 2^bits, signed in two's complement except for the
+   unsigned_ functions. *)
+module type FIXED =
+sig
+  type t
+  val bits : int
+  val zero : t
+  val one : t
+  val minus_one : t
+  val of_int : int -> t
+  val to_int : t -> int
+  val of_z : Z.t -> t
+  val to_z : t -> Z.t
+  val to_z_unsigned : t -> Z.t
+  val of_string : string -> t
+  val to_string : t -> string
+  val add : t -> t -> t
+  val sub : t -> t -> t
+  val mul : t -> t -> t
+  val neg : t -> t
+  val unsigned_div : t -> t -> t
+  val unsigned_rem : t -> t -> t
+  val logand : t -> t -> t
+  val logor : t -> t -> t
+  val logxor : t -> t -> t
+  val lognot : t -> t
+  val shift_left : t -> int -> t
+  val shift_right : t -> int -> t
+  val shift_right_logical : t -> int -> t
+  val compare : t -> t -> int
+  val unsigned_compare : t -> t -> int
+  val equal : t -> t -> bool
+end;;
+
+external fixed_initialize : unit->unit = "_mlgmp_fixed_initialize";;
+fixed_initialize ();;
+
+module Z128 = struct
+  type t
+  let bits = 128
+  external of_int: int->t = "_mlgmp_z128_of_int"
+  external to_int: t->(int [@untagged]) =
+    "_mlgmp_z128_to_int" "_mlgmp_z128_to_int_untagged" [@@noalloc]
+  external of_z: Z.t->t = "_mlgmp_z128_of_z"
+  external to_z: t->Z.t = "_mlgmp_z128_to_z"
+  external to_z_unsigned: t->Z.t = "_mlgmp_z128_to_z_unsigned"
+  external add: t->t->t = "_mlgmp_z128_add"
+  external sub: t->t->t = "_mlgmp_z128_sub"
+  external mul: t->t->t = "_mlgmp_z128_mul"
+  external neg: t->t = "_mlgmp_z128_neg"
+  external unsigned_div: t->t->t = "_mlgmp_z128_unsigned_div"
+  external unsigned_rem: t->t->t = "_mlgmp_z128_unsigned_rem"
+  external logand: t->t->t = "_mlgmp_z128_logand"
+  external logor: t->t->t = "_mlgmp_z128_logor"
+  external logxor: t->t->t = "_mlgmp_z128_logxor"
+  external lognot: t->t = "_mlgmp_z128_lognot"
+  external shift_left: t->int->t = "_mlgmp_z128_shift_left"
+  external shift_right: t->int->t = "_mlgmp_z128_shift_right"
+  external shift_right_logical: t->int->t = "_mlgmp_z128_shift_right_logical"
+  external compare: t->t->(int [@untagged]) =
+    "_mlgmp_z128_compare" "_mlgmp_z128_compare_untagged" [@@noalloc]
+  external unsigned_compare: t->t->(int [@untagged]) =
+    "_mlgmp_z128_unsigned_compare" "_mlgmp_z128_unsigned_compare_untagged"
+    [@@noalloc]
+  external equal: t->t->bool = "_mlgmp_z128_equal" [@@noalloc]
+  let zero = of_int 0
+  let one = of_int 1
+  let minus_one = of_int (-1)
+  let of_string s = of_z (Z.from_string s)
+  let to_string x = Z.to_string (to_z x)
+end;;
+
+module Z256 = struct
+  type t
+  let bits = 256
+  external of_int: int->t = "_mlgmp_z256_of_int"
+  external to_int: t->(int [@untagged]) =
+    "_mlgmp_z256_to_int" "_mlgmp_z256_to_int_untagged" [@@noalloc]
+  external of_z: Z.t->t = "_mlgmp_z256_of_z"
+  external to_z: t->Z.t = "_mlgmp_z256_to_z"
+  external to_z_unsigned: t->Z.t = "_mlgmp_z256_to_z_unsigned"
+  external add: t->t->t = "_mlgmp_z256_add"
+  external sub: t->t->t = "_mlgmp_z256_sub"
+  external mul: t->t->t = "_mlgmp_z256_mul"
+  external neg: t->t = "_mlgmp_z256_neg"
+  external unsigned_div: t->t->t = "_mlgmp_z256_unsigned_div"
+  external unsigned_rem: t->t->t = "_mlgmp_z256_unsigned_rem"
+  external logand: t->t->t = "_mlgmp_z256_logand"
+  external logor: t->t->t = "_mlgmp_z256_logor"
+  external logxor: t->t->t = "_mlgmp_z256_logxor"
+  external lognot: t->t = "_mlgmp_z256_lognot"
+  external shift_left: t->int->t = "_mlgmp_z256_shift_left"
+  external shift_right: t->int->t = "_mlgmp_z256_shift_right"
+  external shift_right_logical: t->int->t = "_mlgmp_z256_shift_right_logical"
+  external compare: t->t->(int [@untagged]) =
+    "_mlgmp_z256_compare" "_mlgmp_z256_compare_untagged" [@@noalloc]
+  external unsigned_compare: t->t->(int [@untagged]) =
+    "_mlgmp_z256_unsigned_compare" "_mlgmp_z256_unsigned_compare_untagged"
+    [@@noalloc]
+  external equal: t->t->bool = "_mlgmp_z256_equal" [@@noalloc]
+  let zero = of_int 0
+  let one = of_int 1
+  let minus_one = of_int (-1)
+  let of_string s = of_z (Z.from_string s)
+  let to_string x = Z.to_string (to_z x)
 end;;
 
 module Q = struct
@@ -259,12 +717,20 @@ module Q = struct
   external from_z : Z.t->t = "_mlgmp_q_from_z";;
   external from_si : int->int->t = "_mlgmp_q_from_si";;
   external from_ints : int->int->t = "_mlgmp_q_from_si";;
-  external from_float : float->t = "_mlgmp_q_from_float";;
+  external from_float : (float [@unboxed])->t =
+    "_mlgmp_q_from_float" "_mlgmp_q_from_float_unboxed";;
 
   let from_int x = from_ints x 1
 
-  external float_from : t->float = "_mlgmp_q_to_float";;
-  external to_float : t->float = "_mlgmp_q_to_float";;
+  (* num or num/den *)
+  external of_substring_base : base: int->string->pos: int->len: int->t =
+    "_mlgmp_q_from_substring";;
+  let of_substring = of_substring_base ~base: 10
+
+  external float_from : t->(float [@unboxed]) =
+    "_mlgmp_q_to_float" "_mlgmp_q_to_float_unboxed" [@@noalloc];;
+  external to_float : t->(float [@unboxed]) =
+    "_mlgmp_q_to_float" "_mlgmp_q_to_float_unboxed" [@@noalloc];;
 
   external add : t->t->t = "_mlgmp_q_add";;
   external sub : t->t->t = "_mlgmp_q_sub";;
@@ -278,10 +744,14 @@ module Q = struct
   external get_num : t->Z.t = "_mlgmp_q_get_num";;
   external get_den : t->Z.t = "_mlgmp_q_get_den";;
 
-  external cmp : t->t->int = "_mlgmp_q_cmp";;
-  external compare : t->t->int = "_mlgmp_q_cmp";;
-  external cmp_ui : t->int->int->int = "_mlgmp_q_cmp_ui";;
-  external sgn : t->int = "_mlgmp_q_sgn";;
+  external cmp : t->t->(int [@untagged]) =
+    "_mlgmp_q_cmp" "_mlgmp_q_cmp_untagged" [@@noalloc];;
+  external compare : t->t->(int [@untagged]) =
+    "_mlgmp_q_cmp" "_mlgmp_q_cmp_untagged" [@@noalloc];;
+  external cmp_ui : t->(int [@untagged])->(int [@untagged])->(int [@untagged]) =
+    "_mlgmp_q_cmp_ui" "_mlgmp_q_cmp_ui_untagged" [@@noalloc];;
+  external sgn : t->(int [@untagged]) =
+    "_mlgmp_q_sgn" "_mlgmp_q_sgn_untagged" [@@noalloc];;
 
   let zero = create ();;
   let is_zero x = (sgn x) = 0;;
@@ -316,10 +786,160 @@ module Q = struct
   end;;
 end;;
 
+(* Destination-passing operations on rationals, as Z2 for integers. *)
 module Q2 = struct
-  type t = Q.t
-  external add : t->t->t->unit = "_mlgmp_q2_add"
-end
+  type t;;
+  external create: unit->t = "_mlgmp_q_create";;
+  external of_q: Q.t->t = "_mlgmp_q_copy";;
+  external to_q: t->Q.t = "_mlgmp_q_copy";;
+  external as_q: t->Q.t = "%identity";;
+
+  external from_z: dest: t->Z.t->unit = "_mlgmp_q2_from_z";;
+  external from_si: dest: t->int->int->unit = "_mlgmp_q2_from_si";;
+  external from_ints: dest: t->int->int->unit = "_mlgmp_q2_from_si";;
+  external from_float: dest: t->(float [@unboxed])->unit =
+    "_mlgmp_q2_from_float" "_mlgmp_q2_from_float_unboxed";;
+  external copy: dest: t-> from: Q.t->unit = "_mlgmp_q2_set";;
+
+  external add: dest: t->Q.t->Q.t->unit = "_mlgmp_q2_add";;
+  external sub: dest: t->Q.t->Q.t->unit = "_mlgmp_q2_sub";;
+  external mul: dest: t->Q.t->Q.t->unit = "_mlgmp_q2_mul";;
+  external div: dest: t->Q.t->Q.t->unit = "_mlgmp_q2_div";;
+
+  external neg: dest: t->Q.t->unit = "_mlgmp_q2_neg";;
+  external inv: dest: t->Q.t->unit = "_mlgmp_q2_inv";;
+  external abs: dest: t->Q.t->unit = "_mlgmp_q2_abs";;
+
+  external get_num: dest: Z2.t->Q.t->unit = "_mlgmp_q2_get_num";;
+  external get_den: dest: Z2.t->Q.t->unit = "_mlgmp_q2_get_den";;
+end;;
+
+(* Chinese remaindering over a fixed array of pairwise coprime positive
+   moduli, whose product tree and inverses are computed once by create
+   and then reused by every reconstruction. *)
+module CRT = struct
+  type t;;
+  external create: Z.t array->t = "_mlgmp_crt_create";;
+  external modulus: t->Z.t = "_mlgmp_crt_modulus";;
+  external to_z: t->Z.t array->Z.t = "_mlgmp_crt_to_z";;
+  external to_q: t->Z.t array->Q.t option = "_mlgmp_crt_to_q";;
+  external rational_reconstruction: Z.t->Z.t->Q.t option =
+    "_mlgmp_ratrecon";;
+
+  let to_z_signed c residues =
+    let x = to_z c residues and m = modulus c in
+    if Z.compare (Z.mul_2exp x 1) m > 0 then Z.sub x m else x
+
+  let crt pairs = to_z (create (Array.map snd pairs)) (Array.map fst pairs)
+end;;
+
+module ZPoly = struct
+  (* Coefficients from degree 0 up. *)
+  type t;;
+  external of_array: Z.t array->t = "_mlgmp_zpoly_of_array";;
+  external to_array: t->Z.t array = "_mlgmp_zpoly_to_array";;
+  external degree: t->int = "_mlgmp_zpoly_degree";;
+  external coeff: t->int->Z.t = "_mlgmp_zpoly_coeff";;
+  external equal: t->t->bool = "_mlgmp_zpoly_equal";;
+  external add: t->t->t = "_mlgmp_zpoly_add";;
+  external sub: t->t->t = "_mlgmp_zpoly_sub";;
+  external neg: t->t = "_mlgmp_zpoly_neg";;
+  external mul: t->t->t = "_mlgmp_zpoly_mul";;
+  external scale: Z.t->t->t = "_mlgmp_zpoly_scale";;
+  external divexact_z: t->Z.t->t = "_mlgmp_zpoly_divexact_z";;
+  external eval: t->Z.t->Z.t = "_mlgmp_zpoly_eval";;
+  external eval_frac: t->Z.t->Z.t->Z.t = "_mlgmp_zpoly_eval_frac";;
+  external pseudo_divrem: t->t->t*t = "_mlgmp_zpoly_pseudo_divrem";;
+  external divexact: t->t->t = "_mlgmp_zpoly_divexact";;
+  external content: t->Z.t = "_mlgmp_zpoly_content";;
+  external primitive_part: t->t = "_mlgmp_zpoly_primitive_part";;
+  external gcd: t->t->t = "_mlgmp_zpoly_gcd";;
+  external derivative: t->t = "_mlgmp_zpoly_derivative";;
+
+  let zero = of_array [||]
+  let one = of_array [| Z.one |]
+  let x = of_array [| Z.zero; Z.one |]
+  let leading_coeff p = coeff p (degree p)
+end;;
+
+module QPoly = struct
+  (* num/den, with den > 0 and coprime with the content of num. *)
+  type t = { num: ZPoly.t; den: Z.t };;
+
+  let make num den =
+    let g = Z.gcd (ZPoly.content num) den in
+    let g = if Z.sgn den < 0 then Z.neg g else g in
+    { num = ZPoly.divexact_z num g; den = Z.divexact den g }
+
+  let zero = { num = ZPoly.zero; den = Z.one }
+  let one = { num = ZPoly.one; den = Z.one }
+  let x = { num = ZPoly.x; den = Z.one }
+  let of_zpoly p = { num = p; den = Z.one }
+  let num p = p.num
+  let den p = p.den
+
+  let of_array a =
+    let den = Array.fold_left (fun d c -> Z.lcm d (Q.get_den c)) Z.one a in
+    let scaled c = Z.mul (Q.get_num c) (Z.divexact den (Q.get_den c)) in
+    make (ZPoly.of_array (Array.map scaled a)) den
+  let to_array p = Array.map (fun c -> Q.from_zs c p.den) (ZPoly.to_array p.num)
+  let degree p = ZPoly.degree p.num
+  let coeff p i = Q.from_zs (ZPoly.coeff p.num i) p.den
+  let leading_coeff p = coeff p (degree p)
+  let equal p q = ZPoly.equal p.num q.num && Z.equal p.den q.den
+
+  let add p q =
+    make (ZPoly.add (ZPoly.scale q.den p.num) (ZPoly.scale p.den q.num))
+      (Z.mul p.den q.den)
+  let sub p q =
+    make (ZPoly.sub (ZPoly.scale q.den p.num) (ZPoly.scale p.den q.num))
+      (Z.mul p.den q.den)
+  let neg p = { p with num = ZPoly.neg p.num }
+  let mul p q = make (ZPoly.mul p.num q.num) (Z.mul p.den q.den)
+  let scale c p =
+    make (ZPoly.scale (Q.get_num c) p.num) (Z.mul (Q.get_den c) p.den)
+
+  let eval p c =
+    let d = degree p in
+    if d < 0 then Q.zero
+    else Q.from_zs (ZPoly.eval_frac p.num (Q.get_num c) (Q.get_den c))
+	(Z.mul (Z.pow_ui (Q.get_den c) d) p.den)
+
+  (* From the pseudo-division of the numerators, c^e a.num = q b.num + r
+     with c the leading coefficient of b.num:
+     a = (q b.den / (c^e a.den)) b + r / (c^e a.den). *)
+  let divrem a b =
+    let (q, r) = ZPoly.pseudo_divrem a.num b.num in
+    let e = degree a - degree b + 1 in
+    if e <= 0 then (zero, a)
+    else
+      let d = Z.mul (Z.pow_ui (ZPoly.leading_coeff b.num) e) a.den in
+      (make (ZPoly.scale b.den q) d, make r d)
+  let div a b = fst (divrem a b)
+  let rem a b = snd (divrem a b)
+
+  (* monic, or zero *)
+  let gcd a b =
+    let g = ZPoly.gcd a.num b.num in
+    if ZPoly.degree g < 0 then zero else make g (ZPoly.leading_coeff g)
+  let derivative p = make (ZPoly.derivative p.num) p.den
+end;;
+
+(* The scientific notation of a float, built in a single string from the
+   digits (after an optional sign) and the exponent given by the C
+   conversions, with the radix point after the first digit. *)
+let scientific_string base mantissa exponent =
+  let lm = String.length mantissa
+  and e = string_of_int (exponent - 1) in
+  let i = if mantissa.[0] = '-' then 2 else 1 in
+  let point = if lm > i then 1 else 0 in
+  let s = Bytes.create (lm + point + 1 + String.length e) in
+  Bytes.blit_string mantissa 0 s 0 i;
+  if point = 1 then Bytes.set s i '.';
+  Bytes.blit_string mantissa i s (i + point) (lm - i);
+  Bytes.set s (lm + point) (if base <= 10 then 'E' else '@');
+  Bytes.blit_string e 0 s (lm + point + 1) (String.length e);
+  Bytes.unsafe_to_string s;;
 
 module F = struct
   external f_initialize : unit->unit = "_mlgmp_f_initialize";;
@@ -331,14 +951,17 @@ module F = struct
   let default_prec = ref 120
 
   external from_z_prec : prec: int->Z.t->t = "_mlgmp_f_from_z";;
-  external from_q_prec : prec: int->Z.t->t = "_mlgmp_f_from_q";;
+  external from_q_prec : prec: int->Q.t->t = "_mlgmp_f_from_q";;
   external from_si_prec : prec: int->int->t = "_mlgmp_f_from_si";;
-  external from_float_prec : prec: int->float->t = "_mlgmp_f_from_float";;
+  external from_float_prec : prec: int->(float [@unboxed])->t =
+    "_mlgmp_f_from_float" "_mlgmp_f_from_float_unboxed";;
   external from_string_prec_base : prec: int->base: int->string->t =
     "_mlgmp_f_from_string";;
 
-  external float_from : t->float = "_mlgmp_f_to_float";;
-  external to_float : t->float = "_mlgmp_f_to_float";;
+  external float_from : t->(float [@unboxed]) =
+    "_mlgmp_f_to_float" "_mlgmp_f_to_float_unboxed" [@@noalloc];;
+  external to_float : t->(float [@unboxed]) =
+    "_mlgmp_f_to_float" "_mlgmp_f_to_float_unboxed" [@@noalloc];;
 
   external to_string_exp_base_digits : base: int-> digits: int->t->string*int =
     "_mlgmp_f_to_string_exp_base_digits"
@@ -362,6 +985,11 @@ module F = struct
   external ceil_prec : prec: int->t->t = "_mlgmp_f_ceil";;
   external trunc_prec : prec: int->t->t = "_mlgmp_f_trunc";;
 
+  external sqrt_prec : prec: int->t->t = "_mlgmp_f_sqrt";;
+  external pow_prec_ui : prec: int->t->int->t = "_mlgmp_f_pow_ui";;
+  external mul_prec_2exp : prec: int->t->int->t = "_mlgmp_f_mul_2exp";;
+  external div_prec_2exp : prec: int->t->int->t = "_mlgmp_f_div_2exp";;
+
   let default f x = f ~prec: !default_prec x
 
   let from_z = default from_z_prec
@@ -391,11 +1019,19 @@ module F = struct
   let floor = default floor_prec
   let ceil = default ceil_prec
   let trunc = default trunc_prec
-
-  external cmp : t->t->int = "_mlgmp_f_cmp";;
-  external compare : t->t->int = "_mlgmp_f_cmp";;
-  external sgn : t->int = "_mlgmp_f_sgn";;
-  external eq : t->t-> prec: int->bool = "_mlgmp_f_eq";;
+  let sqrt = default sqrt_prec
+  let pow_ui = default pow_prec_ui
+  let mul_2exp = default mul_prec_2exp
+  let div_2exp = default div_prec_2exp
+
+  external cmp : t->t->(int [@untagged]) =
+    "_mlgmp_f_cmp" "_mlgmp_f_cmp_untagged" [@@noalloc];;
+  external compare : t->t->(int [@untagged]) =
+    "_mlgmp_f_cmp" "_mlgmp_f_cmp_untagged" [@@noalloc];;
+  external sgn : t->(int [@untagged]) =
+    "_mlgmp_f_sgn" "_mlgmp_f_sgn_untagged" [@@noalloc];;
+  external eq : t->t-> prec: (int [@untagged])->bool =
+    "_mlgmp_f_eq" "_mlgmp_f_eq_untagged" [@@noalloc];;
 
   external urandomb_prec : prec: int -> state: RNG.randstate_t ->
     nbits: int -> t = "_mlgmp_f_urandomb"
@@ -408,29 +1044,64 @@ module F = struct
   let equal x y = eq x y ~prec: 90;;
 
   let to_string_base_digits ~base: base ~digits: digits x =
-    let mantissa, exponent =
-      to_string_exp_base_digits ~base: base ~digits: digits (abs x)
-    in
-    let sign = sgn x in
-    if sign = 0 then "0"
+    if sgn x = 0 then "0"
     else
-      ((if sign < 0 then "-" else "")
-       ^ (let lm=String.length mantissa
-        in if lm > 1
-           then let tmp = Bytes.create (succ lm)
-                in Bytes.blit_string mantissa 0 tmp 0 1;
-                   Bytes.blit_string mantissa 1 tmp 2 (pred lm);
-                   Bytes.set tmp 1 '.';
-                   Bytes.to_string tmp
-           else mantissa)
-       ^ (if base <= 10 then "E" else "@")
-       ^ (string_of_int (pred exponent)));;
+      let mantissa, exponent =
+        to_string_exp_base_digits ~base: base ~digits: digits x in
+      scientific_string base mantissa exponent;;
 
   let to_string = to_string_base_digits ~base: 10 ~digits: 10;;
 
 (* It seems that marshalling for F.t is not accurate. *)
 end;;
 
+(* Destination-passing operations on floats.  Results are rounded to the
+   precision the destination was created with. *)
+module F2 = struct
+  type t;;
+  external create_prec: prec: int->t = "_mlgmp_f_create";;
+  let create () = create_prec ~prec: !F.default_prec
+  external of_f: F.t->t = "_mlgmp_f_copy";;
+  external to_f: t->F.t = "_mlgmp_f_copy";;
+  external as_f: t->F.t = "%identity";;
+
+  external from_z: dest: t->Z.t->unit = "_mlgmp_f2_from_z";;
+  external from_q: dest: t->Q.t->unit = "_mlgmp_f2_from_q";;
+  external from_si: dest: t->int->unit = "_mlgmp_f2_from_si";;
+  external from_int: dest: t->int->unit = "_mlgmp_f2_from_si";;
+  external from_float: dest: t->(float [@unboxed])->unit =
+    "_mlgmp_f2_from_float" "_mlgmp_f2_from_float_unboxed" [@@noalloc];;
+  external from_string_base: dest: t->base: int->string->unit =
+    "_mlgmp_f2_from_string";;
+  external copy: dest: t-> from: F.t->unit = "_mlgmp_f2_set";;
+
+  external add: dest: t->F.t->F.t->unit = "_mlgmp_f2_add";;
+  external sub: dest: t->F.t->F.t->unit = "_mlgmp_f2_sub";;
+  external mul: dest: t->F.t->F.t->unit = "_mlgmp_f2_mul";;
+  external div: dest: t->F.t->F.t->unit = "_mlgmp_f2_div";;
+  external reldiff: dest: t->F.t->F.t->unit = "_mlgmp_f2_reldiff";;
+
+  external add_ui: dest: t->F.t->int->unit = "_mlgmp_f2_add_ui";;
+  external sub_ui: dest: t->F.t->int->unit = "_mlgmp_f2_sub_ui";;
+  external mul_ui: dest: t->F.t->int->unit = "_mlgmp_f2_mul_ui";;
+  external div_ui: dest: t->F.t->int->unit = "_mlgmp_f2_div_ui";;
+  external ui_sub: dest: t->int->F.t->unit = "_mlgmp_f2_ui_sub";;
+  external ui_div: dest: t->int->F.t->unit = "_mlgmp_f2_ui_div";;
+  external pow_ui: dest: t->F.t->int->unit = "_mlgmp_f2_pow_ui";;
+  external mul_2exp: dest: t->F.t->int->unit = "_mlgmp_f2_mul_2exp";;
+  external div_2exp: dest: t->F.t->int->unit = "_mlgmp_f2_div_2exp";;
+
+  external neg: dest: t->F.t->unit = "_mlgmp_f2_neg";;
+  external abs: dest: t->F.t->unit = "_mlgmp_f2_abs";;
+  external sqrt: dest: t->F.t->unit = "_mlgmp_f2_sqrt";;
+  external floor: dest: t->F.t->unit = "_mlgmp_f2_floor";;
+  external ceil: dest: t->F.t->unit = "_mlgmp_f2_ceil";;
+  external trunc: dest: t->F.t->unit = "_mlgmp_f2_trunc";;
+
+  external urandomb: dest: t-> state: RNG.randstate_t->nbits: int->unit =
+    "_mlgmp_f2_urandomb";;
+end;;
+
 module FR = struct
   external fr_initialize : unit->unit = "_mlgmp_fr_initialize";;
   fr_initialize ();;
@@ -448,9 +1119,13 @@ module FR = struct
   external from_si_prec : prec: int -> mode: rounding_mode -> 
     int->t = "_mlgmp_fr_from_si";;
   external from_float_prec : prec: int -> mode: rounding_mode -> 
-    float->t = "_mlgmp_fr_from_float";;
+    (float [@unboxed])->t =
+    "_mlgmp_fr_from_float" "_mlgmp_fr_from_float_unboxed";;
   external from_string_prec_base : prec: int-> mode: rounding_mode ->
     base: int->string->t = "_mlgmp_fr_from_string";;
+  external of_substring_prec_base : prec: int-> mode: rounding_mode ->
+    base: int->string->pos: int->len: int->t =
+    "_mlgmp_fr_from_substring_bytecode" "_mlgmp_fr_from_substring";;
 
   external to_string_exp_base_digits :
     mode: rounding_mode ->
@@ -465,6 +1140,10 @@ module FR = struct
     t->t->t = "_mlgmp_fr_mul";;
   external div_prec : prec: int -> mode: rounding_mode -> 
     t->t->t = "_mlgmp_fr_div";;
+  external fma_prec : prec: int -> mode: rounding_mode -> 
+    t->t->t->t = "_mlgmp_fr_fma";;
+  external fms_prec : prec: int -> mode: rounding_mode -> 
+    t->t->t->t = "_mlgmp_fr_fms";;
 
   external add_prec_ui : prec: int -> mode: rounding_mode -> 
     t->int->t = "_mlgmp_fr_add_ui";;
@@ -518,9 +1197,25 @@ module FR = struct
       = "_mlgmp_fr_pow";;
   external pow_prec_ui : prec: int -> mode: rounding_mode -> t->int->t
       = "_mlgmp_fr_pow_ui";;
-
-  external float_from : t->float = "_mlgmp_fr_to_float";;
-  external to_float_mode : mode: rounding_mode -> t -> float = "_mlgmp_fr_to_float";;
+  external cbrt_prec : prec: int -> mode: rounding_mode -> t->t
+      = "_mlgmp_fr_cbrt";;
+  external expm1_prec : prec: int -> mode: rounding_mode -> t->t
+      = "_mlgmp_fr_expm1";;
+  external log_prec : prec: int -> mode: rounding_mode -> t->t
+      = "_mlgmp_fr_log";;
+  external log2_prec : prec: int -> mode: rounding_mode -> t->t
+      = "_mlgmp_fr_log2";;
+  external log10_prec : prec: int -> mode: rounding_mode -> t->t
+      = "_mlgmp_fr_log10";;
+  external log1p_prec : prec: int -> mode: rounding_mode -> t->t
+      = "_mlgmp_fr_log1p";;
+  external atan2_prec : prec: int -> mode: rounding_mode -> t->t->t
+      = "_mlgmp_fr_atan2";;
+  external hypot_prec : prec: int -> mode: rounding_mode -> t->t->t
+      = "_mlgmp_fr_hypot";;
+
+  external to_float_mode : mode: rounding_mode -> t -> (float [@unboxed]) =
+    "_mlgmp_fr_to_float" "_mlgmp_fr_to_float_unboxed" [@@noalloc];;
 
   external to_z_exp : t->Z.t*int = "_mlgmp_fr_to_z_exp";;
 
@@ -529,11 +1224,15 @@ module FR = struct
   external trunc_prec : prec: int -> t -> t = "_mlgmp_fr_trunc";;
   external rint_prec : prec:int -> mode:rounding_mode -> t -> t = "_mlgmp_fr_rint"
 
-  external cmp : t->t->int = "_mlgmp_fr_cmp";;
-  external compare : t->t->int = "_mlgmp_fr_cmp";;
-  external sgn : t->int = "_mlgmp_fr_sgn";;
-  external eq : t->t-> prec: int->bool = "_mlgmp_fr_eq";;
-  external is_nan : t->bool = "_mlgmp_fr_is_nan";;
+  external cmp : t->t->(int [@untagged]) =
+    "_mlgmp_fr_cmp" "_mlgmp_fr_cmp_untagged" [@@noalloc];;
+  external compare : t->t->(int [@untagged]) =
+    "_mlgmp_fr_cmp" "_mlgmp_fr_cmp_untagged" [@@noalloc];;
+  external sgn : t->(int [@untagged]) =
+    "_mlgmp_fr_sgn" "_mlgmp_fr_sgn_untagged" [@@noalloc];;
+  external eq : t->t-> prec: (int [@untagged])->bool =
+    "_mlgmp_fr_eq" "_mlgmp_fr_eq_untagged" [@@noalloc];;
+  external is_nan : t->bool = "_mlgmp_fr_is_nan" [@@noalloc];;
 
   external urandomb : prec: int -> state: RNG.randstate_t -> t=
     "_mlgmp_fr_urandomb";;
@@ -555,7 +1254,10 @@ module FR = struct
   let from_string_base = from_string_prec_base
       ~prec: !default_prec ~mode: GMP_RNDN
   let from_string = from_string_base ~base: 10
+  let of_substring = of_substring_prec_base
+      ~prec: !default_prec ~mode: GMP_RNDN ~base: 10
   let to_float = to_float_mode ~mode: GMP_RNDN
+  let float_from = to_float
 
   let zero =
     try from_int 0
@@ -565,6 +1267,8 @@ module FR = struct
   let sub = default sub_prec
   let mul = default mul_prec
   let div = default div_prec
+  let fma = default fma_prec
+  let fms = default fms_prec
   let reldiff = default reldiff_prec
 
   let add_ui = default add_prec_ui
@@ -591,6 +1295,14 @@ module FR = struct
   let sqrt = default sqrt_prec
   let exp = default exp_prec
   let exp2 = default exp2_prec
+  let cbrt = default cbrt_prec
+  let expm1 = default expm1_prec
+  let log = default log_prec
+  let log2 = default log2_prec
+  let log10 = default log10_prec
+  let log1p = default log1p_prec
+  let atan2 = default atan2_prec
+  let hypot = default hypot_prec
   let pow = default pow_prec
   let pow_ui = default pow_prec_ui
 
@@ -601,27 +1313,14 @@ module FR = struct
 
   let equal x y = eq x y ~prec: 90;;
 
+  (* NaN and infinities come as "@NaN@", "@Inf@" and "-@Inf@" *)
   let to_string_base_digits ~mode: mode
      ~base: base ~digits: digits x =
    let mantissa, exponent =
      to_string_exp_base_digits ~mode: mode ~base: base ~digits: digits x
    in
-   let i = (if (sgn x) < 0 then 1 else 0) in
-   let prefix : string =
-     if mantissa = "Inf" then "Inf"
-     else
-       let lm=String.length mantissa in
-       if lm > 1 then
-         let tmp = Bytes.create (succ lm) in
-         Bytes.blit_string mantissa 0 tmp 0 (1+i);
-         Bytes.blit_string mantissa (1+i) tmp (2+i) ((pred lm)-i);
-         Bytes.set tmp (1+i) '.';
-         Bytes.to_string tmp
-       else mantissa
-   in
-   prefix
-   ^ (if base <= 10 then "E" else "@")
-   ^ (string_of_int (pred exponent))
+   if String.contains mantissa '@' then mantissa
+   else scientific_string base mantissa exponent
 ;;
 
   let to_string = to_string_base_digits ~mode: GMP_RNDN ~base: 10 ~digits: 10;;
@@ -649,7 +1348,271 @@ module FR = struct
  let z_from = to_z
 end;;
 
+(* Destination-passing operations on MPFR floats.  Results are rounded to
+   the precision the destination was created with; the functions without
+   a _mode suffix round to nearest. *)
+module FR2 = struct
+  type t;;
+  external create_prec: prec: int->unit->t = "_mlgmp_fr_create";;
+  let create () = create_prec ~prec: !FR.default_prec ()
+  external of_fr: FR.t->t = "_mlgmp_fr_copy";;
+  external to_fr: t->FR.t = "_mlgmp_fr_copy";;
+  external as_fr: t->FR.t = "%identity";;
+
+  external copy_mode: dest: t-> mode: rounding_mode-> from: FR.t->unit =
+    "_mlgmp_fr2_set";;
+  external from_z_mode: dest: t-> mode: rounding_mode->Z.t->unit =
+    "_mlgmp_fr2_from_z";;
+  external from_q_mode: dest: t-> mode: rounding_mode->Q.t->unit =
+    "_mlgmp_fr2_from_q";;
+  external from_si_mode: dest: t-> mode: rounding_mode->int->unit =
+    "_mlgmp_fr2_from_si";;
+  external from_float_mode:
+    dest: t-> mode: rounding_mode->(float [@unboxed])->unit =
+    "_mlgmp_fr2_from_float" "_mlgmp_fr2_from_float_unboxed" [@@noalloc];;
+  external from_string_base_mode: dest: t-> mode: rounding_mode->
+    base: int->string->unit = "_mlgmp_fr2_from_string";;
+
+  external add_mode: dest: t-> mode: rounding_mode->FR.t->FR.t->unit =
+    "_mlgmp_fr2_add";;
+  external sub_mode: dest: t-> mode: rounding_mode->FR.t->FR.t->unit =
+    "_mlgmp_fr2_sub";;
+  external mul_mode: dest: t-> mode: rounding_mode->FR.t->FR.t->unit =
+    "_mlgmp_fr2_mul";;
+  external div_mode: dest: t-> mode: rounding_mode->FR.t->FR.t->unit =
+    "_mlgmp_fr2_div";;
+  external fma_mode: dest: t-> mode: rounding_mode->FR.t->FR.t->FR.t->unit =
+    "_mlgmp_fr2_fma";;
+  external fms_mode: dest: t-> mode: rounding_mode->FR.t->FR.t->FR.t->unit =
+    "_mlgmp_fr2_fms";;
+  external pow_mode: dest: t-> mode: rounding_mode->FR.t->FR.t->unit =
+    "_mlgmp_fr2_pow";;
+  external atan2_mode: dest: t-> mode: rounding_mode->FR.t->FR.t->unit =
+    "_mlgmp_fr2_atan2";;
+  external hypot_mode: dest: t-> mode: rounding_mode->FR.t->FR.t->unit =
+    "_mlgmp_fr2_hypot";;
+  external reldiff_mode: dest: t-> mode: rounding_mode->FR.t->FR.t->unit =
+    "_mlgmp_fr2_reldiff";;
+
+  external add_ui_mode: dest: t-> mode: rounding_mode->FR.t->int->unit =
+    "_mlgmp_fr2_add_ui";;
+  external sub_ui_mode: dest: t-> mode: rounding_mode->FR.t->int->unit =
+    "_mlgmp_fr2_sub_ui";;
+  external mul_ui_mode: dest: t-> mode: rounding_mode->FR.t->int->unit =
+    "_mlgmp_fr2_mul_ui";;
+  external div_ui_mode: dest: t-> mode: rounding_mode->FR.t->int->unit =
+    "_mlgmp_fr2_div_ui";;
+  external pow_ui_mode: dest: t-> mode: rounding_mode->FR.t->int->unit =
+    "_mlgmp_fr2_pow_ui";;
+  external mul_2ui_mode: dest: t-> mode: rounding_mode->FR.t->int->unit =
+    "_mlgmp_fr2_mul_2ui";;
+  external div_2ui_mode: dest: t-> mode: rounding_mode->FR.t->int->unit =
+    "_mlgmp_fr2_div_2ui";;
+
+  external ui_sub_mode: dest: t-> mode: rounding_mode->int->FR.t->unit =
+    "_mlgmp_fr2_ui_sub";;
+  external ui_div_mode: dest: t-> mode: rounding_mode->int->FR.t->unit =
+    "_mlgmp_fr2_ui_div";;
+  external ui_pow_mode: dest: t-> mode: rounding_mode->int->FR.t->unit =
+    "_mlgmp_fr2_ui_pow";;
+
+  external neg_mode: dest: t-> mode: rounding_mode->FR.t->unit =
+    "_mlgmp_fr2_neg";;
+  external abs_mode: dest: t-> mode: rounding_mode->FR.t->unit =
+    "_mlgmp_fr2_abs";;
+  external sqrt_mode: dest: t-> mode: rounding_mode->FR.t->unit =
+    "_mlgmp_fr2_sqrt";;
+  external cbrt_mode: dest: t-> mode: rounding_mode->FR.t->unit =
+    "_mlgmp_fr2_cbrt";;
+  external exp_mode: dest: t-> mode: rounding_mode->FR.t->unit =
+    "_mlgmp_fr2_exp";;
+  external exp2_mode: dest: t-> mode: rounding_mode->FR.t->unit =
+    "_mlgmp_fr2_exp2";;
+  external expm1_mode: dest: t-> mode: rounding_mode->FR.t->unit =
+    "_mlgmp_fr2_expm1";;
+  external log_mode: dest: t-> mode: rounding_mode->FR.t->unit =
+    "_mlgmp_fr2_log";;
+  external log2_mode: dest: t-> mode: rounding_mode->FR.t->unit =
+    "_mlgmp_fr2_log2";;
+  external log10_mode: dest: t-> mode: rounding_mode->FR.t->unit =
+    "_mlgmp_fr2_log10";;
+  external log1p_mode: dest: t-> mode: rounding_mode->FR.t->unit =
+    "_mlgmp_fr2_log1p";;
+  external sin_mode: dest: t-> mode: rounding_mode->FR.t->unit =
+    "_mlgmp_fr2_sin";;
+  external cos_mode: dest: t-> mode: rounding_mode->FR.t->unit =
+    "_mlgmp_fr2_cos";;
+  external tan_mode: dest: t-> mode: rounding_mode->FR.t->unit =
+    "_mlgmp_fr2_tan";;
+  external asin_mode: dest: t-> mode: rounding_mode->FR.t->unit =
+    "_mlgmp_fr2_asin";;
+  external acos_mode: dest: t-> mode: rounding_mode->FR.t->unit =
+    "_mlgmp_fr2_acos";;
+  external atan_mode: dest: t-> mode: rounding_mode->FR.t->unit =
+    "_mlgmp_fr2_atan";;
+  external sinh_mode: dest: t-> mode: rounding_mode->FR.t->unit =
+    "_mlgmp_fr2_sinh";;
+  external cosh_mode: dest: t-> mode: rounding_mode->FR.t->unit =
+    "_mlgmp_fr2_cosh";;
+  external tanh_mode: dest: t-> mode: rounding_mode->FR.t->unit =
+    "_mlgmp_fr2_tanh";;
+  external asinh_mode: dest: t-> mode: rounding_mode->FR.t->unit =
+    "_mlgmp_fr2_asinh";;
+  external acosh_mode: dest: t-> mode: rounding_mode->FR.t->unit =
+    "_mlgmp_fr2_acosh";;
+  external atanh_mode: dest: t-> mode: rounding_mode->FR.t->unit =
+    "_mlgmp_fr2_atanh";;
+  external rint_mode: dest: t-> mode: rounding_mode->FR.t->unit =
+    "_mlgmp_fr2_rint";;
+
+  external floor: dest: t->FR.t->unit = "_mlgmp_fr2_floor";;
+  external ceil: dest: t->FR.t->unit = "_mlgmp_fr2_ceil";;
+  external trunc: dest: t->FR.t->unit = "_mlgmp_fr2_trunc";;
+
+  external urandomb: dest: t-> state: RNG.randstate_t->unit =
+    "_mlgmp_fr2_urandomb";;
+
+  let default f ~dest = f ~dest ~mode: GMP_RNDN
+
+  let copy = default copy_mode
+  let from_z = default from_z_mode
+  let from_q = default from_q_mode
+  let from_si = default from_si_mode
+  let from_float = default from_float_mode
+  let from_string_base = default from_string_base_mode
+  let add = default add_mode
+  let sub = default sub_mode
+  let mul = default mul_mode
+  let div = default div_mode
+  let fma = default fma_mode
+  let fms = default fms_mode
+  let pow = default pow_mode
+  let atan2 = default atan2_mode
+  let hypot = default hypot_mode
+  let reldiff = default reldiff_mode
+  let add_ui = default add_ui_mode
+  let sub_ui = default sub_ui_mode
+  let mul_ui = default mul_ui_mode
+  let div_ui = default div_ui_mode
+  let pow_ui = default pow_ui_mode
+  let mul_2ui = default mul_2ui_mode
+  let div_2ui = default div_2ui_mode
+  let ui_sub = default ui_sub_mode
+  let ui_div = default ui_div_mode
+  let ui_pow = default ui_pow_mode
+  let neg = default neg_mode
+  let abs = default abs_mode
+  let sqrt = default sqrt_mode
+  let cbrt = default cbrt_mode
+  let exp = default exp_mode
+  let exp2 = default exp2_mode
+  let expm1 = default expm1_mode
+  let log = default log_mode
+  let log2 = default log2_mode
+  let log10 = default log10_mode
+  let log1p = default log1p_mode
+  let sin = default sin_mode
+  let cos = default cos_mode
+  let tan = default tan_mode
+  let asin = default asin_mode
+  let acos = default acos_mode
+  let atan = default atan_mode
+  let sinh = default sinh_mode
+  let cosh = default cosh_mode
+  let tanh = default tanh_mode
+  let asinh = default asinh_mode
+  let acosh = default acosh_mode
+  let atanh = default atanh_mode
+  let rint = default rint_mode
+  let from_int = from_si
+end;;
+
 external get_gmp_runtime_version: unit->string =
   "_mlgmp_get_runtime_version";;
 external get_gmp_compile_version: unit->int*int*int =
   "_mlgmp_get_compile_version";;
+
+(* Percentage of the limb memory of bignums that is reported to the GC
+   (default 100; 0 disables the accounting). *)
+external set_gc_ratio: int->unit = "_mlgmp_set_gc_ratio";;
+external get_gc_ratio: unit->int = "_mlgmp_get_gc_ratio";;
+
+(* Allocation of limbs from a pool of size-classed free lists, with a
+   cache per thread, instead of malloc and free.  Memory taken by the
+   pool is kept for reuse rather than given back to the system. *)
+module Alloc = struct
+  external set_pooling: bool->unit = "_mlgmp_alloc_set_pooling";;
+  external get_pooling: unit->bool = "_mlgmp_alloc_get_pooling";;
+  external enter_arena: unit->unit = "_mlgmp_alloc_enter_arena";;
+  external leave_arena: unit->unit = "_mlgmp_alloc_leave_arena";;
+
+  let with_arena f =
+    enter_arena ();
+    let r = try f () with e -> leave_arena (); raise e in
+    leave_arena ();
+    r
+
+  (* The limbs of freed numbers are kept by their thread for the next
+     results of about the same size, up to a limit in bytes over all
+     threads. *)
+  type recycle_stats =
+      { hits: int; misses: int; drops: int; kept: int; limit: int }
+  external set_recycling: bool->unit = "_mlgmp_alloc_set_recycling";;
+  external get_recycling: unit->bool = "_mlgmp_alloc_get_recycling";;
+  external set_recycle_limit: int->unit = "_mlgmp_alloc_set_recycle_limit";;
+  external flush_recycled: unit->unit = "_mlgmp_alloc_flush_recycled";;
+  external recycle_stats: unit->recycle_stats = "_mlgmp_alloc_recycle_stats";;
+end;;
+
+(* Counters of the library compiled with STATS in config.h; all zero
+   otherwise.  Calls are counted per stub entry point, blocks per kind of
+   number since the last reset. *)
+module Stats = struct
+  type blocks =
+      { allocated: int; finalized: int;
+        bytes_allocated: int; bytes_freed: int }
+  type snapshot =
+      { enabled: bool; timed: bool;
+        stubs: (string * int * float) array;
+        z: blocks; q: blocks; f: blocks; fr: blocks;
+        bytes_grown: int }
+  external snapshot: unit->snapshot = "_mlgmp_stats_snapshot";;
+  external reset: unit->unit = "_mlgmp_stats_reset";;
+
+  let calls s name =
+    Array.fold_left (fun n (stub, c, _) -> if stub = name then n + c else n)
+      0 s.stubs
+end;;
+
+(* The live Z.t, Q.t, F.t and FR.t blocks, with the library compiled with
+   CENSUS in config.h; nothing otherwise. *)
+module Census = struct
+  type count = { blocks: int; bytes: int; histogram: int array }
+  type t =
+      { enabled: bool;
+        z: count; q: count; f: count; fr: count;
+        largest: (string * int) array }
+  external take: int->t = "_mlgmp_census_take";;
+
+  let print oc c =
+    if not c.enabled then
+      output_string oc "mlgmp census: not compiled in\n"
+    else begin
+      List.iter (fun (name, k) ->
+        Printf.fprintf oc "mlgmp census: %s %d blocks, %d bytes\n"
+          name k.blocks k.bytes;
+        Array.iteri (fun i n ->
+          if n > 0 then
+            Printf.fprintf oc "  %d-%d limbs: %d\n"
+              (if i = 0 then 0 else 1 lsl i) ((2 lsl i) - 1) n) k.histogram)
+        ["Z.t", c.z; "Q.t", c.q; "F.t", c.f; "FR.t", c.fr];
+      Array.iter (fun (name, bytes) ->
+        Printf.fprintf oc "mlgmp census: largest %s %d bytes\n" name bytes)
+        c.largest
+    end;
+    flush oc
+
+  let dump_on_signal ?(largest=10) signal =
+    Sys.set_signal signal
+      (Sys.Signal_handle (fun _ -> print stderr (take largest)))
+end;;
@@ -1,56 +1,90 @@
 type rounding_mode = GMP_RNDN | GMP_RNDZ | GMP_RNDU | GMP_RNDD
+type bigstring =
+    (char, Bigarray.int8_unsigned_elt, Bigarray.c_layout) Bigarray.Array1.t
 module RNG :
   sig
     type randstate_t
-    and randalg_t = GMP_RAND_ALG_LC of int
+    and randalg_t = GMP_RAND_ALG_LC of int | GMP_RAND_ALG_MT
+    external randinit_mt : unit -> randstate_t = "_mlgmp_randinit_mt"
+    external copy : randstate_t -> randstate_t = "_mlgmp_randinit_copy"
+    external seed : randstate_t -> int -> unit = "_mlgmp_randseed_ui"
+    external seed_string : randstate_t -> string -> unit
+      = "_mlgmp_randseed_string"
+    (* a new Mersenne Twister state seeded from the given one *)
+    external split : randstate_t -> randstate_t = "_mlgmp_randsplit"
     val randinit : randalg_t -> randstate_t
+    (* shared by all domains: use local () instead from parallel code *)
     val default : randstate_t
-  end
-module Z2 :
-  sig
-    type t
-    external from_int : dest:t -> int -> unit = "_mlgmp_z2_from_int"
-    external from_string_base : dest:t -> base:int -> string -> unit
-      = "_mlgmp_z2_from_string_base"
-    external from_float : dest:t -> float -> unit = "_mlgmp_z2_from_float"
-    external create : unit -> t = "_mlgmp_z_create"
-    external copy : dest:t -> from:t -> unit = "_mlgmp_z_copy"
-    external add : dest:t -> t -> t -> unit = "_mlgmp_z2_add"
-    external sub : dest:t -> t -> t -> unit = "_mlgmp_z2_sub"
-    external mul : dest:t -> t -> t -> unit = "_mlgmp_z2_mul"
-    external tdiv_q : dest:t -> t -> t -> unit = "_mlgmp_z2_tdiv_q"
-    external tdiv_r : dest:t -> t -> t -> unit = "_mlgmp_z2_tdiv_r"
-    external cdiv_q : dest:t -> t -> t -> unit = "_mlgmp_z2_cdiv_q"
-    external cdiv_r : dest:t -> t -> t -> unit = "_mlgmp_z2_cdiv_r"
-    external fdiv_q : dest:t -> t -> t -> unit = "_mlgmp_z2_fdiv_q"
-    external fdiv_r : dest:t -> t -> t -> unit = "_mlgmp_z2_fdiv_r"
-    external divexact : dest:t -> t -> t -> unit = "_mlgmp_z2_divexact"
-    external neg : dest:t -> t -> unit = "_mlgmp_z2_neg"
-    external abs : dest:t -> t -> unit = "_mlgmp_z2_abs"
+    (* the state of the calling domain; the state of a new domain is split
+       from the one of its parent *)
+    val local : unit -> randstate_t
   end
 module Z :
   sig
-    type t = Z2.t
-    external from_int : int -> t = "_mlgmp_z_from_int"
-    external of_int : int -> t = "_mlgmp_z_from_int"
+    type t
+    val from_int : int -> t
+    val of_int : int -> t
     external from_string_base : base:int -> string -> t
       = "_mlgmp_z_from_string_base"
-    external from_float : float -> t = "_mlgmp_z_from_float"
-    external of_float : float -> t = "_mlgmp_z_from_float"
+    external of_substring_base : base:int -> string -> pos:int -> len:int -> t
+      = "_mlgmp_z_from_substring"
+    external of_subbytes_base : base:int -> bytes -> pos:int -> len:int -> t
+      = "_mlgmp_z_from_substring"
+    external from_float : (float [@unboxed]) -> t
+      = "_mlgmp_z_from_float" "_mlgmp_z_from_float_unboxed"
+    external of_float : (float [@unboxed]) -> t
+      = "_mlgmp_z_from_float" "_mlgmp_z_from_float_unboxed"
     external to_string_base : base:int -> t -> string
       = "_mlgmp_z_to_string_base"
-    external to_int : t -> int = "_mlgmp_z_to_int"
-    external to_float : t -> float = "_mlgmp_z_to_float"
-    external int_from : t -> int = "_mlgmp_z_to_int"
-    external float_from : t -> float = "_mlgmp_z_to_float"
-    external add : t -> t -> t = "_mlgmp_z_add"
-    external sub : t -> t -> t = "_mlgmp_z_sub"
-    external mul : t -> t -> t = "_mlgmp_z_mul"
+    (* room needed by blit_string_base *)
+    external string_size_base : base:int -> t -> int
+      = "_mlgmp_z_string_size_base"
+    (* writes the digits at the given position, returns their number *)
+    external blit_string_base : base:int -> t -> bytes -> int -> int
+      = "_mlgmp_z_blit_string_base"
+    (* bytes taken by the magnitude; the sign is not stored *)
+    external raw_size : t -> (int [@untagged])
+      = "_mlgmp_z_raw_size" "_mlgmp_z_raw_size_untagged" [@@noalloc]
+    external import_bytes :
+      little_endian:bool -> bytes -> pos:int -> len:int -> t
+      = "_mlgmp_z_import_bytes"
+    external import_string :
+      little_endian:bool -> string -> pos:int -> len:int -> t
+      = "_mlgmp_z_import_bytes"
+    external import_bigstring :
+      little_endian:bool -> bigstring -> pos:int -> len:int -> t
+      = "_mlgmp_z_import_bigstring"
+    (* writes the magnitude on exactly len bytes, zero-padded *)
+    external export_bytes :
+      little_endian:bool -> t -> bytes -> pos:int -> len:int -> unit
+      = "_mlgmp_z_export_bytes"
+    external export_bigstring :
+      little_endian:bool -> t -> bigstring -> pos:int -> len:int -> unit
+      = "_mlgmp_z_export_bigstring"
+    val to_int : t -> int
+    external to_float : t -> (float [@unboxed])
+      = "_mlgmp_z_to_float" "_mlgmp_z_to_float_unboxed" [@@noalloc]
+    val int_from : t -> int
+    external float_from : t -> (float [@unboxed])
+      = "_mlgmp_z_to_float" "_mlgmp_z_to_float_unboxed" [@@noalloc]
+    val add : t -> t -> t
+    val sub : t -> t -> t
+    val mul : t -> t -> t
     external add_ui : t -> int -> t = "_mlgmp_z_add_ui"
     external sub_ui : t -> int -> t = "_mlgmp_z_sub_ui"
     external mul_ui : t -> int -> t = "_mlgmp_z_mul_ui"
-    external neg : t -> t = "_mlgmp_z_neg"
-    external abs : t -> t = "_mlgmp_z_abs"
+    (* addmul acc a b is acc + a * b, submul acc a b is acc - a * b *)
+    external addmul : t -> t -> t -> t = "_mlgmp_z_addmul"
+    external submul : t -> t -> t -> t = "_mlgmp_z_submul"
+    external addmul_ui : t -> t -> int -> t = "_mlgmp_z_addmul_ui"
+    external submul_ui : t -> t -> int -> t = "_mlgmp_z_submul_ui"
+    (* mul_add a b c d is a * b + c * d *)
+    external mul_add : t -> t -> t -> t -> t = "_mlgmp_z_mul_add"
+    (* the sum of the products of coefficients and numbers of the same
+       index *)
+    external lincomb : t array -> t array -> t = "_mlgmp_z_lincomb"
+    val neg : t -> t
+    val abs : t -> t
     external tdiv_qr : t -> t -> t * t = "_mlgmp_z_tdiv_qr"
     external tdiv_q : t -> t -> t = "_mlgmp_z_tdiv_q"
     external tdiv_r : t -> t -> t = "_mlgmp_z_tdiv_r"
@@ -93,41 +127,53 @@ module Z :
     external sqrt : t -> t = "_mlgmp_z_sqrt"
     external sqrtrem : t -> t * t = "_mlgmp_z_sqrtrem"
     external root : t -> int -> t = "_mlgmp_z_root"
-    external perfect_power_p : t -> bool = "_mlgmp_z_perfect_power_p"
-    external perfect_square_p : t -> bool = "_mlgmp_z_perfect_square_p"
-    external is_perfect_power : t -> bool = "_mlgmp_z_perfect_power_p"
-    external is_perfect_square : t -> bool = "_mlgmp_z_perfect_square_p"
+    external perfect_power_p : t -> bool
+      = "_mlgmp_z_perfect_power_p" [@@noalloc]
+    external perfect_square_p : t -> bool
+      = "_mlgmp_z_perfect_square_p" [@@noalloc]
+    external is_perfect_power : t -> bool
+      = "_mlgmp_z_perfect_power_p" [@@noalloc]
+    external is_perfect_square : t -> bool
+      = "_mlgmp_z_perfect_square_p" [@@noalloc]
     external probab_prime_p : t -> int -> bool = "_mlgmp_z_probab_prime_p"
     external is_probab_prime : t -> int -> bool = "_mlgmp_z_probab_prime_p"
     external nextprime : t -> t = "_mlgmp_z_nextprime"
     external gcd : t -> t -> t = "_mlgmp_z_gcd"
-    external gcd_ui : t -> t -> t = "_mlgmp_z_gcd_ui"
+    external gcd_ui : t -> int -> t = "_mlgmp_z_gcd_ui"
     external lcm : t -> t -> t = "_mlgmp_z_lcm"
     external gcdext : t -> t -> t * t * t = "_mlgmp_z_gcdext"
     external inverse : t -> t -> t option = "_mlgmp_z_invert"
-    external legendre : t -> t -> int = "_mlgmp_z_legendre"
-    external jacobi : t -> t -> int = "_mlgmp_z_jacobi"
-    external kronecker_si : t -> int -> int = "_mlgmp_z_kronecker_si"
-    external si_kronecker : int -> t -> int = "_mlgmp_z_si_kronecker"
+    external legendre : t -> t -> (int [@untagged])
+      = "_mlgmp_z_legendre" "_mlgmp_z_legendre_untagged" [@@noalloc]
+    external jacobi : t -> t -> (int [@untagged])
+      = "_mlgmp_z_jacobi" "_mlgmp_z_jacobi_untagged" [@@noalloc]
+    external kronecker_si : t -> (int [@untagged]) -> (int [@untagged])
+      = "_mlgmp_z_kronecker_si" "_mlgmp_z_kronecker_si_untagged" [@@noalloc]
+    external si_kronecker : (int [@untagged]) -> t -> (int [@untagged])
+      = "_mlgmp_z_si_kronecker" "_mlgmp_z_si_kronecker_untagged" [@@noalloc]
     external remove : t -> t -> t * int = "_mlgmp_z_remove"
     external fac_ui : int -> t = "_mlgmp_z_fac_ui"
     external fib_ui : int -> t = "_mlgmp_z_fib_ui"
     external bin_ui : n:t -> k:int -> t = "_mlgmp_z_bin_ui"
     external bin_uiui : n:int -> k:int -> t = "_mlgmp_z_bin_uiui"
-    external cmp : t -> t -> int = "_mlgmp_z_compare"
-    external cmp_si : t -> int -> int = "_mlgmp_z_compare_si"
-    external compare : t -> t -> int = "_mlgmp_z_compare"
-    external compare_si : t -> int -> int = "_mlgmp_z_compare_si"
-    external compare_int : t -> int -> int = "_mlgmp_z_compare_si"
-    external sgn : t -> int = "_mlgmp_z_sgn"
+    val cmp : t -> t -> int
+    val cmp_si : t -> int -> int
+    val compare : t -> t -> int
+    val compare_si : t -> int -> int
+    val compare_int : t -> int -> int
+    val sgn : t -> int
     external band : t -> t -> t = "_mlgmp_z_and"
     external bior : t -> t -> t = "_mlgmp_z_ior"
     external bxor : t -> t -> t = "_mlgmp_z_xor"
     external bcom : t -> t = "_mlgmp_z_com"
-    external popcount : t -> int = "_mlgmp_z_popcount"
-    external hamdist : t -> t -> int = "_mlgmp_z_hamdist"
-    external scan0 : t -> int -> int = "_mlgmp_z_scan0"
-    external scan1 : t -> int -> int = "_mlgmp_z_scan1"
+    external popcount : t -> (int [@untagged])
+      = "_mlgmp_z_popcount" "_mlgmp_z_popcount_untagged" [@@noalloc]
+    external hamdist : t -> t -> (int [@untagged])
+      = "_mlgmp_z_hamdist" "_mlgmp_z_hamdist_untagged" [@@noalloc]
+    external scan0 : t -> (int [@untagged]) -> (int [@untagged])
+      = "_mlgmp_z_scan0" "_mlgmp_z_scan0_untagged" [@@noalloc]
+    external scan1 : t -> (int [@untagged]) -> (int [@untagged])
+      = "_mlgmp_z_scan1" "_mlgmp_z_scan1_untagged" [@@noalloc]
     external urandomb : state:RNG.randstate_t -> nbits:int -> t
       = "_mlgmp_z_urandomb"
     external urandomm : state:RNG.randstate_t -> n:t -> t
@@ -143,7 +189,18 @@ module Z :
     val to_string : t -> string
     val from_string : string -> t
     val string_from : t -> string
+    val of_substring : string -> pos:int -> len:int -> t
+    val of_subbytes : bytes -> pos:int -> len:int -> t
+    (* big-endian unless told otherwise *)
+    val of_raw_string : ?little_endian:bool -> string -> t
+    val to_raw_string : ?little_endian:bool -> t -> string
+    (* reads blanks, an optional sign and digits; the first character that
+       is not a digit is left in the buffer *)
+    val scan_base : base:int -> Scanf.Scanning.in_channel -> t
+    val scan : Scanf.Scanning.in_channel -> t
     val output : out_channel -> t -> unit
+    val add_to_buffer_base : base:int -> Buffer.t -> t -> unit
+    val add_to_buffer : Buffer.t -> t -> unit
     val sprintf : unit -> t -> string
 
     val print : Format.formatter -> t -> unit
@@ -154,9 +211,9 @@ module Z :
 
     module Infixes :
       sig
-        external ( +! ) : t -> t -> t = "_mlgmp_z_add"
-        external ( -! ) : t -> t -> t = "_mlgmp_z_sub"
-        external ( *! ) : t -> t -> t = "_mlgmp_z_mul"
+        val ( +! ) : t -> t -> t
+        val ( -! ) : t -> t -> t
+        val ( *! ) : t -> t -> t
         external ( /! ) : t -> t -> t = "_mlgmp_z_fdiv_q"
         external ( %! ) : t -> t -> t = "_mlgmp_z_fdiv_r"
         val ( <! ) : t -> t -> bool
@@ -166,7 +223,223 @@ module Z :
         val ( >! ) : t -> t -> bool
         val ( <>! ) : t -> t -> bool
       end
+    module Vec :
+      sig
+        external sum : t array -> t = "_mlgmp_z_vec_sum"
+        external dot : t array -> t array -> t = "_mlgmp_z_vec_dot"
+        external product : t array -> t = "_mlgmp_z_vec_product"
+        external add : t array -> t array -> t array = "_mlgmp_z_vec_add"
+        external sub : t array -> t array -> t array = "_mlgmp_z_vec_sub"
+        external mul : t array -> t array -> t array = "_mlgmp_z_vec_mul"
+        external scale : t -> t array -> t array = "_mlgmp_z_vec_scale"
+      end
+    module Tree :
+      sig
+        type tree
+        external create : t array -> tree = "_mlgmp_z_tree_create"
+        external length : tree -> int = "_mlgmp_z_tree_length"
+        (* the product of all the numbers *)
+        external product : tree -> t = "_mlgmp_z_tree_product"
+        (* the remainders (mod) of a number by each of the numbers *)
+        external remainders : tree -> t -> t array
+          = "_mlgmp_z_tree_remainders"
+        (* the gcd of each number with the product of all the others *)
+        external batch_gcd : t array -> t array = "_mlgmp_z_batch_gcd"
+      end
+    (* files of numbers that are mapped into memory rather than read, and
+       only copied to the heap one by one *)
+    module Column :
+      sig
+        type column
+        external write : string -> t array -> unit = "_mlgmp_z_column_write"
+        external open_file : string -> column = "_mlgmp_z_column_open"
+        (* unmaps the file; numbers got from it stay valid *)
+        external close : column -> unit = "_mlgmp_z_column_close"
+        external length : column -> int = "_mlgmp_z_column_length"
+        external get : column -> int -> t = "_mlgmp_z_column_get"
+        (* these work on the mapped number, without copying it *)
+        external sgn : column -> int -> int = "_mlgmp_z_column_sgn"
+        external compare : column -> int -> t -> int
+          = "_mlgmp_z_column_compare"
+        external sum : column -> t = "_mlgmp_z_column_sum"
+        val to_array : column -> t array
+      end
+
+    (* arithmetic modulo a fixed m >= 2, in Montgomery form for odd m;
+       elements belong to the modulus they were made for *)
+    module Modular :
+      sig
+        type modulus
+        type elt
+        external create : t -> modulus = "_mlgmp_z_modular_create"
+        external modulus : modulus -> t = "_mlgmp_z_modular_modulus"
+        (* a fresh zero, to be used as a destination *)
+        external elt : modulus -> elt = "_mlgmp_z_modular_elt"
+        external of_z : modulus -> t -> elt = "_mlgmp_z_modular_of_z"
+        external to_z : modulus -> elt -> t = "_mlgmp_z_modular_to_z"
+        external set_z : modulus -> dest:elt -> t -> unit
+          = "_mlgmp_z_modular_set_z"
+        external add : modulus -> dest:elt -> elt -> elt -> unit
+          = "_mlgmp_z_modular_add"
+        external sub : modulus -> dest:elt -> elt -> elt -> unit
+          = "_mlgmp_z_modular_sub"
+        external mul : modulus -> dest:elt -> elt -> elt -> unit
+          = "_mlgmp_z_modular_mul"
+        external sqr : modulus -> dest:elt -> elt -> unit
+          = "_mlgmp_z_modular_sqr"
+        (* the exponent must be nonnegative *)
+        external pow : modulus -> dest:elt -> elt -> t -> unit
+          = "_mlgmp_z_modular_pow"
+        (* false, leaving dest alone, when the element is not invertible *)
+        external inv : modulus -> dest:elt -> elt -> bool
+          = "_mlgmp_z_modular_inv"
+      end
+  end
+module Z2 :
+  sig
+    type t
+    external create : unit -> t = "_mlgmp_z_create"
+    external of_z : Z.t -> t = "_mlgmp_z2_of_z"
+    external to_z : t -> Z.t = "_mlgmp_z_copy"
+    external as_z : t -> Z.t = "%identity"
+    external from_int : dest:t -> int -> unit = "_mlgmp_z2_from_int"
+    external from_string_base : dest:t -> base:int -> string -> unit
+      = "_mlgmp_z2_from_string_base"
+    external from_float : dest:t -> (float [@unboxed]) -> unit
+      = "_mlgmp_z2_from_float" "_mlgmp_z2_from_float_unboxed"
+    external import_bytes :
+      dest:t -> little_endian:bool -> bytes -> pos:int -> len:int -> unit
+      = "_mlgmp_z2_import_bytes"
+    external import_bigstring :
+      dest:t -> little_endian:bool -> bigstring -> pos:int -> len:int -> unit
+      = "_mlgmp_z2_import_bigstring"
+    external column_get : dest:t -> Z.Column.column -> int -> unit
+      = "_mlgmp_z2_column_get"
+    external copy : dest:t -> from:Z.t -> unit = "_mlgmp_z2_set"
+    external add : dest:t -> Z.t -> Z.t -> unit = "_mlgmp_z2_add"
+    external sub : dest:t -> Z.t -> Z.t -> unit = "_mlgmp_z2_sub"
+    external mul : dest:t -> Z.t -> Z.t -> unit = "_mlgmp_z2_mul"
+    external add_ui : dest:t -> Z.t -> int -> unit = "_mlgmp_z2_add_ui"
+    external sub_ui : dest:t -> Z.t -> int -> unit = "_mlgmp_z2_sub_ui"
+    external mul_ui : dest:t -> Z.t -> int -> unit = "_mlgmp_z2_mul_ui"
+    (* addmul ~dest a b adds a * b to dest, submul subtracts it *)
+    external addmul : dest:t -> Z.t -> Z.t -> unit = "_mlgmp_z2_addmul"
+    external submul : dest:t -> Z.t -> Z.t -> unit = "_mlgmp_z2_submul"
+    external addmul_ui : dest:t -> Z.t -> int -> unit = "_mlgmp_z2_addmul_ui"
+    external submul_ui : dest:t -> Z.t -> int -> unit = "_mlgmp_z2_submul_ui"
+    external mul_add : dest:t -> Z.t -> Z.t -> Z.t -> Z.t -> unit
+      = "_mlgmp_z2_mul_add"
+    external lincomb : dest:t -> Z.t array -> Z.t array -> unit
+      = "_mlgmp_z2_lincomb"
+    external neg : dest:t -> Z.t -> unit = "_mlgmp_z2_neg"
+    external abs : dest:t -> Z.t -> unit = "_mlgmp_z2_abs"
+    external tdiv_qr : q:t -> r:t -> Z.t -> Z.t -> unit = "_mlgmp_z2_tdiv_qr"
+    external tdiv_q : dest:t -> Z.t -> Z.t -> unit = "_mlgmp_z2_tdiv_q"
+    external tdiv_r : dest:t -> Z.t -> Z.t -> unit = "_mlgmp_z2_tdiv_r"
+    external cdiv_qr : q:t -> r:t -> Z.t -> Z.t -> unit = "_mlgmp_z2_cdiv_qr"
+    external cdiv_q : dest:t -> Z.t -> Z.t -> unit = "_mlgmp_z2_cdiv_q"
+    external cdiv_r : dest:t -> Z.t -> Z.t -> unit = "_mlgmp_z2_cdiv_r"
+    external fdiv_qr : q:t -> r:t -> Z.t -> Z.t -> unit = "_mlgmp_z2_fdiv_qr"
+    external fdiv_q : dest:t -> Z.t -> Z.t -> unit = "_mlgmp_z2_fdiv_q"
+    external fdiv_r : dest:t -> Z.t -> Z.t -> unit = "_mlgmp_z2_fdiv_r"
+    external dmod : dest:t -> Z.t -> Z.t -> unit = "_mlgmp_z2_mod"
+    external dmod_ui : dest:t -> Z.t -> int -> unit = "_mlgmp_z2_mod_ui"
+    external modulo : dest:t -> Z.t -> Z.t -> unit = "_mlgmp_z2_mod"
+    external tdiv_qr_ui : q:t -> r:t -> Z.t -> int -> unit = "_mlgmp_z2_tdiv_qr_ui"
+    external tdiv_q_ui : dest:t -> Z.t -> int -> unit = "_mlgmp_z2_tdiv_q_ui"
+    external tdiv_r_ui : dest:t -> Z.t -> int -> unit = "_mlgmp_z2_tdiv_r_ui"
+    external cdiv_qr_ui : q:t -> r:t -> Z.t -> int -> unit = "_mlgmp_z2_cdiv_qr_ui"
+    external cdiv_q_ui : dest:t -> Z.t -> int -> unit = "_mlgmp_z2_cdiv_q_ui"
+    external cdiv_r_ui : dest:t -> Z.t -> int -> unit = "_mlgmp_z2_cdiv_r_ui"
+    external fdiv_qr_ui : q:t -> r:t -> Z.t -> int -> unit = "_mlgmp_z2_fdiv_qr_ui"
+    external fdiv_q_ui : dest:t -> Z.t -> int -> unit = "_mlgmp_z2_fdiv_q_ui"
+    external fdiv_r_ui : dest:t -> Z.t -> int -> unit = "_mlgmp_z2_fdiv_r_ui"
+    external divexact : dest:t -> Z.t -> Z.t -> unit = "_mlgmp_z2_divexact"
+    external mul_2exp : dest:t -> Z.t -> int -> unit = "_mlgmp_z2_mul_2exp"
+    external tdiv_q_2exp : dest:t -> Z.t -> int -> unit = "_mlgmp_z2_tdiv_q_2exp"
+    external tdiv_r_2exp : dest:t -> Z.t -> int -> unit = "_mlgmp_z2_tdiv_r_2exp"
+    external fdiv_q_2exp : dest:t -> Z.t -> int -> unit = "_mlgmp_z2_fdiv_q_2exp"
+    external fdiv_r_2exp : dest:t -> Z.t -> int -> unit = "_mlgmp_z2_fdiv_r_2exp"
+    external cdiv_q_2exp : dest:t -> Z.t -> int -> unit = "_mlgmp_z2_cdiv_q_2exp"
+    external cdiv_r_2exp : dest:t -> Z.t -> int -> unit = "_mlgmp_z2_cdiv_r_2exp"
+    external powm : dest:t -> Z.t -> Z.t -> Z.t -> unit = "_mlgmp_z2_powm"
+    external powm_ui : dest:t -> Z.t -> int -> Z.t -> unit = "_mlgmp_z2_powm_ui"
+    external pow_ui : dest:t -> Z.t -> int -> unit = "_mlgmp_z2_pow_ui"
+    external ui_pow_ui : dest:t -> int -> int -> unit = "_mlgmp_z2_ui_pow_ui"
+    external sqrt : dest:t -> Z.t -> unit = "_mlgmp_z2_sqrt"
+    external sqrtrem : s:t -> r:t -> Z.t -> unit = "_mlgmp_z2_sqrtrem"
+    external root : dest:t -> Z.t -> int -> unit = "_mlgmp_z2_root"
+    external nextprime : dest:t -> Z.t -> unit = "_mlgmp_z2_nextprime"
+    external gcd : dest:t -> Z.t -> Z.t -> unit = "_mlgmp_z2_gcd"
+    external gcd_ui : dest:t -> Z.t -> int -> unit = "_mlgmp_z2_gcd_ui"
+    external lcm : dest:t -> Z.t -> Z.t -> unit = "_mlgmp_z2_lcm"
+    external gcdext : g:t -> s:t -> t:t -> Z.t -> Z.t -> unit = "_mlgmp_z2_gcdext"
+    (* false if there is no inverse, dest is then undefined *)
+    external inverse : dest:t -> Z.t -> Z.t -> bool = "_mlgmp_z2_invert"
+    external remove : dest:t -> Z.t -> Z.t -> int = "_mlgmp_z2_remove"
+    external fac_ui : dest:t -> int -> unit = "_mlgmp_z2_fac_ui"
+    external fib_ui : dest:t -> int -> unit = "_mlgmp_z2_fib_ui"
+    external bin_ui : dest:t -> n:Z.t -> k:int -> unit = "_mlgmp_z2_bin_ui"
+    external bin_uiui : dest:t -> n:int -> k:int -> unit = "_mlgmp_z2_bin_uiui"
+    external band : dest:t -> Z.t -> Z.t -> unit = "_mlgmp_z2_and"
+    external bior : dest:t -> Z.t -> Z.t -> unit = "_mlgmp_z2_ior"
+    external bxor : dest:t -> Z.t -> Z.t -> unit = "_mlgmp_z2_xor"
+    external bcom : dest:t -> Z.t -> unit = "_mlgmp_z2_com"
+    external urandomb : dest:t -> state:RNG.randstate_t -> nbits:int -> unit =
+      "_mlgmp_z2_urandomb"
+    external urandomm : dest:t -> state:RNG.randstate_t -> n:Z.t -> unit =
+      "_mlgmp_z2_urandomm"
+    external rrandomb : dest:t -> state:RNG.randstate_t -> nbits:int -> unit =
+      "_mlgmp_z2_rrandomb"
+    module Vec :
+      sig
+        external add : dest:t array -> Z.t array -> Z.t array -> unit
+          = "_mlgmp_z2_vec_add"
+        external sub : dest:t array -> Z.t array -> Z.t array -> unit
+          = "_mlgmp_z2_vec_sub"
+        external mul : dest:t array -> Z.t array -> Z.t array -> unit
+          = "_mlgmp_z2_vec_mul"
+        external scale : dest:t array -> Z.t -> Z.t array -> unit
+          = "_mlgmp_z2_vec_scale"
+      end
+  end
+(* integers modulo 2^bits, signed in two's complement except for the
+   unsigned_ functions; shifts by bits or more give 0 or -1, and
+   unsigned_div raises Division_by_zero; negative shifts are invalid *)
+module type FIXED =
+  sig
+    type t
+    val bits : int
+    val zero : t
+    val one : t
+    val minus_one : t
+    (* of_int, of_z and of_string keep the low bits; to_int as well *)
+    val of_int : int -> t
+    val to_int : t -> int
+    val of_z : Z.t -> t
+    val to_z : t -> Z.t
+    val to_z_unsigned : t -> Z.t
+    val of_string : string -> t
+    val to_string : t -> string
+    val add : t -> t -> t
+    val sub : t -> t -> t
+    val mul : t -> t -> t
+    val neg : t -> t
+    val unsigned_div : t -> t -> t
+    val unsigned_rem : t -> t -> t
+    val logand : t -> t -> t
+    val logor : t -> t -> t
+    val logxor : t -> t -> t
+    val lognot : t -> t
+    val shift_left : t -> int -> t
+    val shift_right : t -> int -> t
+    val shift_right_logical : t -> int -> t
+    val compare : t -> t -> int
+    val unsigned_compare : t -> t -> int
+    val equal : t -> t -> bool
   end
+module Z128 : FIXED
+module Z256 : FIXED
 module Q :
   sig
     type t
@@ -174,10 +447,17 @@ module Q :
     external from_z : Z.t -> t = "_mlgmp_q_from_z"
     external from_si : int -> int -> t = "_mlgmp_q_from_si"
     external from_ints : int -> int -> t = "_mlgmp_q_from_si"
+    (* num or num/den *)
+    external of_substring_base : base:int -> string -> pos:int -> len:int -> t
+      = "_mlgmp_q_from_substring"
+    val of_substring : string -> pos:int -> len:int -> t
     val from_int : int -> t
-    external from_float : float -> t = "_mlgmp_q_from_float"
-    external float_from : t -> float = "_mlgmp_q_to_float"
-    external to_float : t -> float = "_mlgmp_q_to_float"
+    external from_float : (float [@unboxed]) -> t
+      = "_mlgmp_q_from_float" "_mlgmp_q_from_float_unboxed"
+    external float_from : t -> (float [@unboxed])
+      = "_mlgmp_q_to_float" "_mlgmp_q_to_float_unboxed" [@@noalloc]
+    external to_float : t -> (float [@unboxed])
+      = "_mlgmp_q_to_float" "_mlgmp_q_to_float_unboxed" [@@noalloc]
     external add : t -> t -> t = "_mlgmp_q_add"
     external sub : t -> t -> t = "_mlgmp_q_sub"
     external mul : t -> t -> t = "_mlgmp_q_mul"
@@ -186,10 +466,15 @@ module Q :
     external inv : t -> t = "_mlgmp_q_inv"
     external get_num : t -> Z.t = "_mlgmp_q_get_num"
     external get_den : t -> Z.t = "_mlgmp_q_get_den"
-    external cmp : t -> t -> int = "_mlgmp_q_cmp"
-    external compare : t -> t -> int = "_mlgmp_q_cmp"
-    external cmp_ui : t -> int -> int -> int = "_mlgmp_q_cmp_ui"
-    external sgn : t -> int = "_mlgmp_q_sgn"
+    external cmp : t -> t -> (int [@untagged])
+      = "_mlgmp_q_cmp" "_mlgmp_q_cmp_untagged" [@@noalloc]
+    external compare : t -> t -> (int [@untagged])
+      = "_mlgmp_q_cmp" "_mlgmp_q_cmp_untagged" [@@noalloc]
+    external cmp_ui :
+      t -> (int [@untagged]) -> (int [@untagged]) -> (int [@untagged])
+      = "_mlgmp_q_cmp_ui" "_mlgmp_q_cmp_ui_untagged" [@@noalloc]
+    external sgn : t -> (int [@untagged])
+      = "_mlgmp_q_sgn" "_mlgmp_q_sgn_untagged" [@@noalloc]
     external abs : t -> t = "_mlgmp_q_abs"
     val zero : t
     val is_zero : t -> bool
@@ -216,8 +501,111 @@ module Q :
   end
 module Q2 :
   sig
-    type t = Q.t
-    external add : t->t->t->unit = "_mlgmp_q2_add"
+    type t
+    external create : unit -> t = "_mlgmp_q_create"
+    external of_q : Q.t -> t = "_mlgmp_q_copy"
+    external to_q : t -> Q.t = "_mlgmp_q_copy"
+    external as_q : t -> Q.t = "%identity"
+    external from_z : dest:t -> Z.t -> unit = "_mlgmp_q2_from_z"
+    external from_si : dest:t -> int -> int -> unit = "_mlgmp_q2_from_si"
+    external from_ints : dest:t -> int -> int -> unit = "_mlgmp_q2_from_si"
+    external from_float : dest:t -> (float [@unboxed]) -> unit
+      = "_mlgmp_q2_from_float" "_mlgmp_q2_from_float_unboxed"
+    external copy : dest:t -> from:Q.t -> unit = "_mlgmp_q2_set"
+    external add : dest:t -> Q.t -> Q.t -> unit = "_mlgmp_q2_add"
+    external sub : dest:t -> Q.t -> Q.t -> unit = "_mlgmp_q2_sub"
+    external mul : dest:t -> Q.t -> Q.t -> unit = "_mlgmp_q2_mul"
+    external div : dest:t -> Q.t -> Q.t -> unit = "_mlgmp_q2_div"
+    external neg : dest:t -> Q.t -> unit = "_mlgmp_q2_neg"
+    external inv : dest:t -> Q.t -> unit = "_mlgmp_q2_inv"
+    external abs : dest:t -> Q.t -> unit = "_mlgmp_q2_abs"
+    external get_num : dest:Z2.t -> Q.t -> unit = "_mlgmp_q2_get_num"
+    external get_den : dest:Z2.t -> Q.t -> unit = "_mlgmp_q2_get_den"
+  end
+module CRT :
+  sig
+    type t
+    external create : Z.t array -> t = "_mlgmp_crt_create"
+    (* the product of the moduli *)
+    external modulus : t -> Z.t = "_mlgmp_crt_modulus"
+    (* the number in [0, modulus) with the given residues *)
+    external to_z : t -> Z.t array -> Z.t = "_mlgmp_crt_to_z"
+    (* the fraction n/d with |n| and d at most sqrt(modulus/2) *)
+    external to_q : t -> Z.t array -> Q.t option = "_mlgmp_crt_to_q"
+    external rational_reconstruction : Z.t -> Z.t -> Q.t option
+      = "_mlgmp_ratrecon"
+    (* the number in (-modulus/2, modulus/2] with the given residues *)
+    val to_z_signed : t -> Z.t array -> Z.t
+    (* from (residue, modulus) pairs *)
+    val crt : (Z.t * Z.t) array -> Z.t
+  end
+(* polynomials over Z, their coefficients from degree 0 up in C memory;
+   products go through a single integer product (Kronecker substitution) *)
+module ZPoly :
+  sig
+    type t
+    external of_array : Z.t array -> t = "_mlgmp_zpoly_of_array"
+    external to_array : t -> Z.t array = "_mlgmp_zpoly_to_array"
+    (* -1 for zero *)
+    external degree : t -> int = "_mlgmp_zpoly_degree"
+    (* zero above the degree *)
+    external coeff : t -> int -> Z.t = "_mlgmp_zpoly_coeff"
+    external equal : t -> t -> bool = "_mlgmp_zpoly_equal"
+    external add : t -> t -> t = "_mlgmp_zpoly_add"
+    external sub : t -> t -> t = "_mlgmp_zpoly_sub"
+    external neg : t -> t = "_mlgmp_zpoly_neg"
+    external mul : t -> t -> t = "_mlgmp_zpoly_mul"
+    external scale : Z.t -> t -> t = "_mlgmp_zpoly_scale"
+    (* raises Invalid_argument unless the number divides the polynomial *)
+    external divexact_z : t -> Z.t -> t = "_mlgmp_zpoly_divexact_z"
+    external eval : t -> Z.t -> Z.t = "_mlgmp_zpoly_eval"
+    (* eval_frac p n d = d^(degree p) p(n/d) *)
+    external eval_frac : t -> Z.t -> Z.t -> Z.t = "_mlgmp_zpoly_eval_frac"
+    (* (q, r) with c^(deg a - deg b + 1) a = q b + r, c the leading
+       coefficient of b and deg r < deg b; (0, a) if deg a < deg b *)
+    external pseudo_divrem : t -> t -> t * t = "_mlgmp_zpoly_pseudo_divrem"
+    (* raises Invalid_argument unless the division is exact over Z *)
+    external divexact : t -> t -> t = "_mlgmp_zpoly_divexact"
+    (* the nonnegative gcd of the coefficients *)
+    external content : t -> Z.t = "_mlgmp_zpoly_content"
+    external primitive_part : t -> t = "_mlgmp_zpoly_primitive_part"
+    (* with a positive leading coefficient *)
+    external gcd : t -> t -> t = "_mlgmp_zpoly_gcd"
+    external derivative : t -> t = "_mlgmp_zpoly_derivative"
+    val zero : t
+    val one : t
+    val x : t
+    val leading_coeff : t -> Z.t
+  end
+(* polynomials over Q, as a polynomial over Z and a common denominator *)
+module QPoly :
+  sig
+    type t
+    val zero : t
+    val one : t
+    val x : t
+    val of_zpoly : ZPoly.t -> t
+    (* p = num p / den p, den p > 0 coprime with the content of num p *)
+    val num : t -> ZPoly.t
+    val den : t -> Z.t
+    val of_array : Q.t array -> t
+    val to_array : t -> Q.t array
+    val degree : t -> int
+    val coeff : t -> int -> Q.t
+    val leading_coeff : t -> Q.t
+    val equal : t -> t -> bool
+    val add : t -> t -> t
+    val sub : t -> t -> t
+    val neg : t -> t
+    val mul : t -> t -> t
+    val scale : Q.t -> t -> t
+    val eval : t -> Q.t -> Q.t
+    val divrem : t -> t -> t * t
+    val div : t -> t -> t
+    val rem : t -> t -> t
+    (* monic, or zero *)
+    val gcd : t -> t -> t
+    val derivative : t -> t
   end
 module F :
   sig
@@ -226,13 +614,16 @@ module F :
     external create : unit -> t = "_mlgmp_f_create"
     val default_prec : int ref
     external from_z_prec : prec:int -> Z.t -> t = "_mlgmp_f_from_z"
-    external from_q_prec : prec:int -> Z.t -> t = "_mlgmp_f_from_q"
+    external from_q_prec : prec:int -> Q.t -> t = "_mlgmp_f_from_q"
     external from_si_prec : prec:int -> int -> t = "_mlgmp_f_from_si"
-    external from_float_prec : prec:int -> float -> t = "_mlgmp_f_from_float"
+    external from_float_prec : prec:int -> (float [@unboxed]) -> t
+      = "_mlgmp_f_from_float" "_mlgmp_f_from_float_unboxed"
     external from_string_prec_base : prec:int -> base:int -> string -> t
       = "_mlgmp_f_from_string"
-    external float_from : t->float = "_mlgmp_f_to_float";;
-    external to_float : t->float = "_mlgmp_f_to_float";;
+    external float_from : t->(float [@unboxed])
+      = "_mlgmp_f_to_float" "_mlgmp_f_to_float_unboxed" [@@noalloc];;
+    external to_float : t->(float [@unboxed])
+      = "_mlgmp_f_to_float" "_mlgmp_f_to_float_unboxed" [@@noalloc];;
     external to_string_exp_base_digits :
       base:int -> digits:int -> t -> string * int
       = "_mlgmp_f_to_string_exp_base_digits"
@@ -251,8 +642,12 @@ module F :
     external floor_prec : prec:int -> t -> t = "_mlgmp_f_floor"
     external ceil_prec : prec:int -> t -> t = "_mlgmp_f_ceil"
     external trunc_prec : prec:int -> t -> t = "_mlgmp_f_trunc"
+    external sqrt_prec : prec:int -> t -> t = "_mlgmp_f_sqrt"
+    external pow_prec_ui : prec:int -> t -> int -> t = "_mlgmp_f_pow_ui"
+    external mul_prec_2exp : prec:int -> t -> int -> t = "_mlgmp_f_mul_2exp"
+    external div_prec_2exp : prec:int -> t -> int -> t = "_mlgmp_f_div_2exp"
     val from_z : Z.t -> t
-    val from_q : Z.t -> t
+    val from_q : Q.t -> t
     val from_si : int -> t
     val from_int : int -> t
     val from_float : float -> t
@@ -273,10 +668,18 @@ module F :
     val floor : t -> t
     val ceil : t -> t
     val trunc : t -> t
-    external cmp : t -> t -> int = "_mlgmp_f_cmp"
-    external compare : t -> t -> int = "_mlgmp_f_cmp"
-    external sgn : t -> int = "_mlgmp_f_sgn"
-    external eq : t -> t -> prec:int -> bool = "_mlgmp_f_eq"
+    val sqrt : t -> t
+    val pow_ui : t -> int -> t
+    val mul_2exp : t -> int -> t
+    val div_2exp : t -> int -> t
+    external cmp : t -> t -> (int [@untagged])
+      = "_mlgmp_f_cmp" "_mlgmp_f_cmp_untagged" [@@noalloc]
+    external compare : t -> t -> (int [@untagged])
+      = "_mlgmp_f_cmp" "_mlgmp_f_cmp_untagged" [@@noalloc]
+    external sgn : t -> (int [@untagged])
+      = "_mlgmp_f_sgn" "_mlgmp_f_sgn_untagged" [@@noalloc]
+    external eq : t -> t -> prec:(int [@untagged]) -> bool
+      = "_mlgmp_f_eq" "_mlgmp_f_eq_untagged" [@@noalloc]
     external urandomb_prec :
       prec:int -> state:RNG.randstate_t -> nbits:int -> t
       = "_mlgmp_f_urandomb"
@@ -287,6 +690,46 @@ module F :
     val to_string_base_digits : base:int -> digits:int -> t -> string
     val to_string : t -> string
   end
+module F2 :
+  sig
+    type t
+    external create_prec : prec:int -> t = "_mlgmp_f_create"
+    val create : unit -> t
+    external of_f : F.t -> t = "_mlgmp_f_copy"
+    external to_f : t -> F.t = "_mlgmp_f_copy"
+    external as_f : t -> F.t = "%identity"
+    external from_z : dest:t -> Z.t -> unit = "_mlgmp_f2_from_z"
+    external from_q : dest:t -> Q.t -> unit = "_mlgmp_f2_from_q"
+    external from_si : dest:t -> int -> unit = "_mlgmp_f2_from_si"
+    external from_int : dest:t -> int -> unit = "_mlgmp_f2_from_si"
+    external from_float : dest:t -> (float [@unboxed]) -> unit
+      = "_mlgmp_f2_from_float" "_mlgmp_f2_from_float_unboxed" [@@noalloc]
+    external from_string_base : dest:t -> base:int -> string -> unit =
+      "_mlgmp_f2_from_string"
+    external copy : dest:t -> from:F.t -> unit = "_mlgmp_f2_set"
+    external add : dest:t -> F.t -> F.t -> unit = "_mlgmp_f2_add"
+    external sub : dest:t -> F.t -> F.t -> unit = "_mlgmp_f2_sub"
+    external mul : dest:t -> F.t -> F.t -> unit = "_mlgmp_f2_mul"
+    external div : dest:t -> F.t -> F.t -> unit = "_mlgmp_f2_div"
+    external reldiff : dest:t -> F.t -> F.t -> unit = "_mlgmp_f2_reldiff"
+    external add_ui : dest:t -> F.t -> int -> unit = "_mlgmp_f2_add_ui"
+    external sub_ui : dest:t -> F.t -> int -> unit = "_mlgmp_f2_sub_ui"
+    external mul_ui : dest:t -> F.t -> int -> unit = "_mlgmp_f2_mul_ui"
+    external div_ui : dest:t -> F.t -> int -> unit = "_mlgmp_f2_div_ui"
+    external ui_sub : dest:t -> int -> F.t -> unit = "_mlgmp_f2_ui_sub"
+    external ui_div : dest:t -> int -> F.t -> unit = "_mlgmp_f2_ui_div"
+    external pow_ui : dest:t -> F.t -> int -> unit = "_mlgmp_f2_pow_ui"
+    external mul_2exp : dest:t -> F.t -> int -> unit = "_mlgmp_f2_mul_2exp"
+    external div_2exp : dest:t -> F.t -> int -> unit = "_mlgmp_f2_div_2exp"
+    external neg : dest:t -> F.t -> unit = "_mlgmp_f2_neg"
+    external abs : dest:t -> F.t -> unit = "_mlgmp_f2_abs"
+    external sqrt : dest:t -> F.t -> unit = "_mlgmp_f2_sqrt"
+    external floor : dest:t -> F.t -> unit = "_mlgmp_f2_floor"
+    external ceil : dest:t -> F.t -> unit = "_mlgmp_f2_ceil"
+    external trunc : dest:t -> F.t -> unit = "_mlgmp_f2_trunc"
+    external urandomb : dest:t -> state:RNG.randstate_t -> nbits:int -> unit =
+      "_mlgmp_f2_urandomb"
+  end
 module FR :
   sig
     type t
@@ -300,14 +743,19 @@ module FR :
       = "_mlgmp_fr_from_q"
     external from_si_prec : prec:int -> mode:rounding_mode -> int -> t
       = "_mlgmp_fr_from_si"
-    external from_float_prec : prec:int -> mode:rounding_mode -> float -> t
-      = "_mlgmp_fr_from_float"
-    external float_from : t->float = "_mlgmp_fr_to_float";;
-    external to_float_mode : mode:rounding_mode -> t -> float =
-      "_mlgmp_fr_to_float";;
+    external from_float_prec :
+      prec:int -> mode:rounding_mode -> (float [@unboxed]) -> t
+      = "_mlgmp_fr_from_float" "_mlgmp_fr_from_float_unboxed"
+    val float_from : t -> float
+    external to_float_mode : mode:rounding_mode -> t -> (float [@unboxed]) =
+      "_mlgmp_fr_to_float" "_mlgmp_fr_to_float_unboxed" [@@noalloc];;
     external from_string_prec_base :
       prec:int -> mode:rounding_mode -> base:int -> string -> t
       = "_mlgmp_fr_from_string"
+    external of_substring_prec_base :
+      prec:int -> mode:rounding_mode -> base:int -> string -> pos:int ->
+      len:int -> t
+      = "_mlgmp_fr_from_substring_bytecode" "_mlgmp_fr_from_substring"
     external to_string_exp_base_digits :
       mode:rounding_mode -> base:int -> digits:int -> t -> string * int
       = "_mlgmp_fr_to_string_exp_base_digits"
@@ -319,6 +767,11 @@ module FR :
       = "_mlgmp_fr_mul"
     external div_prec : prec:int -> mode:rounding_mode -> t -> t -> t
       = "_mlgmp_fr_div"
+    (* fma a b c is a * b + c and fms a b c is a * b - c, rounded once *)
+    external fma_prec : prec:int -> mode:rounding_mode -> t -> t -> t -> t
+      = "_mlgmp_fr_fma"
+    external fms_prec : prec:int -> mode:rounding_mode -> t -> t -> t -> t
+      = "_mlgmp_fr_fms"
     external add_prec_ui : prec:int -> mode:rounding_mode -> t -> int -> t
       = "_mlgmp_fr_add_ui"
     external sub_prec_ui : prec:int -> mode:rounding_mode -> t -> int -> t
@@ -339,11 +792,15 @@ module FR :
     external floor_prec : prec:int -> t -> t = "_mlgmp_fr_floor"
     external trunc_prec : prec:int -> t -> t = "_mlgmp_fr_trunc"
     external rint_prec : prec:int -> mode:rounding_mode -> t -> t = "_mlgmp_fr_rint"
-    external cmp : t -> t -> int = "_mlgmp_fr_cmp"
-    external compare : t -> t -> int = "_mlgmp_fr_cmp"
-    external sgn : t -> int = "_mlgmp_fr_sgn"
-    external eq : t -> t -> prec:int -> bool = "_mlgmp_fr_eq"
-    external is_nan : t -> bool = "_mlgmp_fr_is_nan"
+    external cmp : t -> t -> (int [@untagged])
+      = "_mlgmp_fr_cmp" "_mlgmp_fr_cmp_untagged" [@@noalloc]
+    external compare : t -> t -> (int [@untagged])
+      = "_mlgmp_fr_cmp" "_mlgmp_fr_cmp_untagged" [@@noalloc]
+    external sgn : t -> (int [@untagged])
+      = "_mlgmp_fr_sgn" "_mlgmp_fr_sgn_untagged" [@@noalloc]
+    external eq : t -> t -> prec:(int [@untagged]) -> bool
+      = "_mlgmp_fr_eq" "_mlgmp_fr_eq_untagged" [@@noalloc]
+    external is_nan : t -> bool = "_mlgmp_fr_is_nan" [@@noalloc]
     external urandomb : prec:int -> state:RNG.randstate_t -> t
       = "_mlgmp_fr_urandomb"
     val from_z : Z.t -> t
@@ -354,10 +811,13 @@ module FR :
     val to_float : t -> float
     val from_string_base : base:int -> string -> t
     val from_string : string -> t
+    val of_substring : string -> pos:int -> len:int -> t
     val add : t -> t -> t
     val sub : t -> t -> t
     val mul : t -> t -> t
     val div : t -> t -> t
+    val fma : t -> t -> t -> t
+    val fms : t -> t -> t -> t
 
   external sin_prec : prec: int -> mode: rounding_mode -> t->t
       = "_mlgmp_fr_sin";;
@@ -393,6 +853,22 @@ module FR :
       = "_mlgmp_fr_pow";;
   external pow_prec_ui : prec: int -> mode: rounding_mode -> t->int->t
       = "_mlgmp_fr_pow_ui";;
+  external cbrt_prec : prec: int -> mode: rounding_mode -> t->t
+      = "_mlgmp_fr_cbrt";;
+  external expm1_prec : prec: int -> mode: rounding_mode -> t->t
+      = "_mlgmp_fr_expm1";;
+  external log_prec : prec: int -> mode: rounding_mode -> t->t
+      = "_mlgmp_fr_log";;
+  external log2_prec : prec: int -> mode: rounding_mode -> t->t
+      = "_mlgmp_fr_log2";;
+  external log10_prec : prec: int -> mode: rounding_mode -> t->t
+      = "_mlgmp_fr_log10";;
+  external log1p_prec : prec: int -> mode: rounding_mode -> t->t
+      = "_mlgmp_fr_log1p";;
+  external atan2_prec : prec: int -> mode: rounding_mode -> t->t->t
+      = "_mlgmp_fr_atan2";;
+  external hypot_prec : prec: int -> mode: rounding_mode -> t->t->t
+      = "_mlgmp_fr_hypot";;
 
     val reldiff : t -> t
     val add_ui : t -> int -> t
@@ -418,6 +894,14 @@ module FR :
     val sqrt : t -> t
     val exp : t -> t
     val exp2 : t -> t
+    val cbrt : t -> t
+    val expm1 : t -> t
+    val log : t -> t
+    val log2 : t -> t
+    val log10 : t -> t
+    val log1p : t -> t
+    val atan2 : t -> t -> t
+    val hypot : t -> t -> t
     val pow : t -> t -> t
     val pow_ui : t -> int -> t
 
@@ -438,8 +922,242 @@ module FR :
 
     external is_available : unit -> bool = "_mlgmp_is_mpfr_available"
   end
+module FR2 :
+  sig
+    type t
+    external create_prec : prec:int -> unit -> t = "_mlgmp_fr_create"
+    val create : unit -> t
+    external of_fr : FR.t -> t = "_mlgmp_fr_copy"
+    external to_fr : t -> FR.t = "_mlgmp_fr_copy"
+    external as_fr : t -> FR.t = "%identity"
+    external copy_mode : dest:t -> mode:rounding_mode -> from:FR.t -> unit =
+      "_mlgmp_fr2_set"
+    external from_z_mode : dest:t -> mode:rounding_mode -> Z.t -> unit =
+      "_mlgmp_fr2_from_z"
+    external from_q_mode : dest:t -> mode:rounding_mode -> Q.t -> unit =
+      "_mlgmp_fr2_from_q"
+    external from_si_mode : dest:t -> mode:rounding_mode -> int -> unit =
+      "_mlgmp_fr2_from_si"
+    external from_float_mode :
+      dest:t -> mode:rounding_mode -> (float [@unboxed]) -> unit =
+      "_mlgmp_fr2_from_float" "_mlgmp_fr2_from_float_unboxed" [@@noalloc]
+    external from_string_base_mode : dest:t -> mode:rounding_mode ->
+      base:int -> string -> unit = "_mlgmp_fr2_from_string"
+    external add_mode : dest:t -> mode:rounding_mode -> FR.t -> FR.t -> unit =
+      "_mlgmp_fr2_add"
+    external sub_mode : dest:t -> mode:rounding_mode -> FR.t -> FR.t -> unit =
+      "_mlgmp_fr2_sub"
+    external mul_mode : dest:t -> mode:rounding_mode -> FR.t -> FR.t -> unit =
+      "_mlgmp_fr2_mul"
+    external div_mode : dest:t -> mode:rounding_mode -> FR.t -> FR.t -> unit =
+      "_mlgmp_fr2_div"
+    external fma_mode :
+      dest:t -> mode:rounding_mode -> FR.t -> FR.t -> FR.t -> unit =
+      "_mlgmp_fr2_fma"
+    external fms_mode :
+      dest:t -> mode:rounding_mode -> FR.t -> FR.t -> FR.t -> unit =
+      "_mlgmp_fr2_fms"
+    external pow_mode : dest:t -> mode:rounding_mode -> FR.t -> FR.t -> unit =
+      "_mlgmp_fr2_pow"
+    external atan2_mode : dest:t -> mode:rounding_mode -> FR.t -> FR.t -> unit =
+      "_mlgmp_fr2_atan2"
+    external hypot_mode : dest:t -> mode:rounding_mode -> FR.t -> FR.t -> unit =
+      "_mlgmp_fr2_hypot"
+    external reldiff_mode : dest:t -> mode:rounding_mode -> FR.t -> FR.t -> unit =
+      "_mlgmp_fr2_reldiff"
+    external add_ui_mode : dest:t -> mode:rounding_mode -> FR.t -> int -> unit =
+      "_mlgmp_fr2_add_ui"
+    external sub_ui_mode : dest:t -> mode:rounding_mode -> FR.t -> int -> unit =
+      "_mlgmp_fr2_sub_ui"
+    external mul_ui_mode : dest:t -> mode:rounding_mode -> FR.t -> int -> unit =
+      "_mlgmp_fr2_mul_ui"
+    external div_ui_mode : dest:t -> mode:rounding_mode -> FR.t -> int -> unit =
+      "_mlgmp_fr2_div_ui"
+    external pow_ui_mode : dest:t -> mode:rounding_mode -> FR.t -> int -> unit =
+      "_mlgmp_fr2_pow_ui"
+    external mul_2ui_mode : dest:t -> mode:rounding_mode -> FR.t -> int -> unit =
+      "_mlgmp_fr2_mul_2ui"
+    external div_2ui_mode : dest:t -> mode:rounding_mode -> FR.t -> int -> unit =
+      "_mlgmp_fr2_div_2ui"
+    external ui_sub_mode : dest:t -> mode:rounding_mode -> int -> FR.t -> unit =
+      "_mlgmp_fr2_ui_sub"
+    external ui_div_mode : dest:t -> mode:rounding_mode -> int -> FR.t -> unit =
+      "_mlgmp_fr2_ui_div"
+    external ui_pow_mode : dest:t -> mode:rounding_mode -> int -> FR.t -> unit =
+      "_mlgmp_fr2_ui_pow"
+    external neg_mode : dest:t -> mode:rounding_mode -> FR.t -> unit =
+      "_mlgmp_fr2_neg"
+    external abs_mode : dest:t -> mode:rounding_mode -> FR.t -> unit =
+      "_mlgmp_fr2_abs"
+    external sqrt_mode : dest:t -> mode:rounding_mode -> FR.t -> unit =
+      "_mlgmp_fr2_sqrt"
+    external cbrt_mode : dest:t -> mode:rounding_mode -> FR.t -> unit =
+      "_mlgmp_fr2_cbrt"
+    external exp_mode : dest:t -> mode:rounding_mode -> FR.t -> unit =
+      "_mlgmp_fr2_exp"
+    external exp2_mode : dest:t -> mode:rounding_mode -> FR.t -> unit =
+      "_mlgmp_fr2_exp2"
+    external expm1_mode : dest:t -> mode:rounding_mode -> FR.t -> unit =
+      "_mlgmp_fr2_expm1"
+    external log_mode : dest:t -> mode:rounding_mode -> FR.t -> unit =
+      "_mlgmp_fr2_log"
+    external log2_mode : dest:t -> mode:rounding_mode -> FR.t -> unit =
+      "_mlgmp_fr2_log2"
+    external log10_mode : dest:t -> mode:rounding_mode -> FR.t -> unit =
+      "_mlgmp_fr2_log10"
+    external log1p_mode : dest:t -> mode:rounding_mode -> FR.t -> unit =
+      "_mlgmp_fr2_log1p"
+    external sin_mode : dest:t -> mode:rounding_mode -> FR.t -> unit =
+      "_mlgmp_fr2_sin"
+    external cos_mode : dest:t -> mode:rounding_mode -> FR.t -> unit =
+      "_mlgmp_fr2_cos"
+    external tan_mode : dest:t -> mode:rounding_mode -> FR.t -> unit =
+      "_mlgmp_fr2_tan"
+    external asin_mode : dest:t -> mode:rounding_mode -> FR.t -> unit =
+      "_mlgmp_fr2_asin"
+    external acos_mode : dest:t -> mode:rounding_mode -> FR.t -> unit =
+      "_mlgmp_fr2_acos"
+    external atan_mode : dest:t -> mode:rounding_mode -> FR.t -> unit =
+      "_mlgmp_fr2_atan"
+    external sinh_mode : dest:t -> mode:rounding_mode -> FR.t -> unit =
+      "_mlgmp_fr2_sinh"
+    external cosh_mode : dest:t -> mode:rounding_mode -> FR.t -> unit =
+      "_mlgmp_fr2_cosh"
+    external tanh_mode : dest:t -> mode:rounding_mode -> FR.t -> unit =
+      "_mlgmp_fr2_tanh"
+    external asinh_mode : dest:t -> mode:rounding_mode -> FR.t -> unit =
+      "_mlgmp_fr2_asinh"
+    external acosh_mode : dest:t -> mode:rounding_mode -> FR.t -> unit =
+      "_mlgmp_fr2_acosh"
+    external atanh_mode : dest:t -> mode:rounding_mode -> FR.t -> unit =
+      "_mlgmp_fr2_atanh"
+    external rint_mode : dest:t -> mode:rounding_mode -> FR.t -> unit =
+      "_mlgmp_fr2_rint"
+    external floor : dest:t -> FR.t -> unit = "_mlgmp_fr2_floor"
+    external ceil : dest:t -> FR.t -> unit = "_mlgmp_fr2_ceil"
+    external trunc : dest:t -> FR.t -> unit = "_mlgmp_fr2_trunc"
+    external urandomb : dest:t -> state:RNG.randstate_t -> unit =
+      "_mlgmp_fr2_urandomb"
+    val copy : dest:t -> from:FR.t -> unit
+    val from_z : dest:t -> Z.t -> unit
+    val from_q : dest:t -> Q.t -> unit
+    val from_si : dest:t -> int -> unit
+    val from_float : dest:t -> float -> unit
+    val from_string_base : dest:t -> base:int -> string -> unit
+    val add : dest:t -> FR.t -> FR.t -> unit
+    val sub : dest:t -> FR.t -> FR.t -> unit
+    val mul : dest:t -> FR.t -> FR.t -> unit
+    val div : dest:t -> FR.t -> FR.t -> unit
+    val fma : dest:t -> FR.t -> FR.t -> FR.t -> unit
+    val fms : dest:t -> FR.t -> FR.t -> FR.t -> unit
+    val pow : dest:t -> FR.t -> FR.t -> unit
+    val atan2 : dest:t -> FR.t -> FR.t -> unit
+    val hypot : dest:t -> FR.t -> FR.t -> unit
+    val reldiff : dest:t -> FR.t -> FR.t -> unit
+    val add_ui : dest:t -> FR.t -> int -> unit
+    val sub_ui : dest:t -> FR.t -> int -> unit
+    val mul_ui : dest:t -> FR.t -> int -> unit
+    val div_ui : dest:t -> FR.t -> int -> unit
+    val pow_ui : dest:t -> FR.t -> int -> unit
+    val mul_2ui : dest:t -> FR.t -> int -> unit
+    val div_2ui : dest:t -> FR.t -> int -> unit
+    val ui_sub : dest:t -> int -> FR.t -> unit
+    val ui_div : dest:t -> int -> FR.t -> unit
+    val ui_pow : dest:t -> int -> FR.t -> unit
+    val neg : dest:t -> FR.t -> unit
+    val abs : dest:t -> FR.t -> unit
+    val sqrt : dest:t -> FR.t -> unit
+    val cbrt : dest:t -> FR.t -> unit
+    val exp : dest:t -> FR.t -> unit
+    val exp2 : dest:t -> FR.t -> unit
+    val expm1 : dest:t -> FR.t -> unit
+    val log : dest:t -> FR.t -> unit
+    val log2 : dest:t -> FR.t -> unit
+    val log10 : dest:t -> FR.t -> unit
+    val log1p : dest:t -> FR.t -> unit
+    val sin : dest:t -> FR.t -> unit
+    val cos : dest:t -> FR.t -> unit
+    val tan : dest:t -> FR.t -> unit
+    val asin : dest:t -> FR.t -> unit
+    val acos : dest:t -> FR.t -> unit
+    val atan : dest:t -> FR.t -> unit
+    val sinh : dest:t -> FR.t -> unit
+    val cosh : dest:t -> FR.t -> unit
+    val tanh : dest:t -> FR.t -> unit
+    val asinh : dest:t -> FR.t -> unit
+    val acosh : dest:t -> FR.t -> unit
+    val atanh : dest:t -> FR.t -> unit
+    val rint : dest:t -> FR.t -> unit
+    val from_int : dest:t -> int -> unit
+  end
 exception Unimplemented of string
 external get_gmp_runtime_version : unit -> string
   = "_mlgmp_get_runtime_version"
 external get_gmp_compile_version : unit -> int * int * int
   = "_mlgmp_get_compile_version"
+external set_gc_ratio : int -> unit = "_mlgmp_set_gc_ratio"
+external get_gc_ratio : unit -> int = "_mlgmp_get_gc_ratio"
+(* a pool of size-classed free lists for the limbs of small and medium
+   numbers, installed through mp_set_memory_functions *)
+module Alloc :
+  sig
+    external set_pooling : bool -> unit = "_mlgmp_alloc_set_pooling"
+    external get_pooling : unit -> bool = "_mlgmp_alloc_get_pooling"
+    (* the numbers made by the calling thread in the arena take their limbs
+       from chunks that are recycled as a whole; they may outlive it *)
+    external enter_arena : unit -> unit = "_mlgmp_alloc_enter_arena"
+    external leave_arena : unit -> unit = "_mlgmp_alloc_leave_arena"
+    val with_arena : (unit -> 'a) -> 'a
+    (* hits and misses count the results that found a kept buffer or not,
+       drops the buffers freed for want of room, kept the bytes kept *)
+    type recycle_stats =
+        { hits : int; misses : int; drops : int; kept : int; limit : int }
+    (* reuse of the limbs of freed numbers for new results; turning it off
+       frees the buffers kept by the calling thread, and those of the
+       other threads when they next free or make a number (until then
+       they stay in kept) *)
+    external set_recycling : bool -> unit = "_mlgmp_alloc_set_recycling"
+    external get_recycling : unit -> bool = "_mlgmp_alloc_get_recycling"
+    external set_recycle_limit : int -> unit
+      = "_mlgmp_alloc_set_recycle_limit"
+    external flush_recycled : unit -> unit = "_mlgmp_alloc_flush_recycled"
+    external recycle_stats : unit -> recycle_stats
+      = "_mlgmp_alloc_recycle_stats"
+  end
+(* runtime statistics, collected when the library is compiled with STATS
+   (and STATS_TIME for the timings) in config.h *)
+module Stats :
+  sig
+    (* custom blocks made and finalized, and the bytes of their limbs *)
+    type blocks =
+        { allocated : int; finalized : int;
+          bytes_allocated : int; bytes_freed : int }
+    (* stubs are (name, calls, seconds), e.g. ("Gmp.Z.add", 12, 0.);
+       bytes_grown counts the limbs added in place to Z2.t and Q2.t *)
+    type snapshot =
+        { enabled : bool; timed : bool;
+          stubs : (string * int * float) array;
+          z : blocks; q : blocks; f : blocks; fr : blocks;
+          bytes_grown : int }
+    external snapshot : unit -> snapshot = "_mlgmp_stats_snapshot"
+    external reset : unit -> unit = "_mlgmp_stats_reset"
+    (* calls of the stub of that name in a snapshot *)
+    val calls : snapshot -> string -> int
+  end
+(* census of the live numbers, kept when the library is compiled with
+   CENSUS in config.h; numbers read by input_value are not counted *)
+module Census :
+  sig
+    (* histogram.(i) counts the blocks of 2^i to 2^(i+1)-1 limbs, and
+       histogram.(0) those of 0 or 1; bytes are those of the limbs *)
+    type count = { blocks : int; bytes : int; histogram : int array }
+    type t =
+        { enabled : bool;
+          z : count; q : count; f : count; fr : count;
+          largest : (string * int) array }
+    (* with the n largest blocks, as (type, bytes), largest first *)
+    external take : int -> t = "_mlgmp_census_take"
+    val print : out_channel -> t -> unit
+    (* prints the census on stderr whenever the signal is received *)
+    val dump_on_signal : ?largest:int -> int -> unit
+  end
@@ -0,0 +1,6 @@
+(* Domain-local values: one per domain with OCaml 5, a single global one
+   with older compilers.  The right implementation is copied to
+   gmp_local.ml by the Makefile. *)
+type 'a key
+val new_key : split:('a -> 'a) -> (unit -> 'a) -> 'a key
+val get : 'a key -> 'a
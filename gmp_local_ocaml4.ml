@@ -0,0 +1,8 @@
+(* Without domains there is a single value, created on first use. *)
+type 'a key = { init : unit -> 'a; mutable v : 'a option }
+
+let new_key ~split init = { init = init; v = None }
+let get k =
+  match k.v with
+    Some v -> v
+  | None -> let v = k.init () in k.v <- Some v; v
@@ -0,0 +1,6 @@
+(* A domain spawned after the value was created starts from split applied
+   to the value of its parent. *)
+type 'a key = 'a Domain.DLS.key
+
+let new_key ~split init = Domain.DLS.new_key ~split_from_parent: split init
+let get = Domain.DLS.get
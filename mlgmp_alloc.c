@@ -0,0 +1,586 @@
+#include <caml/mlvalues.h>
+#include <caml/custom.h>
+#include <caml/alloc.h>
+#include <caml/memory.h>
+#include <caml/fail.h>
+#include <caml/callback.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "config.h"
+#include "mlgmp.h"
+#include "conversions.c"
+
+#include <pthread.h>
+#include <stdatomic.h>
+
+#define MODULE "Gmp.Alloc."
+
+/*** Recycled limbs */
+
+/* With recycling on, the limbs of numbers that are freed (finalized
+   custom blocks, results that turned out small) are kept in lists of the
+   thread, by power-of-two classes of their size, and given to the next
+   results of about the same size instead of going through malloc and
+   realloc again.  The lists are threaded through the buffers themselves,
+   which therefore need room for a struct recycled.  At most
+   mlgmp_recycle_limit bytes are kept, over all threads. */
+#define RECYCLE_CLASSES (8 * sizeof(mp_size_t))
+
+struct recycled
+{
+  struct recycled *next;
+  mp_size_t alloc;
+};
+
+int mlgmp_recycling = 0;
+_Thread_local int mlgmp_recycled_here;
+static atomic_size_t recycle_limit = RECYCLE_LIMIT_BYTES;
+static atomic_size_t recycle_kept;
+static atomic_long recycle_hits, recycle_misses, recycle_drops;
+static pthread_key_t recycle_key;
+static pthread_once_t recycle_once = PTHREAD_ONCE_INIT;
+
+static _Thread_local struct
+{
+  struct recycled *head[RECYCLE_CLASSES];
+  int registered;
+} recycle_lists;
+
+static inline int size_class(mp_size_t n)
+{
+  int k = 0;
+  while (n >>= 1) k++;
+  return k;
+}
+
+static inline size_t buffer_bytes(mp_size_t alloc)
+{
+  return (size_t) alloc * sizeof(mp_limb_t);
+}
+
+static void recycle_free(struct recycled *b)
+{
+  void (*free_func)(void *, size_t);
+  mp_get_memory_functions(NULL, NULL, &free_func);
+  atomic_fetch_sub(&recycle_kept, buffer_bytes(b->alloc));
+  free_func(b, buffer_bytes(b->alloc));
+}
+
+/* Frees the buffers kept by the calling thread; also run when it exits,
+   and when it next frees or makes a number after recycling was turned
+   off. */
+static void recycle_flush(void *arg)
+{
+  int k;
+  mlgmp_recycled_here = 0;
+  for(k=0; k<RECYCLE_CLASSES; k++)
+    while (recycle_lists.head[k] != NULL)
+      {
+	struct recycled *b = recycle_lists.head[k];
+	recycle_lists.head[k] = b->next;
+	recycle_free(b);
+      }
+}
+
+static void recycle_key_create(void)
+{
+  pthread_key_create(&recycle_key, recycle_flush);
+}
+
+/* Same as mpz_clear, keeping the limbs of z when there is room. */
+void mlgmp_recycle(mpz_ptr z)
+{
+  size_t bytes = buffer_bytes(z->_mp_alloc);
+  struct recycled *b = (struct recycled *) z->_mp_d;
+  int k = size_class(z->_mp_alloc);
+  if (!mlgmp_recycling)
+    {
+      recycle_flush(NULL);
+      mpz_clear(z);
+      return;
+    }
+  if (bytes < sizeof(struct recycled)
+      || atomic_fetch_add(&recycle_kept, bytes) + bytes
+         > atomic_load(&recycle_limit))
+    {
+      if (bytes >= sizeof(struct recycled))
+	{
+	  atomic_fetch_sub(&recycle_kept, bytes);
+	  atomic_fetch_add_explicit(&recycle_drops, 1, memory_order_relaxed);
+	}
+      mpz_clear(z);
+      return;
+    }
+  if (!recycle_lists.registered)
+    {
+      pthread_once(&recycle_once, recycle_key_create);
+      pthread_setspecific(recycle_key, &recycle_lists);
+      recycle_lists.registered = 1;
+    }
+  b->alloc = z->_mp_alloc;
+  b->next = recycle_lists.head[k];
+  recycle_lists.head[k] = b;
+  mlgmp_recycled_here = 1;
+}
+
+/* Same as mpz_init, with room for n limbs when a kept buffer has it:
+   the first one of the class of n if it is big enough, or else the first
+   one of the next class. */
+void mlgmp_init_limbs(mpz_ptr z, mp_size_t n)
+{
+  int k = size_class(n);
+  struct recycled *b;
+  if (!mlgmp_recycling)
+    recycle_flush(NULL);
+  if (!mlgmp_recycling || n <= 1)
+    {
+      mpz_init(z);
+      return;
+    }
+  b = recycle_lists.head[k];
+  if ((b == NULL || b->alloc < n) && k + 1 < RECYCLE_CLASSES)
+    b = recycle_lists.head[++k];
+  if (b == NULL)
+    {
+      atomic_fetch_add_explicit(&recycle_misses, 1, memory_order_relaxed);
+      mpz_init(z);
+      return;
+    }
+  atomic_fetch_add_explicit(&recycle_hits, 1, memory_order_relaxed);
+  recycle_lists.head[k] = b->next;
+  atomic_fetch_sub(&recycle_kept, buffer_bytes(b->alloc));
+  z->_mp_alloc = b->alloc;
+  z->_mp_size = 0;
+  z->_mp_d = (mp_limb_t *) b;
+}
+
+value _mlgmp_alloc_set_recycling(value on)
+{
+  mlgmp_recycling = Bool_val(on);
+  if (!mlgmp_recycling)
+    recycle_flush(NULL);
+  return Val_unit;
+}
+
+value _mlgmp_alloc_get_recycling(value dummy)
+{
+  return Val_bool(mlgmp_recycling);
+}
+
+value _mlgmp_alloc_set_recycle_limit(value bytes)
+{
+  if (Long_val(bytes) < 0)
+    caml_invalid_argument(MODULE "set_recycle_limit");
+  atomic_store(&recycle_limit, Long_val(bytes));
+  return Val_unit;
+}
+
+value _mlgmp_alloc_flush_recycled(value dummy)
+{
+  recycle_flush(NULL);
+  return Val_unit;
+}
+
+value _mlgmp_alloc_recycle_stats(value dummy)
+{
+  CAMLparam0();
+  CAMLlocal1(r);
+  r = caml_alloc_tuple(5);
+  Store_field(r, 0, Val_long(atomic_load(&recycle_hits)));
+  Store_field(r, 1, Val_long(atomic_load(&recycle_misses)));
+  Store_field(r, 2, Val_long(atomic_load(&recycle_drops)));
+  Store_field(r, 3, Val_long(atomic_load(&recycle_kept)));
+  Store_field(r, 4, Val_long(atomic_load(&recycle_limit)));
+  CAMLreturn(r);
+}
+
+#ifdef USE_POOL
+#include <sys/mman.h>
+
+#ifndef MAP_ANONYMOUS
+#define MAP_ANONYMOUS MAP_ANON
+#endif
+#ifndef MAP_NORESERVE
+#define MAP_NORESERVE 0
+#endif
+
+/*** Limb pool */
+
+/* Once installed through mp_set_memory_functions, the pool serves blocks
+   of up to POOL_MAX_BYTES from size classes of 16, 32, ... bytes.  Each
+   thread keeps a short free list per class, and gives its surplus to
+   lists shared by all threads.  The blocks are carved out of chunks of a
+   single reserved address range, so that the blocks of the pool are
+   told from those of the previous functions by their address alone:
+   blocks allocated before the pool was installed, or too big for it,
+   are handed back to the previous functions.
+
+   In arena mode, a thread takes its blocks by bumping a pointer through
+   chunks of its own, and freeing them only decrements the count of live
+   blocks of their chunk; a chunk is recycled as a whole when this count
+   drops to zero and the thread has left it.  Numbers made in an arena
+   may thus outlive it: their chunk is recycled when they are freed. */
+#define POOL_CLASSES 8
+#define ARENA_MAX_BYTES (POOL_CHUNK_BYTES / 4)
+
+#define round16(n) (((n) + 15) & ~(size_t) 15)
+
+static char *pool_base, *pool_end;
+static pthread_mutex_t pool_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_key_t pool_key;
+
+/* Under pool_lock */
+static char *pool_top;		/* first chunk never used */
+static void *free_chunks;
+static void *shared[POOL_CLASSES];
+
+static atomic_int pool_on;
+static atomic_long *chunk_live;	/* live blocks of arena chunks, + 1 while
+				   their thread bumps through them */
+static unsigned char *chunk_arena;
+
+static void *(*old_alloc)(size_t);
+static void *(*old_realloc)(void *, size_t, size_t);
+static void (*old_free)(void *, size_t);
+
+struct cache
+{
+  void *head[POOL_CLASSES];
+  unsigned count[POOL_CLASSES];
+  char *next, *end;		/* carving chunk */
+  char *arena_next, *arena_end;
+  int arena_depth;
+  int registered;
+};
+
+static _Thread_local struct cache cache;
+
+static inline int pool_owns(const void *p)
+{
+  return (const char *) p >= pool_base && (const char *) p < pool_end;
+}
+
+static inline size_t chunk_index(const void *p)
+{
+  return ((const char *) p - pool_base) / POOL_CHUNK_BYTES;
+}
+
+static inline int class_of(size_t n)
+{
+  int k = 0;
+  while (((size_t) 16 << k) < n) k++;
+  return k;
+}
+
+static inline void push(void **head, void *p)
+{
+  *(void **) p = *head;
+  *head = p;
+}
+
+static inline void *pop(void **head)
+{
+  void *p = *head;
+  *head = *(void **) p;
+  return p;
+}
+
+/* A free chunk, or NULL when the reserved range is used up. */
+static char *chunk_get(int arena)
+{
+  char *p;
+  pthread_mutex_lock(&pool_lock);
+  if (free_chunks != NULL)
+    p = pop(&free_chunks);
+  else if (pool_top + POOL_CHUNK_BYTES <= pool_end)
+    {
+      p = pool_top;
+      pool_top += POOL_CHUNK_BYTES;
+    }
+  else
+    p = NULL;
+  pthread_mutex_unlock(&pool_lock);
+  if (p != NULL)
+    {
+      chunk_arena[chunk_index(p)] = arena;
+      if (arena)
+	atomic_store(&chunk_live[chunk_index(p)], 1);
+    }
+  return p;
+}
+
+static void chunk_release(size_t i)
+{
+  if (atomic_fetch_sub(&chunk_live[i], 1) == 1)
+    {
+      pthread_mutex_lock(&pool_lock);
+      push(&free_chunks, pool_base + i * POOL_CHUNK_BYTES);
+      pthread_mutex_unlock(&pool_lock);
+    }
+}
+
+/* Cuts what is left of the carving chunk into blocks of the largest
+   classes that fit, for the free lists of c. */
+static void cache_cut_rest(struct cache *c)
+{
+  int k;
+  for(k=POOL_CLASSES-1; k>=0; k--)
+    while ((size_t) (c->end - c->next) >= ((size_t) 16 << k))
+      {
+	push(&c->head[k], c->next);
+	c->count[k]++;
+	c->next += (size_t) 16 << k;
+      }
+  c->next = c->end = NULL;
+}
+
+static void arena_close(struct cache *c)
+{
+  if (c->arena_end == NULL) return;
+  chunk_release(chunk_index(c->arena_end - 1));
+  c->arena_next = c->arena_end = NULL;
+}
+
+/* Gives everything the thread holds back to the shared lists, when it
+   exits. */
+static void cache_flush(void *arg)
+{
+  struct cache *c = arg;
+  int k;
+  arena_close(c);
+  cache_cut_rest(c);
+  pthread_mutex_lock(&pool_lock);
+  for(k=0; k<POOL_CLASSES; k++)
+    {
+      while (c->head[k] != NULL)
+	push(&shared[k], pop(&c->head[k]));
+      c->count[k] = 0;
+    }
+  pthread_mutex_unlock(&pool_lock);
+}
+
+/* So that cache_flush runs when the thread exits. */
+static inline void cache_register(struct cache *c)
+{
+  if (!c->registered)
+    {
+      pthread_setspecific(pool_key, c);
+      c->registered = 1;
+    }
+}
+
+static void *arena_alloc(struct cache *c, size_t n)
+{
+  void *p;
+  n = round16(n);
+  if ((size_t) (c->arena_end - c->arena_next) < n)
+    {
+      char *chunk;
+      arena_close(c);
+      if ((chunk = chunk_get(1)) == NULL)
+	return old_alloc(n);
+      c->arena_next = chunk;
+      c->arena_end = chunk + POOL_CHUNK_BYTES;
+    }
+  p = c->arena_next;
+  c->arena_next += n;
+  atomic_fetch_add(&chunk_live[chunk_index(p)], 1);
+  return p;
+}
+
+/* Takes blocks of class k from the shared list, or from the carving
+   chunk; NULL when the reserved range is used up. */
+static void *cache_refill(struct cache *c, int k)
+{
+  size_t size = (size_t) 16 << k;
+  unsigned n;
+  cache_register(c);
+  pthread_mutex_lock(&pool_lock);
+  for(n=0; n<POOL_CACHE_BLOCKS/2 && shared[k] != NULL; n++)
+    push(&c->head[k], pop(&shared[k]));
+  pthread_mutex_unlock(&pool_lock);
+  c->count[k] += n;
+  if (n > 0)
+    {
+      c->count[k]--;
+      return pop(&c->head[k]);
+    }
+  if ((size_t) (c->end - c->next) < size)
+    {
+      char *chunk;
+      cache_cut_rest(c);
+      if (c->head[k] != NULL)
+	{
+	  c->count[k]--;
+	  return pop(&c->head[k]);
+	}
+      if ((chunk = chunk_get(0)) == NULL)
+	return NULL;
+      c->next = chunk;
+      c->end = chunk + POOL_CHUNK_BYTES;
+    }
+  c->next += size;
+  return c->next - size;
+}
+
+static void *pool_alloc(size_t n)
+{
+  struct cache *c = &cache;
+  void *p;
+  int k;
+  if (c->arena_depth > 0 && n <= ARENA_MAX_BYTES)
+    return arena_alloc(c, n);
+  if (n > POOL_MAX_BYTES || !atomic_load_explicit(&pool_on,
+						  memory_order_relaxed))
+    return old_alloc(n);
+  k = class_of(n);
+  if (c->head[k] != NULL)
+    {
+      c->count[k]--;
+      return pop(&c->head[k]);
+    }
+  p = cache_refill(c, k);
+  return p != NULL ? p : old_alloc(n);
+}
+
+static void pool_free(void *p, size_t n)
+{
+  struct cache *c = &cache;
+  int k;
+  unsigned i;
+  if (!pool_owns(p))
+    {
+      old_free(p, n);
+      return;
+    }
+  if (chunk_arena[chunk_index(p)])
+    {
+      chunk_release(chunk_index(p));
+      return;
+    }
+  k = class_of(n);
+  cache_register(c);
+  push(&c->head[k], p);
+  if (++c->count[k] > POOL_CACHE_BLOCKS)
+    {
+      pthread_mutex_lock(&pool_lock);
+      for(i=0; i<POOL_CACHE_BLOCKS/2; i++)
+	push(&shared[k], pop(&c->head[k]));
+      pthread_mutex_unlock(&pool_lock);
+      c->count[k] -= POOL_CACHE_BLOCKS/2;
+    }
+}
+
+static void *pool_realloc(void *p, size_t old, size_t n)
+{
+  struct cache *c = &cache;
+  void *q;
+  if (!pool_owns(p))
+    return old_realloc(p, old, n);
+  if (chunk_arena[chunk_index(p)])
+    {
+      /* The last block of the current chunk grows in place. */
+      if ((char *) p + round16(old) == c->arena_next
+	  && (char *) p + round16(n) <= c->arena_end)
+	{
+	  c->arena_next = (char *) p + round16(n);
+	  return p;
+	}
+    }
+  else if (n <= POOL_MAX_BYTES && class_of(n) == class_of(old))
+    return p;
+  q = pool_alloc(n);
+  memcpy(q, p, old < n ? old : n);
+  pool_free(p, old);
+  return q;
+}
+
+/* Reserves the address range and installs the functions; they then
+   stay installed, since blocks of the pool may be anywhere. */
+static void pool_install(void)
+{
+  size_t nchunks = POOL_RESERVE_BYTES / POOL_CHUNK_BYTES;
+  void *r, *live, *arena;
+  int ok = 1;
+  pthread_mutex_lock(&pool_lock);
+  if (pool_base == NULL)
+    {
+      r = mmap(NULL, POOL_RESERVE_BYTES, PROT_READ | PROT_WRITE,
+	       MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+      live = mmap(NULL, nchunks * sizeof(atomic_long), PROT_READ | PROT_WRITE,
+		  MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+      arena = mmap(NULL, nchunks, PROT_READ | PROT_WRITE,
+		   MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+      if (r == MAP_FAILED || live == MAP_FAILED || arena == MAP_FAILED
+	  || pthread_key_create(&pool_key, cache_flush) != 0)
+	{
+	  if (r != MAP_FAILED) munmap(r, POOL_RESERVE_BYTES);
+	  if (live != MAP_FAILED) munmap(live, nchunks * sizeof(atomic_long));
+	  if (arena != MAP_FAILED) munmap(arena, nchunks);
+	  ok = 0;
+	}
+      else
+	{
+	  chunk_live = live;
+	  chunk_arena = arena;
+	  pool_top = r;
+	  mp_get_memory_functions(&old_alloc, &old_realloc, &old_free);
+	  mp_set_memory_functions(pool_alloc, pool_realloc, pool_free);
+	  pool_end = (char *) r + nchunks * POOL_CHUNK_BYTES;
+	  pool_base = r;
+	}
+    }
+  pthread_mutex_unlock(&pool_lock);
+  if (!ok)
+    caml_raise_out_of_memory();
+}
+
+value _mlgmp_alloc_set_pooling(value on)
+{
+  if (Bool_val(on))
+    pool_install();
+  atomic_store(&pool_on, Bool_val(on));
+  return Val_unit;
+}
+
+value _mlgmp_alloc_get_pooling(value dummy)
+{
+  return Val_bool(atomic_load(&pool_on));
+}
+
+value _mlgmp_alloc_enter_arena(value dummy)
+{
+  pool_install();
+  cache.arena_depth++;
+  return Val_unit;
+}
+
+value _mlgmp_alloc_leave_arena(value dummy)
+{
+  if (cache.arena_depth == 0)
+    caml_invalid_argument(MODULE "leave_arena");
+  if (--cache.arena_depth == 0)
+    arena_close(&cache);
+  return Val_unit;
+}
+
+#else
+
+#define pool_unimplemented(name)		\
+value _mlgmp_alloc_##name(value dummy)		\
+{						\
+  raise_unimplemented(MODULE #name);		\
+}
+
+pool_unimplemented(set_pooling)
+pool_unimplemented(enter_arena)
+pool_unimplemented(leave_arena)
+
+value _mlgmp_alloc_get_pooling(value dummy)
+{
+  return Val_false;
+}
+
+#endif /* USE_POOL */
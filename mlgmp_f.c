@@ -17,10 +17,13 @@
 
 void _mlgmp_f_finalize(value r)
 {
+  stat_free(STAT_F, (*mpf_val(r))->_mp_prec + 1);
+  census_unregister(r, sizeof(mpf_t));
   mpf_clear(*mpf_val(r));
 }
 
 int _mlgmp_f_custom_compare(value a, value b);
+long _mlgmp_f_hash(value v);
 
 void _mlgmp_f_serialize(value v,
 			unsigned long * wsize_32,
@@ -32,7 +35,7 @@ struct custom_operations _mlgmp_custom_f =
     field(identifier)  "Gmp.F.t",
     field(finalize)    &_mlgmp_f_finalize,
     field(compare)     &_mlgmp_f_custom_compare,
-    field(hash)        custom_hash_default,
+    field(hash)        &_mlgmp_f_hash,
 #ifdef SERIALIZE
     field(serialize)   &_mlgmp_f_serialize,
     field(deserialize) &_mlgmp_f_deserialize
@@ -52,8 +55,9 @@ value _mlgmp_f_from_z(value prec, value a)
 {
   CAMLparam2(prec, a);
   CAMLlocal1(r);
+  mpz_small_t sa;
   r=alloc_init_mpf(prec);
-  mpf_set_z(*mpf_val(r), *mpz_val(a));
+  mpf_set_z(*mpf_val(r), mpz_src(a, sa));
   CAMLreturn(r);
 }
 
@@ -75,23 +79,87 @@ value _mlgmp_f_from_si(value prec, value a)
   CAMLreturn(r);
 }
 
+/* See mlgmp_z.c for the _unboxed and _untagged stubs. */
+value _mlgmp_f_from_float_unboxed(value prec, double d)
+{
+  value r=alloc_init_mpf(prec);
+  mpf_set_d(*mpf_val(r), d);
+  return r;
+}
+
 value _mlgmp_f_from_float(value prec, value v)
 {
-  CAMLparam2(prec, v);
+  return _mlgmp_f_from_float_unboxed(prec, Double_val(v));
+}
+
+/* F2.t accumulators keep the precision they were created with; all F2
+   operations round to it. */
+value _mlgmp_f_copy(value a)
+{
+  CAMLparam1(a);
   CAMLlocal1(r);
-  r=alloc_init_mpf(prec);
-  mpf_set_d(*mpf_val(r), Double_val(v));
+  r=alloc_init_mpf(Val_int(mpf_get_prec(*mpf_val(a))));
+  mpf_set(*mpf_val(r), *mpf_val(a));
   CAMLreturn(r);
 }
 
+value _mlgmp_f2_set(value r, value a)
+{
+  CAMLparam2(r, a);
+  mpf_set(*mpf_val(r), *mpf_val(a));
+  CAMLreturn(Val_unit);
+}
+
+value _mlgmp_f2_from_z(value r, value a)
+{
+  CAMLparam2(r, a);
+  mpz_small_t sa;
+  mpf_set_z(*mpf_val(r), mpz_src(a, sa));
+  CAMLreturn(Val_unit);
+}
+
+value _mlgmp_f2_from_q(value r, value a)
+{
+  CAMLparam2(r, a);
+  mpf_set_q(*mpf_val(r), *mpq_val(a));
+  CAMLreturn(Val_unit);
+}
+
+value _mlgmp_f2_from_si(value r, value a)
+{
+  CAMLparam2(r, a);
+  mpf_set_si(*mpf_val(r), Long_val(a));
+  CAMLreturn(Val_unit);
+}
+
+value _mlgmp_f2_from_float_unboxed(value r, double d)
+{
+  mpf_set_d(*mpf_val(r), d);
+  return Val_unit;
+}
+
+value _mlgmp_f2_from_float(value r, value v)
+{
+  return _mlgmp_f2_from_float_unboxed(r, Double_val(v));
+}
+
+value _mlgmp_f2_from_string(value r, value base, value str)
+{
+  CAMLparam3(r, base, str);
+  mpf_set_str(*mpf_val(r), String_val(str), Int_val(base));
+  CAMLreturn(Val_unit);
+}
+
 /*** Conversions */
 
+double _mlgmp_f_to_float_unboxed(value v)
+{
+  return mpf_get_d(*mpf_val(v));
+}
+
 value _mlgmp_f_to_float(value v)
 {
-  CAMLparam1(v);
-  CAMLlocal1(r);
-  r = caml_copy_double(mpf_get_d(*mpf_val(v)));
-  CAMLreturn(r);
+  return caml_copy_double(_mlgmp_f_to_float_unboxed(v));
 }
 
 value _mlgmp_f_to_string_exp_base_digits(value base, value digits, value val)
@@ -99,11 +167,18 @@ value _mlgmp_f_to_string_exp_base_digits(value base, value digits, value val)
   CAMLparam3(base, digits, val);
   CAMLlocal2(r, rs);
   mp_exp_t exponent;
-  char *s= mpf_get_str(NULL, &exponent, Int_val(base), Int_val(digits),
-		       *mpf_val(val));
-  rs=caml_alloc_string(strlen(s));
-  strcpy((char*) String_val(rs), s);
-  free(s);
+  size_t size = Int_val(digits);
+  if (!valid_base(Int_val(base)) || Int_val(digits) < 0)
+    caml_invalid_argument("Gmp.F.to_string_exp_base_digits");
+  /* As many digits as the precision warrants when digits is 0, with
+     GMP's own bound (one limb more than the precision). */
+  if (size == 0)
+    size = mantissa_digits(((*mpf_val(val))->_mp_prec + 1) * GMP_NUMB_BITS,
+			   abs(Int_val(base)));
+  rs=caml_alloc_string(size + 2);
+  mpf_get_str((char*) String_val(rs), &exponent, Int_val(base),
+	      Int_val(digits), *mpf_val(val));
+  rs=trim_string(rs, strlen(String_val(rs)));
   r=caml_alloc_tuple(2);
   Store_field(r, 0, rs);
   Store_field(r, 1, Val_int(exponent));
@@ -126,30 +201,57 @@ value _mlgmp_f_from_string(value prec, value base, value str)
 value _mlgmp_f_##op(value prec, value a, value b)	\
 {							\
   CAMLparam3(prec, a, b);                               \
+  trace(op);                                            \
   CAMLlocal1(r);                                        \
   r=alloc_init_mpf(prec);	       		        \
   mpf_##op(*mpf_val(r), *mpf_val(a), *mpf_val(b));	\
   CAMLreturn(r);	       				\
+}							\
+							\
+value _mlgmp_f2_##op(value r, value a, value b)		\
+{							\
+  CAMLparam3(r, a, b);                                  \
+  trace_name("Gmp.F2." #op);                            \
+  mpf_##op(*mpf_val(r), *mpf_val(a), *mpf_val(b));	\
+  CAMLreturn(Val_unit);	       				\
 }
 
 #define f_binary_op_ui(op)	       			\
 value _mlgmp_f_##op(value prec, value a, value b)	\
 {							\
   CAMLparam3(prec, a, b);                               \
+  trace(op);                                            \
   CAMLlocal1(r);                                        \
   r=alloc_init_mpf(prec);	       		        \
   mpf_##op(*mpf_val(r), *mpf_val(a), Long_val(b));	\
   CAMLreturn(r);	       				\
+}							\
+							\
+value _mlgmp_f2_##op(value r, value a, value b)		\
+{							\
+  CAMLparam3(r, a, b);                                  \
+  trace_name("Gmp.F2." #op);                            \
+  mpf_##op(*mpf_val(r), *mpf_val(a), Long_val(b));	\
+  CAMLreturn(Val_unit);	       				\
 }
 
 #define f_binary_ui_op(op)	       			\
 value _mlgmp_f_##op(value prec, value a, value b)	\
 {							\
   CAMLparam3(prec, a, b);                               \
+  trace(op);                                            \
   CAMLlocal1(r);                                        \
   r=alloc_init_mpf(prec);	       		        \
   mpf_##op(*mpf_val(r), Long_val(a), *mpf_val(b));	\
   CAMLreturn(r);	       				\
+}							\
+							\
+value _mlgmp_f2_##op(value r, value a, value b)		\
+{							\
+  CAMLparam3(r, a, b);                                  \
+  trace_name("Gmp.F2." #op);                            \
+  mpf_##op(*mpf_val(r), Long_val(a), *mpf_val(b));	\
+  CAMLreturn(Val_unit);	       				\
 }
 
 #define f_binary_op(op)				\
@@ -160,10 +262,19 @@ f_binary_op_mpf(op)
 value _mlgmp_f_##op(value prec, value a)	\
 {						\
   CAMLparam2(prec, a);				\
+  trace(op);                                    \
   CAMLlocal1(r);				\
   r=alloc_init_mpf(prec);      			\
   mpf_##op(*mpf_val(r), *mpf_val(a));		\
   CAMLreturn(r);				\
+}						\
+						\
+value _mlgmp_f2_##op(value r, value a)		\
+{						\
+  CAMLparam2(r, a);				\
+  trace_name("Gmp.F2." #op);                    \
+  mpf_##op(*mpf_val(r), *mpf_val(a));		\
+  CAMLreturn(Val_unit);				\
 }
 
 f_binary_op(add)
@@ -215,7 +326,57 @@ value _mlgmp_f_ui_div(value prec, value n, value d)
   CAMLreturn(r);
 }
 
+value _mlgmp_f2_div(value r, value n, value d)
+{
+  CAMLparam3(r, n, d);
+  if (! mpf_sgn(*mpf_val(d)))
+    division_by_zero();
+  mpf_div(*mpf_val(r), *mpf_val(n), *mpf_val(d));
+  CAMLreturn(Val_unit);
+}
+
+value _mlgmp_f2_div_ui(value r, value n, value d)
+{
+  CAMLparam3(r, n, d);
+  if (! Long_val(d))
+    division_by_zero();
+  mpf_div_ui(*mpf_val(r), *mpf_val(n), Long_val(d));
+  CAMLreturn(Val_unit);
+}
+
+value _mlgmp_f2_ui_div(value r, value n, value d)
+{
+  CAMLparam3(r, n, d);
+  if (! mpf_sgn(*mpf_val(d)))
+    division_by_zero();
+  mpf_ui_div(*mpf_val(r), Long_val(n), *mpf_val(d));
+  CAMLreturn(Val_unit);
+}
+
 f_binary_ui_op(ui_sub)
+f_binary_op_ui(pow_ui)
+f_binary_op_ui(mul_2exp)
+f_binary_op_ui(div_2exp)
+
+value _mlgmp_f_sqrt(value prec, value a)
+{
+  CAMLparam2(prec, a);
+  CAMLlocal1(r);
+  if (mpf_sgn(*mpf_val(a)) < 0)
+    caml_invalid_argument(MODULE "sqrt");
+  r = alloc_init_mpf(prec);
+  mpf_sqrt(*mpf_val(r), *mpf_val(a));
+  CAMLreturn(r);
+}
+
+value _mlgmp_f2_sqrt(value r, value a)
+{
+  CAMLparam2(r, a);
+  if (mpf_sgn(*mpf_val(a)) < 0)
+    caml_invalid_argument("Gmp.F2.sqrt");
+  mpf_sqrt(*mpf_val(r), *mpf_val(a));
+  CAMLreturn(Val_unit);
+}
 
 f_unary_op(neg)
 f_unary_op(abs)
@@ -232,10 +393,25 @@ int _mlgmp_f_custom_compare(value a, value b)
   CAMLreturn(mpf_cmp(*mpf_val(a), *mpf_val(b)));
 }
 
+/* Consistent with mpf_cmp: equal values with different precisions only
+   differ by low zero limbs, which hash_limbs ignores. */
+long _mlgmp_f_hash(value v)
+{
+  mpf_srcptr f = *mpf_val(v);
+  if (f->_mp_size == 0) return 0;
+  return hash_limbs(caml_hash_mix_uint32((uint32_t) f->_mp_exp,
+					 (uint32_t) (f->_mp_size < 0)),
+		    f->_mp_d, f->_mp_size < 0 ? - f->_mp_size : f->_mp_size);
+}
+
+intnat _mlgmp_f_cmp_untagged(value a, value b)
+{
+  return mpf_cmp(*mpf_val(a), *mpf_val(b));
+}
+
 value _mlgmp_f_cmp(value a, value b)
 {
-  CAMLparam2(a, b);
-  CAMLreturn(Val_int(mpf_cmp(*mpf_val(a), *mpf_val(b))));
+  return Val_int(_mlgmp_f_cmp_untagged(a, b));
 }
 
 value _mlgmp_f_cmp_si(value a, value b)
@@ -244,17 +420,24 @@ value _mlgmp_f_cmp_si(value a, value b)
   CAMLreturn(Val_int(mpf_cmp_si(*mpf_val(a), Long_val(b))));
 }
 
+intnat _mlgmp_f_sgn_untagged(value a)
+{
+  return mpf_sgn(*mpf_val(a));
+}
+
 value _mlgmp_f_sgn(value a)
 {
-  CAMLparam1(a);
-  CAMLreturn(Val_int(mpf_sgn(*mpf_val(a))));
+  return Val_int(_mlgmp_f_sgn_untagged(a));
+}
+
+value _mlgmp_f_eq_untagged(value a, value b, intnat nbits)
+{
+  return mpf_eq(*mpf_val(a), *mpf_val(b), nbits) ? Val_true : Val_false;
 }
 
 value _mlgmp_f_eq(value a, value b, value nbits)
 {
-  CAMLparam3(a, b, nbits);
-  CAMLreturn(mpf_eq(*mpf_val(a), *mpf_val(b), Int_val(nbits))
-	     ? Val_true : Val_false);
+  return _mlgmp_f_eq_untagged(a, b, Long_val(nbits));
 }
 
 f_binary_op_mpf(reldiff)
@@ -270,6 +453,13 @@ value _mlgmp_f_urandomb(value prec, value state, value nbits)
   CAMLreturn(r);
 }
 
+value _mlgmp_f2_urandomb(value r, value state, value nbits)
+{
+  CAMLparam3(r, state, nbits);
+  mpf_urandomb(*mpf_val(r), *randstate_val(state), Int_val(nbits));
+  CAMLreturn(Val_unit);
+}
+
 value _mlgmp_f_random2(value prec, value nlimbs, value max_exp)
 {
   CAMLparam3(prec, nlimbs, max_exp);
@@ -289,41 +479,56 @@ value _mlgmp_f_initialize()
 }
 
 #ifdef SERIALIZE
+/* Binary format: precision, then the value as mantissa * 2^exponent. */
 void _mlgmp_f_serialize(value v,
 			unsigned long * wsize_32,
 			unsigned long * wsize_64)
 {
   CAMLparam1(v);
-  char *s;
-  int len;
-  mp_exp_t exponent;
-  char exponent_buf[10];
+  mpf_srcptr f = *mpf_val(v);
+  __mpz_struct mantissa;
 
   *wsize_32 = MPF_SIZE_ARCH32;
   *wsize_64 = MPF_SIZE_ARCH64;
 
-  caml_serialize_int_4(mpf_get_prec(*mpf_val(v)));
-
-  s = mpf_get_str (NULL, &exponent, 16, 0, *mpf_val(v));
-  len = strlen(s);
-  caml_serialize_int_4(len + 11);
-
-  caml_serialize_block_1("0.", 2);
-  caml_serialize_block_1(s, len);
-  free(s);
-
-  sprintf(exponent_buf, "@%08lx", (exponent & 0xFFFFFFFFUL));
-  caml_serialize_block_1(exponent_buf, 9);
+  mantissa._mp_alloc = f->_mp_prec + 1;
+  mantissa._mp_size = f->_mp_size;
+  mantissa._mp_d = f->_mp_d;
 
+  serialize_header();
+  caml_serialize_int_8(mpf_get_prec(f));
+  caml_serialize_int_8((int64_t) GMP_NUMB_BITS
+		       * (f->_mp_exp - (mp_exp_t) mpz_size(&mantissa)));
+  serialize_mpz(&mantissa);
   CAMLreturn0;
 }
 
 unsigned long _mlgmp_f_deserialize(void * dst)
 {
   char *s;
-  int len;
-
-  mpf_init2(*((mpf_t*) dst), caml_deserialize_uint_4());
+  uint32_t len;
+
+  if (deserialize_header(&len))
+    {
+      int64_t exponent;
+      mpz_t mantissa;
+
+      mpf_init2(*((mpf_t*) dst), caml_deserialize_sint_8());
+      exponent = caml_deserialize_sint_8();
+      mpz_init(mantissa);
+      deserialize_mpz(mantissa);
+      mpf_set_z(*((mpf_t*) dst), mantissa);
+      mpz_clear(mantissa);
+      if (exponent >= 0)
+	mpf_mul_2exp(*((mpf_t*) dst), *((mpf_t*) dst), exponent);
+      else
+	mpf_div_2exp(*((mpf_t*) dst), *((mpf_t*) dst), - exponent);
+      stat_alloc(STAT_F, (*((mpf_t*) dst))->_mp_prec + 1);
+      return sizeof(mpf_t);
+    }
+
+  /* Old hex format: len is the precision */
+  mpf_init2(*((mpf_t*) dst), len);
 
   len = caml_deserialize_uint_4();
   s = malloc(len+1);
@@ -331,6 +536,7 @@ unsigned long _mlgmp_f_deserialize(void * dst)
   s[len] = 0;
   mpf_set_str (*((mpf_t*) dst), s, 16);
   free(s);
+  stat_alloc(STAT_F, (*((mpf_t*) dst))->_mp_prec + 1);
 
   return sizeof(mpf_t);
 }
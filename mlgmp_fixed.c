@@ -0,0 +1,422 @@
+#include <caml/mlvalues.h>
+#include <caml/custom.h>
+#include <caml/alloc.h>
+#include <caml/memory.h>
+#include <caml/fail.h>
+#include <caml/callback.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "config.h"
+#include "mlgmp.h"
+#include "conversions.c"
+
+/*** Fixed-width integers */
+
+/* Z128.t, Z256.t...: integers modulo 2^bits, read as two's complement
+   when signed.  Their limbs sit inline in custom blocks without
+   finalizer, which the runtime allocates on the minor heap.  The kernels
+   below take the limb count as a parameter; the stubs are generated per
+   width with it as a constant, so the compiler specializes them. */
+
+#if GMP_NUMB_BITS < 8 * SIZEOF_PTR
+#error "mlgmp: fixed-width integers need limbs at least as wide as an int"
+#endif
+
+#define fixed_limbs(bits) ((bits) / GMP_NUMB_BITS)
+#define fixed_val(v) ((mp_limb_t *) Data_custom_val(v))
+#define fixed_neg_p(d, n) ((d)[(n)-1] >> (GMP_NUMB_BITS - 1))
+
+static inline void fixed_add(mp_ptr r, mp_srcptr a, mp_srcptr b, int n)
+{
+  mp_limb_t c = 0;
+  int i;
+  for(i=0; i<n; i++)
+    {
+      mp_limb_t s = a[i] + c;
+      c = s < c;
+      s += b[i];
+      c += s < b[i];
+      r[i] = s;
+    }
+}
+
+static inline void fixed_sub(mp_ptr r, mp_srcptr a, mp_srcptr b, int n)
+{
+  mp_limb_t c = 0;
+  int i;
+  for(i=0; i<n; i++)
+    {
+      mp_limb_t x = a[i], d = x - b[i] - c;
+      c = x < b[i] || (x == b[i] && c);
+      r[i] = d;
+    }
+}
+
+static inline void fixed_neg(mp_ptr r, mp_srcptr a, int n)
+{
+  mp_limb_t c = 1;
+  int i;
+  for(i=0; i<n; i++)
+    {
+      mp_limb_t x = ~a[i] + c;
+      c = c && x == 0;
+      r[i] = x;
+    }
+}
+
+/* The low n limbs of the product. */
+static inline void fixed_mul(mp_ptr r, mp_srcptr a, mp_srcptr b, int n)
+{
+  mp_limb_t t[n];
+  int i;
+  mpn_mul_1(t, a, n, b[0]);
+  for(i=1; i<n; i++)
+    mpn_addmul_1(t + i, a, n - i, b[i]);
+  memcpy(r, t, n * sizeof(mp_limb_t));
+}
+
+#define fixed_logic(name, expr)						\
+static inline void fixed_##name(mp_ptr r, mp_srcptr a, mp_srcptr b, int n) \
+{									\
+  int i;								\
+  for(i=0; i<n; i++)							\
+    r[i] = expr;							\
+}
+
+fixed_logic(logand, a[i] & b[i])
+fixed_logic(logor, a[i] | b[i])
+fixed_logic(logxor, a[i] ^ b[i])
+
+static inline void fixed_lognot(mp_ptr r, mp_srcptr a, int n)
+{
+  int i;
+  for(i=0; i<n; i++)
+    r[i] = ~a[i];
+}
+
+/* Shifts by s < n GMP_NUMB_BITS bits.  Right shifts bring in the bits
+   of fill, which is 0 or all ones. */
+static inline void fixed_shift_left(mp_ptr r, mp_srcptr a, unsigned long s,
+				    int n)
+{
+  int k = s / GMP_NUMB_BITS, i;
+  unsigned b = s % GMP_NUMB_BITS;
+  for(i=n-1; i>=k; i--)
+    r[i] = a[i-k] << b | (b && i > k ? a[i-k-1] >> (GMP_NUMB_BITS - b) : 0);
+  for(; i>=0; i--)
+    r[i] = 0;
+}
+
+static inline void fixed_shift_right(mp_ptr r, mp_srcptr a, unsigned long s,
+				     mp_limb_t fill, int n)
+{
+  int k = s / GMP_NUMB_BITS, i;
+  unsigned b = s % GMP_NUMB_BITS;
+  for(i=0; i<n-k; i++)
+    r[i] = a[i+k] >> b
+      | (b ? (i+k+1 < n ? a[i+k+1] : fill) << (GMP_NUMB_BITS - b) : 0);
+  for(; i<n; i++)
+    r[i] = fill;
+}
+
+/* Unsigned comparison, then signed. */
+static inline int fixed_unsigned_compare(mp_srcptr a, mp_srcptr b, int n)
+{
+  int i;
+  for(i=n-1; i>=0; i--)
+    if (a[i] != b[i])
+      return a[i] < b[i] ? -1 : 1;
+  return 0;
+}
+
+static inline int fixed_compare(mp_srcptr a, mp_srcptr b, int n)
+{
+  mp_limb_t sa = fixed_neg_p(a, n), sb = fixed_neg_p(b, n);
+  if (sa != sb)
+    return sa ? -1 : 1;
+  return fixed_unsigned_compare(a, b, n);
+}
+
+/* Unsigned quotient and remainder, either of which may be NULL. */
+static void fixed_divmod(mp_ptr q, mp_ptr r, mp_srcptr a, mp_srcptr b, int n)
+{
+  mp_size_t na = n, nb = n;
+  mp_limb_t tq[n], tr[n];
+  while (nb > 0 && b[nb-1] == 0) nb--;
+  if (nb == 0)
+    division_by_zero();
+  while (na > 0 && a[na-1] == 0) na--;
+  memset(tq, 0, sizeof(tq));
+  memset(tr, 0, sizeof(tr));
+  if (na < nb)
+    memcpy(tr, a, n * sizeof(mp_limb_t));
+  else
+    mpn_tdiv_qr(tq, tr, 0, a, na, b, nb);
+  if (q) memcpy(q, tq, sizeof(tq));
+  if (r) memcpy(r, tr, sizeof(tr));
+}
+
+/* Low n limbs of z in two's complement. */
+static inline void fixed_of_mpz(mp_ptr r, mpz_srcptr z, int n)
+{
+  mp_size_t k = mpz_size(z);
+  if (k > n)
+    k = n;
+  memcpy(r, z->_mp_d, k * sizeof(mp_limb_t));
+  memset(r + k, 0, (n - k) * sizeof(mp_limb_t));
+  if (mpz_sgn(z) < 0)
+    fixed_neg(r, r, n);
+}
+
+static value fixed_to_z(mp_srcptr a, int n, int is_signed)
+{
+  mp_limb_t t[n];
+  __mpz_struct zt;
+  mpz_t r;
+  int neg = is_signed && fixed_neg_p(a, n);
+  if (neg)
+    fixed_neg(t, a, n);
+  else
+    memcpy(t, a, n * sizeof(mp_limb_t));
+  mpz_init_set(r, mpz_roinit_n(&zt, t, n));
+  if (neg)
+    mpz_neg(r, r);
+  return wrap_mpz(r);
+}
+
+#ifdef SERIALIZE
+/* Limbs as 64-bit words, least significant first; n GMP_NUMB_BITS bits
+   are a whole number of words for the widths below. */
+static void fixed_serialize(mp_srcptr d, int n)
+{
+#if GMP_NUMB_BITS == 64
+  caml_serialize_block_8((void *) d, n);
+#elif GMP_NUMB_BITS == 32
+  int i;
+  for(i = 0; i < n; i += 2)
+    caml_serialize_int_8((int64_t) ((uint64_t) d[i+1] << 32 | d[i]));
+#else
+#error "mlgmp: serialization needs 32-bit or 64-bit limbs"
+#endif
+}
+
+static void fixed_deserialize(mp_ptr d, int n)
+{
+#if GMP_NUMB_BITS == 64
+  caml_deserialize_block_8(d, n);
+#else
+  int i;
+  for(i = 0; i < n; i += 2)
+    {
+      uint64_t w = caml_deserialize_uint_8();
+      d[i] = (mp_limb_t) w;
+      d[i+1] = (mp_limb_t) (w >> 32);
+    }
+#endif
+}
+#endif
+
+/**** Per-width stubs */
+
+#define fixed_alloc(bits) \
+  caml_alloc_custom(&_mlgmp_custom_z##bits, (bits) / 8, 0, 1)
+
+#ifdef SERIALIZE
+#define fixed_serialization(bits)					\
+static void _mlgmp_z##bits##_serialize(value v,				\
+				       unsigned long *wsize_32,		\
+				       unsigned long *wsize_64)		\
+{									\
+  *wsize_32 = *wsize_64 = (bits) / 8;					\
+  fixed_serialize(fixed_val(v), fixed_limbs(bits));			\
+}									\
+									\
+static unsigned long _mlgmp_z##bits##_deserialize(void *dst)		\
+{									\
+  fixed_deserialize((mp_ptr) dst, fixed_limbs(bits));			\
+  return (bits) / 8;							\
+}
+#define fixed_serialize_field(bits)					\
+    field(serialize)   &_mlgmp_z##bits##_serialize,			\
+    field(deserialize) &_mlgmp_z##bits##_deserialize,
+#else
+#define fixed_serialization(bits)
+#define fixed_serialize_field(bits)					\
+    field(serialize)   custom_serialize_default,			\
+    field(deserialize) custom_deserialize_default,
+#endif
+
+#define fixed_custom(bits)						\
+static int _mlgmp_z##bits##_custom_compare(value a, value b)		\
+{									\
+  return fixed_compare(fixed_val(a), fixed_val(b), fixed_limbs(bits));	\
+}									\
+									\
+static long _mlgmp_z##bits##_hash(value v)				\
+{									\
+  return hash_limbs(0, fixed_val(v), fixed_limbs(bits));		\
+}									\
+									\
+fixed_serialization(bits)						\
+									\
+struct custom_operations _mlgmp_custom_z##bits =			\
+  {									\
+    field(identifier)  "Gmp.Z" #bits ".t",				\
+    field(finalize)    custom_finalize_default,				\
+    field(compare)     &_mlgmp_z##bits##_custom_compare,		\
+    field(hash)        &_mlgmp_z##bits##_hash,				\
+    fixed_serialize_field(bits)						\
+  };
+
+#define fixed_binary_op(bits, op)					\
+value _mlgmp_z##bits##_##op(value a, value b)				\
+{									\
+  CAMLparam2(a, b);							\
+  CAMLlocal1(r);							\
+  r = fixed_alloc(bits);						\
+  fixed_##op(fixed_val(r), fixed_val(a), fixed_val(b), fixed_limbs(bits)); \
+  CAMLreturn(r);							\
+}
+
+#define fixed_unary_op(bits, op)					\
+value _mlgmp_z##bits##_##op(value a)					\
+{									\
+  CAMLparam1(a);							\
+  CAMLlocal1(r);							\
+  r = fixed_alloc(bits);						\
+  fixed_##op(fixed_val(r), fixed_val(a), fixed_limbs(bits));		\
+  CAMLreturn(r);							\
+}
+
+#define fixed_division_op(bits, name, q, r)				\
+value _mlgmp_z##bits##_##name(value a, value b)				\
+{									\
+  CAMLparam2(a, b);							\
+  CAMLlocal1(x);							\
+  x = fixed_alloc(bits);						\
+  fixed_divmod(q, r, fixed_val(a), fixed_val(b), fixed_limbs(bits));	\
+  CAMLreturn(x);							\
+}
+
+/* See mlgmp_z.c for the _untagged stubs. */
+#define fixed_compare_op(bits, op)					\
+intnat _mlgmp_z##bits##_##op##_untagged(value a, value b)		\
+{									\
+  return fixed_##op(fixed_val(a), fixed_val(b), fixed_limbs(bits));	\
+}									\
+									\
+value _mlgmp_z##bits##_##op(value a, value b)				\
+{									\
+  return Val_int(_mlgmp_z##bits##_##op##_untagged(a, b));		\
+}
+
+/* Shifts by bits or more give 0, or -1 for negative numbers shifted
+   right arithmetically. */
+#define fixed_shift_op(bits, op, fill)					\
+value _mlgmp_z##bits##_##op(value a, value s)				\
+{									\
+  CAMLparam2(a, s);							\
+  CAMLlocal1(r);							\
+  mp_ptr d;								\
+  mp_limb_t f;								\
+  if (Long_val(s) < 0)							\
+    caml_invalid_argument("Gmp.Z" #bits "." #op);			\
+  r = fixed_alloc(bits);						\
+  d = fixed_val(r);							\
+  f = fill;								\
+  if (Long_val(s) >= (bits))						\
+    {									\
+      int i;								\
+      for(i=0; i<fixed_limbs(bits); i++)				\
+	d[i] = f;							\
+    }									\
+  else									\
+    fixed_shift(op, d, fixed_val(a), Long_val(s), f, fixed_limbs(bits)); \
+  CAMLreturn(r);							\
+}
+
+#define fixed_shift(op, r, a, s, f, n) fixed_shift_##op(r, a, s, f, n)
+#define fixed_shift_shift_left(r, a, s, f, n) fixed_shift_left(r, a, s, n)
+#define fixed_shift_shift_right(r, a, s, f, n) fixed_shift_right(r, a, s, f, n)
+#define fixed_shift_shift_right_logical(r, a, s, f, n) \
+  fixed_shift_right(r, a, s, 0, n)
+
+#define fixed_type(bits)						\
+fixed_custom(bits)							\
+fixed_binary_op(bits, add)						\
+fixed_binary_op(bits, sub)						\
+fixed_binary_op(bits, mul)						\
+fixed_binary_op(bits, logand)						\
+fixed_binary_op(bits, logor)						\
+fixed_binary_op(bits, logxor)						\
+fixed_unary_op(bits, neg)						\
+fixed_unary_op(bits, lognot)						\
+fixed_division_op(bits, unsigned_div, fixed_val(x), NULL)		\
+fixed_division_op(bits, unsigned_rem, NULL, fixed_val(x))		\
+fixed_compare_op(bits, compare)						\
+fixed_compare_op(bits, unsigned_compare)				\
+fixed_shift_op(bits, shift_left, 0)					\
+fixed_shift_op(bits, shift_right,					\
+	       fixed_neg_p(fixed_val(a), fixed_limbs(bits)) ? ~(mp_limb_t) 0 : 0) \
+fixed_shift_op(bits, shift_right_logical, 0)				\
+									\
+value _mlgmp_z##bits##_equal(value a, value b)				\
+{									\
+  return Val_bool(memcmp(fixed_val(a), fixed_val(b), (bits) / 8) == 0);	\
+}									\
+									\
+value _mlgmp_z##bits##_of_int(value v)					\
+{									\
+  value r = fixed_alloc(bits);						\
+  mp_ptr d = fixed_val(r);						\
+  int i;								\
+  d[0] = (mp_limb_t) Long_val(v);					\
+  for(i=1; i<fixed_limbs(bits); i++)					\
+    d[i] = Long_val(v) < 0 ? ~(mp_limb_t) 0 : 0;			\
+  return r;								\
+}									\
+									\
+intnat _mlgmp_z##bits##_to_int_untagged(value a)			\
+{									\
+  return (intnat) fixed_val(a)[0];					\
+}									\
+									\
+value _mlgmp_z##bits##_to_int(value a)					\
+{									\
+  return Val_long(_mlgmp_z##bits##_to_int_untagged(a));			\
+}									\
+									\
+value _mlgmp_z##bits##_of_z(value z)					\
+{									\
+  CAMLparam1(z);							\
+  CAMLlocal1(r);							\
+  mpz_small_t sz;							\
+  r = fixed_alloc(bits);						\
+  fixed_of_mpz(fixed_val(r), mpz_src(z, sz), fixed_limbs(bits));	\
+  CAMLreturn(r);							\
+}									\
+									\
+value _mlgmp_z##bits##_to_z(value a)					\
+{									\
+  CAMLparam1(a);							\
+  CAMLreturn(fixed_to_z(fixed_val(a), fixed_limbs(bits), 1));		\
+}									\
+									\
+value _mlgmp_z##bits##_to_z_unsigned(value a)				\
+{									\
+  CAMLparam1(a);							\
+  CAMLreturn(fixed_to_z(fixed_val(a), fixed_limbs(bits), 0));		\
+}
+
+fixed_type(128)
+fixed_type(256)
+
+value _mlgmp_fixed_initialize(void)
+{
+  CAMLparam0();
+  caml_register_custom_operations(& _mlgmp_custom_z128);
+  caml_register_custom_operations(& _mlgmp_custom_z256);
+  CAMLreturn(Val_unit);
+}
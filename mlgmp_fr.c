@@ -22,11 +22,14 @@
 void _mlgmp_fr_finalize(value r)
 {
 #ifdef USE_MPFR
+  stat_free(STAT_FR, mpfr_prec_limbs(mpfr_get_prec(*mpfr_val(r))));
+  census_unregister(r, sizeof(mpfr_t));
   mpfr_clear(*mpfr_val(r));
 #endif
 }
 
 int _mlgmp_fr_custom_compare(value a, value b);
+long _mlgmp_fr_hash(value v);
 
 void _mlgmp_fr_serialize(value v,
 			unsigned long * wsize_32,
@@ -35,10 +38,10 @@ unsigned long _mlgmp_fr_deserialize(void * dst);
 
 struct custom_operations _mlgmp_custom_fr =
   {
-    field(identifier)  "Gmp.F.t",
+    field(identifier)  "Gmp.FR.t",
     field(finalize)    &_mlgmp_fr_finalize,
     field(compare)     &_mlgmp_fr_custom_compare,
-    field(hash)        custom_hash_default,
+    field(hash)        &_mlgmp_fr_hash,
 #if defined(SERIALIZE) && defined(USE_MPFR)
     field(serialize)   &_mlgmp_fr_serialize,
     field(deserialize) &_mlgmp_fr_deserialize
@@ -63,8 +66,9 @@ value _mlgmp_fr_from_z(value prec, value mode, value a)
 #ifdef USE_MPFR
   CAMLparam2(prec, a);
   CAMLlocal1(r);
+  mpz_small_t sa;
   r=alloc_init_mpfr(prec);
-  mpfr_set_z(*mpfr_val(r), *mpz_val(a), Mode_val(mode));
+  mpfr_set_z(*mpfr_val(r), mpz_src(a, sa), Mode_val(mode));
   CAMLreturn(r);
 #else
   unimplemented(from_z);
@@ -97,42 +101,138 @@ value _mlgmp_fr_from_si(value prec, value mode, value a)
 #endif
 }
 
+/* See mlgmp_z.c for the _unboxed and _untagged stubs.  The [@@noalloc]
+   ones cannot raise Unimplemented without MPFR; they are never reached
+   then, since no FR.t can be made. */
+value _mlgmp_fr_from_float_unboxed(value prec, value mode, double d)
+{
+#ifdef USE_MPFR
+  value r=alloc_init_mpfr(prec);
+  mpfr_set_d(*mpfr_val(r), d, Mode_val(mode));
+  return r;
+#else
+  unimplemented(from_float);
+#endif
+}
+
 value _mlgmp_fr_from_float(value prec, value mode, value v)
+{
+  return _mlgmp_fr_from_float_unboxed(prec, mode, Double_val(v));
+}
+
+/* FR2.t accumulators keep the precision they were created with; all FR2
+   operations round to it. */
+value _mlgmp_fr_copy(value a)
 {
 #ifdef USE_MPFR
-  CAMLparam2(prec, v);
+  CAMLparam1(a);
   CAMLlocal1(r);
-  r=alloc_init_mpfr(prec);
-  mpfr_set_d(*mpfr_val(r), Double_val(v), Mode_val(mode));
+  r=alloc_init_mpfr(Val_int(mpfr_get_prec(*mpfr_val(a))));
+  mpfr_set(*mpfr_val(r), *mpfr_val(a), GMP_RNDN);
   CAMLreturn(r);
 #else
-  unimplemented(from_float);
+  unimplemented(copy);
+#endif
+}
+
+value _mlgmp_fr2_set(value r, value mode, value a)
+{
+#ifdef USE_MPFR
+  CAMLparam2(r, a);
+  mpfr_set(*mpfr_val(r), *mpfr_val(a), Mode_val(mode));
+  CAMLreturn(Val_unit);
+#else
+  unimplemented(set);
+#endif
+}
+
+value _mlgmp_fr2_from_z(value r, value mode, value a)
+{
+#ifdef USE_MPFR
+  CAMLparam2(r, a);
+  mpz_small_t sa;
+  mpfr_set_z(*mpfr_val(r), mpz_src(a, sa), Mode_val(mode));
+  CAMLreturn(Val_unit);
+#else
+  unimplemented(from_z);
+#endif
+}
+
+value _mlgmp_fr2_from_q(value r, value mode, value a)
+{
+#ifdef USE_MPFR
+  CAMLparam2(r, a);
+  mpfr_set_q(*mpfr_val(r), *mpq_val(a), Mode_val(mode));
+  CAMLreturn(Val_unit);
+#else
+  unimplemented(from_q);
+#endif
+}
+
+value _mlgmp_fr2_from_si(value r, value mode, value a)
+{
+#ifdef USE_MPFR
+  CAMLparam2(r, a);
+  mpfr_set_si(*mpfr_val(r), Long_val(a), Mode_val(mode));
+  CAMLreturn(Val_unit);
+#else
+  unimplemented(from_si);
+#endif
+}
+
+value _mlgmp_fr2_from_float_unboxed(value r, value mode, double d)
+{
+#ifdef USE_MPFR
+  mpfr_set_d(*mpfr_val(r), d, Mode_val(mode));
+#endif
+  return Val_unit;
+}
+
+value _mlgmp_fr2_from_float(value r, value mode, value v)
+{
+  return _mlgmp_fr2_from_float_unboxed(r, mode, Double_val(v));
+}
+
+value _mlgmp_fr2_from_string(value r, value mode, value base, value str)
+{
+#ifdef USE_MPFR
+  CAMLparam4(r, mode, base, str);
+  mpfr_set_str(*mpfr_val(r), String_val(str), Int_val(base), Mode_val(mode));
+  CAMLreturn(Val_unit);
+#else
+  unimplemented(from_string);
 #endif
 }
 
 /*** Conversions */
 
-value _mlgmp_fr_to_float(value mode, value v)
+double _mlgmp_fr_to_float_unboxed(value mode, value v)
 {
 #ifdef USE_MPFR
-  CAMLparam1(v);
-  CAMLlocal1(r);
-  r = caml_copy_double(mpfr_get_d(*mpfr_val(v), Mode_val(mode)));
-  CAMLreturn(r);
+  return mpfr_get_d(*mpfr_val(v), Mode_val(mode));
 #else
-  unimplemented(to_float);
+  return 0.;
 #endif
 }
 
+value _mlgmp_fr_to_float(value mode, value v)
+{
+  return caml_copy_double(_mlgmp_fr_to_float_unboxed(mode, v));
+}
+
 value _mlgmp_fr_to_z_exp(value v)
 {
 #ifdef USE_MPFR
   CAMLparam1(v);
   CAMLlocal2(r, z);
+  mpz_t mz;
+  long exponent;
+  mpz_init(mz);
+  exponent = mpfr_get_z_exp(mz, *mpfr_val(v));
+  z = wrap_mpz(mz);
   r = caml_alloc_tuple(2);
-  z = alloc_init_mpz();
   Store_field(r, 0, z);
-  Store_field(r, 1, Val_int(mpfr_get_z_exp(*mpz_val(z), *mpfr_val(v))));
+  Store_field(r, 1, Val_int(exponent));
   CAMLreturn(r);
 #else
   unimplemented(to_z_exp);
@@ -146,11 +246,19 @@ value _mlgmp_fr_to_string_exp_base_digits(value mode,
   CAMLparam4(mode, base, digits, val);
   CAMLlocal2(r, rs);
   mp_exp_t exponent;
-  char *s= mpfr_get_str(NULL, &exponent, Int_val(base), Int_val(digits),
-		       *mpfr_val(val), Mode_val(mode));
-  rs=caml_alloc_string(strlen(s));
-  strcpy((char*) String_val(rs), s);
-  free(s);
+  size_t size = Int_val(digits);
+  if (Int_val(base) < 2 || Int_val(base) > 62 || Int_val(digits) < 0)
+    caml_invalid_argument("Gmp.FR.to_string_exp_base_digits");
+  /* As many digits as the precision warrants when digits is 0; room is
+     also needed for "-@Inf@" */
+  if (size == 0)
+    size = mantissa_digits(mpfr_get_prec(*mpfr_val(val)), Int_val(base));
+  if (size < 5)
+    size = 5;
+  rs=caml_alloc_string(size + 2);
+  mpfr_get_str((char*) String_val(rs), &exponent, Int_val(base),
+	       Int_val(digits), *mpfr_val(val), Mode_val(mode));
+  rs=trim_string(rs, strlen(String_val(rs)));
   r=caml_alloc_tuple(2);
   Store_field(r, 0, rs);
   Store_field(r, 1, Val_int(exponent));
@@ -173,6 +281,44 @@ value _mlgmp_fr_from_string(value prec, value mode, value base, value str)
 #endif
 }
 
+/* mpfr_strtofr needs a NUL at the end, so the substring is copied, but
+   in C memory only. */
+value _mlgmp_fr_from_substring(value prec, value mode, value base,
+			       value s, value pos, value len)
+{
+#ifdef USE_MPFR
+  CAMLparam5(prec, mode, base, s, pos);
+  CAMLxparam1(len);
+  CAMLlocal1(r);
+  char stack[PARSE_STACK_DIGITS + 1], *str, *end;
+  size_t n = Long_val(len);
+  int ok;
+  check_substring(s, pos, len, "Gmp.FR.of_substring");
+  if (Int_val(base) < 2 || Int_val(base) > 62)
+    caml_invalid_argument("Gmp.FR.of_substring");
+  r=alloc_init_mpfr(prec);
+  str = n <= PARSE_STACK_DIGITS ? stack : malloc(n + 1);
+  if (str == NULL)
+    caml_raise_out_of_memory();
+  memcpy(str, String_val(s) + Long_val(pos), n);
+  str[n] = 0;
+  mpfr_strtofr(*mpfr_val(r), str, &end, Int_val(base), Mode_val(mode));
+  ok = n > 0 && end == str + n;
+  if (str != stack) free(str);
+  if (!ok)
+    caml_invalid_argument("Gmp.FR.of_substring");
+  CAMLreturn(r);
+#else
+  unimplemented(from_substring);
+#endif
+}
+
+value _mlgmp_fr_from_substring_bytecode(value *argv, int argn)
+{
+  return _mlgmp_fr_from_substring(argv[0], argv[1], argv[2],
+				  argv[3], argv[4], argv[5]);
+}
+
 /*** Operations */
 /**** Arithmetic */
 
@@ -182,83 +328,248 @@ value _mlgmp_fr_from_string(value prec, value mode, value base, value str)
 value _mlgmp_fr_##op(value prec, value mode, value a, value b)	\
 {							\
   CAMLparam3(prec, a, b);                               \
+  trace(op);                                            \
   CAMLlocal1(r);                                        \
   r=alloc_init_mpfr(prec);	       		        \
   mpfr_##op(*mpfr_val(r), *mpfr_val(a), *mpfr_val(b), Mode_val(mode));	\
   CAMLreturn(r);	       				\
+}							\
+							\
+value _mlgmp_fr2_##op(value r, value mode, value a, value b)	\
+{							\
+  CAMLparam3(r, a, b);                                  \
+  trace_name("Gmp.FR2." #op);                           \
+  mpfr_##op(*mpfr_val(r), *mpfr_val(a), *mpfr_val(b), Mode_val(mode));	\
+  CAMLreturn(Val_unit);	       				\
 }
 
 #define fr_binary_op_ui(op)	       			\
 value _mlgmp_fr_##op(value prec, value mode, value a, value b)	\
 {							\
   CAMLparam3(prec, a, b);                               \
+  trace(op);                                            \
   CAMLlocal1(r);                                        \
   r=alloc_init_mpfr(prec);	       		        \
   mpfr_##op(*mpfr_val(r), *mpfr_val(a), Long_val(b), Mode_val(mode));	\
   CAMLreturn(r);	       				\
+}							\
+							\
+value _mlgmp_fr2_##op(value r, value mode, value a, value b)	\
+{							\
+  CAMLparam3(r, a, b);                                  \
+  trace_name("Gmp.FR2." #op);                           \
+  mpfr_##op(*mpfr_val(r), *mpfr_val(a), Long_val(b), Mode_val(mode));	\
+  CAMLreturn(Val_unit);	       				\
 }
 
 #define fr_binary_ui_op(op)	       			\
 value _mlgmp_fr_##op(value prec, value mode, value a, value b)	\
 {							\
   CAMLparam3(prec, a, b);                               \
+  trace(op);                                            \
   CAMLlocal1(r);                                        \
   r=alloc_init_mpfr(prec);	       		        \
   mpfr_##op(*mpfr_val(r), Long_val(a), *mpfr_val(b), Mode_val(mode));	\
   CAMLreturn(r);	       				\
+}							\
+							\
+value _mlgmp_fr2_##op(value r, value mode, value a, value b)	\
+{							\
+  CAMLparam3(r, a, b);                                  \
+  trace_name("Gmp.FR2." #op);                           \
+  mpfr_##op(*mpfr_val(r), Long_val(a), *mpfr_val(b), Mode_val(mode));	\
+  CAMLreturn(Val_unit);	       				\
 }
 
 #define fr_unary_op(op)				\
 value _mlgmp_fr_##op(value prec, value mode, value a)	\
 {						\
   CAMLparam2(prec, a);				\
+  trace(op);                                    \
   CAMLlocal1(r);				\
   r=alloc_init_mpfr(prec);      			\
   mpfr_##op(*mpfr_val(r), *mpfr_val(a), Mode_val(mode));	    \
   CAMLreturn(r);				\
+}						\
+						\
+value _mlgmp_fr2_##op(value r, value mode, value a)	\
+{						\
+  CAMLparam2(r, a);				\
+  trace_name("Gmp.FR2." #op);                   \
+  mpfr_##op(*mpfr_val(r), *mpfr_val(a), Mode_val(mode));	    \
+  CAMLreturn(Val_unit);				\
 }
 
 #define fr_rounding_op(op)				\
 value _mlgmp_fr_##op(value prec, value a)	\
 {						\
   CAMLparam2(prec, a);				\
+  trace(op);                                    \
   CAMLlocal1(r);				\
   r=alloc_init_mpfr(prec);      			\
   mpfr_##op(*mpfr_val(r), *mpfr_val(a));	    \
   CAMLreturn(r);				\
+}						\
+						\
+value _mlgmp_fr2_##op(value r, value a)		\
+{						\
+  CAMLparam2(r, a);				\
+  trace_name("Gmp.FR2." #op);                   \
+  mpfr_##op(*mpfr_val(r), *mpfr_val(a));	    \
+  CAMLreturn(Val_unit);				\
+}
+
+/* Transcendental functions release the runtime lock at high precision. */
+#define fr_long_unary_op(op)				\
+value _mlgmp_fr_##op(value prec, value mode, value a)	\
+{							\
+  CAMLparam2(prec, a);					\
+  trace(op);                                            \
+  mpfr_t r;						\
+  __mpfr_struct xa = mpfr_detach(a);			\
+  mp_rnd_t rnd = Mode_val(mode);			\
+  mpfr_init2(r, Int_val(prec));				\
+  blocking_section(release_lock_p(mpfr_prec_limbs(Int_val(prec))),	\
+		   mpfr_##op(r, &xa, rnd));		\
+  CAMLreturn(wrap_mpfr(r));				\
+}							\
+							\
+value _mlgmp_fr2_##op(value r, value mode, value a)	\
+{							\
+  CAMLparam2(r, a);					\
+  trace_name("Gmp.FR2." #op);                           \
+  mp_rnd_t rnd = Mode_val(mode);			\
+  if (release_lock_p(mpfr_prec_limbs(mpfr_get_prec(*mpfr_val(r)))))	\
+    {							\
+      __mpfr_struct xa = mpfr_detach(a);		\
+      fr2_blocking_section(r, mpfr_##op, &xa, rnd);	\
+    }							\
+  else							\
+    mpfr_##op(*mpfr_val(r), *mpfr_val(a), rnd);		\
+  CAMLreturn(Val_unit);					\
+}
+
+#define fr_long_binary_op(op)					\
+value _mlgmp_fr_##op(value prec, value mode, value a, value b)	\
+{								\
+  CAMLparam3(prec, a, b);					\
+  trace(op);                                                    \
+  mpfr_t r;							\
+  __mpfr_struct xa = mpfr_detach(a), xb = mpfr_detach(b);	\
+  mp_rnd_t rnd = Mode_val(mode);				\
+  mpfr_init2(r, Int_val(prec));					\
+  blocking_section(release_lock_p(mpfr_prec_limbs(Int_val(prec))),	\
+		   mpfr_##op(r, &xa, &xb, rnd));		\
+  CAMLreturn(wrap_mpfr(r));					\
+}								\
+								\
+value _mlgmp_fr2_##op(value r, value mode, value a, value b)	\
+{								\
+  CAMLparam3(r, a, b);						\
+  trace_name("Gmp.FR2." #op);                                   \
+  mp_rnd_t rnd = Mode_val(mode);				\
+  if (release_lock_p(mpfr_prec_limbs(mpfr_get_prec(*mpfr_val(r)))))	\
+    {								\
+      __mpfr_struct xa = mpfr_detach(a), xb = mpfr_detach(b);	\
+      fr2_blocking_section(r, mpfr_##op, &xa, &xb, rnd);	\
+    }								\
+  else								\
+    mpfr_##op(*mpfr_val(r), *mpfr_val(a), *mpfr_val(b), rnd);	\
+  CAMLreturn(Val_unit);						\
+}
+
+/* a * b + c (fma) or a * b - c (fms), with a single rounding. */
+#define fr_ternary_op(op)					\
+value _mlgmp_fr_##op(value prec, value mode, value a, value b, value c) \
+{								\
+  CAMLparam4(prec, a, b, c);					\
+  trace(op);                                                    \
+  CAMLlocal1(r);						\
+  r=alloc_init_mpfr(prec);					\
+  mpfr_##op(*mpfr_val(r), *mpfr_val(a), *mpfr_val(b), *mpfr_val(c), \
+	    Mode_val(mode));					\
+  CAMLreturn(r);						\
+}								\
+								\
+value _mlgmp_fr2_##op(value r, value mode, value a, value b, value c) \
+{								\
+  CAMLparam4(r, a, b, c);					\
+  trace_name("Gmp.FR2." #op);                                   \
+  mpfr_##op(*mpfr_val(r), *mpfr_val(a), *mpfr_val(b), *mpfr_val(c), \
+	    Mode_val(mode));					\
+  CAMLreturn(Val_unit);						\
 }
 
 #else
 
 #define fr_binary_op_mpfr(op)	        		\
 value _mlgmp_fr_##op(value prec, value mode, value a, value b)	\
+{							\
+  unimplemented(op)                                     \
+}							\
+							\
+value _mlgmp_fr2_##op(value r, value mode, value a, value b)	\
 {							\
   unimplemented(op)                                     \
 }
 
 #define fr_binary_op_ui(op)	       			\
 value _mlgmp_fr_##op(value prec, value mode, value a, value b)	\
+{							\
+  unimplemented(op)                                     \
+}							\
+							\
+value _mlgmp_fr2_##op(value r, value mode, value a, value b)	\
 {							\
   unimplemented(op)                                     \
 }
 
 #define fr_binary_ui_op(op)	       			\
 value _mlgmp_fr_##op(value prec, value mode, value a, value b)	\
+{							\
+  unimplemented(op)                                     \
+}							\
+							\
+value _mlgmp_fr2_##op(value r, value mode, value a, value b)	\
 {							\
   unimplemented(op)                                     \
 }
 
 #define fr_unary_op(op)				\
 value _mlgmp_fr_##op(value prec, value mode, value a)	\
+{						\
+  unimplemented(op)                             \
+}						\
+						\
+value _mlgmp_fr2_##op(value r, value mode, value a)	\
 {						\
   unimplemented(op)                             \
 }
 
 #define fr_rounding_op(op)				\
 value _mlgmp_fr_##op(value prec, value mode, value a)	\
+{						\
+  unimplemented(op)                             \
+}						\
+						\
+value _mlgmp_fr2_##op(value r, value a)		\
+{						\
+  unimplemented(op)                             \
+}
+
+#define fr_ternary_op(op)				\
+value _mlgmp_fr_##op(value prec, value mode, value a, value b, value c) \
+{						\
+  unimplemented(op)                             \
+}						\
+						\
+value _mlgmp_fr2_##op(value r, value mode, value a, value b, value c) \
 {						\
   unimplemented(op)                             \
 }
+
+#define fr_long_unary_op(op) fr_unary_op(op)
+#define fr_long_binary_op(op) fr_binary_op_mpfr(op)
 #endif
 
 
@@ -274,28 +585,40 @@ fr_binary_ui_op(ui_sub)
 fr_binary_ui_op(ui_div)
 fr_binary_op_ui(mul_2ui)
 fr_binary_op_ui(div_2ui)
-fr_binary_op(pow)
+fr_binary_op_ui(pow_ui)
+fr_long_binary_op(pow)
 fr_binary_ui_op(ui_pow)
+fr_ternary_op(fma)
+fr_ternary_op(fms)
 
 fr_unary_op(neg)
 fr_unary_op(abs)
 
-fr_unary_op(sin)
-fr_unary_op(cos)
-fr_unary_op(tan)
-fr_unary_op(asin)
-fr_unary_op(acos)
-fr_unary_op(atan)
-fr_unary_op(sinh)
-fr_unary_op(cosh)
-fr_unary_op(tanh)
-fr_unary_op(asinh)
-fr_unary_op(acosh)
-fr_unary_op(atanh)
+fr_long_unary_op(sin)
+fr_long_unary_op(cos)
+fr_long_unary_op(tan)
+fr_long_unary_op(asin)
+fr_long_unary_op(acos)
+fr_long_unary_op(atan)
+fr_long_unary_op(sinh)
+fr_long_unary_op(cosh)
+fr_long_unary_op(tanh)
+fr_long_unary_op(asinh)
+fr_long_unary_op(acosh)
+fr_long_unary_op(atanh)
+
+fr_long_binary_op(atan2)
+fr_long_binary_op(hypot)
 
 fr_unary_op(sqrt)
-fr_unary_op(exp)
-fr_unary_op(exp2)
+fr_long_unary_op(cbrt)
+fr_long_unary_op(exp)
+fr_long_unary_op(exp2)
+fr_long_unary_op(expm1)
+fr_long_unary_op(log)
+fr_long_unary_op(log2)
+fr_long_unary_op(log10)
+fr_long_unary_op(log1p)
 
 fr_unary_op(rint)
 fr_rounding_op(ceil)
@@ -314,16 +637,37 @@ int _mlgmp_fr_custom_compare(value a, value b)
 #endif
 }
 
-value _mlgmp_fr_cmp(value a, value b)
+/* Zeros of both signs hash alike since mpfr_cmp finds them equal. */
+long _mlgmp_fr_hash(value v)
 {
 #ifdef USE_MPFR
-  CAMLparam2(a, b);
-  CAMLreturn(Val_int(mpfr_cmp(*mpfr_val(a), *mpfr_val(b))));
+  mpfr_srcptr x = *mpfr_val(v);
+  if (mpfr_nan_p(x)) return 1;
+  if (mpfr_zero_p(x)) return 0;
+  if (mpfr_inf_p(x)) return mpfr_sgn(x) > 0 ? 2 : 3;
+  return hash_limbs(caml_hash_mix_uint32((uint32_t) mpfr_get_exp(x),
+					 (uint32_t) (mpfr_sgn(x) < 0)),
+		    x->_mpfr_d,
+		    (mpfr_get_prec(x) + GMP_NUMB_BITS - 1) / GMP_NUMB_BITS);
 #else
-  unimplemented(create);
+  return 0;
+#endif
+}
+
+intnat _mlgmp_fr_cmp_untagged(value a, value b)
+{
+#ifdef USE_MPFR
+  return mpfr_cmp(*mpfr_val(a), *mpfr_val(b));
+#else
+  return 0;
 #endif
 }
 
+value _mlgmp_fr_cmp(value a, value b)
+{
+  return Val_int(_mlgmp_fr_cmp_untagged(a, b));
+}
+
 value _mlgmp_fr_cmp_si(value a, value b)
 {
 #ifdef USE_MPFR
@@ -334,37 +678,43 @@ value _mlgmp_fr_cmp_si(value a, value b)
 #endif
 }
 
-value _mlgmp_fr_sgn(value a)
+intnat _mlgmp_fr_sgn_untagged(value a)
 {
 #ifdef USE_MPFR
-  CAMLparam1(a);
-  CAMLreturn(Val_int(mpfr_sgn(*mpfr_val(a))));
+  return mpfr_sgn(*mpfr_val(a));
 #else
-  unimplemented(create);
+  return 0;
 #endif
 }
 
+value _mlgmp_fr_sgn(value a)
+{
+  return Val_int(_mlgmp_fr_sgn_untagged(a));
+}
+
 value _mlgmp_fr_is_nan(value a)
 {
 #ifdef USE_MPFR
-  CAMLparam1(a);
-  CAMLreturn(mpfr_nan_p(*mpfr_val(a)) ? Val_true : Val_false);
+  return mpfr_nan_p(*mpfr_val(a)) ? Val_true : Val_false;
 #else
-  unimplemented(create);
+  return Val_false;
 #endif
 }
 
-value _mlgmp_fr_eq(value a, value b, value nbits)
+value _mlgmp_fr_eq_untagged(value a, value b, intnat nbits)
 {
 #ifdef USE_MPFR
-  CAMLparam3(a, b, nbits);
-  CAMLreturn(mpfr_eq(*mpfr_val(a), *mpfr_val(b), Int_val(nbits))
-	     ? Val_true : Val_false);
+  return mpfr_eq(*mpfr_val(a), *mpfr_val(b), nbits) ? Val_true : Val_false;
 #else
-  unimplemented(create);
+  return Val_false;
 #endif
 }
 
+value _mlgmp_fr_eq(value a, value b, value nbits)
+{
+  return _mlgmp_fr_eq_untagged(a, b, Long_val(nbits));
+}
+
 fr_binary_op_mpfr(reldiff)
 
 
@@ -382,6 +732,17 @@ value _mlgmp_fr_urandomb(value prec, value state)
 #endif
 }
 
+value _mlgmp_fr2_urandomb(value r, value state)
+{
+#ifdef USE_MPFR
+  CAMLparam2(r, state);
+  mpfr_urandomb(*mpfr_val(r), *randstate_val(state));
+  CAMLreturn(Val_unit);
+#else
+  unimplemented(urandomb);
+#endif
+}
+
 /* Old mpfr - no longer exists in 3.0.1-p3
 value _mlgmp_fr_random(value prec)
 {
@@ -429,54 +790,102 @@ value _mlgmp_fr_initialize(void)
 {
 #ifdef USE_MPFR
   CAMLparam0();
-  caml_register_custom_operations(& _mlgmp_custom_f);
+  caml_register_custom_operations(& _mlgmp_custom_fr);
   CAMLreturn(Val_unit);
 #endif
 }
 
 #if defined(SERIALIZE) && defined(USE_MPFR)
+/* Binary format: precision, kind of number, sign, and for regular numbers
+   the value as mantissa * 2^exponent. */
+enum { FR_REGULAR, FR_ZERO, FR_INF, FR_NAN };
+
 void _mlgmp_fr_serialize(value v,
 			unsigned long * wsize_32,
 			unsigned long * wsize_64)
 {
   CAMLparam1(v);
-  char *s;
-  int len;
-  mp_exp_t exponent;
-  char exponent_buf[10];
+  mpfr_srcptr x = *mpfr_val(v);
 
   *wsize_32 = MPFR_SIZE_ARCH32;
   *wsize_64 = MPFR_SIZE_ARCH64;
 
-  caml_serialize_int_4(mpfr_get_prec(*mpfr_val(v)));
-
-  s = mpfr_get_str (NULL, &exponent, 16, 0, *mpfr_val(v), GMP_RNDN);
-  len = strlen(s);
-  caml_serialize_int_4(len + 11);
-
-  caml_serialize_block_1("0.", 2);
-  caml_serialize_block_1(s, len);
-  free(s);
-
-  sprintf(exponent_buf, "@%08lx", (exponent & 0xFFFFFFFFUL));
-  caml_serialize_block_1(exponent_buf, 9);
-
+  serialize_header();
+  caml_serialize_int_8(mpfr_get_prec(x));
+  if (mpfr_nan_p(x))
+    caml_serialize_int_1(FR_NAN);
+  else if (mpfr_inf_p(x))
+    caml_serialize_int_1(FR_INF);
+  else if (mpfr_zero_p(x))
+    caml_serialize_int_1(FR_ZERO);
+  else
+    caml_serialize_int_1(FR_REGULAR);
+  caml_serialize_int_1(mpfr_signbit(x) ? -1 : 1);
+
+  if (mpfr_number_p(x) && ! mpfr_zero_p(x))
+    {
+      mpz_t mantissa;
+      mpz_init(mantissa);
+      caml_serialize_int_8(mpfr_get_z_exp(mantissa, x));
+      serialize_mpz(mantissa);
+      mpz_clear(mantissa);
+    }
   CAMLreturn0;
 }
 
 unsigned long _mlgmp_fr_deserialize(void * dst)
 {
   char *s;
-  int len;
-
-  mpfr_init2(*((mpfr_t*) dst), caml_deserialize_uint_4());
+  uint32_t len;
+  mpfr_ptr x = *((mpfr_t*) dst);
+
+  if (deserialize_header(&len))
+    {
+      int kind, sign;
+
+      mpfr_init2(x, caml_deserialize_sint_8());
+      kind = caml_deserialize_uint_1();
+      sign = caml_deserialize_sint_1();
+      switch (kind)
+	{
+	case FR_NAN:
+	  mpfr_set_nan(x);
+	  break;
+	case FR_INF:
+	  mpfr_set_inf(x, sign);
+	  break;
+	case FR_ZERO:
+	  mpfr_set_ui(x, 0, GMP_RNDN);
+	  if (sign < 0) mpfr_neg(x, x, GMP_RNDN);
+	  break;
+	case FR_REGULAR:
+	  {
+	    int64_t exponent = caml_deserialize_sint_8();
+	    mpz_t mantissa;
+	    mpz_init(mantissa);
+	    deserialize_mpz(mantissa);
+	    mpfr_set_z(x, mantissa, GMP_RNDN);
+	    mpz_clear(mantissa);
+	    mpfr_mul_2si(x, x, exponent, GMP_RNDN);
+	    break;
+	  }
+	default:
+	  caml_deserialize_error("Gmp: bad FR.t kind");
+	}
+      stat_alloc(STAT_FR, mpfr_prec_limbs(mpfr_get_prec(x)));
+      return sizeof(mpfr_t);
+    }
+
+  /* Old hex format: len is the precision */
+  mpfr_init2(x, len);
 
   len = caml_deserialize_uint_4();
   s = malloc(len+1);
   caml_deserialize_block_1(s, len);
   s[len] = 0;
-  mpfr_set_str (*((mpfr_t*) dst), s, 16, GMP_RNDN);
+  mpfr_set_str (x, s, 16, GMP_RNDN);
   free(s);
+  stat_alloc(STAT_FR, mpfr_prec_limbs(mpfr_get_prec(x)));
 
   return sizeof(mpfr_t);
 }
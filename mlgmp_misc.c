@@ -13,6 +13,21 @@
 
 #define MODULE "Gmp."
 
+uintnat mlgmp_gc_ratio = 100;
+
+value _mlgmp_set_gc_ratio(value ratio)
+{
+  if (Long_val(ratio) < 0)
+    caml_invalid_argument("Gmp.set_gc_ratio");
+  mlgmp_gc_ratio = Long_val(ratio);
+  return Val_unit;
+}
+
+value _mlgmp_get_gc_ratio(value dummy)
+{
+  return Val_long(mlgmp_gc_ratio);
+}
+
 value _mlgmp_get_runtime_version(value dummy)
 {
   CAMLparam0();
@@ -51,3 +66,325 @@ void raise_unimplemented(char *s)
 {
   caml_raise_with_string(*caml_named_value("Gmp.Unimplemented"), s);
 }
+
+/* For bench_suite: n additions (op 0) or multiplications (op 1) straight
+   on the numbers behind a and b, giving the cost of GMP itself.  kind is
+   0 for Z.t, 1 for Q.t, 2 for F.t and 3 for FR.t. */
+value _mlgmp_bench_loop(value kind, value op, value a, value b, value n)
+{
+  CAMLparam5(kind, op, a, b, n);
+  intnat i, count = Long_val(n);
+  int mul = Int_val(op);
+  switch (Int_val(kind))
+    {
+    case 0:
+      {
+	mpz_small_t sa, sb;
+	mpz_srcptr za = mpz_src(a, sa), zb = mpz_src(b, sb);
+	mpz_t r;
+	mpz_init(r);
+	for(i=0; i<count; i++)
+	  if (mul) mpz_mul(r, za, zb); else mpz_add(r, za, zb);
+	mpz_clear(r);
+	break;
+      }
+    case 1:
+      {
+	mpq_t r;
+	mpq_init(r);
+	for(i=0; i<count; i++)
+	  if (mul) mpq_mul(r, *mpq_val(a), *mpq_val(b));
+	  else mpq_add(r, *mpq_val(a), *mpq_val(b));
+	mpq_clear(r);
+	break;
+      }
+    case 2:
+      {
+	mpf_t r;
+	mpf_init2(r, mpf_get_prec(*mpf_val(a)));
+	for(i=0; i<count; i++)
+	  if (mul) mpf_mul(r, *mpf_val(a), *mpf_val(b));
+	  else mpf_add(r, *mpf_val(a), *mpf_val(b));
+	mpf_clear(r);
+	break;
+      }
+    case 3:
+#ifdef USE_MPFR
+      {
+	mpfr_t r;
+	mpfr_init2(r, mpfr_get_prec(*mpfr_val(a)));
+	for(i=0; i<count; i++)
+	  if (mul) mpfr_mul(r, *mpfr_val(a), *mpfr_val(b), GMP_RNDN);
+	  else mpfr_add(r, *mpfr_val(a), *mpfr_val(b), GMP_RNDN);
+	mpfr_clear(r);
+	break;
+      }
+#else
+      raise_unimplemented(MODULE "bench_loop");
+#endif
+    default:
+      caml_invalid_argument(MODULE "bench_loop");
+    }
+  CAMLreturn(Val_unit);
+}
+
+/*** Statistics */
+
+#ifdef STATS
+struct stat_blocks mlgmp_stat_blocks[STAT_KINDS];
+atomic_ulong mlgmp_stat_bytes_grown;
+
+/* Sites are only ever pushed, so that the list may be read without a
+   lock. */
+static struct stat_site *_Atomic stat_sites;
+
+void mlgmp_stat_link(struct stat_site *s)
+{
+  int unlinked = 0;
+  if (atomic_compare_exchange_strong(&s->linked, &unlinked, 1))
+    {
+      s->next = atomic_load(&stat_sites);
+      while (! atomic_compare_exchange_weak(&stat_sites, &s->next, s));
+    }
+}
+#endif
+
+/* Gmp.Stats.blocks of a kind of numbers. */
+static value alloc_stat_blocks(enum stat_kind kind)
+{
+  value r = caml_alloc_tuple(4);
+#ifndef STATS
+  int i;
+  for(i=0; i<4; i++)
+    Store_field(r, i, Val_long(0));
+#else
+  Store_field(r, 0, Val_long(atomic_load(&mlgmp_stat_blocks[kind].allocated)));
+  Store_field(r, 1, Val_long(atomic_load(&mlgmp_stat_blocks[kind].finalized)));
+  Store_field(r, 2,
+	      Val_long(atomic_load(&mlgmp_stat_blocks[kind].bytes_allocated)));
+  Store_field(r, 3,
+	      Val_long(atomic_load(&mlgmp_stat_blocks[kind].bytes_freed)));
+#endif
+  return r;
+}
+
+/* The sites are listed from the last one reached first. */
+value _mlgmp_stats_snapshot(value dummy)
+{
+  CAMLparam0();
+  CAMLlocal4(r, stubs, stub, v);
+  int kind, n = 0;
+#ifdef STATS
+  struct stat_site *s, *first = atomic_load(&stat_sites);
+  for(s = first; s; s = s->next)
+    n++;
+#endif
+  stubs = caml_alloc_tuple(n);
+#ifdef STATS
+  for(s = first, n = 0; n < Wosize_val(stubs); s = s->next, n++)
+    {
+      stub = caml_alloc_tuple(3);
+      Store_field(stub, 1, Val_long(atomic_load(&s->calls)));
+      v = caml_copy_string(s->name);
+      Store_field(stub, 0, v);
+      v = caml_copy_double(atomic_load(&s->nanos) * 1e-9);
+      Store_field(stub, 2, v);
+      Store_field(stubs, n, stub);
+    }
+#endif
+  r = caml_alloc_tuple(8);
+#ifdef STATS
+  Store_field(r, 0, Val_true);
+#if defined(STATS_TIME) && defined(__GNUC__)
+  Store_field(r, 1, Val_true);
+#else
+  Store_field(r, 1, Val_false);
+#endif
+  Store_field(r, 7, Val_long(atomic_load(&mlgmp_stat_bytes_grown)));
+#else
+  Store_field(r, 0, Val_false);
+  Store_field(r, 1, Val_false);
+  Store_field(r, 7, Val_long(0));
+#endif
+  Store_field(r, 2, stubs);
+  for(kind = 0; kind < STAT_KINDS; kind++)
+    {
+      v = alloc_stat_blocks(kind);
+      Store_field(r, 3 + kind, v);
+    }
+  CAMLreturn(r);
+}
+
+value _mlgmp_stats_reset(value dummy)
+{
+#ifdef STATS
+  struct stat_site *s;
+  int kind;
+  for(s = atomic_load(&stat_sites); s; s = s->next)
+    {
+      atomic_store(&s->calls, 0);
+      atomic_store(&s->nanos, 0);
+    }
+  for(kind = 0; kind < STAT_KINDS; kind++)
+    {
+      atomic_store(&mlgmp_stat_blocks[kind].allocated, 0);
+      atomic_store(&mlgmp_stat_blocks[kind].finalized, 0);
+      atomic_store(&mlgmp_stat_blocks[kind].bytes_allocated, 0);
+      atomic_store(&mlgmp_stat_blocks[kind].bytes_freed, 0);
+    }
+  atomic_store(&mlgmp_stat_bytes_grown, 0);
+#endif
+  return Val_unit;
+}
+
+/*** Census */
+
+/* Blocks of 2^i to 2^(i+1)-1 limbs go to bucket i, empty ones to 0. */
+#define CENSUS_BUCKETS (8 * sizeof(mp_size_t))
+
+static const char *census_names[STAT_KINDS] = { "Z.t", "Q.t", "F.t", "FR.t" };
+
+#ifdef CENSUS
+#include <pthread.h>
+
+/* The list of live blocks and its summary, under census_lock, which is
+   never held across an OCaml allocation. */
+static pthread_mutex_t census_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct census_node *census_nodes;
+static intnat census_blocks[STAT_KINDS], census_limbs[STAT_KINDS];
+static intnat census_histogram[STAT_KINDS][CENSUS_BUCKETS];
+
+static int census_bucket(mp_size_t limbs)
+{
+  int b = 0;
+  while (limbs > 1)
+    {
+      limbs >>= 1;
+      b++;
+    }
+  return b;
+}
+
+static void census_count(struct census_node *n, int sign)
+{
+  census_blocks[n->kind] += sign;
+  census_limbs[n->kind] += sign * n->limbs;
+  census_histogram[n->kind][census_bucket(n->limbs)] += sign;
+}
+
+/* NULL, for a block that is not counted, when out of memory. */
+struct census_node *mlgmp_census_add(enum stat_kind kind, mp_size_t limbs)
+{
+  struct census_node *n = malloc(sizeof(struct census_node));
+  if (n == NULL)
+    return NULL;
+  n->kind = kind;
+  n->limbs = limbs;
+  n->prev = NULL;
+  pthread_mutex_lock(&census_lock);
+  n->next = census_nodes;
+  if (census_nodes != NULL)
+    census_nodes->prev = n;
+  census_nodes = n;
+  census_count(n, 1);
+  pthread_mutex_unlock(&census_lock);
+  return n;
+}
+
+void mlgmp_census_remove(struct census_node *n)
+{
+  pthread_mutex_lock(&census_lock);
+  census_count(n, -1);
+  if (n->prev != NULL)
+    n->prev->next = n->next;
+  else
+    census_nodes = n->next;
+  if (n->next != NULL)
+    n->next->prev = n->prev;
+  pthread_mutex_unlock(&census_lock);
+  free(n);
+}
+
+void mlgmp_census_resize(struct census_node *n, mp_size_t limbs)
+{
+  pthread_mutex_lock(&census_lock);
+  census_count(n, -1);
+  n->limbs = limbs;
+  census_count(n, 1);
+  pthread_mutex_unlock(&census_lock);
+}
+#endif
+
+/* Gmp.Census.t, with the count largest blocks. */
+value _mlgmp_census_take(value count)
+{
+  CAMLparam1(count);
+  CAMLlocal4(r, v, hist, entry);
+  intnat blocks[STAT_KINDS], limbs[STAT_KINDS];
+  intnat histogram[STAT_KINDS][CENSUS_BUCKETS];
+  struct census_node *top = NULL;
+  mlsize_t i, n = 0, wanted = Long_val(count);
+  int kind, len;
+
+  if (Long_val(count) < 0)
+    caml_invalid_argument(MODULE "Census.take");
+  memset(blocks, 0, sizeof(blocks));
+  memset(limbs, 0, sizeof(limbs));
+  memset(histogram, 0, sizeof(histogram));
+#ifdef CENSUS
+  if (wanted > 0)
+    {
+      top = malloc(wanted * sizeof(struct census_node));
+      if (top == NULL)
+	caml_raise_out_of_memory();
+    }
+  pthread_mutex_lock(&census_lock);
+  memcpy(blocks, census_blocks, sizeof(blocks));
+  memcpy(limbs, census_limbs, sizeof(limbs));
+  memcpy(histogram, census_histogram, sizeof(histogram));
+  if (wanted > 0)
+    {
+      struct census_node *s;
+      for(s = census_nodes; s != NULL; s = s->next)
+	if (n < wanted || s->limbs > top[n-1].limbs)
+	  {
+	    i = n < wanted ? n++ : n - 1;
+	    for(; i > 0 && top[i-1].limbs < s->limbs; i--)
+	      top[i] = top[i-1];
+	    top[i] = *s;
+	  }
+    }
+  pthread_mutex_unlock(&census_lock);
+#endif
+
+  r = caml_alloc_tuple(6);
+#ifdef CENSUS
+  Store_field(r, 0, Val_true);
+#else
+  Store_field(r, 0, Val_false);
+#endif
+  for(kind = 0; kind < STAT_KINDS; kind++)
+    {
+      for(len = CENSUS_BUCKETS; len > 0 && !histogram[kind][len-1]; len--);
+      hist = caml_alloc_tuple(len);
+      for(i = 0; i < len; i++)
+	Store_field(hist, i, Val_long(histogram[kind][i]));
+      v = caml_alloc_tuple(3);
+      Store_field(v, 0, Val_long(blocks[kind]));
+      Store_field(v, 1, Val_long(limbs[kind] * sizeof(mp_limb_t)));
+      Store_field(v, 2, hist);
+      Store_field(r, 1 + kind, v);
+    }
+  v = caml_alloc_tuple(n);
+  for(i = 0; i < n; i++)
+    {
+      entry = caml_alloc_tuple(2);
+      Store_field(entry, 1, Val_long(top[i].limbs * sizeof(mp_limb_t)));
+      hist = caml_copy_string(census_names[top[i].kind]);
+      Store_field(entry, 0, hist);
+      Store_field(v, i, entry);
+    }
+  Store_field(r, 5, v);
+  free(top);
+  CAMLreturn(r);
+}
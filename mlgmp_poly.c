@@ -0,0 +1,805 @@
+#include <caml/mlvalues.h>
+#include <caml/custom.h>
+#include <caml/alloc.h>
+#include <caml/memory.h>
+#include <caml/fail.h>
+#include <caml/callback.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "config.h"
+#include "mlgmp.h"
+#include "conversions.c"
+
+#define MODULE "Gmp.ZPoly."
+
+/*** Polynomials over Z */
+
+/* Coefficients c_0 ... c_{len-1}, the last one nonzero, in one malloc'd
+   array; the zero polynomial has len 0.  alloc coefficients are
+   initialized.  The arrays live in C memory, so that products can be
+   computed outside the runtime lock. */
+struct zpoly
+{
+  mlsize_t len, alloc;
+  mpz_t c[];
+};
+
+static struct zpoly *zpoly_new(mlsize_t len)
+{
+  mlsize_t i;
+  struct zpoly *p = malloc(sizeof(struct zpoly) + len * sizeof(mpz_t));
+  if (p == NULL)
+    caml_raise_out_of_memory();
+  p->len = p->alloc = len;
+  for(i=0; i<len; i++)
+    mpz_init(p->c[i]);
+  return p;
+}
+
+static void zpoly_free(struct zpoly *p)
+{
+  mlsize_t i;
+  if (p == NULL) return;
+  for(i=0; i<p->alloc; i++)
+    mpz_clear(p->c[i]);
+  free(p);
+}
+
+static void zpoly_trim(struct zpoly *p)
+{
+  while (p->len > 0 && mpz_sgn(p->c[p->len-1]) == 0)
+    p->len--;
+}
+
+static struct zpoly *zpoly_copy(const struct zpoly *a)
+{
+  mlsize_t i;
+  struct zpoly *r = zpoly_new(a->len);
+  for(i=0; i<a->len; i++)
+    mpz_set(r->c[i], a->c[i]);
+  return r;
+}
+
+static mp_size_t zpoly_limbs(const struct zpoly *p)
+{
+  mlsize_t i;
+  mp_size_t n = 0;
+  for(i=0; i<p->len; i++)
+    n += mpz_size(p->c[i]);
+  return n;
+}
+
+/* r = a + s b, for s = 1 or -1. */
+static struct zpoly *zpoly_addsub(const struct zpoly *a,
+				  const struct zpoly *b, int s)
+{
+  mlsize_t i, n = a->len > b->len ? a->len : b->len;
+  struct zpoly *r = zpoly_new(n);
+  for(i=0; i<n; i++)
+    {
+      if (i < a->len)
+	mpz_set(r->c[i], a->c[i]);
+      if (i < b->len)
+	{
+	  if (s > 0)
+	    mpz_add(r->c[i], r->c[i], b->c[i]);
+	  else
+	    mpz_sub(r->c[i], r->c[i], b->c[i]);
+	}
+    }
+  zpoly_trim(r);
+  return r;
+}
+
+static struct zpoly *zpoly_scale(mpz_srcptr x, const struct zpoly *a)
+{
+  mlsize_t i;
+  struct zpoly *r = zpoly_new(mpz_sgn(x) ? a->len : 0);
+  for(i=0; i<r->len; i++)
+    mpz_mul(r->c[i], a->c[i], x);
+  return r;
+}
+
+/* a divided by x, coefficientwise; returns 0 if some division is not
+   exact. */
+static int zpoly_divexact_z(struct zpoly *a, mpz_srcptr x)
+{
+  mlsize_t i;
+  if (mpz_cmp_ui(x, 1) == 0)
+    return 1;
+  for(i=0; i<a->len; i++)
+    {
+      if (!mpz_divisible_p(a->c[i], x))
+	return 0;
+      mpz_divexact(a->c[i], a->c[i], x);
+    }
+  return 1;
+}
+
+/**** Kronecker substitution */
+
+/* Products go through a single product of integers: a(2^k) b(2^k), with
+   k bits enough for the coefficients of the result and their sign.  The
+   coefficients are read back as balanced digits in base 2^k. */
+
+static mp_bitcnt_t zpoly_maxbits(const struct zpoly *p)
+{
+  mlsize_t i;
+  mp_bitcnt_t m = 0;
+  for(i=0; i<p->len; i++)
+    if (mpz_sgn(p->c[i]))
+      {
+	mp_bitcnt_t b = mpz_sizeinbase(p->c[i], 2);
+	if (b > m)
+	  m = b;
+      }
+  return m;
+}
+
+/* d |= s << off, d being large enough. */
+static void bits_or(mp_ptr d, mp_bitcnt_t off, mp_srcptr s, mp_size_t n)
+{
+  mp_size_t w = off / GMP_NUMB_BITS, j;
+  unsigned b = off % GMP_NUMB_BITS;
+  for(j=0; j<n; j++)
+    if (b == 0)
+      d[w+j] |= s[j];
+    else
+      {
+	d[w+j] |= s[j] << b;
+	d[w+j+1] |= s[j] >> (GMP_NUMB_BITS - b);
+      }
+}
+
+/* t = bits off ... off+k-1 of the n limbs of d. */
+static void bits_get(mpz_ptr t, mp_srcptr d, mp_size_t n,
+		     mp_bitcnt_t off, mp_bitcnt_t k)
+{
+  mp_size_t w = off / GMP_NUMB_BITS;
+  mp_size_t m = (k + GMP_NUMB_BITS - 1) / GMP_NUMB_BITS;
+  unsigned b = off % GMP_NUMB_BITS;
+  mp_ptr tp = mpz_limbs_write(t, m);
+  mp_size_t j;
+  for(j=0; j<m; j++)
+    {
+      mp_limb_t lo = w+j < n ? d[w+j] : 0, hi = w+j+1 < n ? d[w+j+1] : 0;
+      tp[j] = b ? lo >> b | hi << (GMP_NUMB_BITS - b) : lo;
+    }
+  if (k % GMP_NUMB_BITS)
+    tp[m-1] &= ((mp_limb_t) 1 << (k % GMP_NUMB_BITS)) - 1;
+  mpz_limbs_finish(t, m);
+}
+
+static void kronecker_pack(mpz_ptr v, const struct zpoly *p, mp_bitcnt_t k)
+{
+  mp_size_t n = (p->len * k) / GMP_NUMB_BITS + 2;
+  mp_ptr dp, dn;
+  mlsize_t i;
+  mpz_t neg;
+  mpz_init(neg);
+  dp = mpz_limbs_write(v, n);
+  dn = mpz_limbs_write(neg, n);
+  mpn_zero(dp, n);
+  mpn_zero(dn, n);
+  for(i=0; i<p->len; i++)
+    bits_or(mpz_sgn(p->c[i]) < 0 ? dn : dp, i * k,
+	    p->c[i]->_mp_d, mpz_size(p->c[i]));
+  mpz_limbs_finish(v, n);
+  mpz_limbs_finish(neg, n);
+  mpz_sub(v, v, neg);
+  mpz_clear(neg);
+}
+
+/* The r->len coefficients of r from v = r(2^k). */
+static void kronecker_unpack(struct zpoly *r, mpz_srcptr v, mp_bitcnt_t k)
+{
+  mp_srcptr d = v->_mp_d;
+  mp_size_t n = mpz_size(v);
+  int carry = 0, neg = mpz_sgn(v) < 0;
+  mlsize_t i;
+  mpz_t base;
+  mpz_init(base);
+  mpz_setbit(base, k);
+  for(i=0; i<r->len; i++)
+    {
+      mpz_ptr t = r->c[i];
+      bits_get(t, d, n, i * k, k);
+      if (carry)
+	mpz_add_ui(t, t, 1);
+      carry = mpz_sgn(t) && mpz_sizeinbase(t, 2) >= k;
+      if (carry)
+	mpz_sub(t, t, base);
+      if (neg)
+	mpz_neg(t, t);
+    }
+  mpz_clear(base);
+}
+
+/* r = a b, r having a->len + b->len - 1 coefficients; touches no OCaml
+   value. */
+static void zpoly_mul_into(struct zpoly *r, const struct zpoly *a,
+			   const struct zpoly *b)
+{
+  mlsize_t i, j, m = a->len < b->len ? a->len : b->len;
+  if (m < ZPOLY_KRONECKER_LENGTH)
+    {
+      for(i=0; i<r->len; i++)
+	mpz_set_ui(r->c[i], 0);
+      for(i=0; i<a->len; i++)
+	for(j=0; j<b->len; j++)
+	  mpz_addmul(r->c[i+j], a->c[i], b->c[j]);
+    }
+  else
+    {
+      mp_bitcnt_t k = zpoly_maxbits(a) + zpoly_maxbits(b) + 2;
+      mpz_t va, vb;
+      for(; m > 1; m >>= 1)
+	k++;
+      mpz_init(va);
+      mpz_init(vb);
+      kronecker_pack(va, a, k);
+      if (a == b)
+	mpz_mul(va, va, va);
+      else
+	{
+	  kronecker_pack(vb, b, k);
+	  mpz_mul(va, va, vb);
+	}
+      kronecker_unpack(r, va, k);
+      mpz_clear(va);
+      mpz_clear(vb);
+    }
+}
+
+static struct zpoly *zpoly_mul(const struct zpoly *a, const struct zpoly *b)
+{
+  struct zpoly *r;
+  if (a->len == 0 || b->len == 0)
+    return zpoly_new(0);
+  r = zpoly_new(a->len + b->len - 1);
+  zpoly_mul_into(r, a, b);
+  return r;
+}
+
+/* a b mod x^n */
+static struct zpoly *zpoly_mullo(const struct zpoly *a,
+				 const struct zpoly *b, mlsize_t n)
+{
+  struct zpoly *r = zpoly_mul(a, b);
+  if (r->len > n)
+    r->len = n;
+  zpoly_trim(r);
+  return r;
+}
+
+/**** Division */
+
+/* Pseudo-division: c^(m+1) a = q b + r, with c the leading coefficient
+   of b, m = deg a - deg b >= 0 and deg r < deg b.  Knuth's algorithm R
+   for short quotients or divisors; otherwise, q comes from the reversed
+   polynomials, whose quotient is rev(a) / rev(b) mod x^(m+1), with the
+   inverse of rev(b) from Newton's iteration.  I = c^k / rev(b) mod x^k
+   has integer coefficients, and going from k to k' <= 2k,
+     I' = I (2 c^k' - c^(k'-k) rev(b) I) / c^k  mod x^k'.
+   q is then c^(m+1) rev(rev(a) / rev(b) mod x^(m+1)). */
+
+static void zpoly_pseudo_divrem_basecase(struct zpoly **q, struct zpoly **r,
+					 const struct zpoly *a,
+					 const struct zpoly *b)
+{
+  mlsize_t n = b->len - 1, m = a->len - b->len, j;
+  long k;
+  mpz_srcptr c = b->c[n];
+  struct zpoly *qq = zpoly_new(m + 1), *rr = zpoly_copy(a);
+  mpz_t p;
+  for(k=m; k>=0; k--)
+    {
+      mpz_set(qq->c[k], rr->c[n+k]);
+      for(j=n+k; j-- > 0; )
+	{
+	  mpz_mul(rr->c[j], rr->c[j], c);
+	  if (j >= (mlsize_t) k)
+	    mpz_submul(rr->c[j], rr->c[n+k], b->c[j-k]);
+	}
+    }
+  mpz_init_set_ui(p, 1);
+  for(j=0; j<=m; j++)
+    {
+      mpz_mul(qq->c[j], qq->c[j], p);
+      mpz_mul(p, p, c);
+    }
+  mpz_clear(p);
+  rr->len = n;
+  zpoly_trim(rr);
+  *q = qq;
+  *r = rr;
+}
+
+/* The first n coefficients of the reverse of p. */
+static struct zpoly *zpoly_rev(const struct zpoly *p, mlsize_t n)
+{
+  mlsize_t i;
+  struct zpoly *r = zpoly_new(n);
+  for(i=0; i<n && i<p->len; i++)
+    mpz_set(r->c[i], p->c[p->len-1-i]);
+  zpoly_trim(r);
+  return r;
+}
+
+/* c^n / rb mod x^n, rb(0) = c. */
+static struct zpoly *zpoly_inverse(const struct zpoly *rb, mpz_srcptr c,
+				   mlsize_t n)
+{
+  struct zpoly *inv = zpoly_new(1), *t, *u;
+  mlsize_t k = 1, kk;
+  mpz_t ck, cd;
+  int steps = 0;
+  mlsize_t prec[8 * sizeof(mlsize_t)];
+  for(kk=n; kk>1; kk=(kk+1)/2)
+    prec[steps++] = kk;
+  mpz_set_ui(inv->c[0], 1);
+  mpz_init(ck);
+  mpz_init(cd);
+  while (steps-- > 0)
+    {
+      kk = prec[steps];
+      /* u = 2 c^kk - c^(kk-k) (rb inv mod x^kk) */
+      t = zpoly_mullo(rb, inv, kk);
+      mpz_pow_ui(cd, c, kk - k);
+      mpz_neg(cd, cd);
+      u = zpoly_scale(cd, t);
+      zpoly_free(t);
+      mpz_pow_ui(ck, c, kk);
+      mpz_addmul_ui(u->c[0], ck, 2);
+      zpoly_trim(u);
+      t = zpoly_mullo(inv, u, kk);
+      zpoly_free(u);
+      mpz_pow_ui(ck, c, k);
+      zpoly_divexact_z(t, ck);
+      zpoly_free(inv);
+      inv = t;
+      k = kk;
+    }
+  mpz_clear(ck);
+  mpz_clear(cd);
+  return inv;
+}
+
+static void zpoly_pseudo_divrem_newton(struct zpoly **q, struct zpoly **r,
+				       const struct zpoly *a,
+				       const struct zpoly *b)
+{
+  mlsize_t n = a->len - b->len + 1, i;
+  mpz_srcptr c = b->c[b->len-1];
+  struct zpoly *rb = zpoly_rev(b, n), *ra = zpoly_rev(a, n), *inv, *qr, *qq,
+    *ca, *qb;
+  mpz_t cn;
+  inv = zpoly_inverse(rb, c, n);
+  qr = zpoly_mullo(ra, inv, n);
+  zpoly_free(rb);
+  zpoly_free(ra);
+  zpoly_free(inv);
+  qq = zpoly_new(n);
+  for(i=0; i<qr->len; i++)
+    mpz_swap(qq->c[n-1-i], qr->c[i]);
+  zpoly_free(qr);
+  zpoly_trim(qq);
+  mpz_init(cn);
+  mpz_pow_ui(cn, c, n);
+  ca = zpoly_scale(cn, a);
+  mpz_clear(cn);
+  qb = zpoly_mul(qq, b);
+  *r = zpoly_addsub(ca, qb, -1);
+  zpoly_free(ca);
+  zpoly_free(qb);
+  *q = qq;
+}
+
+/* With deg a < deg b, q = 0 and r = a. */
+static void zpoly_pseudo_divrem(struct zpoly **q, struct zpoly **r,
+				const struct zpoly *a, const struct zpoly *b)
+{
+  if (b->len == 0)
+    division_by_zero();
+  if (a->len < b->len)
+    {
+      *q = zpoly_new(0);
+      *r = zpoly_copy(a);
+    }
+  else if (a->len - b->len + 1 < ZPOLY_NEWTON_LENGTH
+	   || b->len < ZPOLY_NEWTON_LENGTH)
+    zpoly_pseudo_divrem_basecase(q, r, a, b);
+  else
+    zpoly_pseudo_divrem_newton(q, r, a, b);
+}
+
+/**** Content and gcd */
+
+static void zpoly_content(mpz_ptr g, const struct zpoly *p)
+{
+  mlsize_t i;
+  mpz_set_ui(g, 0);
+  for(i=0; i<p->len && mpz_cmp_ui(g, 1) != 0; i++)
+    mpz_gcd(g, g, p->c[i]);
+}
+
+/* p divided by its content, in place. */
+static void zpoly_make_primitive(struct zpoly *p)
+{
+  mpz_t g;
+  mpz_init(g);
+  zpoly_content(g, p);
+  if (mpz_sgn(g))
+    zpoly_divexact_z(p, g);
+  mpz_clear(g);
+}
+
+/* The gcd with a positive leading coefficient, from the primitive
+   remainder sequence. */
+static struct zpoly *zpoly_gcd(const struct zpoly *a, const struct zpoly *b)
+{
+  struct zpoly *x, *y, *q, *r;
+  mpz_t g, h;
+  mlsize_t i;
+  mpz_init(g);
+  mpz_init(h);
+  zpoly_content(g, a);
+  zpoly_content(h, b);
+  mpz_gcd(g, g, h);
+  mpz_clear(h);
+  if (a->len >= b->len)
+    x = zpoly_copy(a), y = zpoly_copy(b);
+  else
+    x = zpoly_copy(b), y = zpoly_copy(a);
+  zpoly_make_primitive(x);
+  zpoly_make_primitive(y);
+  while (y->len > 0)
+    {
+      zpoly_pseudo_divrem(&q, &r, x, y);
+      zpoly_free(q);
+      zpoly_free(x);
+      x = y;
+      y = r;
+      zpoly_make_primitive(y);
+    }
+  zpoly_free(y);
+  if (x->len > 0 && mpz_sgn(x->c[x->len-1]) < 0)
+    mpz_neg(g, g);
+  for(i=0; i<x->len; i++)
+    mpz_mul(x->c[i], x->c[i], g);
+  mpz_clear(g);
+  return x;
+}
+
+/**** Stubs */
+
+#define zpoly_val(v) (*((struct zpoly **) Data_custom_val(v)))
+
+void _mlgmp_zpoly_finalize(value v)
+{
+  zpoly_free(zpoly_val(v));
+}
+
+int _mlgmp_zpoly_custom_compare(value va, value vb)
+{
+  const struct zpoly *a = zpoly_val(va), *b = zpoly_val(vb);
+  mlsize_t i;
+  if (a->len != b->len)
+    return a->len < b->len ? -1 : 1;
+  for(i=a->len; i-- > 0; )
+    {
+      int c = mpz_cmp(a->c[i], b->c[i]);
+      if (c)
+	return c < 0 ? -1 : 1;
+    }
+  return 0;
+}
+
+long _mlgmp_zpoly_hash(value v)
+{
+  const struct zpoly *p = zpoly_val(v);
+  uint32_t h = (uint32_t) p->len;
+  mlsize_t i;
+  for(i=0; i<p->len; i++)
+    h = hash_limbs(caml_hash_mix_uint32(h, (uint32_t) p->c[i]->_mp_size),
+		   p->c[i]->_mp_d, mpz_size(p->c[i]));
+  return h;
+}
+
+struct custom_operations _mlgmp_custom_zpoly =
+  {
+    field(identifier)  "Gmp.ZPoly.t",
+    field(finalize)    &_mlgmp_zpoly_finalize,
+    field(compare)     &_mlgmp_zpoly_custom_compare,
+    field(hash)        &_mlgmp_zpoly_hash,
+    field(serialize)   custom_serialize_default,
+    field(deserialize) custom_deserialize_default
+  };
+
+/* The block of a result, allocated empty before the result is built so
+   that nothing leaks if the stub raises; zpoly_set stores the result and
+   reports its limbs to the GC. */
+static value alloc_zpoly(void)
+{
+  value r = alloc_custom_limbs(&_mlgmp_custom_zpoly, sizeof(struct zpoly *),
+			       0);
+  zpoly_val(r) = NULL;
+  return r;
+}
+
+static void zpoly_set(value r, struct zpoly *p)
+{
+  mp_size_t n = zpoly_limbs(p);
+  zpoly_val(r) = p;
+  if (n > 0 && mlgmp_gc_ratio)
+    caml_adjust_gc_speed(limbs_mem(n), GC_LIMB_MAX);
+}
+
+value _mlgmp_zpoly_of_array(value a)
+{
+  CAMLparam1(a);
+  CAMLlocal1(r);
+  mlsize_t i, n = Wosize_val(a);
+  mpz_small_t sa;
+  struct zpoly *p;
+  r = alloc_zpoly();
+  p = zpoly_new(n);
+  for(i=0; i<n; i++)
+    mpz_set(p->c[i], mpz_src(Field(a, i), sa));
+  zpoly_trim(p);
+  zpoly_set(r, p);
+  CAMLreturn(r);
+}
+
+value _mlgmp_zpoly_to_array(value v)
+{
+  CAMLparam1(v);
+  CAMLlocal2(a, x);
+  mlsize_t i, n = zpoly_val(v)->len;
+  mpz_t z;
+  if (n == 0)
+    CAMLreturn(Atom(0));
+  a = caml_alloc(n, 0);
+  for(i=0; i<n; i++)
+    {
+      mpz_init_set(z, zpoly_val(v)->c[i]);
+      x = wrap_mpz(z);
+      Store_field(a, i, x);
+    }
+  CAMLreturn(a);
+}
+
+value _mlgmp_zpoly_degree(value v)
+{
+  return Val_long((long) zpoly_val(v)->len - 1);
+}
+
+value _mlgmp_zpoly_coeff(value v, value i)
+{
+  CAMLparam2(v, i);
+  const struct zpoly *p = zpoly_val(v);
+  mpz_t z;
+  if (Long_val(i) < 0)
+    caml_invalid_argument(MODULE "coeff");
+  if ((mlsize_t) Long_val(i) < p->len)
+    mpz_init_set(z, p->c[Long_val(i)]);
+  else
+    mpz_init(z);
+  CAMLreturn(wrap_mpz(z));
+}
+
+value _mlgmp_zpoly_equal(value a, value b)
+{
+  return Val_bool(_mlgmp_zpoly_custom_compare(a, b) == 0);
+}
+
+value _mlgmp_zpoly_add(value a, value b)
+{
+  CAMLparam2(a, b);
+  CAMLlocal1(r);
+  r = alloc_zpoly();
+  zpoly_set(r, zpoly_addsub(zpoly_val(a), zpoly_val(b), 1));
+  CAMLreturn(r);
+}
+
+value _mlgmp_zpoly_sub(value a, value b)
+{
+  CAMLparam2(a, b);
+  CAMLlocal1(r);
+  r = alloc_zpoly();
+  zpoly_set(r, zpoly_addsub(zpoly_val(a), zpoly_val(b), -1));
+  CAMLreturn(r);
+}
+
+value _mlgmp_zpoly_neg(value a)
+{
+  CAMLparam1(a);
+  CAMLlocal1(v);
+  struct zpoly *r;
+  mlsize_t i;
+  v = alloc_zpoly();
+  r = zpoly_copy(zpoly_val(a));
+  for(i=0; i<r->len; i++)
+    mpz_neg(r->c[i], r->c[i]);
+  zpoly_set(v, r);
+  CAMLreturn(v);
+}
+
+value _mlgmp_zpoly_scale(value x, value a)
+{
+  CAMLparam2(x, a);
+  CAMLlocal1(r);
+  mpz_small_t sx;
+  r = alloc_zpoly();
+  zpoly_set(r, zpoly_scale(mpz_src(x, sx), zpoly_val(a)));
+  CAMLreturn(r);
+}
+
+value _mlgmp_zpoly_mul(value va, value vb)
+{
+  CAMLparam2(va, vb);
+  CAMLlocal1(v);
+  const struct zpoly *a = zpoly_val(va), *b = zpoly_val(vb);
+  struct zpoly *r;
+  v = alloc_zpoly();
+  if (a->len == 0 || b->len == 0)
+    {
+      zpoly_set(v, zpoly_new(0));
+      CAMLreturn(v);
+    }
+  r = zpoly_val(v) = zpoly_new(a->len + b->len - 1);
+  blocking_section(release_lock_p(zpoly_limbs(a) + zpoly_limbs(b)),
+		   zpoly_mul_into(r, a, b));
+  zpoly_set(v, r);
+  CAMLreturn(v);
+}
+
+value _mlgmp_zpoly_pseudo_divrem(value a, value b)
+{
+  CAMLparam2(a, b);
+  CAMLlocal3(t, x, y);
+  struct zpoly *q, *r;
+  x = alloc_zpoly();
+  y = alloc_zpoly();
+  zpoly_pseudo_divrem(&q, &r, zpoly_val(a), zpoly_val(b));
+  zpoly_set(x, q);
+  zpoly_set(y, r);
+  t = caml_alloc_tuple(2);
+  Store_field(t, 0, x);
+  Store_field(t, 1, y);
+  CAMLreturn(t);
+}
+
+value _mlgmp_zpoly_divexact(value va, value vb)
+{
+  CAMLparam2(va, vb);
+  CAMLlocal1(v);
+  const struct zpoly *a = zpoly_val(va), *b = zpoly_val(vb);
+  struct zpoly *q, *r;
+  int ok;
+  mpz_t cn;
+  v = alloc_zpoly();
+  zpoly_pseudo_divrem(&q, &r, a, b);
+  zpoly_val(v) = q;
+  ok = r->len == 0;
+  zpoly_free(r);
+  if (ok && a->len >= b->len)
+    {
+      mpz_init(cn);
+      mpz_pow_ui(cn, b->c[b->len-1], a->len - b->len + 1);
+      ok = zpoly_divexact_z(q, cn);
+      mpz_clear(cn);
+    }
+  if (!ok)
+    caml_invalid_argument(MODULE "divexact");
+  zpoly_set(v, q);
+  CAMLreturn(v);
+}
+
+value _mlgmp_zpoly_divexact_z(value v, value x)
+{
+  CAMLparam2(v, x);
+  CAMLlocal1(r);
+  mpz_small_t sx;
+  mpz_srcptr zx;
+  struct zpoly *p;
+  if (mpz_sgn(mpz_src(x, sx)) == 0)
+    division_by_zero();
+  r = alloc_zpoly();
+  zx = mpz_src(x, sx);
+  p = zpoly_val(r) = zpoly_copy(zpoly_val(v));
+  if (!zpoly_divexact_z(p, zx))
+    caml_invalid_argument(MODULE "divexact_z");
+  zpoly_set(r, p);
+  CAMLreturn(r);
+}
+
+value _mlgmp_zpoly_content(value v)
+{
+  CAMLparam1(v);
+  mpz_t g;
+  mpz_init(g);
+  zpoly_content(g, zpoly_val(v));
+  CAMLreturn(wrap_mpz(g));
+}
+
+value _mlgmp_zpoly_primitive_part(value v)
+{
+  CAMLparam1(v);
+  CAMLlocal1(r);
+  struct zpoly *p;
+  r = alloc_zpoly();
+  p = zpoly_copy(zpoly_val(v));
+  zpoly_make_primitive(p);
+  zpoly_set(r, p);
+  CAMLreturn(r);
+}
+
+value _mlgmp_zpoly_gcd(value a, value b)
+{
+  CAMLparam2(a, b);
+  CAMLlocal1(r);
+  r = alloc_zpoly();
+  zpoly_set(r, zpoly_gcd(zpoly_val(a), zpoly_val(b)));
+  CAMLreturn(r);
+}
+
+value _mlgmp_zpoly_derivative(value v)
+{
+  CAMLparam1(v);
+  CAMLlocal1(w);
+  const struct zpoly *p = zpoly_val(v);
+  struct zpoly *r;
+  mlsize_t i;
+  w = alloc_zpoly();
+  r = zpoly_new(p->len > 0 ? p->len - 1 : 0);
+  for(i=0; i<r->len; i++)
+    mpz_mul_ui(r->c[i], p->c[i+1], i+1);
+  zpoly_set(w, r);
+  CAMLreturn(w);
+}
+
+/* Horner's rule. */
+value _mlgmp_zpoly_eval(value v, value x)
+{
+  CAMLparam2(v, x);
+  const struct zpoly *p = zpoly_val(v);
+  mpz_small_t sx;
+  mpz_srcptr zx = mpz_src(x, sx);
+  mpz_t r;
+  mlsize_t i;
+  mpz_init(r);
+  for(i=p->len; i-- > 0; )
+    {
+      mpz_mul(r, r, zx);
+      mpz_add(r, r, p->c[i]);
+    }
+  CAMLreturn(wrap_mpz(r));
+}
+
+/* d^deg p p(n/d), an integer. */
+value _mlgmp_zpoly_eval_frac(value v, value n, value d)
+{
+  CAMLparam3(v, n, d);
+  const struct zpoly *p = zpoly_val(v);
+  mpz_small_t sn, sd;
+  mpz_srcptr zn = mpz_src(n, sn), zd = mpz_src(d, sd);
+  mpz_t r, dk;
+  mlsize_t i;
+  mpz_init(r);
+  mpz_init_set_ui(dk, 1);
+  if (p->len > 0)
+    {
+      mpz_set(r, p->c[p->len-1]);
+      for(i=p->len-1; i-- > 0; )
+	{
+	  mpz_mul(dk, dk, zd);
+	  mpz_mul(r, r, zn);
+	  mpz_addmul(r, p->c[i], dk);
+	}
+    }
+  mpz_clear(dk);
+  CAMLreturn(wrap_mpz(r));
+}
@@ -6,9 +6,11 @@
 #include <caml/callback.h>
 #include <stdio.h>
 #include <string.h>
+#include <limits.h>
 #include <assert.h>
 
 #include "config.h"
+#include "mlgmp.h"
 #include "conversions.c"
 
 #define MODULE "Gmp.Q."
@@ -19,9 +21,20 @@ CAMLreturn(r)
 
 /*** Allocation functions */
 
+/* In-place operations may grow the limbs of their destination. */
+#define q2_enter(r) mp_size_t q2_alloc = mpq_alloc(*mpq_val(r))
+#define q2_leave(r)					\
+  do {							\
+    account_limbs(mpq_alloc(*mpq_val(r)) - q2_alloc);	\
+    census_resize(r, sizeof(mpq_t), mpq_alloc(*mpq_val(r)));	\
+  } while (0)
+
 void _mlgmp_q_finalize(value r)
 {
-  mpq_clear(*mpq_val(r));
+  stat_free(STAT_Q, mpq_alloc(*mpq_val(r)));
+  census_unregister(r, sizeof(mpq_t));
+  z_clear(mpq_numref(*mpq_val(r)));
+  z_clear(mpq_denref(*mpq_val(r)));
 }
 
 int _mlgmp_q_custom_compare(value a, value b);
@@ -59,9 +72,12 @@ value _mlgmp_q_from_z(value a)
 {
   CAMLparam1(a);
   CAMLlocal1(r);
+  mpz_small_t sa;
+  mpq_t q;
   trace(from_z);
-  r=alloc_init_mpq();
-  mpq_set_z(*mpq_val(r), *mpz_val(a));
+  mpq_init(q);
+  mpq_set_z(q, mpz_src(a, sa));
+  r=wrap_mpq(q);
   CAMLcheckreturn(r);
 }
 
@@ -69,35 +85,251 @@ value _mlgmp_q_from_si(value n, value d)
 {
   CAMLparam2(n, d);
   CAMLlocal1(r);
+  mpq_t q;
   trace(from_si);
-  r=alloc_init_mpq();
+  mpq_init(q);
+  mpq_set_si(q, Long_val(n), Long_val(d));
+  mpq_canonicalize(q);
+  r=wrap_mpq(q);
+  CAMLcheckreturn(r);
+}
+
+/* Q2.t accumulators have the same representation as Q.t; Q2.of_q and
+   Q2.to_q both copy. */
+value _mlgmp_q_copy(value a)
+{
+  CAMLparam1(a);
+  CAMLlocal1(r);
+  mpq_t q;
+  trace(copy);
+  mpq_init(q);
+  mpq_set(q, *mpq_val(a));
+  r=wrap_mpq(q);
+  CAMLcheckreturn(r);
+}
+
+value _mlgmp_q2_set(value r, value a)
+{
+  CAMLparam2(r, a);
+  q2_enter(r);
+  mpq_set(*mpq_val(r), *mpq_val(a));
+  q2_leave(r);
+  CAMLreturn(Val_unit);
+}
+
+value _mlgmp_q2_from_z(value r, value a)
+{
+  CAMLparam2(r, a);
+  q2_enter(r);
+  mpz_small_t sa;
+  mpq_set_z(*mpq_val(r), mpz_src(a, sa));
+  q2_leave(r);
+  CAMLreturn(Val_unit);
+}
+
+value _mlgmp_q2_from_si(value r, value n, value d)
+{
+  CAMLparam3(r, n, d);
+  q2_enter(r);
   mpq_set_si(*mpq_val(r), Long_val(n), Long_val(d));
   mpq_canonicalize(*mpq_val(r));
-  CAMLcheckreturn(r);
+  q2_leave(r);
+  CAMLreturn(Val_unit);
+}
+
+value _mlgmp_q2_from_float_unboxed(value r, double d)
+{
+  CAMLparam1(r);
+  q2_enter(r);
+  mpq_set_d(*mpq_val(r), d);
+  q2_leave(r);
+  CAMLreturn(Val_unit);
+}
+
+value _mlgmp_q2_from_float(value r, value v)
+{
+  return _mlgmp_q2_from_float_unboxed(r, Double_val(v));
 }
 
 /*** Conversions */
 
+value _mlgmp_q_from_float_unboxed(double d)
+{
+  mpq_t q;
+  trace(from_float);
+  mpq_init(q);
+  mpq_set_d(q, d);
+  return wrap_mpq(q);
+}
+
 value _mlgmp_q_from_float(value v)
 {
-  CAMLparam1(v);
+  return _mlgmp_q_from_float_unboxed(Double_val(v));
+}
+
+/* num or num/den */
+value _mlgmp_q_from_substring(value base, value s, value pos, value len)
+{
+  CAMLparam4(base, s, pos, len);
   CAMLlocal1(r);
-  trace(from_float);
-  r=alloc_init_mpq();
-  mpq_set_d(*mpq_val(r), Double_val(v));
+  mpq_t q;
+  const char *slash;
+  size_t nlen;
+  int ok;
+  trace(from_substring);
+  check_substring(s, pos, len, "Gmp.Q.of_substring");
+  slash = memchr(String_val(s) + Long_val(pos), '/', Long_val(len));
+  nlen = slash ? slash - (String_val(s) + Long_val(pos)) : Long_val(len);
+  mpq_init(q);
+  /* s may move while the numerator is parsed */
+  ok = mpz_set_substring(mpq_numref(q), String_val(s) + Long_val(pos), nlen,
+			 Int_val(base))
+    && (slash == NULL
+	|| mpz_set_substring(mpq_denref(q),
+			     String_val(s) + Long_val(pos) + nlen + 1,
+			     Long_val(len) - nlen - 1, Int_val(base)));
+  if (!ok)
+    {
+      mpq_clear(q);
+      caml_invalid_argument("Gmp.Q.of_substring");
+    }
+  if (mpz_sgn(mpq_denref(q)) == 0)
+    {
+      mpq_clear(q);
+      division_by_zero();
+    }
+  mpq_canonicalize(q);
+  r=wrap_mpq(q);
   CAMLcheckreturn(r);
 }
 
-value _mlgmp_q_to_float(value v)
+/* See mlgmp_z.c for the _unboxed and _untagged stubs. */
+double _mlgmp_q_to_float_unboxed(value v)
 {
-  CAMLparam1(v);
-  CAMLlocal1(r);
   trace(to_float);
-  r = caml_copy_double(mpq_get_d(*mpq_val(v)));
-  CAMLreturn(r);
+  return mpq_get_d(*mpq_val(v));
+}
+
+value _mlgmp_q_to_float(value v)
+{
+  return caml_copy_double(_mlgmp_q_to_float_unboxed(v));
 }
 
 /*** Operations */
+/**** Small fractions */
+
+/* With Q_SMALL, the four operations on fractions whose terms are at most
+   LONG_MAX in absolute value are done on longs: the result is canonical
+   as mpq's would be, and q_small_* return 0 when it would overflow, or
+   for a division by zero, so that mpq does the job. */
+
+#ifdef Q_SMALL
+/* Binary gcd. */
+static inline unsigned long gcd_ul(unsigned long u, unsigned long v)
+{
+  int shift;
+  if (u == 0) return v;
+  if (v == 0) return u;
+  shift = __builtin_ctzl(u | v);
+  u >>= __builtin_ctzl(u);
+  do
+    {
+      v >>= __builtin_ctzl(v);
+      if (u > v) { unsigned long t = u; u = v; v = t; }
+      v -= u;
+    }
+  while (v != 0);
+  return u << shift;
+}
+
+static inline int mpz_small(mpz_srcptr z, long *l)
+{
+  long n;
+  if (z->_mp_size == 0) { *l = 0; return 1; }
+  if (z->_mp_size > 1 || z->_mp_size < -1
+      || z->_mp_d[0] > (mp_limb_t) LONG_MAX)
+    return 0;
+  n = (long) z->_mp_d[0];
+  *l = z->_mp_size > 0 ? n : -n;
+  return 1;
+}
+
+static inline int mpq_small(mpq_srcptr q, long *n, long *d)
+{
+  return mpz_small(mpq_numref(q), n) && mpz_small(mpq_denref(q), d);
+}
+
+static inline unsigned long abs_ul(long l)
+{
+  return l < 0 ? -(unsigned long) l : (unsigned long) l;
+}
+
+/* a/b + c/d, Knuth 4.5.1: with g = gcd(b, d) and t = a(d/g) + c(b/g),
+   gcd(t, b(d/g)) = gcd(t, g). */
+static inline int q_small_sum(long a, long b, long c, long d,
+                              long *rn, long *rd)
+{
+  long g = gcd_ul(b, d), b1 = b / g, d1 = d / g, x, y, t, den, g2;
+  if (__builtin_mul_overflow(a, d1, &x)
+      || __builtin_mul_overflow(c, b1, &y)
+      || __builtin_add_overflow(x, y, &t)
+      || __builtin_mul_overflow(b, d1, &den)
+      || t == LONG_MIN)
+    return 0;
+  if (t == 0) { *rn = 0; *rd = 1; return 1; }
+  g2 = gcd_ul(abs_ul(t), g);
+  *rn = t / g2;
+  *rd = den / g2;
+  return 1;
+}
+
+/* (a/b)(c/d) = ((a/g1)(c/g2)) / ((b/g2)(d/g1)), with g1 = gcd(a, d) and
+   g2 = gcd(c, b). */
+static inline int q_small_product(long a, long b, long c, long d,
+                                  long *rn, long *rd)
+{
+  long g1 = gcd_ul(abs_ul(a), d), g2 = gcd_ul(abs_ul(c), b);
+  return !__builtin_mul_overflow(a / g1, c / g2, rn)
+    && !__builtin_mul_overflow(b / g2, d / g1, rd)
+    && *rn != LONG_MIN;
+}
+
+static int q_small_add(mpq_srcptr x, mpq_srcptr y, long *n, long *d)
+{
+  long a, b, c, e;
+  return mpq_small(x, &a, &b) && mpq_small(y, &c, &e)
+    && q_small_sum(a, b, c, e, n, d);
+}
+
+static int q_small_sub(mpq_srcptr x, mpq_srcptr y, long *n, long *d)
+{
+  long a, b, c, e;
+  return mpq_small(x, &a, &b) && mpq_small(y, &c, &e)
+    && q_small_sum(a, b, -c, e, n, d);
+}
+
+static int q_small_mul(mpq_srcptr x, mpq_srcptr y, long *n, long *d)
+{
+  long a, b, c, e;
+  return mpq_small(x, &a, &b) && mpq_small(y, &c, &e)
+    && q_small_product(a, b, c, e, n, d);
+}
+
+static int q_small_div(mpq_srcptr x, mpq_srcptr y, long *n, long *d)
+{
+  long a, b, c, e;
+  if (!(mpq_small(x, &a, &b) && mpq_small(y, &c, &e)) || c == 0)
+    return 0;
+  return c > 0 ? q_small_product(a, b, e, c, n, d)
+    : q_small_product(a, b, -e, -c, n, d);
+}
+#else
+#define q_small_add(x, y, n, d) 0
+#define q_small_sub(x, y, n, d) 0
+#define q_small_mul(x, y, n, d) 0
+#define q_small_div(x, y, n, d) 0
+#endif
+
 /**** Arithmetic */
 
 #define q_binary_op(op)	        			\
@@ -105,16 +337,37 @@ value _mlgmp_q_##op(value a, value b)			\
 {							\
   CAMLparam2(a, b);                                     \
   CAMLlocal1(r);                                        \
+  mpq_t q;                                              \
+  long n, d;                                            \
   trace(op);	                		\
-  r=alloc_init_mpq();				        \
-  mpq_##op(*mpq_val(r), *mpq_val(a), *mpq_val(b));	\
+  if (q_small_##op(*mpq_val(a), *mpq_val(b), &n, &d))   \
+    {                                                   \
+      mpz_init_set_si(mpq_numref(q), n);                \
+      mpz_init_set_si(mpq_denref(q), d);                \
+    }                                                   \
+  else                                                  \
+    {                                                   \
+      mpq_init(q);                                      \
+      mpq_##op(q, *mpq_val(a), *mpq_val(b));            \
+    }                                                   \
+  r=wrap_mpq(q);				        \
   CAMLcheckreturn(r);	       				\
 }                                                       \
                                                         \
 value _mlgmp_q2_##op(value r, value a, value b)		\
 {							\
   CAMLparam3(r, a, b);                                  \
-  mpq_##op(*mpq_val(r), *mpq_val(a), *mpq_val(b));	\
+  long n, d;                                            \
+  trace_name("Gmp.Q2." #op);                            \
+  q2_enter(r);                                          \
+  if (q_small_##op(*mpq_val(a), *mpq_val(b), &n, &d))   \
+    {                                                   \
+      mpz_set_si(mpq_numref(*mpq_val(r)), n);           \
+      mpz_set_si(mpq_denref(*mpq_val(r)), d);           \
+    }                                                   \
+  else                                                  \
+    mpq_##op(*mpq_val(r), *mpq_val(a), *mpq_val(b));    \
+  q2_leave(r);                                          \
   CAMLreturn(Val_unit);	       				\
 }
 
@@ -123,10 +376,22 @@ value _mlgmp_q_##op(value a)			\
 {						\
   CAMLparam1(a);				\
   CAMLlocal1(r);				\
+  mpq_t q;					\
   trace(op);	                	\
-  r=alloc_init_mpq();				\
-  mpq_##op(*mpq_val(r), *mpq_val(a));		\
+  mpq_init(q);					\
+  mpq_##op(q, *mpq_val(a));			\
+  r=wrap_mpq(q);				\
   CAMLcheckreturn(r);				\
+}						\
+						\
+value _mlgmp_q2_##op(value r, value a)		\
+{						\
+  CAMLparam2(r, a);				\
+  trace_name("Gmp.Q2." #op);                    \
+  q2_enter(r);					\
+  mpq_##op(*mpq_val(r), *mpq_val(a));		\
+  q2_leave(r);					\
+  CAMLreturn(Val_unit);				\
 }
 
 q_binary_op(add)
@@ -142,11 +407,21 @@ q_unary_op(abs)
 value _mlgmp_q_##op(value a)			\
 {						\
   CAMLparam1(a);				\
-  CAMLlocal1(r);				\
+  mpz_t r;					\
   trace(op);	                	\
-  r=alloc_init_mpz();				\
+  mpz_init(r);					\
+  mpq_##op(r, *mpq_val(a));			\
+  CAMLreturn(wrap_mpz(r));			\
+}						\
+						\
+value _mlgmp_q2_##op(value r, value a)		\
+{						\
+  CAMLparam2(r, a);				\
+  trace_name("Gmp.Q2." #op);                    \
+  z2_enter(r);					\
   mpq_##op(*mpz_val(r), *mpq_val(a));		\
-  CAMLcheckreturn(r);				\
+  z2_leave(r);					\
+  CAMLreturn(Val_unit);				\
 }
 
 q_z_unary_op(get_num)
@@ -160,25 +435,37 @@ int _mlgmp_q_custom_compare(value a, value b)
   CAMLreturn(mpq_cmp(*mpq_val(a), *mpq_val(b)));
 }
 
+intnat _mlgmp_q_cmp_untagged(value a, value b)
+{
+  trace(cmp);
+  return mpq_cmp(*mpq_val(a), *mpq_val(b));
+}
+
 value _mlgmp_q_cmp(value a, value b)
 {
-  CAMLparam2(a, b);
-  trace(cmp);	                	\
-  CAMLreturn(Val_int(mpq_cmp(*mpq_val(a), *mpq_val(b))));
+  return Val_int(_mlgmp_q_cmp_untagged(a, b));
+}
+
+intnat _mlgmp_q_cmp_ui_untagged(value a, intnat n, intnat d)
+{
+  trace(cmp_ui);
+  return mpq_cmp_ui(*mpq_val(a), n, d);
 }
 
 value _mlgmp_q_cmp_ui(value a, value n, value d)
 {
-  CAMLparam3(a, n, d);
-  trace(cmp_ui);	                	\
-  CAMLreturn(Val_int(mpq_cmp_ui(*mpq_val(a), Long_val(n), Long_val(d))));
+  return Val_int(_mlgmp_q_cmp_ui_untagged(a, Long_val(n), Long_val(d)));
+}
+
+intnat _mlgmp_q_sgn_untagged(value a)
+{
+  trace(sgn);
+  return mpq_sgn(*mpq_val(a));
 }
 
 value _mlgmp_q_sgn(value a)
 {
-  CAMLparam1(a);
-  trace(sgn);	                	\
-  CAMLreturn(Val_int(mpq_sgn(*mpq_val(a))));
+  return Val_int(_mlgmp_q_sgn_untagged(a));
 }
 
 /*** Serialization */
@@ -195,45 +482,46 @@ void _mlgmp_q_serialize(value v,
 			unsigned long * wsize_64)
 {
   CAMLparam1(v);
-  char *s;
-  int len;
 
   *wsize_32 = MPQ_SIZE_ARCH32;
   *wsize_64 = MPQ_SIZE_ARCH64;
 
-  s = mpz_get_str (NULL, 16, mpq_numref(*mpq_val(v)));
-  len = strlen(s);
-  caml_serialize_int_4(len);
-  caml_serialize_block_1(s, len);
-  free(s);
-
-  s = mpz_get_str (NULL, 16, mpq_denref(*mpq_val(v)));
-  len = strlen(s);
-  caml_serialize_int_4(len);
-  caml_serialize_block_1(s, len);
-  free(s);
-
+  serialize_header();
+  serialize_mpz(mpq_numref(*mpq_val(v)));
+  serialize_mpz(mpq_denref(*mpq_val(v)));
   CAMLreturn0;
 }
 
 unsigned long _mlgmp_q_deserialize(void * dst)
 {
   char *s;
-  int len;
-
-  len = caml_deserialize_uint_4();
+  uint32_t len;
+
+  mpq_init(*((mpq_t*) dst));
+  if (deserialize_header(&len))
+    {
+      deserialize_mpz(mpq_numref(*((mpq_t*) dst)));
+      deserialize_mpz(mpq_denref(*((mpq_t*) dst)));
+      if (mpz_sgn(mpq_denref(*((mpq_t*) dst))) <= 0)
+	caml_deserialize_error("Gmp: bad rational denominator");
+      stat_alloc(STAT_Q, mpq_alloc(*((mpq_t*) dst)));
+      return sizeof(mpq_t);
+    }
+
+  /* Old hex format */
   s = malloc(len+1);
   caml_deserialize_block_1(s, len);
   s[len] = 0;
-  mpz_init_set_str (mpq_numref(*((mpq_t*) dst)), s, 16);
+  mpz_set_str (mpq_numref(*((mpq_t*) dst)), s, 16);
   free(s);
 
   len = caml_deserialize_uint_4();
   s = malloc(len+1);
   caml_deserialize_block_1(s, len);
   s[len] = 0;
-  mpz_init_set_str (mpq_denref(*((mpq_t*) dst)), s, 16);
+  mpz_set_str (mpq_denref(*((mpq_t*) dst)), s, 16);
   free(s);
+  stat_alloc(STAT_Q, mpq_alloc(*((mpq_t*) dst)));
 
   return sizeof(mpq_t);
 }
@@ -241,14 +529,6 @@ unsigned long _mlgmp_q_deserialize(void * dst)
 
 long _mlgmp_q_hash(value v)
 {
-  CAMLparam1(v);
-  mpz_t dummy;
-  long r;
-  mpz_init(dummy);
-
-  r = mpz_mod_ui(dummy, mpq_denref(*mpq_val(v)), HASH_MODULUS)
-    ^ mpz_mod_ui(dummy, mpq_numref(*mpq_val(v)), HASH_MODULUS);
-
-  mpz_clear(dummy);
-  CAMLreturn(r);
+  return caml_hash_mix_uint32(hash_mpz(mpq_numref(*mpq_val(v))),
+			      hash_mpz(mpq_denref(*mpq_val(v))));
 }
@@ -8,6 +8,7 @@
 #include <stdio.h>
 
 #include "config.h"
+#include "conversions.c"
 
 #define MODULE "Gmp.Random."
 
@@ -30,16 +31,79 @@ struct custom_operations _mlgmp_custom_random =
 
 #undef field
 
+/* The state must be initialized right after allocation, before anything
+   else may trigger the finalizer. */
+static inline value alloc_randstate(void)
+{
+  return caml_alloc_custom(&_mlgmp_custom_random,
+			   sizeof(gmp_randstate_t),
+			   4,
+			   1000000);
+}
+
 value _mlgmp_randinit_lc(value n)
 {
   CAMLparam1(n);
   CAMLlocal1(r);
-  r = caml_alloc_custom(&_mlgmp_custom_random,
-		       sizeof(gmp_randstate_t),
-		       4,
-		       1000000);
-  gmp_randinit(*((gmp_randstate_t*) Data_custom_val(r)),
-	       GMP_RAND_ALG_LC,
-	       Long_val(n));
+  r = alloc_randstate();
+  gmp_randinit(*randstate_val(r), GMP_RAND_ALG_LC, Long_val(n));
   CAMLreturn(r); 
 }
+
+value _mlgmp_randinit_mt(value unit)
+{
+  CAMLparam1(unit);
+  CAMLlocal1(r);
+  r = alloc_randstate();
+  gmp_randinit_mt(*randstate_val(r));
+  CAMLreturn(r);
+}
+
+value _mlgmp_randinit_copy(value state)
+{
+  CAMLparam1(state);
+  CAMLlocal1(r);
+  r = alloc_randstate();
+  gmp_randinit_set(*randstate_val(r), *randstate_val(state));
+  CAMLreturn(r);
+}
+
+/*** Seeding */
+
+value _mlgmp_randseed_ui(value state, value seed)
+{
+  CAMLparam2(state, seed);
+  gmp_randseed_ui(*randstate_val(state), Long_val(seed));
+  CAMLreturn(Val_unit);
+}
+
+/* The seed is the big-endian number made of the bytes of the string. */
+value _mlgmp_randseed_string(value state, value seed)
+{
+  CAMLparam2(state, seed);
+  mpz_t s;
+  mpz_init(s);
+  mpz_import(s, caml_string_length(seed), 1, 1, 0, 0, String_val(seed));
+  gmp_randseed(*randstate_val(state), s);
+  mpz_clear(s);
+  CAMLreturn(Val_unit);
+}
+
+/* A new Mersenne Twister state, seeded from RANDSPLIT_BITS bits drawn
+   from the given state; GMP offers no jump-ahead, so this is how
+   independent streams are derived from a parent one. */
+#define RANDSPLIT_BITS 256
+
+value _mlgmp_randsplit(value state)
+{
+  CAMLparam1(state);
+  CAMLlocal1(r);
+  mpz_t s;
+  mpz_init(s);
+  mpz_urandomb(s, *randstate_val(state), RANDSPLIT_BITS);
+  r = alloc_randstate();
+  gmp_randinit_mt(*randstate_val(r));
+  gmp_randseed(*randstate_val(r), s);
+  mpz_clear(s);
+  CAMLreturn(r);
+}
@@ -4,9 +4,11 @@
 #include <caml/memory.h>
 #include <caml/fail.h>
 #include <caml/callback.h>
+#include <caml/bigarray.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <errno.h>
 
 #include "config.h"
 #include "mlgmp.h"
@@ -18,10 +20,13 @@
 
 void _mlgmp_z_finalize(value r)
 {
-  mpz_clear(*mpz_val(r));
+  stat_free(STAT_Z, (*mpz_val(r))->_mp_alloc);
+  census_unregister(r, sizeof(mpz_t));
+  z_clear(*mpz_val(r));
 }
 
 int _mlgmp_z_custom_compare(value a, value b);
+int _mlgmp_z_custom_compare_ext(value a, value b);
 void _mlgmp_z_serialize(value v,
 			unsigned long * wsize_32,
 			unsigned long * wsize_64);
@@ -36,129 +41,344 @@ struct custom_operations _mlgmp_custom_z =
     field(hash)        &_mlgmp_z_hash,
 #ifdef SERIALIZE
     field(serialize)   &_mlgmp_z_serialize,
-    field(deserialize) &_mlgmp_z_deserialize
+    field(deserialize) &_mlgmp_z_deserialize,
 #else
     field(serialize)   custom_serialize_default,
-    field(deserialize) custom_deserialize_default
+    field(deserialize) custom_deserialize_default,
 #endif
+    field(compare_ext) &_mlgmp_z_custom_compare_ext
   };
 
+/* Z2.t accumulators are always custom blocks, even for small values. */
 value _mlgmp_z_create(void)
 {
   CAMLparam0();
   CAMLreturn(alloc_init_mpz());
 }
 
-value _mlgmp_z_copy(value from)
+value _mlgmp_z2_of_z(value from)
 {
   CAMLparam1(from);
   CAMLlocal1(r);
-  r = alloc_mpz();
-  mpz_init_set(*mpz_val(r), *mpz_val(from));
+  mpz_small_t sfrom;
+  r = alloc_mpz(mpz_size(mpz_src(from, sfrom)));
+  mpz_init_set(*mpz_val(r), mpz_src(from, sfrom));
   CAMLreturn(r);
 }
 
-value _mlgmp_z_from_int(value ml_val)
+value _mlgmp_z_copy(value from)
 {
-  CAMLparam1(ml_val);
-  CAMLlocal1(r);
-  r=alloc_mpz();
-  mpz_init_set_si(*mpz_val(r), Long_val(ml_val));
-  CAMLreturn(r);
+  CAMLparam1(from);
+  mpz_small_t sfrom;
+  mpz_t r;
+  mpz_init_set(r, mpz_src(from, sfrom));
+  CAMLreturn(wrap_mpz(r));
+}
+
+value _mlgmp_z2_set(value r, value from)
+{
+  CAMLparam2(r, from);
+  z2_enter(r);
+  mpz_small_t sfrom;
+  mpz_set(*mpz_val(r), mpz_src(from, sfrom));
+  z2_leave(r);
+  CAMLreturn(Val_unit);
 }
 
 value _mlgmp_z_from_string_base(value base, value ml_val)
 {
   CAMLparam2(base, ml_val);
-  CAMLlocal1(r);
-  r=alloc_mpz();
-  mpz_init_set_str(*mpz_val(r), String_val(ml_val), Int_val(base));
-  CAMLreturn(r);
+  mpz_t r;
+  mpz_init_set_str(r, String_val(ml_val), Int_val(base));
+  CAMLreturn(wrap_mpz(r));
+}
+
+value _mlgmp_z_from_substring(value base, value s, value pos, value len)
+{
+  CAMLparam4(base, s, pos, len);
+  mpz_t r;
+  check_substring(s, pos, len, "Gmp.Z.of_substring");
+  mpz_init(r);
+  if (!mpz_set_substring(r, String_val(s) + Long_val(pos), Long_val(len),
+			 Int_val(base)))
+    {
+      mpz_clear(r);
+      caml_invalid_argument("Gmp.Z.of_substring");
+    }
+  CAMLreturn(wrap_mpz(r));
+}
+
+/* Stubs with [@unboxed] or [@untagged] arguments or results come in
+   pairs: the native one, suffixed _unboxed or _untagged, works on C
+   values, and the bytecode one wraps it.  Stubs declared [@@noalloc] in
+   gmp.ml neither allocate nor raise, and need no CAMLparam. */
+value _mlgmp_z_from_float_unboxed(double d)
+{
+  mpz_t r;
+  mpz_init_set_d(r, d);
+  return wrap_mpz(r);
 }
 
 value _mlgmp_z_from_float(value ml_val)
 {
-  CAMLparam1(ml_val);
-  CAMLlocal1(r);
-  r=alloc_mpz();
-  mpz_init_set_d(*mpz_val(r), Double_val(ml_val));
-  CAMLreturn(r);
+  return _mlgmp_z_from_float_unboxed(Double_val(ml_val));
 }
 
 value _mlgmp_z2_from_int(value r, value ml_val)
 {
   CAMLparam2(r, ml_val);
-  mpz_init_set_si(*mpz_val(r), Long_val(ml_val));
+  z2_enter(r);
+  mpz_small_t sval;
+  mpz_set(*mpz_val(r), mpz_small_set(&sval, Long_val(ml_val)));
+  z2_leave(r);
   CAMLreturn(Val_unit);
 }
 
 value _mlgmp_z2_from_string_base(value r, value base, value ml_val)
 {
   CAMLparam3(r, base, ml_val);
-  mpz_init_set_str(*mpz_val(r), String_val(ml_val), Int_val(base));
+  z2_enter(r);
+  mpz_set_str(*mpz_val(r), String_val(ml_val), Int_val(base));
+  z2_leave(r);
   CAMLreturn(Val_unit);
 }
 
-value _mlgmp_z2_from_float(value r, value ml_val)
+value _mlgmp_z2_from_float_unboxed(value r, double d)
 {
-  CAMLparam2(r, ml_val);
-  mpz_init_set_d(*mpz_val(r), Double_val(ml_val));
+  CAMLparam1(r);
+  z2_enter(r);
+  mpz_set_d(*mpz_val(r), d);
+  z2_leave(r);
   CAMLreturn(Val_unit);
 }
 
+value _mlgmp_z2_from_float(value r, value ml_val)
+{
+  return _mlgmp_z2_from_float_unboxed(r, Double_val(ml_val));
+}
+
 /*** Conversions */
 
+/* Upper bound of the length of the string of a number in base; the
+   sign is counted, and mpz_sizeinbase may count one digit too many. */
+static size_t z_string_size(mpz_srcptr z, int base, const char *name)
+{
+  if (!valid_base(base))
+    caml_invalid_argument(name);
+  return mpz_sizeinbase(z, base < 0 ? -base : base) + (mpz_sgn(z) < 0);
+}
+
 value _mlgmp_z_to_string_base(value ml_base, value ml_val)
 {
   int base;
-  char *s;
+  mpz_small_t sval;
+  mpz_srcptr z;
 
   CAMLparam2(ml_base, ml_val);
   CAMLlocal1(r);
   base=Int_val(ml_base);
+  z=mpz_src(ml_val, sval);
 
-  /* This is sub-optimal, but using mpz_sizeinbase would
-     need a means of shortening the length of a pre-allocated
-     Caml string (mpz_sizeinbase sometimes overestimates lengths). */
-  s=mpz_get_str(NULL, base, *mpz_val(ml_val));
-  r=caml_alloc_string(strlen(s));
-  strcpy((char*) String_val(r), s);
-  free(s);
+  r=caml_alloc_string(z_string_size(z, base, "Gmp.Z.to_string_base"));
+  /* The allocation may have moved ml_val */
+  z=mpz_src(ml_val, sval);
+  mpz_get_str((char*) String_val(r), base, z);
+  CAMLreturn(trim_string(r, strlen(String_val(r))));
+}
 
-  CAMLreturn(r);
+value _mlgmp_z_string_size_base(value ml_base, value ml_val)
+{
+  CAMLparam2(ml_base, ml_val);
+  mpz_small_t sval;
+  CAMLreturn(Val_long(z_string_size(mpz_src(ml_val, sval), Int_val(ml_base),
+				    "Gmp.Z.string_size_base")));
+}
+
+/* Writes the digits at pos in bytes, which must have room for
+   string_size_base of them; returns how many were written.  The byte
+   right after that room, where the final NUL may go, is kept. */
+value _mlgmp_z_blit_string_base(value ml_base, value ml_val,
+				value bytes, value pos)
+{
+  CAMLparam4(ml_base, ml_val, bytes, pos);
+  mpz_small_t sval;
+  mpz_srcptr z = mpz_src(ml_val, sval);
+  mlsize_t len = caml_string_length(bytes);
+  size_t size = z_string_size(z, Int_val(ml_base), "Gmp.Z.blit_string_base");
+  char *s, saved;
+  if (Long_val(pos) < 0 || Long_val(pos) + size > len)
+    caml_invalid_argument("Gmp.Z.blit_string_base");
+  s = (char*) String_val(bytes) + Long_val(pos);
+  saved = s[size];
+  mpz_get_str(s, Int_val(ml_base), z);
+  len = strlen(s);
+  s[size] = saved;
+  CAMLreturn(Val_long(len));
+}
+
+/*** Raw bytes */
+
+/* Magnitudes are read and written as unsigned numbers on len bytes, most
+   significant first unless little_endian; the sign is left to the
+   caller.  Bigstrings live outside the heap, so they can be shared with
+   other libraries or mapped from files. */
+
+static unsigned char *raw_slice(value buf, int big, value pos, value len,
+				const char *name)
+{
+  uintnat size = big ? Caml_ba_array_val(buf)->dim[0]
+    : caml_string_length(buf);
+  if (Long_val(pos) < 0 || Long_val(len) < 0
+      || Long_val(pos) + Long_val(len) > size)
+    caml_invalid_argument(name);
+  return (unsigned char*) (big ? Caml_ba_data_val(buf)
+			   : (void*) String_val(buf)) + Long_val(pos);
+}
+
+static inline size_t z_raw_size(mpz_srcptr z)
+{
+  return mpz_sgn(z) ? (mpz_sizeinbase(z, 2) + 7) / 8 : 0;
+}
+
+intnat _mlgmp_z_raw_size_untagged(value ml_val)
+{
+  mpz_small_t sval;
+  return z_raw_size(mpz_src(ml_val, sval));
+}
+
+value _mlgmp_z_raw_size(value ml_val)
+{
+  return Val_long(_mlgmp_z_raw_size_untagged(ml_val));
+}
+
+#define z_raw_ops(kind, big)						\
+value _mlgmp_z_import_##kind(value le, value buf, value pos, value len)	\
+{									\
+  CAMLparam4(le, buf, pos, len);					\
+  mpz_t r;								\
+  const unsigned char *p =						\
+    raw_slice(buf, big, pos, len, MODULE "import_" #kind);		\
+  mpz_init(r);								\
+  mpz_import(r, Long_val(len), Bool_val(le) ? -1 : 1, 1, 0, 0, p);	\
+  CAMLreturn(wrap_mpz(r));						\
+}									\
+									\
+value _mlgmp_z2_import_##kind(value r, value le, value buf,		\
+			      value pos, value len)			\
+{									\
+  CAMLparam5(r, le, buf, pos, len);					\
+  const unsigned char *p =						\
+    raw_slice(buf, big, pos, len, "Gmp.Z2.import_" #kind);		\
+  z2_enter(r);								\
+  mpz_import(*mpz_val(r), Long_val(len), Bool_val(le) ? -1 : 1,	\
+	     1, 0, 0, p);						\
+  z2_leave(r);								\
+  CAMLreturn(Val_unit);							\
+}									\
+									\
+value _mlgmp_z_export_##kind(value le, value ml_val, value buf,	\
+			     value pos, value len)			\
+{									\
+  CAMLparam5(le, ml_val, buf, pos, len);				\
+  mpz_small_t sval;							\
+  mpz_srcptr z = mpz_src(ml_val, sval);					\
+  unsigned char *p =							\
+    raw_slice(buf, big, pos, len, MODULE "export_" #kind);		\
+  size_t n = z_raw_size(z), l = Long_val(len);				\
+  if (n > l)								\
+    caml_invalid_argument(MODULE "export_" #kind);			\
+  if (Bool_val(le))							\
+    {									\
+      mpz_export(p, NULL, -1, 1, 0, 0, z);				\
+      memset(p + n, 0, l - n);						\
+    }									\
+  else									\
+    {									\
+      memset(p, 0, l - n);						\
+      mpz_export(p + l - n, NULL, 1, 1, 0, 0, z);			\
+    }									\
+  CAMLreturn(Val_unit);							\
+}
+
+z_raw_ops(bytes, 0)
+z_raw_ops(bigstring, 1)
+
+/* Unboxed values are handled on the Caml side; this truncates big ones. */
+intnat _mlgmp_z_to_int_untagged(value ml_val)
+{
+  mpz_small_t sval;
+  if (Is_long(ml_val)) return Long_val(ml_val);
+  return mpz_get_si(mpz_src(ml_val, sval));
 }
 
 value _mlgmp_z_to_int(value ml_val)
 {
-  CAMLparam1(ml_val);
-  CAMLreturn(Val_int(mpz_get_si(* mpz_val(ml_val))));
+  return Val_long(_mlgmp_z_to_int_untagged(ml_val));
+}
+
+double _mlgmp_z_to_float_unboxed(value v)
+{
+  mpz_small_t sv;
+  return mpz_get_d(mpz_src(v, sv));
 }
 
 value _mlgmp_z_to_float(value v)
 {
-  CAMLparam1(v);
-  CAMLlocal1(r);
-  r = caml_copy_double(mpz_get_d(*mpz_val(v)));
-  CAMLreturn(r);
+  return caml_copy_double(_mlgmp_z_to_float_unboxed(v));
 }
 
 /*** Operations */
+
+/* Limbs that the result of op on operands of na and nb limbs (or na limbs
+   and an unsigned long b) will likely take, for z_init_limbs; 0 when
+   there is no good guess. */
+#define z_limbs_max(na, nb) ((na) > (nb) ? (na) : (nb))
+#define z_limbs_add(na, nb) (z_limbs_max(na, nb) + 1)
+#define z_limbs_sub z_limbs_add
+#define z_limbs_mul(na, nb) ((na) + (nb))
+#define z_limbs_gcd z_limbs_max
+#define z_limbs_lcm z_limbs_mul
+#define z_limbs_and z_limbs_add
+#define z_limbs_ior z_limbs_add
+#define z_limbs_xor z_limbs_add
+#define z_limbs_add_ui(na, b) ((na) + 1)
+#define z_limbs_sub_ui z_limbs_add_ui
+#define z_limbs_mul_ui z_limbs_add_ui
+#define z_limbs_gcd_ui(na, b) 1
+#define z_limbs_root(na, b) ((na) / ((b) > 0 ? (b) : 1) + 1)
+#define z_limbs_pow_ui(na, b) 0
+#define z_limbs_bin_ui(na, b) 0
+#define z_limbs_neg(na) (na)
+#define z_limbs_abs(na) (na)
+#define z_limbs_com(na) ((na) + 1)
+#define z_limbs_sqrt(na) ((na) / 2 + 1)
+#define z_limbs_quotient(nn, nd) ((nn) - (nd) + 1)
+#define z_limbs_divexact z_limbs_quotient
+#define z_limbs_mod(nn, nd) (nd)
+
 /**** Arithmetic */
 
 #define z_binary_op_ui(op)                              \
 value _mlgmp_z_##op(value a, value b)		        \
 {							\
   CAMLparam2(a, b);                                     \
-  CAMLlocal1(r);                                        \
-  r=alloc_init_mpz();				        \
-  mpz_##op(*mpz_val(r), *mpz_val(a), Long_val(b));	\
-  CAMLreturn(r);					\
+  trace(op);                                            \
+  mpz_small_t sa;                                       \
+  mpz_srcptr za = mpz_src(a, sa);                       \
+  mpz_t r;                                              \
+  z_init_limbs(r, z_limbs_##op(mpz_size(za), Long_val(b))); \
+  mpz_##op(r, za, Long_val(b));				\
+  CAMLreturn(wrap_mpz(r));				\
 }                                                       \
                                                         \
 value _mlgmp_z2_##op(value r, value a, value b)		\
 {							\
   CAMLparam3(r, a, b);                                  \
-  mpz_##op(*mpz_val(r), *mpz_val(a), Long_val(b));	\
+  trace_name("Gmp.Z2." #op);                            \
+  z2_enter(r);                                          \
+  mpz_small_t sa;                                       \
+  mpz_##op(*mpz_val(r), mpz_src(a, sa), Long_val(b));	\
+  z2_leave(r);                                          \
   CAMLreturn(Val_unit);					\
 }
 
@@ -166,16 +386,23 @@ value _mlgmp_z2_##op(value r, value a, value b)		\
 value _mlgmp_z_##op(value a, value b)			\
 {							\
   CAMLparam2(a, b);                                     \
-  CAMLlocal1(r);                                        \
-  r=alloc_init_mpz();				        \
-  mpz_##op(*mpz_val(r), *mpz_val(a), *mpz_val(b));	\
-  CAMLreturn(r);	       				\
+  trace(op);                                            \
+  mpz_small_t sa, sb;                                   \
+  mpz_srcptr za = mpz_src(a, sa), zb = mpz_src(b, sb);  \
+  mpz_t r;                                              \
+  z_init_limbs(r, z_limbs_##op(mpz_size(za), mpz_size(zb))); \
+  mpz_##op(r, za, zb);					\
+  CAMLreturn(wrap_mpz(r));     				\
 }                                                       \
                                                         \
 value _mlgmp_z2_##op(value r, value a, value b)	       	\
 {							\
   CAMLparam3(r, a, b);                                  \
-  mpz_##op(*mpz_val(r), *mpz_val(a), *mpz_val(b));	\
+  trace_name("Gmp.Z2." #op);                            \
+  z2_enter(r);                                          \
+  mpz_small_t sa, sb;                                   \
+  mpz_##op(*mpz_val(r), mpz_src(a, sa), mpz_src(b, sb));\
+  z2_leave(r);                                          \
   CAMLreturn(Val_unit);	       				\
 }
 
@@ -187,6 +414,133 @@ z_binary_op(add)
 z_binary_op(sub)
 z_binary_op(mul)
 
+/**** Fused operations */
+
+/* acc + a * b and acc - a * b in one result; Z2 versions update the
+   destination in place. */
+#define z_fused_op(op, val)						\
+value _mlgmp_z_##op(value acc, value a, value b)			\
+{									\
+  CAMLparam3(acc, a, b);						\
+  trace(op);                                                            \
+  mpz_small_t sacc, sa, sb;						\
+  mpz_srcptr zacc = mpz_src(acc, sacc), za = mpz_src(a, sa);		\
+  mpz_t r;								\
+  z_init_limbs(r, z_limbs_add(mpz_size(zacc),				\
+			      mpz_size(za) + val##_limbs(b, sb)));	\
+  mpz_set(r, zacc);							\
+  mpz_##op(r, za, val(b, sb));						\
+  CAMLreturn(wrap_mpz(r));						\
+}									\
+									\
+value _mlgmp_z2_##op(value r, value a, value b)			\
+{									\
+  CAMLparam3(r, a, b);							\
+  trace_name("Gmp.Z2." #op);                                            \
+  z2_enter(r);								\
+  mpz_small_t sa, sb;							\
+  mpz_##op(*mpz_val(r), mpz_src(a, sa), val(b, sb));			\
+  z2_leave(r);								\
+  CAMLreturn(Val_unit);							\
+}
+
+#define fused_mpz(v, s) mpz_src(v, s)
+#define fused_mpz_limbs(v, s) mpz_size(mpz_src(v, s))
+#define fused_ui(v, s) ((unsigned long) Long_val(v))
+#define fused_ui_limbs(v, s) 1
+
+z_fused_op(addmul, fused_mpz)
+z_fused_op(submul, fused_mpz)
+z_fused_op(addmul_ui, fused_ui)
+z_fused_op(submul_ui, fused_ui)
+
+/* a * b + c * d */
+value _mlgmp_z_mul_add(value a, value b, value c, value d)
+{
+  CAMLparam4(a, b, c, d);
+  mpz_small_t sa, sb, sc, sd;
+  mpz_srcptr za = mpz_src(a, sa), zb = mpz_src(b, sb),
+    zc = mpz_src(c, sc), zd = mpz_src(d, sd);
+  mpz_t r;
+  z_init_limbs(r, z_limbs_add(mpz_size(za) + mpz_size(zb),
+			      mpz_size(zc) + mpz_size(zd)));
+  mpz_mul(r, za, zb);
+  mpz_addmul(r, zc, zd);
+  CAMLreturn(wrap_mpz(r));
+}
+
+/* The destination must not be overwritten while it is still an operand,
+   so it gets the result through a temporary when it is one of them. */
+value _mlgmp_z2_mul_add(value r, value a, value b, value c, value d)
+{
+  CAMLparam5(r, a, b, c, d);
+  z2_enter(r);
+  mpz_small_t sa, sb, sc, sd;
+  if (r == c || r == d)
+    {
+      mpz_t t;
+      mpz_init(t);
+      mpz_mul(t, mpz_src(a, sa), mpz_src(b, sb));
+      mpz_addmul(t, mpz_src(c, sc), mpz_src(d, sd));
+      mpz_swap(*mpz_val(r), t);
+      z_clear(t);
+    }
+  else
+    {
+      mpz_mul(*mpz_val(r), mpz_src(a, sa), mpz_src(b, sb));
+      mpz_addmul(*mpz_val(r), mpz_src(c, sc), mpz_src(d, sd));
+    }
+  z2_leave(r);
+  CAMLreturn(Val_unit);
+}
+
+/* The sum of the c.(i) * x.(i), into r; c and x have the same length. */
+static void z_lincomb(mpz_ptr r, value c, value x)
+{
+  mlsize_t i, n = Wosize_val(c);
+  mpz_small_t sc, sx;
+  mpz_set_ui(r, 0);
+  for(i=0; i<n; i++)
+    mpz_addmul(r, mpz_src(Field(c, i), sc), mpz_src(Field(x, i), sx));
+}
+
+value _mlgmp_z_lincomb(value c, value x)
+{
+  CAMLparam2(c, x);
+  mpz_t r;
+  if (Wosize_val(c) != Wosize_val(x))
+    caml_invalid_argument("Gmp.Z.lincomb");
+  mpz_init(r);
+  z_lincomb(r, c, x);
+  CAMLreturn(wrap_mpz(r));
+}
+
+value _mlgmp_z2_lincomb(value r, value c, value x)
+{
+  CAMLparam3(r, c, x);
+  z2_enter(r);
+  mlsize_t i;
+  int alias = 0;
+  if (Wosize_val(c) != Wosize_val(x))
+    caml_invalid_argument("Gmp.Z2.lincomb");
+  for(i=0; i<Wosize_val(c); i++)
+    alias |= Field(c, i) == r;
+  for(i=0; i<Wosize_val(x); i++)
+    alias |= Field(x, i) == r;
+  if (alias)
+    {
+      mpz_t t;
+      mpz_init(t);
+      z_lincomb(t, c, x);
+      mpz_swap(*mpz_val(r), t);
+      z_clear(t);
+    }
+  else
+    z_lincomb(*mpz_val(r), c, x);
+  z2_leave(r);
+  CAMLreturn(Val_unit);
+}
+
 /**** Powers */
 z_binary_op_ui(pow_ui)
 
@@ -194,48 +548,79 @@ z_binary_op_ui(pow_ui)
 value _mlgmp_z_powm_ui(value a, value b, value modulus)
 {
   CAMLparam3(a, b, modulus);
-  CAMLlocal1(r);
-  r=alloc_init_mpz();
-  mpz_powm_ui(*mpz_val(r), *mpz_val(a), Long_val(b), *mpz_val(modulus));
-  CAMLreturn(r);
+  mpz_small_t sa, smod;
+  __mpz_struct za = mpz_detach(a, sa), zmod = mpz_detach(modulus, smod);
+  unsigned long e = Long_val(b);
+  mpz_t r;
+  mpz_init(r);
+  blocking_section(release_lock_p(mpz_size(&zmod)),
+		   mpz_powm_ui(r, &za, e, &zmod));
+  CAMLreturn(wrap_mpz(r));
 }
 
 value _mlgmp_z_ui_pow_ui(value a, value b)
 {
   CAMLparam2(a, b);
-  CAMLlocal1(r);
-  r=alloc_init_mpz();
-  mpz_ui_pow_ui(*mpz_val(r), Long_val(a), Long_val(b));
-  CAMLreturn(r);
+  mpz_t r;
+  mpz_init(r);
+  mpz_ui_pow_ui(r, Long_val(a), Long_val(b));
+  CAMLreturn(wrap_mpz(r));
 }
 
 value _mlgmp_z_powm(value a, value b, value modulus)
 {
   CAMLparam3(a, b, modulus);
-  CAMLlocal1(r);
-  r=alloc_init_mpz();
-  mpz_powm(*mpz_val(r), *mpz_val(a), *mpz_val(b), *mpz_val(modulus));
-  CAMLreturn(r);
+  mpz_small_t sa, sb, smod;
+  __mpz_struct za = mpz_detach(a, sa), zb = mpz_detach(b, sb),
+    zmod = mpz_detach(modulus, smod);
+  mpz_t r;
+  mpz_init(r);
+  blocking_section(release_lock_p(mpz_size(&zmod)),
+		   mpz_powm(r, &za, &zb, &zmod));
+  CAMLreturn(wrap_mpz(r));
 }
 
 value _mlgmp_z2_powm_ui(value r, value a, value b, value modulus)
 {
   CAMLparam4(r, a, b, modulus);
-  mpz_powm_ui(*mpz_val(r), *mpz_val(a), Long_val(b), *mpz_val(modulus));
+  z2_enter(r);
+  mpz_small_t sa, smod;
+  unsigned long e = Long_val(b);
+  if (release_lock_p(mpz_size(mpz_src(modulus, smod))))
+    {
+      __mpz_struct za = mpz_detach(a, sa), zmod = mpz_detach(modulus, smod);
+      z2_blocking_section(r, mpz_powm_ui, &za, e, &zmod);
+    }
+  else
+    mpz_powm_ui(*mpz_val(r), mpz_src(a, sa), e, mpz_src(modulus, smod));
+  z2_leave(r);
   CAMLreturn(Val_unit);
 }
 
 value _mlgmp_z2_ui_pow_ui(value r, value a, value b)
 {
   CAMLparam3(r, a, b);
+  z2_enter(r);
   mpz_ui_pow_ui(*mpz_val(r), Long_val(a), Long_val(b));
+  z2_leave(r);
   CAMLreturn(Val_unit);
 }
 
 value _mlgmp_z2_powm(value r, value a, value b, value modulus)
 {
   CAMLparam4(r, a, b, modulus);
-  mpz_powm(*mpz_val(r), *mpz_val(a), *mpz_val(b), *mpz_val(modulus));
+  z2_enter(r);
+  mpz_small_t sa, sb, smod;
+  if (release_lock_p(mpz_size(mpz_src(modulus, smod))))
+    {
+      __mpz_struct za = mpz_detach(a, sa), zb = mpz_detach(b, sb),
+	zmod = mpz_detach(modulus, smod);
+      z2_blocking_section(r, mpz_powm, &za, &zb, &zmod);
+    }
+  else
+    mpz_powm(*mpz_val(r), mpz_src(a, sa), mpz_src(b, sb),
+	     mpz_src(modulus, smod));
+  z2_leave(r);
   CAMLreturn(Val_unit);
 }
 
@@ -244,16 +629,23 @@ value _mlgmp_z2_powm(value r, value a, value b, value modulus)
 value _mlgmp_z_##op(value a)			\
 {						\
   CAMLparam1(a);				\
-  CAMLlocal1(r);				\
-  r=alloc_init_mpz();   			\
-  mpz_##op(*mpz_val(r), *mpz_val(a));		\
-  CAMLreturn(r);				\
+  trace(op);                                    \
+  mpz_small_t sa;				\
+  mpz_srcptr za = mpz_src(a, sa);		\
+  mpz_t r;					\
+  z_init_limbs(r, z_limbs_##op(mpz_size(za)));	\
+  mpz_##op(r, za);				\
+  CAMLreturn(wrap_mpz(r));			\
 }                                               \
                                                 \
 value _mlgmp_z2_##op(value r, value a)	        \
 {						\
   CAMLparam2(r, a);				\
-  mpz_##op(*mpz_val(r), *mpz_val(a));		\
+  trace_name("Gmp.Z2." #op);                    \
+  z2_enter(r);                                          \
+  mpz_small_t sa;				\
+  mpz_##op(*mpz_val(r), mpz_src(a, sa));	\
+  z2_leave(r);                                          \
   CAMLreturn(Val_unit);				\
 }
 
@@ -269,24 +661,42 @@ value _mlgmp_z_sqrtrem(value a)
 {
   CAMLparam1(a);
   CAMLlocal3(q, r, qr);
-  q=alloc_init_mpz();
-  r=alloc_init_mpz();
+  mpz_small_t sa;
+  mpz_t mq, mr;
+  mpz_init(mq);
+  mpz_init(mr);
 
-  mpz_sqrtrem(*mpz_val(q), *mpz_val(r), *mpz_val(a));
+  mpz_sqrtrem(mq, mr, mpz_src(a, sa));
 
+  q=wrap_mpz(mq);
+  r=wrap_mpz(mr);
   qr=caml_alloc_tuple(2);
   Store_field(qr, 0, q);
   Store_field(qr, 1, r);
   CAMLreturn(qr);
 }
+
+value _mlgmp_z2_sqrtrem(value q, value r, value a)
+{
+  CAMLparam3(q, r, a);
+  z2_enter(q);
+  z2_enter(r);
+  mpz_small_t sa;
+  if (q == r)
+    caml_invalid_argument("Gmp.Z2.sqrtrem");
+  mpz_sqrtrem(*mpz_val(q), *mpz_val(r), mpz_src(a, sa));
+  z2_leave(q);
+  z2_leave(r);
+  CAMLreturn(Val_unit);
+}
 									
 z_binary_op_ui(root)
 
 #define z_unary_p(name)				\
 value _mlgmp_z_##name(value a)			\
 {						\
-  CAMLparam1(a);                                \
-  CAMLreturn(Val_bool(mpz_##name(*mpz_val(a))));\
+  mpz_small_t sa;				\
+  return Val_bool(mpz_##name(mpz_src(a, sa)));	\
 }
 
 z_unary_p(perfect_power_p)
@@ -296,163 +706,244 @@ z_unary_p(perfect_square_p)
 
 /* IMPORTANT NOTE:
 Storing mpz_val(d) into a temporary pointer won't work because the GC
-may move the data when allocating q and r.
+may move the data when allocating q and r.  This is why results are
+computed into local mpz_t's and only wrapped once the operands are no
+longer needed.
 */
 
 #define z_xdivision_op(kind)						\
 value _mlgmp_z_##kind##div_qr(value n, value d)				\
 {									\
   CAMLparam2(n, d);							\
+  trace(kind##div_qr);                                                  \
   CAMLlocal3(q, r, qr);							\
-  if (! mpz_sgn(*mpz_val(d)))						\
+  mpz_small_t sn, sd;							\
+  mpz_t mq, mr;								\
+  if (! mpz_sgn(mpz_src(d, sd)))					\
     division_by_zero();							\
 									\
-  q=alloc_init_mpz();							\
-  r=alloc_init_mpz();							\
+  z_init_limbs(mq, z_limbs_quotient(mpz_size(mpz_src(n, sn)),		\
+				    mpz_size(mpz_src(d, sd))));		\
+  z_init_limbs(mr, mpz_size(mpz_src(d, sd)));				\
 									\
-  mpz_##kind##div_qr(*mpz_val(q), *mpz_val(r), *mpz_val(n), *mpz_val(d));\
+  mpz_##kind##div_qr(mq, mr, mpz_src(n, sn), mpz_src(d, sd));		\
 									\
+  q=wrap_mpz(mq);							\
+  r=wrap_mpz(mr);							\
   qr=caml_alloc_tuple(2);							\
   Store_field(qr, 0, q);						\
   Store_field(qr, 1, r);						\
   CAMLreturn(qr);						        \
 }									\
 									\
+value _mlgmp_z2_##kind##div_qr(value q, value r, value n, value d)	\
+{									\
+  CAMLparam4(q, r, n, d);						\
+  trace_name("Gmp.Z2." #kind "div_qr");                                 \
+  z2_enter(q);								\
+  z2_enter(r);								\
+  mpz_small_t sn, sd;							\
+									\
+  if (q == r)								\
+    caml_invalid_argument("Gmp.Z2." #kind "div_qr");			\
+  if (! mpz_sgn(mpz_src(d, sd)))					\
+    division_by_zero();							\
+									\
+  mpz_##kind##div_qr(*mpz_val(q), *mpz_val(r),				\
+		     mpz_src(n, sn), mpz_src(d, sd));			\
+									\
+  z2_leave(q);								\
+  z2_leave(r);								\
+  CAMLreturn(Val_unit);							\
+}									\
+									\
 value _mlgmp_z_##kind##div_q(value n, value d)				\
 {									\
   CAMLparam2(n, d);                                                     \
-  CAMLlocal1(q);						      	\
+  trace(kind##div_q);                                                   \
+  mpz_small_t sn, sd;							\
+  mpz_t q;								\
 									\
-  if (! mpz_sgn(*mpz_val(d)))						\
+  if (! mpz_sgn(mpz_src(d, sd)))					\
     division_by_zero();							\
 									\
-  q=alloc_init_mpz();							\
+  z_init_limbs(q, z_limbs_quotient(mpz_size(mpz_src(n, sn)),		\
+				   mpz_size(mpz_src(d, sd))));		\
 									\
-  mpz_##kind##div_q(*mpz_val(q), *mpz_val(n), *mpz_val(d));	       	\
+  mpz_##kind##div_q(q, mpz_src(n, sn), mpz_src(d, sd));	       	\
 									\
-  CAMLreturn(q);	       						\
+  CAMLreturn(wrap_mpz(q));	       					\
 }									\
 									\
 value _mlgmp_z2_##kind##div_q(value q, value n, value d)		\
 {									\
   CAMLparam3(q, n, d);                                                  \
+  trace_name("Gmp.Z2." #kind "div_q");                                  \
+  z2_enter(q);                                          \
+  mpz_small_t sn, sd;							\
 									\
-  if (! mpz_sgn(*mpz_val(d)))						\
+  if (! mpz_sgn(mpz_src(d, sd)))					\
     division_by_zero();							\
 									\
-  mpz_##kind##div_q(*mpz_val(q), *mpz_val(n), *mpz_val(d));	       	\
+  mpz_##kind##div_q(*mpz_val(q), mpz_src(n, sn), mpz_src(d, sd));	\
 									\
+  z2_leave(q);                                          \
   CAMLreturn(Val_unit);	       						\
 }									\
 									\
 value _mlgmp_z_##kind##div_r(value n, value d)				\
 {									\
   CAMLparam2(n, d);                                                     \
-  CAMLlocal1(r);						      	\
+  trace(kind##div_r);                                                   \
+  mpz_small_t sn, sd;							\
+  mpz_t r;								\
 									\
-  if (! mpz_sgn(*mpz_val(d)))						\
+  if (! mpz_sgn(mpz_src(d, sd)))					\
     division_by_zero();							\
 									\
-  r=alloc_init_mpz();							\
+  z_init_limbs(r, mpz_size(mpz_src(d, sd)));				\
 									\
-  mpz_##kind##div_r(*mpz_val(r), *mpz_val(n), *mpz_val(d));	       	\
+  mpz_##kind##div_r(r, mpz_src(n, sn), mpz_src(d, sd));	       	\
 									\
-  CAMLreturn(r);	       						\
+  CAMLreturn(wrap_mpz(r));	       					\
 }									\
 									\
 value _mlgmp_z2_##kind##div_r(value r, value n, value d)      		\
 {									\
   CAMLparam3(r, n, d);                                                     \
+  trace_name("Gmp.Z2." #kind "div_r");                                     \
+  z2_enter(r);                                          \
+  mpz_small_t sn, sd;							\
 									\
-  if (! mpz_sgn(*mpz_val(d)))						\
+  if (! mpz_sgn(mpz_src(d, sd)))					\
     division_by_zero();							\
 									\
-  mpz_##kind##div_r(*mpz_val(r), *mpz_val(n), *mpz_val(d));	       	\
+  mpz_##kind##div_r(*mpz_val(r), mpz_src(n, sn), mpz_src(d, sd));	\
 									\
+  z2_leave(r);                                          \
   CAMLreturn(Val_unit);	       						\
 }									\
 									\
 value _mlgmp_z_##kind##div_qr_ui(value n, value d)			\
 {									\
   CAMLparam2(n, d);                                                     \
+  trace(kind##div_qr_ui);                                               \
   CAMLlocal3(q, r, qr);							\
+  mpz_small_t sn;							\
+  mpz_t mq, mr;								\
   unsigned long int ui_d = Long_val(d);					\
 									\
   if (! ui_d) division_by_zero();					\
 									\
-  q=alloc_init_mpz();							\
-  r=alloc_init_mpz();							\
+  z_init_limbs(mq, mpz_size(mpz_src(n, sn)));				\
+  mpz_init(mr);								\
 									\
-  mpz_##kind##div_qr_ui(*mpz_val(q), *mpz_val(r), *mpz_val(n), ui_d);	\
+  mpz_##kind##div_qr_ui(mq, mr, mpz_src(n, sn), ui_d);			\
 									\
+  q=wrap_mpz(mq);							\
+  r=wrap_mpz(mr);							\
   qr=caml_alloc_tuple(2);							\
   Store_field(qr, 0, q);						\
   Store_field(qr, 1, r);						\
   CAMLreturn(qr);	       						\
 }									\
 									\
+value _mlgmp_z2_##kind##div_qr_ui(value q, value r, value n, value d)	\
+{									\
+  CAMLparam4(q, r, n, d);						\
+  trace_name("Gmp.Z2." #kind "div_qr_ui");                              \
+  z2_enter(q);								\
+  z2_enter(r);								\
+  mpz_small_t sn;							\
+  unsigned long int ui_d = Long_val(d);					\
+									\
+  if (q == r)								\
+    caml_invalid_argument("Gmp.Z2." #kind "div_qr_ui");		\
+  if (! ui_d) division_by_zero();					\
+									\
+  mpz_##kind##div_qr_ui(*mpz_val(q), *mpz_val(r), mpz_src(n, sn), ui_d);	\
+									\
+  z2_leave(q);								\
+  z2_leave(r);								\
+  CAMLreturn(Val_unit);							\
+}									\
+									\
 value _mlgmp_z_##kind##div_q_ui(value n, value d)			\
 {									\
   CAMLparam2(n, d);                                                     \
-  CAMLlocal1(q);       							\
+  trace(kind##div_q_ui);                                                \
+  mpz_small_t sn;							\
+  mpz_t q;								\
   unsigned long int ui_d = Long_val(d);					\
 									\
  if (! ui_d) division_by_zero();					\
 									\
-  q=alloc_init_mpz();							\
+  z_init_limbs(q, mpz_size(mpz_src(n, sn)));				\
 									\
-  mpz_##kind##div_q_ui(*mpz_val(q), *mpz_val(n), ui_d);			\
+  mpz_##kind##div_q_ui(q, mpz_src(n, sn), ui_d);			\
 									\
-  CAMLreturn(q);	       						\
+  CAMLreturn(wrap_mpz(q));	       					\
 }									\
 									\
 value _mlgmp_z2_##kind##div_q_ui(value q, value n, value d)		\
 {									\
   CAMLparam3(q, n, d);                                                     \
+  trace_name("Gmp.Z2." #kind "div_q_ui");                                  \
+  z2_enter(q);                                          \
+  mpz_small_t sn;							\
   unsigned long int ui_d = Long_val(d);					\
 									\
  if (! ui_d) division_by_zero();					\
 									\
-  mpz_##kind##div_q_ui(*mpz_val(q), *mpz_val(n), ui_d);			\
+  mpz_##kind##div_q_ui(*mpz_val(q), mpz_src(n, sn), ui_d);		\
 									\
+  z2_leave(q);                                          \
   CAMLreturn(Val_unit);	       						\
 }									\
 									\
 value _mlgmp_z_##kind##div_r_ui(value n, value d)			\
 {									\
   CAMLparam2(n, d);                                                     \
-  CAMLlocal1(r);       							\
+  trace(kind##div_r_ui);                                                \
+  mpz_small_t sn;							\
+  mpz_t r;								\
   unsigned long int ui_d = Long_val(d);					\
 									\
   if (! ui_d) division_by_zero();					\
 									\
-  r=alloc_init_mpz();							\
+  mpz_init(r);								\
 									\
-  mpz_##kind##div_r_ui(*mpz_val(r), *mpz_val(n), ui_d);			\
+  mpz_##kind##div_r_ui(r, mpz_src(n, sn), ui_d);			\
 									\
-  CAMLreturn(r);	       						\
+  CAMLreturn(wrap_mpz(r));	       					\
 }									\
 									\
 value _mlgmp_z2_##kind##div_r_ui(value r, value n, value d)		\
 {									\
   CAMLparam3(r, n, d);                                                  \
+  trace_name("Gmp.Z2." #kind "div_r_ui");                               \
+  z2_enter(r);                                          \
+  mpz_small_t sn;							\
   unsigned long int ui_d = Long_val(d);					\
 									\
  if (! ui_d) division_by_zero();					\
 									\
-  mpz_##kind##div_r_ui(*mpz_val(r), *mpz_val(n), ui_d);			\
+  mpz_##kind##div_r_ui(*mpz_val(r), mpz_src(n, sn), ui_d);		\
 									\
+  z2_leave(r);                                          \
   CAMLreturn(Val_unit);	       						\
 }									\
 									\
 value _mlgmp_z_##kind##div_ui(value n, value d)				\
 {									\
   CAMLparam2(n, d);                                                     \
+  trace(kind##div_ui);                                                  \
+  mpz_small_t sn;							\
   unsigned long int ui_d = Long_val(d);					\
 									\
   if (! ui_d) division_by_zero();					\
 									\
-  CAMLreturn(Val_int(mpz_##kind##div_ui(*mpz_val(n), ui_d)));	        \
+  CAMLreturn(Val_int(mpz_##kind##div_ui(mpz_src(n, sn), ui_d)));	\
 }
 
 z_xdivision_op(t)
@@ -463,27 +954,34 @@ z_xdivision_op(c)
 value _mlgmp_z_##op(value n, value d)		\
 {						\
   CAMLparam2(n, d);				\
-  CAMLlocal1(q);				\
+  trace(op);                                    \
+  mpz_small_t sn, sd;				\
+  mpz_t q;					\
 						\
-  if (! mpz_sgn(*mpz_val(d)))			\
+  if (! mpz_sgn(mpz_src(d, sd)))		\
     division_by_zero();				\
 						\
-  q=alloc_init_mpz();				\
+  z_init_limbs(q, z_limbs_##op(mpz_size(mpz_src(n, sn)),	\
+				mpz_size(mpz_src(d, sd))));	\
 						\
-  mpz_##op(*mpz_val(q), *mpz_val(n), *mpz_val(d)); \
+  mpz_##op(q, mpz_src(n, sn), mpz_src(d, sd));	\
 						\
-  CAMLreturn(q);				\
+  CAMLreturn(wrap_mpz(q));			\
 }						\
 						\
 value _mlgmp_z2_##op(value q, value n, value d)	\
 {						\
   CAMLparam3(q, n, d);				\
+  trace_name("Gmp.Z2." #op);                    \
+  z2_enter(q);                                          \
+  mpz_small_t sn, sd;				\
 						\
-  if (! mpz_sgn(*mpz_val(d)))			\
+  if (! mpz_sgn(mpz_src(d, sd)))		\
     division_by_zero();				\
 						\
-  mpz_##op(*mpz_val(q), *mpz_val(n), *mpz_val(d)); \
+  mpz_##op(*mpz_val(q), mpz_src(n, sn), mpz_src(d, sd)); \
 						\
+  z2_leave(q);                                          \
   CAMLreturn(Val_unit);				\
 }
 
@@ -491,29 +989,35 @@ value _mlgmp_z2_##op(value q, value n, value d)	\
 value _mlgmp_z_##op(value n, value d)		\
 {						\
   CAMLparam2(n, d);				\
-  CAMLlocal1(q);				\
+  trace(op);                                    \
+  mpz_small_t sn;				\
+  mpz_t q;					\
   unsigned long ld = Long_val(d);			\
 						\
   if (! ld)	                 		\
     division_by_zero();				\
 						\
-  q=alloc_init_mpz();				\
+  mpz_init(q);					\
 						\
-  mpz_##op(*mpz_val(q), *mpz_val(n), ld);	\
+  mpz_##op(q, mpz_src(n, sn), ld);		\
 						\
-  CAMLreturn(q);				\
+  CAMLreturn(wrap_mpz(q));			\
 }						\
 						\
 value _mlgmp_z2_##op(value q, value n, value d)	\
 {						\
   CAMLparam3(q, n, d);				\
+  trace_name("Gmp.Z2." #op);                    \
+  z2_enter(q);                                          \
+  mpz_small_t sn;				\
   unsigned long ld = Long_val(d);			\
 						\
   if (! ld)			                \
     division_by_zero();				\
 						\
-  mpz_##op(*mpz_val(q), *mpz_val(n), ld);	\
+  mpz_##op(*mpz_val(q), mpz_src(n, sn), ld);	\
 						\
+  z2_leave(q);                                          \
   CAMLreturn(Val_unit);				\
 }
 
@@ -526,16 +1030,22 @@ z_division_op_ui(mod_ui)
 value _mlgmp_z_##type(value a, value shift)		\
 {                                                       \
   CAMLparam2(a, shift);                                 \
-  CAMLlocal1(r);					\
-  r=alloc_init_mpz();   				\
-  mpz_##type(*mpz_val(r), *mpz_val(a), Int_val(shift));	\
-  CAMLreturn(r);       					\
+  trace(type);                                          \
+  mpz_small_t sa;					\
+  mpz_t r;						\
+  mpz_init(r);						\
+  mpz_##type(r, mpz_src(a, sa), Int_val(shift));	\
+  CAMLreturn(wrap_mpz(r));				\
 }                                                       \
                                                         \
 value _mlgmp_z2_##type(value r, value a, value shift)	\
 {                                                       \
   CAMLparam3(r, a, shift);                              \
-  mpz_##type(*mpz_val(r), *mpz_val(a), Int_val(shift));	\
+  trace_name("Gmp.Z2." #type);                          \
+  z2_enter(r);                                          \
+  mpz_small_t sa;					\
+  mpz_##type(*mpz_val(r), mpz_src(a, sa), Int_val(shift));\
+  z2_leave(r);                                          \
   CAMLreturn(Val_unit);     				\
 }
 
@@ -572,19 +1082,37 @@ z_shift_op_unimplemented(cdiv_r_2exp)
 int _mlgmp_z_custom_compare(value a, value b)
 {
   CAMLparam2(a, b);
-  CAMLreturn(mpz_cmp(*mpz_val(a), *mpz_val(b)));
+  CAMLreturnT(int, mpz_cmp(*mpz_val(a), *mpz_val(b)));
 }
 
-value _mlgmp_z_compare(value a, value b)
+/* Called by compare when a is a custom block and b an unboxed integer. */
+int _mlgmp_z_custom_compare_ext(value a, value b)
 {
   CAMLparam2(a, b);
-  CAMLreturn(Val_int(mpz_cmp(*mpz_val(a), *mpz_val(b))));
+  mpz_small_t sb;
+  CAMLreturnT(int, mpz_cmp(*mpz_val(a), mpz_src(b, sb)));
+}
+
+intnat _mlgmp_z_compare_untagged(value a, value b)
+{
+  mpz_small_t sa, sb;
+  return mpz_cmp(mpz_src(a, sa), mpz_src(b, sb));
+}
+
+value _mlgmp_z_compare(value a, value b)
+{
+  return Val_int(_mlgmp_z_compare_untagged(a, b));
+}
+
+intnat _mlgmp_z_compare_si_untagged(value a, intnat b)
+{
+  mpz_small_t sa, sb;
+  return mpz_cmp(mpz_src(a, sa), mpz_small_set(&sb, b));
 }
 
 value _mlgmp_z_compare_si(value a, value b)
 {
-  CAMLparam2(a, b);
-  CAMLreturn(Val_int(mpz_cmp_si(*mpz_val(a), Long_val(b))));
+  return Val_int(_mlgmp_z_compare_si_untagged(a, Long_val(b)));
 }
 
 /*** Number theory */
@@ -592,10 +1120,40 @@ value _mlgmp_z_compare_si(value a, value b)
 value _mlgmp_z_probab_prime_p(value n, value reps)
 {
   CAMLparam2(n, reps);
-  CAMLreturn(Val_bool(mpz_probab_prime_p(*mpz_val(n), Int_val(reps))));
+  mpz_small_t sn;
+  __mpz_struct zn = mpz_detach(n, sn);
+  int nreps = Int_val(reps), x;
+  blocking_section(release_lock_p(mpz_size(&zn)),
+		   x = mpz_probab_prime_p(&zn, nreps));
+  CAMLreturn(Val_bool(x));
+}
+
+value _mlgmp_z_nextprime(value a)
+{
+  CAMLparam1(a);
+  mpz_small_t sa;
+  __mpz_struct za = mpz_detach(a, sa);
+  mpz_t r;
+  mpz_init(r);
+  blocking_section(release_lock_p(mpz_size(&za)), mpz_nextprime(r, &za));
+  CAMLreturn(wrap_mpz(r));
 }
 
-z_unary_op(nextprime)
+value _mlgmp_z2_nextprime(value r, value a)
+{
+  CAMLparam2(r, a);
+  z2_enter(r);
+  mpz_small_t sa;
+  if (release_lock_p(mpz_size(mpz_src(a, sa))))
+    {
+      __mpz_struct za = mpz_detach(a, sa);
+      z2_blocking_section(r, mpz_nextprime, &za);
+    }
+  else
+    mpz_nextprime(*mpz_val(r), mpz_src(a, sa));
+  z2_leave(r);
+  CAMLreturn(Val_unit);
+}
 
 z_binary_op(gcd)
 z_binary_op_mpz(lcm)
@@ -604,10 +1162,15 @@ value  _mlgmp_z_gcdext(value a, value b)
 {
   CAMLparam2(a, b);
   CAMLlocal4(g, s, t, r);
-  g=alloc_init_mpz();  
-  s=alloc_init_mpz();  
-  t=alloc_init_mpz();
-  mpz_gcdext(*mpz_val(g), *mpz_val(s), *mpz_val(t), *mpz_val(a), *mpz_val(b));
+  mpz_small_t sa, sb;
+  mpz_t mg, ms, mt;
+  mpz_init(mg);
+  mpz_init(ms);
+  mpz_init(mt);
+  mpz_gcdext(mg, ms, mt, mpz_src(a, sa), mpz_src(b, sb));
+  g=wrap_mpz(mg);
+  s=wrap_mpz(ms);
+  t=wrap_mpz(mt);
   r=caml_alloc_tuple(3);
   Store_field(r, 0, g);
   Store_field(r, 1, s);
@@ -615,17 +1178,49 @@ value  _mlgmp_z_gcdext(value a, value b)
   CAMLreturn(r);
 }						     
 
+value  _mlgmp_z2_gcdext(value g, value s, value t, value a, value b)
+{
+  CAMLparam5(g, s, t, a, b);
+  z2_enter(g);
+  z2_enter(s);
+  z2_enter(t);
+  mpz_small_t sa, sb;
+  if (g == s || g == t || s == t)
+    caml_invalid_argument("Gmp.Z2.gcdext");
+  mpz_gcdext(*mpz_val(g), *mpz_val(s), *mpz_val(t),
+	     mpz_src(a, sa), mpz_src(b, sb));
+  z2_leave(g);
+  z2_leave(s);
+  z2_leave(t);
+  CAMLreturn(Val_unit);
+}
+
+/* Returns false, leaving r undefined, when there is no inverse. */
+value  _mlgmp_z2_invert(value r, value a, value b)
+{
+  CAMLparam3(r, a, b);
+  z2_enter(r);
+  mpz_small_t sa, sb;
+  int ok = mpz_invert(*mpz_val(r), mpz_src(a, sa), mpz_src(b, sb));
+  z2_leave(r);
+  CAMLreturn(Val_bool(ok));
+}
+
 value  _mlgmp_z_invert(value a, value b)
 {
   CAMLparam2(a, b);
   CAMLlocal2(i, r);
-  i = alloc_init_mpz();
-  if (! mpz_invert(*mpz_val(i),*mpz_val(a), *mpz_val(b)))
+  mpz_small_t sa, sb;
+  mpz_t mi;
+  mpz_init(mi);
+  if (! mpz_invert(mi, mpz_src(a, sa), mpz_src(b, sb)))
     {
+      mpz_clear(mi);
       r=Val_false;
     }
   else
     {
+      i=wrap_mpz(mi);
       r=caml_alloc_tuple(1);
       Store_field(r, 0, i);
     }
@@ -633,25 +1228,40 @@ value  _mlgmp_z_invert(value a, value b)
 }						     
 
 #define z_int_binary_op(op)					\
+intnat _mlgmp_z_##op##_untagged(value a, value b)		\
+{								\
+  mpz_small_t sa, sb;						\
+  return mpz_##op(mpz_src(a, sa), mpz_src(b, sb));		\
+}								\
+								\
 value _mlgmp_z_##op(value a, value b)				\
 {								\
-  CAMLparam2(a, b);						\
-  CAMLreturn(Val_int(mpz_##op(*mpz_val(a), *mpz_val(b))));	\
+  return Val_long(_mlgmp_z_##op##_untagged(a, b));		\
 }
 
 z_int_binary_op(legendre)
 z_int_binary_op(jacobi)
 
+intnat _mlgmp_z_kronecker_si_untagged(value a, intnat b)
+{
+  mpz_small_t sa;
+  return mpz_kronecker_si(mpz_src(a, sa), b);
+}
+
 value _mlgmp_z_kronecker_si(value a, value b)
 {
-  CAMLparam2(a, b);
-  CAMLreturn(Val_int(mpz_kronecker_si(*mpz_val(a), Long_val(b))));
+  return Val_long(_mlgmp_z_kronecker_si_untagged(a, Long_val(b)));
+}
+
+intnat _mlgmp_z_si_kronecker_untagged(intnat a, value b)
+{
+  mpz_small_t sb;
+  return mpz_si_kronecker(a, mpz_src(b, sb));
 }
 
 value _mlgmp_z_si_kronecker(value a, value b)
 {
-  CAMLparam2(a, b);
-  CAMLreturn(Val_int(mpz_si_kronecker(Long_val(a), *mpz_val(b))));
+  return Val_long(_mlgmp_z_si_kronecker_untagged(Long_val(a), b));
 }
 
 value _mlgmp_z_remove(value a, value b)
@@ -659,22 +1269,76 @@ value _mlgmp_z_remove(value a, value b)
   int x;
   CAMLparam2(a, b);
   CAMLlocal2(f, r);
-  f = alloc_init_mpz();
-  x = mpz_remove(*mpz_val(f), *mpz_val(a), *mpz_val(b));
+  mpz_small_t sa, sb;
+  mpz_t mf;
+  mpz_init(mf);
+  x = mpz_remove(mf, mpz_src(a, sa), mpz_src(b, sb));
+  f = wrap_mpz(mf);
   r=caml_alloc_tuple(2);
   Store_field(r, 0, f);
   Store_field(r, 1, Val_int(x));
   CAMLreturn(r);
 }
 
-#define z_unary_op_ui(op)			\
-value _mlgmp_z_##op(value a)			\
-{						\
-  CAMLparam1(a);				\
-  CAMLlocal1(r);				\
-  r = alloc_init_mpz();				\
-  mpz_##op(*mpz_val(r), Long_val(a));		\
-  CAMLreturn(r);				\
+value _mlgmp_z2_remove(value r, value a, value b)
+{
+  int x;
+  CAMLparam3(r, a, b);
+  z2_enter(r);
+  mpz_small_t sa, sb;
+  x = mpz_remove(*mpz_val(r), mpz_src(a, sa), mpz_src(b, sb));
+  z2_leave(r);
+  CAMLreturn(Val_int(x));
+}
+
+/* Rough sizes in limbs of n!, of the n-th Fibonacci number and of
+   binomial(n, k), to decide whether to release the runtime lock. */
+static mp_size_t ui_bits(unsigned long n)
+{
+  mp_size_t b = 0;
+  for(; n != 0; n >>= 1) b++;
+  return b;
+}
+
+static mp_size_t fac_ui_limbs(unsigned long n)
+{
+  return n / GMP_NUMB_BITS * ui_bits(n);
+}
+
+static mp_size_t fib_ui_limbs(unsigned long n)
+{
+  return n / GMP_NUMB_BITS * 7 / 10;
+}
+
+static mp_size_t bin_uiui_limbs(unsigned long n, unsigned long k)
+{
+  if (k > n) return 0;
+  if (k > n - k) k = n - k;
+  return k / GMP_NUMB_BITS * ui_bits(n);
+}
+
+#define z_unary_op_ui(op)					\
+value _mlgmp_z_##op(value a)					\
+{								\
+  CAMLparam1(a);						\
+  unsigned long n = Long_val(a);				\
+  mpz_t r;							\
+  mpz_init(r);							\
+  blocking_section(release_lock_p(op##_limbs(n)), mpz_##op(r, n)); \
+  CAMLreturn(wrap_mpz(r));					\
+}								\
+								\
+value _mlgmp_z2_##op(value r, value a)				\
+{								\
+  CAMLparam2(r, a);						\
+  z2_enter(r);							\
+  unsigned long n = Long_val(a);				\
+  if (release_lock_p(op##_limbs(n)))				\
+    z2_blocking_section(r, mpz_##op, n);			\
+  else								\
+    mpz_##op(*mpz_val(r), n);					\
+  z2_leave(r);							\
+  CAMLreturn(Val_unit);						\
 }
 
 z_unary_op_ui(fac_ui)
@@ -684,17 +1348,37 @@ z_binary_op_ui(bin_ui)
 value _mlgmp_z_bin_uiui(value n, value k)
 {
   CAMLparam2(n, k);
-  CAMLlocal1(r);
-  r = alloc_init_mpz();
-  mpz_bin_uiui(*mpz_val(r), Long_val(n), Long_val(k));
-  CAMLreturn(r);
+  unsigned long un = Long_val(n), uk = Long_val(k);
+  mpz_t r;
+  mpz_init(r);
+  blocking_section(release_lock_p(bin_uiui_limbs(un, uk)),
+		   mpz_bin_uiui(r, un, uk));
+  CAMLreturn(wrap_mpz(r));
+}
+
+value _mlgmp_z2_bin_uiui(value r, value n, value k)
+{
+  CAMLparam3(r, n, k);
+  z2_enter(r);
+  unsigned long un = Long_val(n), uk = Long_val(k);
+  if (release_lock_p(bin_uiui_limbs(un, uk)))
+    z2_blocking_section(r, mpz_bin_uiui, un, uk);
+  else
+    mpz_bin_uiui(*mpz_val(r), un, uk);
+  z2_leave(r);
+  CAMLreturn(Val_unit);
 }
 
 #define z_int_unary_op(op)			\
+intnat _mlgmp_z_##op##_untagged(value a)	\
+{						\
+  mpz_small_t sa;				\
+  return mpz_##op(mpz_src(a, sa));		\
+}						\
+						\
 value _mlgmp_z_##op(value a)			\
 {						\
-  CAMLparam1(a);				\
-  CAMLreturn(Val_int(mpz_##op(*mpz_val(a))));	\
+  return Val_long(_mlgmp_z_##op##_untagged(a));	\
 }
 
 z_int_unary_op(sgn)
@@ -708,10 +1392,15 @@ z_int_unary_op(popcount)
 z_int_binary_op(hamdist)
 
 #define z_int_binary_op_ui(op)					\
+intnat _mlgmp_z_##op##_untagged(value a, intnat b)		\
+{								\
+  mpz_small_t sa;						\
+  return mpz_##op(mpz_src(a, sa), b);				\
+}								\
+								\
 value _mlgmp_z_##op(value a, value b)				\
 {								\
-  CAMLparam2(a, b);						\
-  CAMLreturn(Val_int(mpz_##op(*mpz_val(a), Long_val(b))));	\
+  return Val_long(_mlgmp_z_##op##_untagged(a, Long_val(b)));	\
 }
 
 z_int_binary_op_ui(scan0)
@@ -722,66 +1411,1443 @@ z_int_binary_op_ui(scan1)
 value _mlgmp_z_##op(value state, value n)			\
 {								\
   CAMLparam2(state, n);						\
-  CAMLlocal1(r);						\
-  r = alloc_init_mpz();						\
+  mpz_t r;							\
+  mpz_init(r);							\
+  mpz_##op(r, *randstate_val(state), Long_val(n));		\
+  CAMLreturn(wrap_mpz(r));					\
+}								\
+								\
+value _mlgmp_z2_##op(value r, value state, value n)		\
+{								\
+  CAMLparam3(r, state, n);					\
+  z2_enter(r);							\
   mpz_##op(*mpz_val(r), *randstate_val(state), Long_val(n));	\
-  CAMLreturn(r);						\
+  z2_leave(r);							\
+  CAMLreturn(Val_unit);						\
 }
 
 #define z_random_op(op)			        		\
 value _mlgmp_z_##op(value state, value n)			\
 {								\
   CAMLparam2(state, n);						\
-  CAMLlocal1(r);						\
-  r = alloc_init_mpz();						\
-  mpz_##op(*mpz_val(r), *randstate_val(state), *mpz_val(n));	\
-  CAMLreturn(r);						\
+  mpz_small_t sn;						\
+  mpz_t r;							\
+  mpz_init(r);							\
+  mpz_##op(r, *randstate_val(state), mpz_src(n, sn));		\
+  CAMLreturn(wrap_mpz(r));					\
+}								\
+								\
+value _mlgmp_z2_##op(value r, value state, value n)		\
+{								\
+  CAMLparam3(r, state, n);					\
+  z2_enter(r);							\
+  mpz_small_t sn;						\
+  mpz_##op(*mpz_val(r), *randstate_val(state), mpz_src(n, sn));	\
+  z2_leave(r);							\
+  CAMLreturn(Val_unit);						\
 }
 
 z_random_op_ui(urandomb)
 z_random_op(urandomm)
 z_random_op_ui(rrandomb)
 
-/*** Serialization */
-value _mlgmp_z_initialize()
+/*** Vectors */
+
+/* Whole-array operations: a single stub call, and for reductions a single
+   result allocation, for a loop over the elements. */
+
+value _mlgmp_z_vec_sum(value a)
 {
-  CAMLparam0();
-  caml_register_custom_operations(& _mlgmp_custom_z);
-  CAMLreturn(Val_unit);
+  CAMLparam1(a);
+  mlsize_t i, n = Wosize_val(a);
+  mpz_small_t sa;
+  mpz_t r;
+  mpz_init(r);
+  for(i=0; i<n; i++)
+    mpz_add(r, r, mpz_src(Field(a, i), sa));
+  CAMLreturn(wrap_mpz(r));
 }
 
-#ifdef SERIALIZE
-void _mlgmp_z_serialize(value v,
-			unsigned long * wsize_32,
-			unsigned long * wsize_64)
+value _mlgmp_z_vec_dot(value a, value b)
 {
-  CAMLparam1(v);
-  char *s;
-  int len;
+  CAMLparam2(a, b);
+  mlsize_t i, n = Wosize_val(a);
+  mpz_small_t sa, sb;
+  mpz_t r;
+  if (Wosize_val(b) != n)
+    caml_invalid_argument("Gmp.Z.Vec.dot");
+  mpz_init(r);
+  for(i=0; i<n; i++)
+    mpz_addmul(r, mpz_src(Field(a, i), sa), mpz_src(Field(b, i), sb));
+  CAMLreturn(wrap_mpz(r));
+}
 
-  *wsize_32 = MPZ_SIZE_ARCH32;
-  *wsize_64 = MPZ_SIZE_ARCH64;
+/* Balanced product tree, so that the big multiplications are done on
+   operands of similar sizes. */
+value _mlgmp_z_vec_product(value a)
+{
+  CAMLparam1(a);
+  mlsize_t i, m, k, n = Wosize_val(a);
+  mpz_small_t sa, sb;
+  mpz_t r, *p;
+  if (n <= 2)
+    {
+      mpz_init_set_ui(r, 1);
+      for(i=0; i<n; i++)
+	mpz_mul(r, r, mpz_src(Field(a, i), sa));
+      CAMLreturn(wrap_mpz(r));
+    }
+  k = (n + 1) / 2;
+  p = malloc(k * sizeof(mpz_t));
+  if (p == NULL) caml_raise_out_of_memory();
+  for(i=0; i<n/2; i++)
+    {
+      mpz_init(p[i]);
+      mpz_mul(p[i], mpz_src(Field(a, 2*i), sa),
+	      mpz_src(Field(a, 2*i+1), sb));
+    }
+  if (n & 1)
+    mpz_init_set(p[k-1], mpz_src(Field(a, n-1), sa));
+  for(m=k; m>1; m=(m+1)/2)
+    {
+      for(i=0; i<m/2; i++)
+	mpz_mul(p[i], p[2*i], p[2*i+1]);
+      if (m & 1)
+	mpz_swap(p[m/2], p[m-1]);
+    }
+  mpz_init(r);
+  mpz_swap(r, p[0]);
+  for(i=0; i<k; i++)
+    mpz_clear(p[i]);
+  free(p);
+  CAMLreturn(wrap_mpz(r));
+}
 
-  s = mpz_get_str (NULL, 16, *mpz_val(v));
-  len = strlen(s);
-  caml_serialize_int_4(len);
-  caml_serialize_block_1(s, len);
+/* Elementwise operations; the first operand of scale is a scalar. */
+#define vec_elt(a, i) Field(a, i)
+#define vec_scalar(a, i) (a)
+#define vec_length_elt(a, n) (Wosize_val(a) == (n))
+#define vec_length_scalar(a, n) 1
 
-  free(s);
-  CAMLreturn0;
+#define z_vec_op(name, op, kind)					\
+value _mlgmp_z_vec_##name(value a, value b)				\
+{									\
+  CAMLparam2(a, b);							\
+  CAMLlocal2(r, x);							\
+  mlsize_t i, n = Wosize_val(b);					\
+  mpz_small_t sa, sb;							\
+  mpz_t z;								\
+  if (!vec_length_##kind(a, n))						\
+    caml_invalid_argument("Gmp.Z.Vec." #name);				\
+  if (n == 0) CAMLreturn(Atom(0));					\
+  r = caml_alloc(n, 0);							\
+  for(i=0; i<n; i++)							\
+    {									\
+      mpz_init(z);							\
+      mpz_##op(z, mpz_src(vec_##kind(a, i), sa),			\
+	       mpz_src(Field(b, i), sb));				\
+      x = wrap_mpz(z);							\
+      Store_field(r, i, x);						\
+    }									\
+  CAMLreturn(r);							\
+}									\
+									\
+value _mlgmp_z2_vec_##name(value dest, value a, value b)		\
+{									\
+  CAMLparam3(dest, a, b);						\
+  mlsize_t i, n = Wosize_val(b);					\
+  mp_size_t grown = 0;							\
+  mpz_small_t sa, sb;							\
+  if (!vec_length_##kind(a, n) || Wosize_val(dest) != n)		\
+    caml_invalid_argument("Gmp.Z2.Vec." #name);			\
+  for(i=0; i<n; i++)							\
+    {									\
+      mpz_ptr d = *mpz_val(Field(dest, i));				\
+      int alloc = d->_mp_alloc;						\
+      mpz_##op(d, mpz_src(vec_##kind(a, i), sa),			\
+	       mpz_src(Field(b, i), sb));				\
+      grown += d->_mp_alloc - alloc;					\
+      census_resize(Field(dest, i), sizeof(mpz_t), d->_mp_alloc);	\
+    }									\
+  account_limbs(grown);							\
+  CAMLreturn(Val_unit);							\
 }
 
-unsigned long _mlgmp_z_deserialize(void * dst)
-{
-  char *s;
-  int len;
+z_vec_op(add, add, elt)
+z_vec_op(sub, sub, elt)
+z_vec_op(mul, mul, elt)
+z_vec_op(scale, mul, scalar)
 
-  len = caml_deserialize_uint_4();
-  s = malloc(len+1);
-  caml_deserialize_block_1(s, len);
+/*** Product and remainder trees */
+
+/* A product tree over n numbers: level 0 holds the numbers themselves,
+   each node of level k+1 the product of two nodes of level k (the last
+   node of an odd level is carried up as is), and the single node of the
+   last level the product of them all.  The nodes live in C memory, so
+   that the trees can be built and walked outside the runtime lock. */
+#define ZTREE_MAX_LEVELS (8 * sizeof(mlsize_t) + 1)
+
+struct ztree
+{
+  mlsize_t nodes;		/* initialized so far */
+  mp_size_t limbs;
+  int levels;
+  mlsize_t size[ZTREE_MAX_LEVELS];
+  mpz_t *level[ZTREE_MAX_LEVELS];
+};
+
+static void ztree_free(struct ztree *t)
+{
+  mlsize_t i;
+  if (t == NULL) return;
+  for(i=0; i<t->nodes; i++)
+    mpz_clear(t->level[0][i]);
+  free(t->level[0]);
+  free(t);
+}
+
+/* The limbs of a product tree over the numbers of the array a: each
+   level has about as many as the leaves. */
+static mp_size_t ztree_limbs(value a)
+{
+  mlsize_t i, m, n = Wosize_val(a);
+  mp_size_t leaves = 0, levels = 1;
+  mpz_small_t sa;
+  for(i=0; i<n; i++)
+    leaves += mpz_size(mpz_src(Field(a, i), sa));
+  for(m=n; m>1; m=(m+1)/2)
+    levels++;
+  return leaves * levels;
+}
+
+/* Copies the numbers of the array a to the leaves; may raise, so the
+   caller must not hold anything to free yet. */
+static struct ztree *ztree_leaves(value a, const char *name)
+{
+  mlsize_t i, m, total = 0, n = Wosize_val(a);
+  mpz_small_t sa;
+  struct ztree *t;
+  mpz_t *p;
+  if (n == 0)
+    caml_invalid_argument(name);
+  for(m=n; m>1; m=(m+1)/2)
+    total += m;
+  total++;
+  t = malloc(sizeof(struct ztree));
+  p = malloc(total * sizeof(mpz_t));
+  if (t == NULL || p == NULL)
+    {
+      free(t);
+      free(p);
+      caml_raise_out_of_memory();
+    }
+  t->nodes = n;
+  t->levels = 1;
+  t->size[0] = n;
+  t->level[0] = p;
+  t->limbs = 0;
+  for(i=0; i<n; i++)
+    {
+      mpz_init_set(p[i], mpz_src(Field(a, i), sa));
+      t->limbs += mpz_size(p[i]);
+    }
+  return t;
+}
+
+/* Computes the levels above the leaves; touches no OCaml value. */
+static void ztree_grow(struct ztree *t)
+{
+  mlsize_t i, m;
+  int k;
+  for(k=0; (m=t->size[k]) > 1; k++)
+    {
+      mpz_t *c = t->level[k], *u = c + m;
+      for(i=0; i<m/2; i++)
+	{
+	  mpz_init(u[i]);
+	  mpz_mul(u[i], c[2*i], c[2*i+1]);
+	}
+      if (m & 1)
+	mpz_init_set(u[m/2], c[m-1]);
+      for(i=0; i<(m+1)/2; i++)
+	t->limbs += mpz_size(u[i]);
+      t->nodes += (m+1)/2;
+      t->level[k+1] = u;
+      t->size[k+1] = (m+1)/2;
+    }
+  t->levels = k+1;
+}
+
+/* r[i] = x mod |leaf i| (or mod leaf i squared), for the n leaves, going
+   down from the root; r must hold n initialized numbers.  Going through
+   a level backwards lets each node overwrite the remainder of its parent
+   only once its siblings no longer need it. */
+static void ztree_remainders(struct ztree *t, mpz_t *r, mpz_srcptr x,
+			     int squared)
+{
+  mlsize_t j;
+  int k;
+  mpz_t sq;
+  mpz_init(sq);
+  mpz_set(r[0], x);
+  for(k=t->levels-1; k>=0; k--)
+    for(j=t->size[k]; j-- > 0; )
+      {
+	mpz_srcptr m = t->level[k][j];
+	if (squared)
+	  {
+	    mpz_mul(sq, m, m);
+	    m = sq;
+	  }
+	mpz_mod(r[j], r[j/2], m);
+      }
+  mpz_clear(sq);
+}
+
+#define ztree_val(v) (*((struct ztree **) Data_custom_val(v)))
+
+void _mlgmp_z_tree_finalize(value v)
+{
+  ztree_free(ztree_val(v));
+}
+
+struct custom_operations _mlgmp_custom_z_tree =
+  {
+    field(identifier)  "Gmp.Z.Tree.tree",
+    field(finalize)    &_mlgmp_z_tree_finalize,
+    field(compare)     custom_compare_default,
+    field(hash)        custom_hash_default,
+    field(serialize)   custom_serialize_default,
+    field(deserialize) custom_deserialize_default
+  };
+
+/* A block that owns a tree, empty for now: allocated before the tree,
+   so that nothing leaks if the stub raises once the tree exists. */
+static value alloc_ztree(mp_size_t nlimbs)
+{
+  value r = alloc_custom_limbs(&_mlgmp_custom_z_tree, sizeof(struct ztree *),
+			       nlimbs);
+  ztree_val(r) = NULL;
+  return r;
+}
+
+value _mlgmp_z_tree_create(value a)
+{
+  CAMLparam1(a);
+  CAMLlocal1(r);
+  struct ztree *t;
+  r = alloc_ztree(ztree_limbs(a));
+  t = ztree_val(r) = ztree_leaves(a, "Gmp.Z.Tree.create");
+  blocking_section(release_lock_p(t->limbs), ztree_grow(t));
+  CAMLreturn(r);
+}
+
+value _mlgmp_z_tree_length(value t)
+{
+  CAMLparam1(t);
+  CAMLreturn(Val_long(ztree_val(t)->size[0]));
+}
+
+value _mlgmp_z_tree_product(value v)
+{
+  CAMLparam1(v);
+  struct ztree *t = ztree_val(v);
+  mpz_t r;
+  mpz_init_set(r, t->level[t->levels-1][0]);
+  CAMLreturn(wrap_mpz(r));
+}
+
+/* Wraps the n numbers of r into a fresh array, and frees r. */
+static value wrap_mpz_array(mpz_t *r, mlsize_t n)
+{
+  CAMLparam0();
+  CAMLlocal2(a, x);
+  mlsize_t i;
+  a = caml_alloc(n, 0);
+  for(i=0; i<n; i++)
+    {
+      x = wrap_mpz(r[i]);
+      Store_field(a, i, x);
+    }
+  free(r);
+  CAMLreturn(a);
+}
+
+/* n initialized numbers, or NULL: the caller raises Out_of_memory once it
+   has freed what it holds. */
+static mpz_t *alloc_mpz_array(mlsize_t n)
+{
+  mlsize_t i;
+  mpz_t *r = malloc(n * sizeof(mpz_t));
+  if (r == NULL)
+    return NULL;
+  for(i=0; i<n; i++)
+    mpz_init(r[i]);
+  return r;
+}
+
+value _mlgmp_z_tree_remainders(value v, value x)
+{
+  CAMLparam2(v, x);
+  struct ztree *t = ztree_val(v);
+  mpz_small_t sx;
+  mpz_t *r, zx;
+  if (mpz_sgn(t->level[t->levels-1][0]) == 0)
+    division_by_zero();
+  r = alloc_mpz_array(t->size[0]);
+  if (r == NULL)
+    caml_raise_out_of_memory();
+  mpz_init_set(zx, mpz_src(x, sx));
+  blocking_section(release_lock_p(t->limbs),
+		   ztree_remainders(t, r, zx, 0));
+  mpz_clear(zx);
+  CAMLreturn(wrap_mpz_array(r, t->size[0]));
+}
+
+/* Bernstein's batch gcd: the gcd of each number with the product of all
+   the others, from the remainders of their product modulo their
+   squares. */
+static void batch_gcd(struct ztree *t, mpz_t *r)
+{
+  mlsize_t i;
+  ztree_grow(t);
+  ztree_remainders(t, r, t->level[t->levels-1][0], 1);
+  for(i=0; i<t->size[0]; i++)
+    {
+      mpz_divexact(r[i], r[i], t->level[0][i]);
+      mpz_gcd(r[i], r[i], t->level[0][i]);
+    }
+}
+
+value _mlgmp_z_batch_gcd(value a)
+{
+  CAMLparam1(a);
+  CAMLlocal2(v, g);
+  mpz_t *r;
+  mlsize_t i;
+  struct ztree *t;
+  v = alloc_ztree(0);
+  t = ztree_val(v) = ztree_leaves(a, "Gmp.Z.Tree.batch_gcd");
+  for(i=0; i<t->size[0]; i++)
+    if (mpz_sgn(t->level[0][i]) == 0)
+      division_by_zero();
+  r = alloc_mpz_array(t->size[0]);
+  if (r == NULL)
+    caml_raise_out_of_memory();
+  blocking_section(release_lock_p(t->limbs), batch_gcd(t, r));
+  g = wrap_mpz_array(r, t->size[0]);
+  ztree_free(t);
+  ztree_val(v) = NULL;
+  CAMLreturn(g);
+}
+
+/*** Chinese remaindering */
+
+/* Moduli, their product tree, and the inverse of M/m_i modulo m_i for
+   each modulus m_i, where M is the product of the moduli. */
+struct zcrt
+{
+  struct ztree *tree;
+  mpz_t *inv;
+};
+
+static void zcrt_free(struct zcrt *c)
+{
+  mlsize_t i;
+  if (c == NULL) return;
+  if (c->inv != NULL)
+    {
+      for(i=0; i<c->tree->size[0]; i++)
+	mpz_clear(c->inv[i]);
+      free(c->inv);
+    }
+  ztree_free(c->tree);
+  free(c);
+}
+
+/* M/m_i mod m_i is (M mod m_i^2)/m_i.  Returns 0 if the moduli are not
+   pairwise coprime. */
+static int zcrt_init(struct zcrt *c)
+{
+  struct ztree *t = c->tree;
+  mlsize_t i;
+  int ok = 1;
+  ztree_grow(t);
+  ztree_remainders(t, c->inv, t->level[t->levels-1][0], 1);
+  for(i=0; i<t->size[0]; i++)
+    {
+      mpz_divexact(c->inv[i], c->inv[i], t->level[0][i]);
+      if (!mpz_invert(c->inv[i], c->inv[i], t->level[0][i]))
+	ok = 0;
+    }
+  return ok;
+}
+
+/* x = sum of w_i (M/m_i) (w_i/(M/m_i) mod m_i), summed up the product
+   tree, then reduced modulo M; overwrites w. */
+static void zcrt_combine(struct zcrt *c, mpz_t *w, mpz_ptr x)
+{
+  struct ztree *t = c->tree;
+  mlsize_t i, m;
+  int k;
+  mpz_t s;
+  mpz_init(s);
+  for(i=0; i<t->size[0]; i++)
+    {
+      mpz_mul(w[i], w[i], c->inv[i]);
+      mpz_mod(w[i], w[i], t->level[0][i]);
+    }
+  for(k=0; k<t->levels-1; k++)
+    {
+      mpz_t *p = t->level[k];
+      m = t->size[k];
+      for(i=0; i<m/2; i++)
+	{
+	  mpz_mul(s, w[2*i], p[2*i+1]);
+	  mpz_addmul(s, w[2*i+1], p[2*i]);
+	  mpz_swap(w[i], s);
+	}
+      if (m & 1)
+	mpz_swap(w[m/2], w[m-1]);
+    }
+  mpz_mod(x, w[0], t->level[t->levels-1][0]);
+  mpz_clear(s);
+}
+
+/* Rational reconstruction (Wang): n/d = x modulo m with |n| and d at most
+   sqrt(m/2), by the half-extended Euclidean algorithm.  Returns 0 if
+   there is no such fraction. */
+static int mpz_ratrecon(mpz_ptr n, mpz_ptr d, mpz_srcptr x, mpz_srcptr m)
+{
+  mpz_t bound, r, t, q;
+  int ok;
+  mpz_init(bound);
+  mpz_init(q);
+  mpz_init_set(r, m);
+  mpz_init_set_ui(t, 0);
+  mpz_tdiv_q_2exp(bound, m, 1);
+  mpz_sqrt(bound, bound);
+  mpz_mod(n, x, m);
+  mpz_set_ui(d, 1);
+  while (mpz_cmp(n, bound) > 0)
+    {
+      mpz_fdiv_qr(q, r, r, n);
+      mpz_swap(r, n);
+      mpz_submul(t, q, d);
+      mpz_swap(t, d);
+    }
+  if (mpz_sgn(d) < 0)
+    {
+      mpz_neg(n, n);
+      mpz_neg(d, d);
+    }
+  mpz_gcd(q, n, d);
+  ok = mpz_sgn(d) != 0 && mpz_cmp(d, bound) <= 0 && mpz_cmp_ui(q, 1) == 0;
+  mpz_clear(bound);
+  mpz_clear(q);
+  mpz_clear(r);
+  mpz_clear(t);
+  return ok;
+}
+
+#define zcrt_val(v) (*((struct zcrt **) Data_custom_val(v)))
+
+void _mlgmp_crt_finalize(value v)
+{
+  zcrt_free(zcrt_val(v));
+}
+
+struct custom_operations _mlgmp_custom_crt =
+  {
+    field(identifier)  "Gmp.CRT.t",
+    field(finalize)    &_mlgmp_crt_finalize,
+    field(compare)     custom_compare_default,
+    field(hash)        custom_hash_default,
+    field(serialize)   custom_serialize_default,
+    field(deserialize) custom_deserialize_default
+  };
+
+/* As for trees, the block is allocated first and owns what is built. */
+value _mlgmp_crt_create(value moduli)
+{
+  CAMLparam1(moduli);
+  CAMLlocal1(r);
+  struct zcrt *c;
+  struct ztree *t;
+  mlsize_t i;
+  int ok;
+  r = alloc_custom_limbs(&_mlgmp_custom_crt, sizeof(struct zcrt *),
+			 2 * ztree_limbs(moduli));
+  zcrt_val(r) = NULL;
+  c = malloc(sizeof(struct zcrt));
+  if (c == NULL)
+    caml_raise_out_of_memory();
+  c->tree = NULL;
+  c->inv = NULL;
+  zcrt_val(r) = c;
+  t = c->tree = ztree_leaves(moduli, "Gmp.CRT.create");
+  for(i=0; i<t->size[0]; i++)
+    if (mpz_sgn(t->level[0][i]) <= 0)
+      caml_invalid_argument("Gmp.CRT.create");
+  c->inv = alloc_mpz_array(t->size[0]);
+  if (c->inv == NULL)
+    caml_raise_out_of_memory();
+  blocking_section(release_lock_p(t->limbs), ok = zcrt_init(c));
+  if (!ok)
+    caml_invalid_argument("Gmp.CRT.create: moduli not coprime");
+  CAMLreturn(r);
+}
+
+value _mlgmp_crt_modulus(value v)
+{
+  CAMLparam1(v);
+  struct ztree *t = zcrt_val(v)->tree;
+  mpz_t r;
+  mpz_init_set(r, t->level[t->levels-1][0]);
+  CAMLreturn(wrap_mpz(r));
+}
+
+/* Combines the residues into x, in [0, M). */
+static void zcrt_residues(value v, value residues, mpz_ptr x,
+			  const char *name)
+{
+  struct zcrt *c = zcrt_val(v);
+  mlsize_t i, n = c->tree->size[0];
+  mpz_small_t sr;
+  mpz_t *w;
+  if (Wosize_val(residues) != n)
+    caml_invalid_argument(name);
+  w = alloc_mpz_array(n);
+  if (w == NULL)
+    caml_raise_out_of_memory();
+  for(i=0; i<n; i++)
+    mpz_set(w[i], mpz_src(Field(residues, i), sr));
+  blocking_section(release_lock_p(c->tree->limbs), zcrt_combine(c, w, x));
+  for(i=0; i<n; i++)
+    mpz_clear(w[i]);
+  free(w);
+}
+
+value _mlgmp_crt_to_z(value v, value residues)
+{
+  CAMLparam2(v, residues);
+  mpz_t x;
+  mpz_init(x);
+  zcrt_residues(v, residues, x, "Gmp.CRT.to_z");
+  CAMLreturn(wrap_mpz(x));
+}
+
+/* Some n/d from the residues of x modulo M */
+static value wrap_ratrecon(mpz_srcptr x, mpz_srcptr m)
+{
+  CAMLparam0();
+  CAMLlocal2(q, r);
+  mpq_t mq;
+  mpq_init(mq);
+  if (mpz_ratrecon(mpq_numref(mq), mpq_denref(mq), x, m))
+    {
+      q = wrap_mpq(mq);
+      r = caml_alloc_tuple(1);
+      Store_field(r, 0, q);
+    }
+  else
+    {
+      mpq_clear(mq);
+      r = Val_false;
+    }
+  CAMLreturn(r);
+}
+
+value _mlgmp_crt_to_q(value v, value residues)
+{
+  CAMLparam2(v, residues);
+  CAMLlocal1(r);
+  struct ztree *t = zcrt_val(v)->tree;
+  mpz_t x;
+  mpz_init(x);
+  zcrt_residues(v, residues, x, "Gmp.CRT.to_q");
+  r = wrap_ratrecon(x, t->level[t->levels-1][0]);
+  mpz_clear(x);
+  CAMLreturn(r);
+}
+
+value _mlgmp_ratrecon(value x, value m)
+{
+  CAMLparam2(x, m);
+  mpz_small_t sx, sm;
+  __mpz_struct zx = mpz_detach(x, sx), zm = mpz_detach(m, sm);
+  if (mpz_sgn(&zm) <= 0)
+    caml_invalid_argument("Gmp.CRT.rational_reconstruction");
+  CAMLreturn(wrap_ratrecon(&zx, &zm));
+}
+
+/*** Modular arithmetic */
+
+/* Arithmetic modulo a fixed m of n limbs, over mpn routines.  Odd moduli
+   use Montgomery's representation: an element stands for x R mod m,
+   with R = B^n, and products are reduced by REDC.  Even moduli use
+   Barrett's reduction with mu = floor(B^2n / m), elements being plain
+   residues.  Elements hold exactly n limbs, inline in custom blocks
+   without finalizer. */
+struct zmod
+{
+  mp_size_t n;
+  int montgomery;
+  mp_limb_t minv;		/* -1/m mod B, for REDC */
+  mp_limb_t *m;
+  mp_limb_t *one;		/* 1 in the representation */
+  mp_limb_t *k;			/* R^2 mod m, or mu (n+1 limbs) */
+};
+
+/* Scratch limbs for one product, and for a power. */
+#define zmod_mul_scratch(n) (6 * (n) + 3)
+#define zmod_pow_scratch(n) (17 * (n) + zmod_mul_scratch(n))
+
+/* t (2n limbs) times 1/R mod m into r; destroys t. */
+static void zmod_redc(const struct zmod *c, mp_ptr r, mp_ptr t)
+{
+  mp_size_t i, n = c->n;
+  mp_limb_t cy = 0;
+  for(i=0; i<n; i++)
+    {
+      mp_limb_t hi = mpn_addmul_1(t + i, c->m, n, t[i] * c->minv);
+      cy += mpn_add_1(t + i + n, t + i + n, n - i, hi);
+    }
+  if (cy || mpn_cmp(t + n, c->m, n) >= 0)
+    mpn_sub_n(r, t + n, c->m, n);
+  else
+    mpn_copyi(r, t + n, n);
+}
+
+/* x (2n limbs, below m^2) mod m into r, with 4n+3 limbs of scratch. */
+static void zmod_barrett(const struct zmod *c, mp_ptr r, mp_srcptr x,
+			 mp_ptr s)
+{
+  mp_size_t n = c->n;
+  mp_ptr q = s, qm = s + 2 * n + 2;
+  mpn_mul_n(q, x + n - 1, c->k, n + 1);
+  mpn_mul(qm, q + n + 1, n + 1, c->m, n);
+  mpn_sub_n(q, x, qm, n + 1);
+  while (q[n] != 0 || mpn_cmp(q, c->m, n) >= 0)
+    mpn_sub(q, q, n + 1, c->m, n);
+  mpn_copyi(r, q, n);
+}
+
+/* r = a b in the representation; r may be a or b. */
+static void zmod_mul(const struct zmod *c, mp_ptr r,
+		     mp_srcptr a, mp_srcptr b, mp_ptr s)
+{
+  mp_size_t n = c->n;
+  if (a == b)
+    mpn_sqr(s, a, n);
+  else
+    mpn_mul_n(s, a, b, n);
+  if (c->montgomery)
+    zmod_redc(c, r, s);
+  else
+    zmod_barrett(c, r, s, s + 2 * n);
+}
+
+/* Sums and differences need no scratch space; s is for the common
+   signature of binary operations. */
+static void zmod_add(const struct zmod *c, mp_ptr r,
+		     mp_srcptr a, mp_srcptr b, mp_ptr s)
+{
+  mp_size_t n = c->n;
+  if (mpn_add_n(r, a, b, n) || mpn_cmp(r, c->m, n) >= 0)
+    mpn_sub_n(r, r, c->m, n);
+}
+
+static void zmod_sub(const struct zmod *c, mp_ptr r,
+		     mp_srcptr a, mp_srcptr b, mp_ptr s)
+{
+  mp_size_t n = c->n;
+  if (mpn_sub_n(r, a, b, n))
+    mpn_add_n(r, r, c->m, n);
+}
+
+/* r = a^e with a window of 4 bits; table and result in s. */
+static void zmod_pow(const struct zmod *c, mp_ptr r, mp_srcptr a,
+		     mpz_srcptr e, mp_ptr s)
+{
+  mp_size_t n = c->n;
+  mp_ptr p = s, x = s + 16 * n, t = s + 17 * n;
+  mp_bitcnt_t i = mpz_sizeinbase(e, 2);
+  int k, started = 0;
+  mpn_copyi(p, c->one, n);
+  mpn_copyi(p + n, a, n);
+  for(k=2; k<16; k++)
+    zmod_mul(c, p + k * n, p + (k-1) * n, a, t);
+  mpn_copyi(x, c->one, n);
+  i = (i + 3) & ~(mp_bitcnt_t) 3;
+  while (i > 0)
+    {
+      int d = 0;
+      for(k=0; k<4; k++)
+	{
+	  i--;
+	  d = 2 * d + mpz_tstbit(e, i);
+	  if (started)
+	    zmod_mul(c, x, x, x, t);
+	}
+      if (d)
+	{
+	  zmod_mul(c, x, x, p + d * n, t);
+	  started = 1;
+	}
+    }
+  mpn_copyi(r, x, n);
+}
+
+/* Scratch on the stack up to MODULAR_STACK_LIMBS, malloc'd beyond. */
+static mp_ptr zmod_scratch(mp_ptr stack, mp_size_t size)
+{
+  mp_ptr s;
+  if (size <= MODULAR_STACK_LIMBS)
+    return stack;
+  s = malloc(size * sizeof(mp_limb_t));
+  if (s == NULL)
+    caml_raise_out_of_memory();
+  return s;
+}
+
+#define zmod_release(s, stack) do { if ((s) != (stack)) free(s); } while (0)
+
+#define zmod_val(v) (*((struct zmod **) Data_custom_val(v)))
+
+/* zmod_val(v) may be NULL if create raised. */
+void _mlgmp_z_modular_finalize(value v)
+{
+  free(zmod_val(v));
+}
+
+struct custom_operations _mlgmp_custom_z_modular =
+  {
+    field(identifier)  "Gmp.Z.Modular.modulus",
+    field(finalize)    &_mlgmp_z_modular_finalize,
+    field(compare)     custom_compare_default,
+    field(hash)        custom_hash_default,
+    field(serialize)   custom_serialize_default,
+    field(deserialize) custom_deserialize_default
+  };
+
+/* Elements: their size n in the first limb, then their n limbs. */
+#define zelt_size(v) ((mp_size_t) ((mp_limb_t *) Data_custom_val(v))[0])
+#define zelt_limbs(v) ((mp_limb_t *) Data_custom_val(v) + 1)
+
+int _mlgmp_z_modular_elt_compare(value a, value b)
+{
+  mp_size_t na = zelt_size(a), nb = zelt_size(b);
+  if (na != nb)
+    return na < nb ? -1 : 1;
+  return mpn_cmp(zelt_limbs(a), zelt_limbs(b), na);
+}
+
+long _mlgmp_z_modular_elt_hash(value v)
+{
+  return hash_limbs(0, zelt_limbs(v), zelt_size(v));
+}
+
+struct custom_operations _mlgmp_custom_z_modular_elt =
+  {
+    field(identifier)  "Gmp.Z.Modular.elt",
+    field(finalize)    custom_finalize_default,
+    field(compare)     &_mlgmp_z_modular_elt_compare,
+    field(hash)        &_mlgmp_z_modular_elt_hash,
+    field(serialize)   custom_serialize_default,
+    field(deserialize) custom_deserialize_default
+  };
+
+static value alloc_zelt(mp_size_t n)
+{
+  value r = caml_alloc_custom(&_mlgmp_custom_z_modular_elt,
+			      (n + 1) * sizeof(mp_limb_t), 0, 1);
+  ((mp_limb_t *) Data_custom_val(r))[0] = n;
+  mpn_zero(zelt_limbs(r), n);
+  return r;
+}
+
+/* The limbs of an element of the modulus v, checking its size. */
+static mp_ptr zelt_check(value v, value e, const char *name)
+{
+  if (zelt_size(e) != zmod_val(v)->n)
+    caml_invalid_argument(name);
+  return zelt_limbs(e);
+}
+
+/* The n limbs of x mod m. */
+static void zmod_limbs_of_mpz(const struct zmod *c, mp_ptr r, mpz_srcptr x)
+{
+  mpz_t t;
+  __mpz_struct zm;
+  mpz_init(t);
+  mpz_mod(t, x, mpz_roinit_n(&zm, c->m, c->n));
+  mpn_zero(r, c->n);
+  mpn_copyi(r, t->_mp_d, mpz_size(t));
+  mpz_clear(t);
+}
+
+/* k = (B^(2n) - 1) / m, or B^(2n) mod m, on size limbs.  Barrett's
+   reduction tolerates the smaller quotient, which fits n+1 limbs even
+   when m = B^(n-1). */
+static void zmod_power_of_base(const struct zmod *c, mp_ptr k,
+			       mp_size_t size, int quotient)
+{
+  mpz_t t;
+  __mpz_struct zm;
+  mpz_init(t);
+  mpz_setbit(t, 2 * c->n * GMP_NUMB_BITS);
+  if (quotient)
+    {
+      mpz_sub_ui(t, t, 1);
+      mpz_tdiv_q(t, t, mpz_roinit_n(&zm, c->m, c->n));
+    }
+  else
+    mpz_mod(t, t, mpz_roinit_n(&zm, c->m, c->n));
+  mpn_zero(k, size);
+  mpn_copyi(k, t->_mp_d, mpz_size(t));
+  mpz_clear(t);
+}
+
+value _mlgmp_z_modular_create(value m)
+{
+  CAMLparam1(m);
+  CAMLlocal1(r);
+  mpz_small_t sm;
+  mpz_srcptr zm;
+  mp_size_t n;
+  struct zmod *c;
+  mp_limb_t stack[MODULAR_STACK_LIMBS], *s;
+  if (mpz_cmp_ui(mpz_src(m, sm), 2) < 0)
+    caml_invalid_argument("Gmp.Z.Modular.create");
+  n = mpz_size(mpz_src(m, sm));
+  /* The block owns c as soon as it exists, as for trees; m may move. */
+  r = alloc_custom_limbs(&_mlgmp_custom_z_modular, sizeof(struct zmod *),
+			 3 * n);
+  zmod_val(r) = NULL;
+  zm = mpz_src(m, sm);
+  c = malloc(sizeof(struct zmod) + (3 * n + 1) * sizeof(mp_limb_t));
+  if (c == NULL)
+    caml_raise_out_of_memory();
+  zmod_val(r) = c;
+  c->n = n;
+  c->montgomery = mpz_odd_p(zm);
+  c->m = (mp_ptr) (c + 1);
+  c->one = c->m + n;
+  c->k = c->one + n;
+  mpn_copyi(c->m, zm->_mp_d, n);
+  if (c->montgomery)
+    {
+      /* Newton's iteration doubles the correct low bits of 1/m0, and m0
+	 is its own inverse modulo 8. */
+      mp_limb_t m0 = c->m[0], x = m0;
+      int bits;
+      for(bits=3; bits<GMP_NUMB_BITS; bits*=2)
+	x *= 2 - m0 * x;
+      c->minv = -x;
+      zmod_power_of_base(c, c->k, n, 0);
+      s = zmod_scratch(stack, 2 * n);
+      mpn_copyi(s, c->k, n);
+      mpn_zero(s + n, n);
+      zmod_redc(c, c->one, s);
+      zmod_release(s, stack);
+    }
+  else
+    {
+      c->minv = 0;
+      zmod_power_of_base(c, c->k, n + 1, 1);
+      mpn_zero(c->one, n);
+      c->one[0] = 1;
+    }
+  CAMLreturn(r);
+}
+
+value _mlgmp_z_modular_modulus(value v)
+{
+  CAMLparam1(v);
+  struct zmod *c = zmod_val(v);
+  __mpz_struct zm;
+  mpz_t r;
+  mpz_init_set(r, mpz_roinit_n(&zm, c->m, c->n));
+  CAMLreturn(wrap_mpz(r));
+}
+
+value _mlgmp_z_modular_elt(value v)
+{
+  CAMLparam1(v);
+  CAMLreturn(alloc_zelt(zmod_val(v)->n));
+}
+
+static void zmod_set_mpz(value v, value dest, mpz_srcptr x, const char *name)
+{
+  struct zmod *c = zmod_val(v);
+  mp_ptr r = zelt_check(v, dest, name);
+  mp_limb_t stack[MODULAR_STACK_LIMBS], *s;
+  if (!c->montgomery)
+    {
+      zmod_limbs_of_mpz(c, r, x);
+      return;
+    }
+  s = zmod_scratch(stack, c->n + zmod_mul_scratch(c->n));
+  zmod_limbs_of_mpz(c, s, x);
+  zmod_mul(c, r, s, c->k, s + c->n);
+  zmod_release(s, stack);
+}
+
+value _mlgmp_z_modular_set_z(value v, value dest, value x)
+{
+  CAMLparam3(v, dest, x);
+  mpz_small_t sx;
+  zmod_set_mpz(v, dest, mpz_src(x, sx), "Gmp.Z.Modular.set_z");
+  CAMLreturn(Val_unit);
+}
+
+value _mlgmp_z_modular_of_z(value v, value x)
+{
+  CAMLparam2(v, x);
+  CAMLlocal1(r);
+  mpz_small_t sx;
+  r = alloc_zelt(zmod_val(v)->n);
+  zmod_set_mpz(v, r, mpz_src(x, sx), "Gmp.Z.Modular.of_z");
+  CAMLreturn(r);
+}
+
+value _mlgmp_z_modular_to_z(value v, value x)
+{
+  CAMLparam2(v, x);
+  struct zmod *c = zmod_val(v);
+  mp_ptr a = zelt_check(v, x, "Gmp.Z.Modular.to_z");
+  mp_limb_t stack[MODULAR_STACK_LIMBS], *s;
+  __mpz_struct zs;
+  mpz_t r;
+  s = zmod_scratch(stack, 3 * c->n);
+  mpn_copyi(s, a, c->n);
+  if (c->montgomery)
+    {
+      mpn_zero(s + c->n, c->n);
+      zmod_redc(c, s, s);
+    }
+  mpz_init_set(r, mpz_roinit_n(&zs, s, c->n));
+  zmod_release(s, stack);
+  CAMLreturn(wrap_mpz(r));
+}
+
+#define zmod_binary_op(op, scratch)					\
+value _mlgmp_z_modular_##op(value v, value dest, value a, value b)	\
+{									\
+  CAMLparam4(v, dest, a, b);						\
+  struct zmod *c = zmod_val(v);						\
+  mp_limb_t stack[MODULAR_STACK_LIMBS], *s;				\
+  mp_ptr r = zelt_check(v, dest, "Gmp.Z.Modular." #op);			\
+  mp_ptr x = zelt_check(v, a, "Gmp.Z.Modular." #op);			\
+  mp_ptr y = zelt_check(v, b, "Gmp.Z.Modular." #op);			\
+  s = zmod_scratch(stack, scratch);					\
+  zmod_##op(c, r, x, y, s);						\
+  zmod_release(s, stack);						\
+  CAMLreturn(Val_unit);							\
+}
+
+zmod_binary_op(add, 0)
+zmod_binary_op(sub, 0)
+zmod_binary_op(mul, zmod_mul_scratch(c->n))
+
+value _mlgmp_z_modular_sqr(value v, value dest, value a)
+{
+  CAMLparam3(v, dest, a);
+  struct zmod *c = zmod_val(v);
+  mp_limb_t stack[MODULAR_STACK_LIMBS], *s;
+  mp_ptr r = zelt_check(v, dest, "Gmp.Z.Modular.sqr");
+  mp_ptr x = zelt_check(v, a, "Gmp.Z.Modular.sqr");
+  s = zmod_scratch(stack, zmod_mul_scratch(c->n));
+  zmod_mul(c, r, x, x, s);
+  zmod_release(s, stack);
+  CAMLreturn(Val_unit);
+}
+
+/* The base is copied to the scratch area, which does not move, so that
+   long powers may run outside the runtime lock. */
+value _mlgmp_z_modular_pow(value v, value dest, value a, value e)
+{
+  CAMLparam4(v, dest, a, e);
+  struct zmod *c = zmod_val(v);
+  mp_size_t n = c->n;
+  mp_limb_t stack[MODULAR_STACK_LIMBS], *s;
+  mpz_small_t se;
+  __mpz_struct ze = mpz_detach(e, se);
+  zelt_check(v, dest, "Gmp.Z.Modular.pow");
+  zelt_check(v, a, "Gmp.Z.Modular.pow");
+  if (mpz_sgn(&ze) < 0)
+    caml_invalid_argument("Gmp.Z.Modular.pow");
+  s = zmod_scratch(stack, n + zmod_pow_scratch(n));
+  mpn_copyi(s, zelt_limbs(a), n);
+  blocking_section(release_lock_p(n) && mpz_size(&ze) > 1,
+		   zmod_pow(c, s, s, &ze, s + n));
+  mpn_copyi(zelt_limbs(dest), s, n);
+  zmod_release(s, stack);
+  CAMLreturn(Val_unit);
+}
+
+/* Inverses go through mpz_invert on the plain residue; returns false
+   when a is not invertible. */
+value _mlgmp_z_modular_inv(value v, value dest, value a)
+{
+  CAMLparam3(v, dest, a);
+  CAMLlocal1(x);
+  struct zmod *c = zmod_val(v);
+  __mpz_struct zm;
+  mpz_small_t sx;
+  mpz_t t;
+  int ok;
+  zelt_check(v, dest, "Gmp.Z.Modular.inv");
+  x = _mlgmp_z_modular_to_z(v, a);
+  mpz_init(t);
+  ok = mpz_invert(t, mpz_src(x, sx), mpz_roinit_n(&zm, c->m, c->n));
+  if (ok)
+    zmod_set_mpz(v, dest, t, "Gmp.Z.Modular.inv");
+  mpz_clear(t);
+  CAMLreturn(Val_bool(ok));
+}
+
+/*** Column files */
+
+/* A column file holds n numbers, meant to be mapped into memory rather
+   than read: a header of four 64-bit words (magic, byte-order mark, limb
+   size in bits, n), then the n+1 offsets of the numbers in the limb
+   area, in limbs, then the limb area.  Bit 63 of the offset of a number
+   is its sign.  Words and limbs are in the byte order and limb size of
+   the machine that wrote the file, so that numbers can be used in place
+   through mpz_roinit_n.  The offsets are only checked when used, so that
+   opening a file touches nothing but its header. */
+#define COLUMN_MAGIC "MLGMPCOL"
+#define COLUMN_BOM 0x0102030405060708ULL
+#define COLUMN_HEADER_WORDS 4
+#define COLUMN_SIGN (1ULL << 63)
+
+#ifdef USE_MMAP
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+struct zcolumn
+{
+  const uint64_t *index;
+  const mp_limb_t *limbs;
+  mlsize_t length;
+  uint64_t nlimbs;		/* in the limb area */
+  void *base;			/* NULL once closed */
+  size_t size;
+  int mapped;
+};
+
+#define zcolumn_val(v) (*((struct zcolumn **) Data_custom_val(v)))
+
+static void zcolumn_unload(struct zcolumn *c)
+{
+  if (c->base == NULL) return;
+#ifdef USE_MMAP
+  if (c->mapped)
+    munmap(c->base, c->size);
+  else
+#endif
+    free(c->base);
+  c->base = NULL;
+  c->length = 0;
+}
+
+/* Maps or reads the whole file; returns 0 and sets errno on failure. */
+static int zcolumn_load(struct zcolumn *c, const char *name)
+{
+  FILE *f;
+  long size;
+#ifdef USE_MMAP
+  struct stat st;
+  int fd = open(name, O_RDONLY);
+  if (fd < 0) return 0;
+  if (fstat(fd, &st) == 0 && st.st_size > 0)
+    {
+      c->size = st.st_size;
+      c->base = mmap(NULL, c->size, PROT_READ, MAP_SHARED, fd, 0);
+      if (c->base != MAP_FAILED)
+	{
+	  close(fd);
+	  c->mapped = 1;
+	  return 1;
+	}
+    }
+  close(fd);
+#endif
+  /* Not mappable (empty, or a pipe...): read it. */
+  c->mapped = 0;
+  c->base = NULL;
+  f = fopen(name, "rb");
+  if (f == NULL) return 0;
+  if (fseek(f, 0, SEEK_END) != 0 || (size = ftell(f)) < 0
+      || fseek(f, 0, SEEK_SET) != 0)
+    {
+      fclose(f);
+      return 0;
+    }
+  c->size = size;
+  c->base = malloc(size > 0 ? size : 1);
+  if (c->base == NULL || fread(c->base, 1, size, f) != (size_t) size)
+    {
+      free(c->base);
+      c->base = NULL;
+      fclose(f);
+      errno = EIO;
+      return 0;
+    }
+  fclose(f);
+  return 1;
+}
+
+static int zcolumn_check_header(struct zcolumn *c)
+{
+  const uint64_t *h = c->base;
+  uint64_t n;
+  size_t start;
+  if (c->size < COLUMN_HEADER_WORDS * sizeof(uint64_t)
+      || memcmp(h, COLUMN_MAGIC, 8) != 0 || h[1] != COLUMN_BOM
+      || h[2] != GMP_NUMB_BITS)
+    return 0;
+  n = h[3];
+  if (n >= c->size / sizeof(uint64_t) - COLUMN_HEADER_WORDS
+      || n > Max_long)
+    return 0;
+  start = (COLUMN_HEADER_WORDS + n + 1) * sizeof(uint64_t);
+  c->length = n;
+  c->index = h + COLUMN_HEADER_WORDS;
+  c->limbs = (const mp_limb_t *) ((const char *) c->base + start);
+  c->nlimbs = (c->size - start) / sizeof(mp_limb_t);
+  return 1;
+}
+
+/* A read-only view of number i, whose limbs stay in the file. */
+static mpz_srcptr zcolumn_view(value v, value i, mpz_ptr view,
+			       const char *name)
+{
+  struct zcolumn *c = zcolumn_val(v);
+  uint64_t start, end;
+  if (Long_val(i) < 0 || (uintnat) Long_val(i) >= c->length)
+    caml_invalid_argument(name);
+  start = c->index[Long_val(i)];
+  end = c->index[Long_val(i) + 1] & ~COLUMN_SIGN;
+  if ((start & ~COLUMN_SIGN) > end || end > c->nlimbs)
+    caml_failwith(name);
+  return mpz_roinit_n(view, c->limbs + (start & ~COLUMN_SIGN),
+		      (start & COLUMN_SIGN)
+		      ? - (mp_size_t) (end - (start & ~COLUMN_SIGN))
+		      : (mp_size_t) (end - start));
+}
+
+/* zcolumn_val(v) may be NULL if open_file raised. */
+void _mlgmp_z_column_finalize(value v)
+{
+  if (zcolumn_val(v) == NULL) return;
+  zcolumn_unload(zcolumn_val(v));
+  free(zcolumn_val(v));
+}
+
+struct custom_operations _mlgmp_custom_z_column =
+  {
+    field(identifier)  "Gmp.Z.Column.column",
+    field(finalize)    &_mlgmp_z_column_finalize,
+    field(compare)     custom_compare_default,
+    field(hash)        custom_hash_default,
+    field(serialize)   custom_serialize_default,
+    field(deserialize) custom_deserialize_default
+  };
+
+static void raise_file_error(value name)
+{
+  char msg[512];
+  snprintf(msg, sizeof(msg), "%s: %s", String_val(name), strerror(errno));
+  caml_raise_sys_error(caml_copy_string(msg));
+}
+
+value _mlgmp_z_column_open(value name)
+{
+  CAMLparam1(name);
+  CAMLlocal1(r);
+  struct zcolumn *c;
+  /* The block owns c before the file is loaded, as for trees. */
+  r = alloc_custom_limbs(&_mlgmp_custom_z_column, sizeof(struct zcolumn *),
+			 0);
+  zcolumn_val(r) = NULL;
+  c = malloc(sizeof(struct zcolumn));
+  if (c == NULL)
+    caml_raise_out_of_memory();
+  c->base = NULL;
+  c->mapped = 0;
+  c->length = 0;
+  zcolumn_val(r) = c;
+  if (!zcolumn_load(c, String_val(name)))
+    raise_file_error(name);
+  if (!zcolumn_check_header(c))
+    caml_failwith("Gmp.Z.Column.open_file");
+  /* Mapped pages belong to the file, not to the heap. */
+  if (!c->mapped && mlgmp_gc_ratio)
+    caml_adjust_gc_speed(limbs_mem(c->size / sizeof(mp_limb_t)),
+			 GC_LIMB_MAX);
+  CAMLreturn(r);
+}
+
+/* The numbers read from the column before stay valid. */
+value _mlgmp_z_column_close(value v)
+{
+  CAMLparam1(v);
+  zcolumn_unload(zcolumn_val(v));
+  CAMLreturn(Val_unit);
+}
+
+value _mlgmp_z_column_length(value v)
+{
+  CAMLparam1(v);
+  CAMLreturn(Val_long(zcolumn_val(v)->length));
+}
+
+value _mlgmp_z_column_get(value v, value i)
+{
+  CAMLparam2(v, i);
+  mpz_t view, r;
+  mpz_init_set(r, zcolumn_view(v, i, view, "Gmp.Z.Column.get"));
+  CAMLreturn(wrap_mpz(r));
+}
+
+value _mlgmp_z2_column_get(value r, value v, value i)
+{
+  CAMLparam3(r, v, i);
+  mpz_t view;
+  mpz_srcptr x = zcolumn_view(v, i, view, "Gmp.Z2.column_get");
+  z2_enter(r);
+  mpz_set(*mpz_val(r), x);
+  z2_leave(r);
+  CAMLreturn(Val_unit);
+}
+
+value _mlgmp_z_column_sgn(value v, value i)
+{
+  CAMLparam2(v, i);
+  mpz_t view;
+  CAMLreturn(Val_int(mpz_sgn(zcolumn_view(v, i, view,
+					  "Gmp.Z.Column.sgn"))));
+}
+
+value _mlgmp_z_column_compare(value v, value i, value x)
+{
+  CAMLparam3(v, i, x);
+  mpz_t view;
+  mpz_small_t sx;
+  int c = mpz_cmp(zcolumn_view(v, i, view, "Gmp.Z.Column.compare"),
+		  mpz_src(x, sx));
+  CAMLreturn(Val_int(c > 0 ? 1 : c < 0 ? -1 : 0));
+}
+
+value _mlgmp_z_column_sum(value v)
+{
+  CAMLparam1(v);
+  mpz_t view, r;
+  mlsize_t i, n = zcolumn_val(v)->length;
+  mpz_init(r);
+  for(i=0; i<n; i++)
+    mpz_add(r, r, zcolumn_view(v, Val_long(i), view, "Gmp.Z.Column.sum"));
+  CAMLreturn(wrap_mpz(r));
+}
+
+/* Writes the whole file in two passes over a, the offsets then the
+   limbs, so that nothing of the size of a is allocated. */
+static int zcolumn_write(FILE *f, value a)
+{
+  mlsize_t i, n = Wosize_val(a);
+  uint64_t h[COLUMN_HEADER_WORDS], offset = 0, w;
+  mpz_small_t sx;
+  memcpy(h, COLUMN_MAGIC, 8);
+  h[1] = COLUMN_BOM;
+  h[2] = GMP_NUMB_BITS;
+  h[3] = n;
+  if (fwrite(h, sizeof(uint64_t), COLUMN_HEADER_WORDS, f)
+      != COLUMN_HEADER_WORDS)
+    return 0;
+  for(i=0; i<=n; i++)
+    {
+      w = offset;
+      if (i < n)
+	{
+	  mpz_srcptr x = mpz_src(Field(a, i), sx);
+	  if (mpz_sgn(x) < 0) w |= COLUMN_SIGN;
+	  offset += mpz_size(x);
+	}
+      if (fwrite(&w, sizeof(uint64_t), 1, f) != 1)
+	return 0;
+    }
+  for(i=0; i<n; i++)
+    {
+      mpz_srcptr x = mpz_src(Field(a, i), sx);
+      if (fwrite(x->_mp_d, sizeof(mp_limb_t), mpz_size(x), f)
+	  != mpz_size(x))
+	return 0;
+    }
+  return 1;
+}
+
+value _mlgmp_z_column_write(value name, value a)
+{
+  CAMLparam2(name, a);
+  FILE *f = fopen(String_val(name), "wb");
+  int ok;
+  if (f == NULL)
+    raise_file_error(name);
+  ok = zcolumn_write(f, a);
+  if (fclose(f) != 0 || !ok)
+    raise_file_error(name);
+  CAMLreturn(Val_unit);
+}
+
+/*** Serialization */
+value _mlgmp_z_initialize()
+{
+  CAMLparam0();
+  caml_register_custom_operations(& _mlgmp_custom_z);
+  CAMLreturn(Val_unit);
+}
+
+#ifdef SERIALIZE
+void _mlgmp_z_serialize(value v,
+			unsigned long * wsize_32,
+			unsigned long * wsize_64)
+{
+  CAMLparam1(v);
+
+  *wsize_32 = MPZ_SIZE_ARCH32;
+  *wsize_64 = MPZ_SIZE_ARCH64;
+
+  serialize_header();
+  serialize_mpz(*mpz_val(v));
+  CAMLreturn0;
+}
+
+unsigned long _mlgmp_z_deserialize(void * dst)
+{
+  char *s;
+  uint32_t len;
+
+  mpz_init(*((mpz_t*) dst));
+  if (deserialize_header(&len))
+    {
+      deserialize_mpz(*((mpz_t*) dst));
+      stat_alloc(STAT_Z, (*((mpz_t*) dst))->_mp_alloc);
+      return sizeof(mpz_t);
+    }
+
+  /* Old hex format */
+  s = malloc(len+1);
+  caml_deserialize_block_1(s, len);
   s[len] = 0;
-  mpz_init_set_str (*((mpz_t*) dst), s, 16);
+  mpz_set_str (*((mpz_t*) dst), s, 16);
   free(s);
+  stat_alloc(STAT_Z, (*((mpz_t*) dst))->_mp_alloc);
 
   return sizeof(mpz_t);
 }
@@ -791,13 +2857,6 @@ unsigned long _mlgmp_z_deserialize(void * dst)
 
 long _mlgmp_z_hash(value v)
 {
-  CAMLparam1(v);
-  mpz_t dummy;
-  long r;
-  mpz_init(dummy);
-
-  r = mpz_mod_ui(dummy, *mpz_val(v), HASH_MODULUS);
-
-  mpz_clear(dummy);
-  CAMLreturn(r);
+  mpz_small_t sv;
+  return hash_mpz(mpz_src(v, sv));
 }
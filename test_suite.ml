@@ -31,6 +31,484 @@ assert ((Z.legendre (Z.from_int 5) (Z.from_int 23)) = -1);
 assert (Z.is_probab_prime (Z.nextprime (Z.from_string "1348913489791348979809769780980976978097980976978098097980979809809")) 30);
 
 
+(* Small values are unboxed, big ones are not: check the boundary. *)
+begin
+let big = Z.add (Z.from_int max_int) Z.one in
+assert (Z.sub big Z.one = Z.from_int max_int);
+assert (Z.to_int (Z.sub big Z.one) = max_int);
+assert (Z.compare big (Z.from_int max_int) > 0);
+assert (Z.neg big = Z.from_int min_int);
+assert (compare (Z.pred (Z.from_int min_int)) (Z.from_int min_int) < 0);
+assert (Z.equal (Z.neg (Z.from_int min_int)) big);
+assert (Z.equal (Z.mul (Z.from_int max_int) (Z.from_int 2))
+	  (Z.add (Z.from_int max_int) (Z.from_int max_int)));
+assert (Z.sgn (Z.sub (Z.from_int min_int) Z.one) < 0);
+assert ((Z.tdiv_q (Z.mul big big) big) = big);
+assert ((Z.tdiv_q (Z.mul big (Z.from_int 3)) big) = (Z.from_int 3));
+let acc = Z2.create () in
+Z2.add ~dest: acc (Z.from_int 40) (Z.from_int 2);
+Z2.mul ~dest: acc (Z2.as_z acc) big;
+assert (Z.equal (Z2.as_z acc) (Z.mul (Z.from_int 42) big));
+assert (Z.to_string (Z2.to_z acc) = Z.to_string (Z.mul big (Z.from_int 42)));
+end;
+
+(* Marshalling round trips *)
+begin
+let remarshal x = Marshal.from_string (Marshal.to_string x []) 0 in
+let big = Z.pow_ui (Z.from_int 3) 200 in
+assert (Z.equal (remarshal big) big);
+assert (Z.equal (remarshal (Z.neg big)) (Z.neg big));
+assert (remarshal [Z.one; big] = [Z.one; big]);
+let q = Q.from_zs (Z.neg big) (Z.pow_ui (Z.from_int 7) 50) in
+assert (Q.equal (remarshal q) q);
+let f = F.from_string "-1234.5678e-20" in
+assert (F.equal (remarshal f) f);
+end;
+
+(* Hashing agrees with equality, whatever the representation *)
+begin
+let acc = Z2.of_z (Z.from_int (-42)) in
+assert (Hashtbl.hash (Z2.as_z acc) = Hashtbl.hash (Z.from_int (-42)));
+let big = Z.pow_ui (Z.from_int 3) 200 in
+assert (Hashtbl.hash big = Hashtbl.hash (Z.add (Z.sub big Z.one) Z.one));
+assert (Hashtbl.hash big <> Hashtbl.hash (Z.neg big));
+assert (Hashtbl.hash (Q.from_ints 2 6) = Hashtbl.hash (Q.from_ints 1 3));
+assert (Hashtbl.hash (F.from_int 5) = Hashtbl.hash (F.from_si_prec ~prec: 500 5));
+end;
+
+(* Destination-passing operations *)
+begin
+let q = Z2.create () and r = Z2.create () and acc = Z2.create () in
+Z2.tdiv_qr ~q ~r (Z.from_int 47) (Z.from_int 5);
+assert (Z.equal (Z2.as_z q) (Z.from_int 9) && Z.equal (Z2.as_z r) (Z.from_int 2));
+Z2.powm ~dest: acc (Z.from_int 3) (Z.from_int 57) (Z.from_int 4);
+assert (Z.equal (Z2.as_z acc) (Z.from_int 3));
+Z2.fac_ui ~dest: acc 20;
+Z2.sqrtrem ~s: q ~r (Z2.as_z acc);
+assert (Z.equal (Z2.as_z q) (Z.sqrt (Z.fac_ui 20)));
+Z2.gcd_ui ~dest: acc (Z.from_int 84) 36;
+assert (Z.equal (Z2.as_z acc) (Z.from_int 12));
+assert (Z2.inverse ~dest: acc (Z.from_int 3) (Z.from_int 7));
+assert (Z.equal (Z2.as_z acc) (Z.from_int 5));
+(try Z2.tdiv_qr ~q ~r: q Z.one Z.one; assert false
+ with Invalid_argument _ -> ());
+let qa = Q2.create () in
+Q2.add ~dest: qa (Q.from_ints 1 2) (Q.from_ints 1 3);
+Q2.mul ~dest: qa (Q2.as_q qa) (Q.from_int 6);
+assert (Q.equal (Q2.to_q qa) (Q.from_int 5));
+Q2.get_num ~dest: acc (Q.from_ints 4 6);
+assert (Z.equal (Z2.as_z acc) (Z.from_int 2));
+let fa = F2.create_prec ~prec: 128 in
+F2.from_int ~dest: fa 2;
+F2.sqrt ~dest: fa (F2.as_f fa);
+F2.mul ~dest: fa (F2.as_f fa) (F2.as_f fa);
+assert (F.eq (F2.as_f fa) (F.from_int 2) ~prec: 100);
+end;
+
+(* Fused operations *)
+begin
+let big = Z.pow_ui (Z.from_int 3) 100 in
+let a = Z.add big Z.one and b = Z.sub big Z.one in
+assert (Z.equal (Z.addmul Z.one a b) (Z.mul big big));
+assert (Z.equal (Z.submul (Z.mul big big) a b) Z.one);
+assert (Z.equal (Z.addmul_ui big big 2) (Z.mul_ui big 3));
+assert (Z.equal (Z.submul_ui big big 3) (Z.neg (Z.mul_ui big 2)));
+assert (Z.equal (Z.mul_add a b (Z.from_int 2) (Z.from_int 3))
+	  (Z.add_ui (Z.mul big big) 5));
+assert (Z.equal (Z.lincomb [| a; b; Z.from_int 7 |] [| b; a; Z.from_int (-1) |])
+	  (Z.sub (Z.mul_ui (Z.mul a b) 2) (Z.from_int 7)));
+(try ignore (Z.lincomb [| a |] [||]); assert false
+ with Invalid_argument _ -> ());
+let acc = Z2.of_z Z.one in
+Z2.addmul ~dest: acc a b;
+assert (Z.equal (Z2.as_z acc) (Z.mul big big));
+Z2.submul_ui ~dest: acc big 2;
+Z2.mul_add ~dest: acc (Z2.as_z acc) Z.one (Z2.as_z acc) (Z.from_int (-1));
+assert (Z.is_zero (Z2.as_z acc));
+Z2.lincomb ~dest: acc [| big; Z.from_int 2 |] [| Z.one; big |];
+Z2.lincomb ~dest: acc [| Z2.as_z acc |] [| Z.from_int 2 |];
+assert (Z.equal (Z2.as_z acc) (Z.mul_ui big 6));
+end;
+
+(* Modular arithmetic *)
+begin
+let check m =
+  let c = Z.Modular.create m in
+  assert (Z.equal (Z.Modular.modulus c) m);
+  let a = Z.sub (Z.pow_ui (Z.from_int 5) 120) m
+  and b = Z.pow_ui (Z.from_int 3) 77 in
+  let x = Z.Modular.of_z c a and y = Z.Modular.of_z c b
+  and r = Z.Modular.elt c in
+  let is v = Z.equal (Z.Modular.to_z c r) (Z.modulo v m) in
+  Z.Modular.mul c ~dest: r x y;
+  assert (is (Z.mul a b));
+  Z.Modular.add c ~dest: r r x;
+  assert (is (Z.add (Z.mul a b) a));
+  Z.Modular.sub c ~dest: r y x;
+  assert (is (Z.sub b a));
+  Z.Modular.sqr c ~dest: r x;
+  assert (is (Z.mul a a));
+  Z.Modular.pow c ~dest: r y (Z.from_int 1001);
+  assert (is (Z.powm b (Z.from_int 1001) m));
+  Z.Modular.set_z c ~dest: r (Z.from_int (-1));
+  assert (is (Z.from_int (-1)));
+  assert (Z.Modular.inv c ~dest: r y = (Z.inverse b m <> None));
+  (match Z.inverse b m with
+   | Some i -> assert (is i)
+   | None -> ())
+in
+List.iter check [ Z.from_int 2; Z.from_int 1000003;
+		  Z.pow_ui (Z.from_int 2) 128;
+		  Z.sub (Z.pow_ui (Z.from_int 2) 255) (Z.from_int 19);
+		  Z.mul_ui (Z.pow_ui (Z.from_int 3) 500) 2 ];
+let c = Z.Modular.create (Z.from_int 7) in
+(try Z.Modular.mul c ~dest: (Z.Modular.elt c)
+       (Z.Modular.of_z c Z.one)
+       (Z.Modular.of_z (Z.Modular.create (Z.pow_ui (Z.from_int 2) 100))
+	  Z.one);
+     assert false
+ with Invalid_argument _ -> ());
+(try ignore (Z.Modular.create Z.one); assert false
+ with Invalid_argument _ -> ());
+end;
+
+(* Fixed-width integers *)
+begin
+let two_128 = Z.pow_ui (Z.from_int 2) 128 in
+let a = Z.sub (Z.pow_ui (Z.from_int 3) 80) Z.one
+and b = Z.neg (Z.pow_ui (Z.from_int 7) 40) in
+let x = Z128.of_z a and y = Z128.of_z b in
+let is v r = Z.equal (Z128.to_z_unsigned r) (Z.modulo v two_128) in
+assert (is (Z.add a b) (Z128.add x y));
+assert (is (Z.sub a b) (Z128.sub x y));
+assert (is (Z.mul a b) (Z128.mul x y));
+assert (is (Z.neg a) (Z128.neg x));
+assert (Z.equal (Z128.to_z y) b);
+assert (Z128.compare y x < 0 && Z128.unsigned_compare y x > 0);
+assert (Z128.equal (Z128.add Z128.minus_one Z128.one) Z128.zero);
+assert (Z128.equal (Z128.shift_right (Z128.of_int (-8)) 2) (Z128.of_int (-2)));
+assert (Z128.equal (Z128.shift_right y 200) Z128.minus_one);
+assert (is (Z.fdiv_q_2exp (Z.modulo b two_128) 70)
+	  (Z128.shift_right_logical y 70));
+assert (is (Z.mul_2exp a 70) (Z128.shift_left x 70));
+assert (is (Z.fdiv_q (Z.modulo b two_128) a) (Z128.unsigned_div y x));
+assert (is (Z.fdiv_r (Z.modulo b two_128) a) (Z128.unsigned_rem y x));
+(try ignore (Z128.unsigned_div x Z128.zero); assert false
+ with Division_by_zero -> ());
+assert (Z128.to_int (Z128.of_int (-5)) = -5);
+assert (Z256.to_string (Z256.mul (Z256.of_z a) (Z256.of_z a))
+	= Z.to_string (Z.mul a a));
+assert (compare (Z256.of_int 3) (Z256.of_int (-3)) > 0);
+assert (Marshal.from_string (Marshal.to_string y []) 0 = y);
+end;
+
+(* Polynomials *)
+begin
+let zp l = ZPoly.of_array (Array.map Z.from_int (Array.of_list l)) in
+let a = zp [1; -2; 3; 0; 5] and b = zp [-7; 0; 2] in
+assert (ZPoly.equal (ZPoly.mul a b) (zp [-7; 14; -19; -4; -29; 0; 10]));
+assert (ZPoly.degree (zp [0; 0]) = -1 && ZPoly.degree a = 4);
+(* large enough for Kronecker substitution and Newton's iteration *)
+let big n = ZPoly.of_array (Array.init n (fun i ->
+  Z.sub (Z.pow_ui (Z.from_int 3) (i * 7)) (Z.from_int i))) in
+let p = big 60 and q = big 25 in
+let naive x y =
+  let c = Array.make (ZPoly.degree x + ZPoly.degree y + 1) Z.zero in
+  Array.iteri (fun i u -> Array.iteri (fun j v ->
+    c.(i+j) <- Z.add c.(i+j) (Z.mul u v)) (ZPoly.to_array y)) (ZPoly.to_array x);
+  ZPoly.of_array c in
+assert (ZPoly.equal (ZPoly.mul p (ZPoly.neg q)) (ZPoly.neg (naive p q)));
+let (pq, pr) = ZPoly.pseudo_divrem p q in
+let e = ZPoly.degree p - ZPoly.degree q + 1 in
+assert (ZPoly.equal (ZPoly.add (ZPoly.mul pq q) pr)
+	  (ZPoly.scale (Z.pow_ui (ZPoly.leading_coeff q) e) p));
+assert (ZPoly.degree pr < ZPoly.degree q);
+assert (ZPoly.equal (ZPoly.divexact (ZPoly.mul p q) q) p);
+(try ignore (ZPoly.divexact a b); assert false
+ with Invalid_argument _ -> ());
+let g = ZPoly.gcd (ZPoly.mul a (ZPoly.scale (Z.from_int 6) b))
+    (ZPoly.mul (ZPoly.scale (Z.from_int 4) b) q) in
+assert (ZPoly.equal g (ZPoly.scale (Z.from_int 2) b));
+assert (Z.equal (ZPoly.eval a (Z.from_int 2)) (Z.from_int 89));
+assert (Z.equal (ZPoly.content (zp [6; -4; 10])) (Z.from_int 2));
+assert (ZPoly.equal (ZPoly.derivative a) (zp [-2; 6; 0; 20]));
+let qp l =
+  QPoly.of_array (Array.of_list (List.map (fun (n, d) -> Q.from_ints n d) l)) in
+let u = qp [(1, 2); (-1, 3); (1, 1)] and v = qp [(2, 5); (1, 1)] in
+let (dq, dr) = QPoly.divrem u v in
+assert (QPoly.equal (QPoly.add (QPoly.mul dq v) dr) u);
+assert (QPoly.degree dr < QPoly.degree v);
+assert (Q.equal (QPoly.eval u (Q.from_ints 1 2)) (Q.from_ints 7 12));
+assert (Z.equal (QPoly.den u) (Z.from_int 6));
+let w = QPoly.mul u (QPoly.sub QPoly.x (QPoly.of_array [| Q.from_ints 1 3 |])) in
+let monic p = QPoly.scale (Q.inv (QPoly.leading_coeff p)) p in
+assert (QPoly.equal (QPoly.gcd w (QPoly.mul v u)) (monic u));
+(try ignore (QPoly.div u QPoly.zero); assert false
+ with Division_by_zero -> ());
+end;
+
+(* Random states *)
+begin
+let s = RNG.randinit RNG.GMP_RAND_ALG_MT in
+RNG.seed s 42;
+let s' = RNG.copy s in
+let a = Z.urandomb ~state: s ~nbits: 200 in
+assert (Z.equal a (Z.urandomb ~state: s' ~nbits: 200));
+let t = RNG.split s and t' = RNG.split s' in
+assert (Z.equal (Z.urandomb ~state: t ~nbits: 200)
+	  (Z.urandomb ~state: t' ~nbits: 200));
+RNG.seed_string s "\001\002\003";
+RNG.seed_string s' "\001\002\003";
+assert (Z.equal (Z.urandomm ~state: s ~n: a) (Z.urandomm ~state: s' ~n: a));
+assert (RNG.local () == RNG.local ());
+end;
+
+(* Vector operations *)
+begin
+let big = Z.pow_ui (Z.from_int 3) 200 in
+let a = [| Z.from_int 2; big; Z.from_int (-5) |]
+and b = [| Z.from_int 7; Z.from_int 3; big |] in
+assert (Z.equal (Z.Vec.sum a) (Z.add big (Z.from_int (-3))));
+assert (Z.equal (Z.Vec.dot a b) (Z.sub (Z.from_int 14) (Z.mul_ui big 2)));
+assert (Z.equal (Z.Vec.product [||]) Z.one);
+assert (Z.equal (Z.Vec.product (Array.init 11 (fun i -> Z.from_int (i + 1))))
+	  (Z.fac_ui 11));
+assert (Z.Vec.add a b = Array.init 3 (fun i -> Z.add a.(i) b.(i)));
+assert (Z.Vec.scale big a = Array.map (Z.mul big) a);
+let d = Array.init 3 (fun _ -> Z2.create ()) in
+Z2.Vec.mul ~dest: d a b;
+assert (Array.map Z2.to_z d = Z.Vec.mul a b);
+(try ignore (Z.Vec.dot a [| Z.one |]); assert false
+ with Invalid_argument _ -> ());
+end;
+
+(* Product and remainder trees *)
+begin
+let m = Array.map Z.from_int [| 15; 77; 221; 13; 1000003; 35; 97 |] in
+let t = Z.Tree.create m in
+assert (Z.Tree.length t = 7);
+assert (Z.equal (Z.Tree.product t) (Z.Vec.product m));
+let x = Z.from_string "123456789012345678901234567890" in
+assert (Z.Tree.remainders t x = Array.map (Z.modulo x) m);
+assert (Z.Tree.batch_gcd m = Array.map Z.from_int [| 5; 7; 13; 13; 1; 35; 1 |]);
+(try ignore (Z.Tree.create [||]); assert false
+ with Invalid_argument _ -> ());
+end;
+
+(* Chinese remaindering *)
+begin
+let m = Array.map Z.from_int [| 1000003; 1000033; 1000037; 1000039; 1000081 |] in
+let c = CRT.create m in
+let x = Z.from_string "-123456789012345678901" in
+let residues = Array.map (Z.modulo x) m in
+assert (Z.equal (CRT.to_z_signed c residues) x);
+assert (Z.equal (CRT.to_z c residues) (Z.add x (CRT.modulus c)));
+assert (Z.equal (CRT.crt [| (Z.from_int 2, Z.from_int 3);
+			    (Z.from_int 3, Z.from_int 5) |]) (Z.from_int 8));
+let q = Q.from_ints (-22) 7 in
+let r = Array.map (fun p ->
+  Z.modulo (Z.mul (Q.get_num q)
+	      (match Z.inverse (Q.get_den q) p with Some i -> i
+	       | None -> assert false)) p) m in
+assert (match CRT.to_q c r with Some q' -> Q.equal q q' | None -> false);
+(try ignore (CRT.create [| Z.from_int 6; Z.from_int 4 |]); assert false
+ with Invalid_argument _ -> ());
+end;
+
+(* String conversions *)
+begin
+let big = Z.neg (Z.pow_ui (Z.from_int 3) 200) in
+List.iter (fun base ->
+  assert (Z.equal (Z.from_string_base ~base (Z.to_string_base ~base big)) big))
+  [2; 3; 10; 16; 36; 62];
+assert (Z.to_string_base ~base: (-16) (Z.from_int 255) = "FF");
+assert (Z.to_string (Z.from_int (-99)) = "-99");
+let b = Buffer.create 16 in
+Z.add_to_buffer b big;
+Buffer.add_char b ' ';
+Z.add_to_buffer_base ~base: 16 b (Z.from_int 255);
+assert (Buffer.contents b = Z.to_string big ^ " ff");
+let s = Bytes.make 8 '.' in
+assert (Z.blit_string_base ~base: 10 (Z.from_int 42) s 1 = 2);
+assert (Bytes.to_string s = ".42.....");
+assert (F.to_string (F.from_int (-1234)) = "-1.234E3");
+let line = "x=-12345678901234567890123, y=22/-6" in
+assert (Z.equal (Z.of_substring line ~pos: 2 ~len: 24)
+	  (Z.from_string "-12345678901234567890123"));
+assert (Q.equal (Q.of_substring line ~pos: 30 ~len: 5) (Q.from_ints (-11) 3));
+assert (Z.equal (Z.of_subbytes_base ~base: 16 (Bytes.of_string "+ff") ~pos: 0 ~len: 3)
+	  (Z.from_int 255));
+(try ignore (Z.of_substring line ~pos: 0 ~len: 3); assert false
+ with Invalid_argument _ -> ());
+let ib = Scanf.Scanning.from_string "  -42 1000000000000000000000000,7" in
+assert (Z.equal (Z.scan ib) (Z.from_int (-42)));
+assert (Z.equal (Z.scan ib) (Z.pow_ui (Z.from_int 10) 24));
+assert (Scanf.bscanf ib ",%d" (fun n -> n) = 7);
+end;
+
+(* Raw bytes *)
+begin
+let x = Z.add_ui (Z.pow_ui (Z.from_int 2) 72) 0x0102 in
+assert (Z.raw_size x = 10 && Z.raw_size Z.zero = 0);
+assert (Z.to_raw_string x = "\001\000\000\000\000\000\000\000\001\002");
+assert (Z.to_raw_string ~little_endian: true (Z.from_int 0x0102) = "\002\001");
+assert (Z.equal (Z.of_raw_string (Z.to_raw_string x)) x);
+assert (Z.equal (Z.of_raw_string ~little_endian: true "\002\001")
+	  (Z.from_int 0x0102));
+let b = Bigarray.Array1.create Bigarray.char Bigarray.c_layout 16 in
+Z.export_bigstring ~little_endian: false x b ~pos: 2 ~len: 12;
+assert (Bigarray.Array1.get b 2 = '\000' && Bigarray.Array1.get b 13 = '\002');
+assert (Z.equal (Z.import_bigstring ~little_endian: false b ~pos: 2 ~len: 12) x);
+let r = Z2.create () in
+Z2.import_bigstring ~dest: r ~little_endian: false b ~pos: 12 ~len: 2;
+assert (Z.equal (Z2.as_z r) (Z.from_int 0x0102));
+(try Z.export_bytes ~little_endian: true x (Bytes.create 9) ~pos: 0 ~len: 9;
+  assert false
+with Invalid_argument _ -> ());
+end;
+
+(* Column files *)
+begin
+let a = [| Z.zero; Z.from_int (-5); Z.pow_ui (Z.from_int 7) 100;
+	   Z.neg (Z.pow_ui (Z.from_int 2) 200); Z.from_int max_int |] in
+let name = Filename.temp_file "mlgmp" ".col" in
+Z.Column.write name a;
+let c = Z.Column.open_file name in
+assert (Z.Column.length c = 5);
+assert (Array.for_all2 Z.equal (Z.Column.to_array c) a);
+assert (Z.Column.sgn c 3 = -1 && Z.Column.sgn c 0 = 0);
+assert (Z.Column.compare c 2 (Z.pow_ui (Z.from_int 7) 100) = 0);
+assert (Z.equal (Z.Column.sum c) (Array.fold_left Z.add Z.zero a));
+let r = Z2.create () in
+Z2.column_get ~dest: r c 3;
+assert (Z.equal (Z2.as_z r) a.(3));
+let x = Z.Column.get c 2 in
+Z.Column.close c;
+assert (Z.equal x a.(2));
+(try ignore (Z.Column.get c 0); assert false with Invalid_argument _ -> ());
+Sys.remove name;
+end;
+
+(* Limb pool *)
+begin
+let f n = Z.sub (Z.pow_ui (Z.from_int 3) n) (Z.pow_ui (Z.from_int 2) n) in
+let before = List.map f [10; 100; 1000] in
+Alloc.set_pooling true;
+assert (Alloc.get_pooling ());
+assert (List.for_all2 Z.equal (List.map f [10; 100; 1000]) before);
+let x = Alloc.with_arena (fun () -> Z.mul (f 1000) (f 100)) in
+Gc.full_major ();
+assert (Z.equal x (Z.mul (List.nth before 2) (List.nth before 1)));
+Alloc.set_pooling false;
+assert (List.for_all2 Z.equal (List.map f [10; 100; 1000]) before);
+Alloc.set_recycling true;
+let x = ref (Z.pow_ui (Z.from_int 7) 300) in
+for i = 1 to 1000 do
+  x := Z.add_ui (Z.sub (Z.mul !x (Z.from_int 3)) !x) i;
+  x := Z.fdiv_q (Z.mul !x (Z.from_int 5)) (Z.from_int 10)
+done;
+Gc.full_major ();
+let x = ref (Z.sub (Z.add !x !x) !x) in
+let s = Alloc.recycle_stats () in
+assert (s.Alloc.hits > 0 && s.Alloc.kept <= s.Alloc.limit);
+let y = ref (Z.pow_ui (Z.from_int 7) 300) in
+Alloc.set_recycling false;
+for i = 1 to 1000 do
+  y := Z.add_ui (Z.sub (Z.mul !y (Z.from_int 3)) !y) i;
+  y := Z.fdiv_q (Z.mul !y (Z.from_int 5)) (Z.from_int 10)
+done;
+assert (Z.equal !x !y);
+end;
+
+(* Stubs with untagged or unboxed arguments and results *)
+begin
+let big = Z.pow_ui (Z.from_int 2) 100 in
+assert (Z.to_float big = 2. ** 100.);
+assert (Z.equal (Z.from_float (2. ** 100.)) big);
+assert (Z.popcount big = 1 && Z.scan1 big 0 = 100);
+assert (Z.kronecker_si big 3 = 1 && Z.si_kronecker (-1) (Z.from_int 7) = -1);
+assert (Q.to_float (Q.from_ints 1 4) = 0.25);
+assert (Q.cmp_ui (Q.from_ints 1 4) 1 3 < 0 && Q.sgn (Q.from_ints (-1) 4) < 0);
+assert (F.sgn (F.from_float (-0.5)) < 0);
+assert (FR.float_from (FR.from_int 578) = 578.);
+end;
+
+(* Small fractions, on either side of the overflow to mpq *)
+begin
+let check r n d =
+  assert (Z.equal (Q.get_num r) (Z.from_int n)
+          && Z.equal (Q.get_den r) (Z.from_int d)) in
+check (Q.add (Q.from_ints 1 2) (Q.from_ints 1 2)) 1 1;
+check (Q.add (Q.from_ints 1 6) (Q.from_ints 1 3)) 1 2;
+check (Q.sub (Q.from_ints (-3) 4) (Q.from_ints (-3) 4)) 0 1;
+check (Q.mul (Q.from_ints (-3) 4) (Q.from_ints 2 3)) (-1) 2;
+check (Q.div (Q.from_ints 1 2) (Q.from_ints (-3) 4)) (-2) 3;
+let m = Z.from_int max_int and inv = Q.from_ints 1 max_int in
+let sq = Q.mul (Q.from_int max_int) (Q.from_int max_int) in
+assert (Z.equal (Q.get_num sq) (Z.mul m m));
+let sum = Q.add inv (Q.from_ints 1 (max_int - 1)) in
+assert (Q.equal sum
+          (Q.from_zs (Z.sub (Z.add m m) Z.one) (Z.mul m (Z.sub m Z.one))));
+let qa = Q2.create () in
+Q2.div ~dest: qa (Q.from_ints 3 4) (Q.from_ints (-9) 8);
+check (Q2.as_q qa) (-2) 3;
+Q2.mul ~dest: qa (Q2.as_q qa) (Q.from_zs (Z.mul m m) Z.one);
+assert (Q.equal (Q2.as_q qa)
+          (Q.from_zs (Z.neg (Z.mul_ui (Z.mul m m) 2)) (Z.from_int 3)));
+end;
+
+(* Statistics *)
+begin
+Stats.reset ();
+let a = Z.pow_ui (Z.from_int 3) 200 in
+let b = Z.mul a a in
+let s = Stats.snapshot () in
+if s.Stats.enabled then begin
+  assert (Stats.calls s "Gmp.Z.mul" = 1);
+  assert (s.Stats.z.Stats.allocated >= 2);
+  assert (s.Stats.z.Stats.bytes_allocated > 0)
+end else
+  assert (s.Stats.stubs = [||] && s.Stats.z.Stats.allocated = 0);
+Stats.reset ();
+assert (Stats.calls (Stats.snapshot ()) "Gmp.Z.mul" = 0);
+assert (Z.equal b (Z.pow_ui a 2));
+let m = Marshal.to_string a [] in
+Stats.reset ();
+let c : Z.t = Marshal.from_string m 0 in
+let s = Stats.snapshot () in
+assert (s.Stats.z.Stats.allocated = (if s.Stats.enabled then 1 else 0));
+assert (Z.equal c a);
+end;
+
+(* Census *)
+begin
+let a = Z.pow_ui (Z.from_int 3) 20000 in
+let c = Census.take 3 in
+if c.Census.enabled then begin
+  assert (c.Census.z.Census.blocks >= 1);
+  assert (Array.fold_left (+) 0 c.Census.z.Census.histogram
+          = c.Census.z.Census.blocks);
+  assert (Array.length c.Census.largest <= 3);
+  assert (snd c.Census.largest.(0) >= Z.string_size_base ~base: 2 a / 8)
+end else
+  assert (c.Census.z.Census.blocks = 0 && c.Census.largest = [||]);
+assert (Z.sgn a = 1);
+end;
+
+(* Operations on big operands, which run outside the runtime lock *)
+begin
+let m = Z.sub_ui (Z.pow_ui (Z.from_int 2) 4423) 1 in
+assert (Z.equal (Z.powm (Z.from_int 3) (Z.sub_ui m 1) m) Z.one);
+assert (Z.is_probab_prime m 5);
+let acc = Z2.of_z (Z.from_int 3) in
+Z2.powm ~dest: acc (Z2.as_z acc) m m;
+assert (Z.equal (Z2.as_z acc) (Z.from_int 3));
+Z2.fac_ui ~dest: acc 4000;
+assert (Z.equal (Z.bin_uiui ~n: 4000 ~k: 2000)
+	  (Z.divexact (Z2.as_z acc)
+	     (Z.pow_ui (Z.fac_ui 2000) 2)));
+end;
+
 (* TODO: the rest of Z is missing *)
 
 begin
@@ -98,6 +576,8 @@ assert ((FR.floor (FR.from_string "-2.2947E3")) = (FR.from_int (- 2295)));
 assert ((FR.compare (FR.from_string "478.99") (FR.from_float 478.67)) > 0);
 assert ((FR.sgn (FR.from_string "-478.99")) < 0);
 assert (FR.eq (FR.from_string "478.99") (FR.from_float 478.99) ~prec: 6);
+assert ((FR.fma (FR.from_int 6) (FR.from_int 7) (FR.from_int (-2))) = (FR.from_int 40));
+assert ((FR.fms (FR.from_int 6) (FR.from_int 7) (FR.from_int (-2))) = (FR.from_int 44));
 assert ((FR.to_string_base_digits ~base:10 ~mode:GMP_RNDN ~digits:30 (FR.sin (FR.from_int 3))) = "1.41120008059867222100744802808E-1"); (*verified w/ Maple*)
 assert ((FR.to_string_base_digits ~base:10 ~mode:GMP_RNDN ~digits:30 (FR.acosh (FR.from_int 3))) = "1.76274717403908605046521864996E0"); (*verified w/ Maple*)
 assert ((FR.to_string_base_digits ~base:10 ~mode:GMP_RNDN
@@ -111,9 +591,23 @@ assert ((FR.to_string_base_digits ~base:10 ~mode:GMP_RNDN
   "5.65685424949238019520675489684E0"); (* verified w/ Mathematica *)
 assert((FR.to_string (FR.pow_ui (FR.from_float 2.1) 6)) =
        "8.576612100E1"); (* verified w/ Mathematica *)
+let x = FR.sqrt (FR.from_int 5) in
+let y = FR2.create () in
+FR2.mul ~dest: y x x;
+FR2.log ~dest: y (FR2.as_fr y);
+assert (FR.equal (FR2.as_fr y) (FR.log (FR.from_int 5)));
+assert (FR.equal (Marshal.from_string (Marshal.to_string x []) 0) x);
 
 with Unimplemented _ -> print_endline "unimplemented"
 end;;
 
+begin
+let ratio = get_gc_ratio () in
+set_gc_ratio 0;
+assert (get_gc_ratio () = 0);
+assert (Z.equal (Z.pow_ui (Z.from_int 7) 1000) (Z.pow_ui (Z.from_int 7) 1000));
+set_gc_ratio ratio
+end;;
+
 Gc.full_major ();;
 